@@ -0,0 +1,93 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmark for record codecs. This reads records from a sample record file
+// and reports the compression ratio and the compression and decompression
+// throughput for each registered codec, so the codec can be chosen for each
+// dataset.
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "sling/base/clock.h"
+#include "sling/base/flags.h"
+#include "sling/base/init.h"
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/file/recordio.h"
+
+DEFINE_string(input, "", "Sample record file");
+DEFINE_int32(max_records, 100000, "Maximum number of records to sample");
+DEFINE_int32(repeat, 5, "Number of decompression rounds per codec");
+
+using namespace sling;
+
+int main(int argc, char *argv[]) {
+  InitProgram(&argc, &argv);
+  CHECK(!FLAGS_input.empty()) << "No sample record file";
+
+  // Read sample record values.
+  std::vector<string> values;
+  int64 total = 0;
+  RecordReader reader(FLAGS_input);
+  while (!reader.Done() && values.size() < FLAGS_max_records) {
+    Record record;
+    CHECK(reader.Read(&record));
+    values.push_back(record.value.str());
+    total += record.value.size();
+  }
+  CHECK(reader.Close());
+  printf("%lu records, %lld bytes\n", values.size(), total);
+
+  printf("%-10s %8s %16s %16s\n",
+         "codec", "ratio", "compress (MB/s)", "decompress (MB/s)");
+  auto *registry = RecordCodec::registry();
+  for (auto *c = registry->components; c != nullptr; c = c->next()) {
+    const RecordCodec *codec = c->object();
+
+    // Compress all values.
+    std::vector<string> compressed;
+    RecordBuffer buffer;
+    int64 size = 0;
+    Clock clock;
+    clock.start();
+    for (const string &value : values) {
+      buffer.clear();
+      codec->Compress(value, &buffer);
+      compressed.emplace_back(buffer.begin(), buffer.size());
+      size += buffer.size();
+    }
+    clock.stop();
+    double compress_time = clock.secs();
+
+    // Decompress all values.
+    clock.start();
+    for (int i = 0; i < FLAGS_repeat; ++i) {
+      for (const string &data : compressed) {
+        buffer.clear();
+        CHECK(codec->Decompress(data, &buffer));
+      }
+    }
+    clock.stop();
+    double decompress_time = clock.secs() / FLAGS_repeat;
+
+    double mb = total / 1e6;
+    printf("%-10s %8.3f %16.1f %16.1f\n", c->type(),
+           static_cast<double>(size) / total,
+           mb / compress_time, mb / decompress_time);
+  }
+
+  return 0;
+}
@@ -14,7 +14,11 @@
 
 #include "sling/file/file.h"
 
+#include <errno.h>
 #include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <string>
 #include <unordered_map>
 
@@ -116,6 +120,34 @@ File *File::TempFile() {
   return f;
 }
 
+Status File::FreeMappedMemory(void *data, size_t size) {
+  if (munmap(data, size) != 0) {
+    return Status(errno, "munmap", strerror(errno));
+  }
+  return Status::OK;
+}
+
+Status File::AdviseMappedMemory(void *data, size_t size,
+                                MemoryAdvice advice) {
+  int flags;
+  switch (advice) {
+    case SEQUENTIAL_ACCESS: flags = MADV_SEQUENTIAL; break;
+    case RANDOM_ACCESS: flags = MADV_RANDOM; break;
+    case PREFETCH_ACCESS: flags = MADV_WILLNEED; break;
+    default: flags = MADV_NORMAL;
+  }
+
+  // The start address must be page-aligned.
+  static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  uintptr_t start = reinterpret_cast<uintptr_t>(data);
+  uintptr_t aligned = start & ~(page_size - 1);
+  if (madvise(reinterpret_cast<void *>(aligned), size + (start - aligned),
+              flags) != 0) {
+    return Status(errno, "madvise", strerror(errno));
+  }
+  return Status::OK;
+}
+
 Status File::Delete(const string &name) {
   // Find file system.
   string rest;
@@ -96,6 +96,13 @@ class File {
   // Flush unwritten data.
   virtual Status Flush() = 0;
 
+  // Map region of file into memory. The mapping is read-only unless writable
+  // is true. Returns null if the region cannot be mapped or if memory mapping
+  // is not supported by the file system.
+  virtual void *MapMemory(uint64 pos, size_t size, bool writable = false) {
+    return nullptr;
+  }
+
   // Return the file name.
   virtual string filename() const = 0;
 
@@ -114,6 +121,21 @@ class File {
   // Create temporary file.
   static File *TempFile();
 
+  // Release memory mapped with MapMemory().
+  static Status FreeMappedMemory(void *data, size_t size);
+
+  // Access pattern hints for memory mapped with MapMemory().
+  enum MemoryAdvice {
+    NORMAL_ACCESS,      // no special treatment
+    SEQUENTIAL_ACCESS,  // memory is read sequentially
+    RANDOM_ACCESS,      // memory is read in random order
+    PREFETCH_ACCESS,    // memory will be read soon
+  };
+
+  // Give hint about access pattern for mapped memory. This is only advisory.
+  static Status AdviseMappedMemory(void *data, size_t size,
+                                   MemoryAdvice advice);
+
   // Delete a file.
   static Status Delete(const string &name);
 
@@ -0,0 +1,254 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/file/parallel-recordio.h"
+
+#include <algorithm>
+
+#include "sling/base/logging.h"
+#include "sling/file/file.h"
+
+namespace sling {
+
+// Batch of records read from a record file. The keys and values are stored in
+// the data buffer.
+struct ParallelRecordReader::Batch {
+  // Location of record key and value in data buffer or in the decompression
+  // buffer for compressed batches.
+  struct Entry {
+    size_t key;
+    size_t key_size;
+    size_t value;
+    size_t value_size;
+  };
+
+  // Add record to batch.
+  void Add(const Record &record) {
+    Entry e;
+    e.key = data.size();
+    e.key_size = record.key.size();
+    data.append(record.key.data(), record.key.size());
+    e.value = data.size();
+    e.value_size = record.value.size();
+    data.append(record.value.data(), record.value.size());
+    entries.push_back(e);
+  }
+
+  // Get record from batch.
+  void Get(int index, Record *record) const {
+    const Entry &e = entries[index];
+    const char *base = codec != nullptr ? decompressed.begin() : data.data();
+    record->key = Slice(base + e.key, e.key_size);
+    record->value = Slice(base + e.value, e.value_size);
+  }
+
+  int reader;                   // reader thread that read the batch
+  int file;                     // file number for batch
+  int64 sequence;               // batch number in file
+  bool last;                    // last batch in file
+  const RecordCodec *codec;     // codec for compressed values
+  string data;                  // record keys and values
+  RecordBuffer decompressed;    // decompressed keys and values
+  std::vector<Entry> entries;   // records in batch
+  Status status;                // error reading batch
+};
+
+ParallelRecordReader::ParallelRecordReader(const string &pattern,
+                                           const Options &options)
+    : options_(options) {
+  // Find record files.
+  CHECK(File::Match(pattern, &files_));
+
+  // Start decompression workers and reader threads. The read-ahead is divided
+  // between the readers, so a reader that is ahead of the consumer cannot
+  // block the reader for the file being consumed.
+  workers_ = new ThreadPool(options_.workers);
+  int num_readers = std::min<int>(options_.readers, files_.size());
+  if (num_readers > 0) quota_ = std::max(options_.prefetch / num_readers, 1);
+  outstanding_.resize(num_readers);
+  for (int i = 0; i < num_readers; ++i) {
+    readers_.emplace_back(&ParallelRecordReader::ReadFiles, this, i);
+  }
+}
+
+ParallelRecordReader::ParallelRecordReader(const string &pattern)
+    : ParallelRecordReader(pattern, Options()) {}
+
+ParallelRecordReader::~ParallelRecordReader() {
+  // Stop reader threads.
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  consumed_.notify_all();
+  for (auto &t : readers_) t.join();
+
+  // Wait for pending decompression tasks.
+  delete workers_;
+
+  // Delete all remaining batches.
+  delete current_;
+  for (auto &it : ready_) delete it.second;
+}
+
+bool ParallelRecordReader::Done() {
+  // The current batch is only accessed by the consumer, so the lock is only
+  // needed when moving on to the next batch.
+  if (current_ != nullptr && next_record_ < current_->entries.size()) {
+    return false;
+  }
+
+  std::unique_lock<std::mutex> lock(mu_);
+  for (;;) {
+    // Check for more records in the current batch.
+    if (current_ != nullptr) {
+      if (next_record_ < current_->entries.size()) return false;
+      if (!current_->status.ok()) return false;
+
+      // Release current batch so more batches can be read ahead.
+      outstanding_[current_->reader]--;
+      delete current_;
+      current_ = nullptr;
+      consumed_.notify_all();
+    }
+
+    // Wait until the next batch has been delivered.
+    if (delivery_file_ == files_.size()) return true;
+    auto key = std::make_pair(delivery_file_, delivery_batch_);
+    delivered_.wait(lock, [this, &key]() { return ready_.count(key) > 0; });
+    auto f = ready_.find(key);
+    current_ = f->second;
+    ready_.erase(f);
+    next_record_ = 0;
+    if (current_->last) {
+      delivery_file_++;
+      delivery_batch_ = 0;
+    } else {
+      delivery_batch_++;
+    }
+  }
+}
+
+Status ParallelRecordReader::Read(Record *record) {
+  if (Done()) return Status(1, "No more records");
+
+  // Return read error after all records in the batch have been consumed.
+  if (next_record_ == current_->entries.size()) {
+    Status st = current_->status;
+    current_->status = Status::OK;
+    return st;
+  }
+
+  current_->Get(next_record_++, record);
+  return Status::OK;
+}
+
+void ParallelRecordReader::ReadFiles(int index) {
+  RecordReader *reader = nullptr;
+  int file = 0;
+  int64 sequence = 0;
+  for (;;) {
+    // Open next file.
+    if (reader == nullptr) {
+      {
+        std::lock_guard<std::mutex> lock(mu_);
+        if (stop_ || next_file_ == files_.size()) break;
+        file = next_file_++;
+      }
+      reader = new RecordReader(files_[file], options_.file);
+      sequence = 0;
+    }
+
+    // Wait until there is room for reading another batch ahead.
+    Batch *batch = new Batch();
+    {
+      std::unique_lock<std::mutex> lock(mu_);
+      consumed_.wait(lock, [this, index]() {
+        return stop_ || outstanding_[index] < quota_;
+      });
+      if (stop_) {
+        delete batch;
+        break;
+      }
+      outstanding_[index]++;
+    }
+    batch->reader = index;
+    batch->file = file;
+    batch->sequence = sequence++;
+
+    // Read records into batch without decompressing the values.
+    batch->codec = RecordCodec::Find(reader->compression());
+    if (batch->codec == nullptr &&
+        reader->compression() != RecordFile::UNCOMPRESSED) {
+      batch->status = Status(1, "Unknown compression type");
+    }
+    batch->data.reserve(options_.batch_size + options_.file.buffer_size);
+    while (batch->status.ok() && batch->data.size() < options_.batch_size &&
+           !reader->Done()) {
+      Record record;
+      batch->status = reader->ReadRaw(&record);
+      if (!batch->status.ok()) break;
+      batch->Add(record);
+    }
+    batch->last = reader->Done() || !batch->status.ok();
+    if (batch->last) {
+      delete reader;
+      reader = nullptr;
+    }
+
+    // Decompress the batch on the worker pool before delivering it.
+    if (batch->codec != nullptr && !batch->entries.empty()) {
+      workers_->Schedule([this, batch]() {
+        Decompress(batch);
+        Deliver(batch);
+      });
+    } else {
+      Deliver(batch);
+    }
+  }
+  delete reader;
+}
+
+void ParallelRecordReader::Decompress(Batch *batch) {
+  // Decompress values and copy keys into the decompression buffer.
+  RecordBuffer &out = batch->decompressed;
+  out.ensure(batch->data.size() * 2);
+  for (Batch::Entry &e : batch->entries) {
+    size_t key = out.size();
+    out.Append(batch->data.data() + e.key, e.key_size);
+    e.key = key;
+    size_t value = out.size();
+    Slice compressed(batch->data.data() + e.value, e.value_size);
+    if (!batch->codec->Decompress(compressed, &out)) {
+      batch->status = Status(1, "Corrupt compressed record");
+      batch->entries.clear();
+      break;
+    }
+    e.value = value;
+    e.value_size = out.size() - value;
+  }
+
+  // Release the compressed data.
+  string().swap(batch->data);
+}
+
+void ParallelRecordReader::Deliver(Batch *batch) {
+  std::lock_guard<std::mutex> lock(mu_);
+  ready_[std::make_pair(batch->file, batch->sequence)] = batch;
+  if (batch->file == delivery_file_ && batch->sequence == delivery_batch_) {
+    delivered_.notify_all();
+  }
+}
+
+}  // namespace sling
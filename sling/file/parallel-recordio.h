@@ -0,0 +1,134 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_FILE_PARALLEL_RECORDIO_H_
+#define SLING_FILE_PARALLEL_RECORDIO_H_
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "sling/base/macros.h"
+#include "sling/base/status.h"
+#include "sling/base/types.h"
+#include "sling/file/recordio.h"
+#include "sling/util/thread-pool.h"
+
+namespace sling {
+
+// Reader for reading records from a set of record files in parallel. A number
+// of reader threads read batches of records ahead from the record files, and
+// the record values in the batches are decompressed by a pool of worker
+// threads. The batches are delivered in file order, so the records are
+// returned in the same order as when reading the files one after another.
+class ParallelRecordReader {
+ public:
+  // Configuration options for parallel record reader.
+  struct Options {
+    // Options for reading the record files.
+    RecordFileOptions file;
+
+    // Number of files read in parallel.
+    int readers = 2;
+
+    // Number of threads for decompressing record values. If this is zero, one
+    // thread is used per hardware thread.
+    int workers = 2;
+
+    // Approximate size of record batches in bytes.
+    int batch_size = 1 << 20;
+
+    // Maximum number of batches read ahead. These are divided evenly between
+    // the readers.
+    int prefetch = 8;
+  };
+
+  // Open record files matching file pattern for reading.
+  ParallelRecordReader(const string &pattern, const Options &options);
+  explicit ParallelRecordReader(const string &pattern);
+  ~ParallelRecordReader();
+
+  // Return true if we have read all records in the files. This waits until the
+  // next batch of records is ready.
+  bool Done();
+
+  // Read next record. The record is valid until the next call to Read() or
+  // Done().
+  Status Read(Record *record);
+
+ private:
+  struct Batch;
+
+  // Reader thread for reading batches of records from files.
+  void ReadFiles(int index);
+
+  // Decompress record values in batch.
+  static void Decompress(Batch *batch);
+
+  // Deliver batch to the consumer.
+  void Deliver(Batch *batch);
+
+  // Reader options.
+  Options options_;
+
+  // Record files.
+  std::vector<string> files_;
+
+  // Next file to be read.
+  int next_file_ = 0;
+
+  // Reader threads.
+  std::vector<std::thread> readers_;
+
+  // Worker threads for decompressing batches.
+  ThreadPool *workers_ = nullptr;
+
+  // Batches that are ready for the consumer, indexed by file number and
+  // batch number in the file.
+  std::map<std::pair<int, int64>, Batch *> ready_;
+
+  // File number and batch number for the next batch to be consumed.
+  int delivery_file_ = 0;
+  int64 delivery_batch_ = 0;
+
+  // Number of batches that have been read ahead but not consumed for each
+  // reader thread.
+  std::vector<int> outstanding_;
+
+  // Maximum number of outstanding batches for each reader thread.
+  int quota_ = 1;
+
+  // Flag to signal reader threads to stop.
+  bool stop_ = false;
+
+  // Current batch being consumed and next record in the batch.
+  Batch *current_ = nullptr;
+  int next_record_ = 0;
+
+  // Mutex for protecting reader state and signals for delivered and consumed
+  // batches.
+  std::mutex mu_;
+  std::condition_variable delivered_;
+  std::condition_variable consumed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ParallelRecordReader);
+};
+
+}  // namespace sling
+
+#endif  // SLING_FILE_PARALLEL_RECORDIO_H_
@@ -20,6 +20,7 @@
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <string>
@@ -145,6 +146,16 @@ class PosixFile : public File {
     return Status::OK;
   }
 
+  void *MapMemory(uint64 pos, size_t size, bool writable) override {
+    int prot = writable ? PROT_READ | PROT_WRITE : PROT_READ;
+    void *mapping = mmap(nullptr, size, prot, MAP_SHARED, fd_, pos);
+    if (mapping == MAP_FAILED) {
+      LOG(ERROR) << "mmap failed for " << filename_ << ": " << strerror(errno);
+      return nullptr;
+    }
+    return mapping;
+  }
+
   string filename() const override { return filename_; }
 
  private:
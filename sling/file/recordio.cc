@@ -14,14 +14,22 @@
 
 #include "sling/file/recordio.h"
 
+#include <errno.h>
+#include <algorithm>
+
 #include "sling/base/logging.h"
 #include "sling/base/types.h"
+#include "sling/util/fingerprint.h"
 #include "sling/util/varint.h"
 #include "third_party/snappy/snappy.h"
 #include "third_party/snappy/snappy-sinksource.h"
+#include "third_party/zlib/zlib.h"
 
 namespace sling {
 
+// Registry for record codecs.
+REGISTER_SINGLETON_REGISTRY("record codec", sling::RecordCodec);
+
 namespace {
 
 // Default record file options.
@@ -50,8 +58,81 @@ class SliceSource : public snappy::Source {
   int pos_ = 0;
 };
 
+// Snappy codec for fast compression with moderate compression ratio.
+class SnappyCodec : public RecordCodec {
+ public:
+  RecordFile::CompressionType type() const override {
+    return RecordFile::SNAPPY;
+  }
+
+  void Compress(const Slice &data, RecordBuffer *output) const override {
+    SliceSource source(data);
+    snappy::Compress(&source, output);
+  }
+
+  bool Decompress(const Slice &data, RecordBuffer *output) const override {
+    snappy::ByteArraySource source(data.data(), data.size());
+    return snappy::Uncompress(&source, output);
+  }
+};
+
+REGISTER_RECORD_CODEC("snappy", SnappyCodec);
+
+// Zlib codec for higher compression ratio at the cost of slower compression
+// and decompression. The compressed data is prefixed with the varint-encoded
+// size of the uncompressed data.
+class ZlibCodec : public RecordCodec {
+ public:
+  // Maximum compression ratio for deflate. This bounds the uncompressed size
+  // so corrupt size prefixes cannot cause huge allocations.
+  static const uint64 kMaxRatio = 1032;
+
+  RecordFile::CompressionType type() const override {
+    return RecordFile::ZLIB;
+  }
+
+  void Compress(const Slice &data, RecordBuffer *output) const override {
+    uLongf size = compressBound(data.size());
+    output->ensure(Varint::kMax64 + size);
+    char *p = Varint::Encode64(output->end(), data.size());
+    output->appended(p - output->end());
+    int rc = compress2(reinterpret_cast<Bytef *>(output->end()), &size,
+                       reinterpret_cast<const Bytef *>(data.data()),
+                       data.size(), Z_DEFAULT_COMPRESSION);
+    CHECK_EQ(rc, Z_OK) << "zlib compression failed";
+    output->appended(size);
+  }
+
+  bool Decompress(const Slice &data, RecordBuffer *output) const override {
+    uint64 length;
+    const char *p = Varint::Parse64WithLimit(data.data(),
+                                             data.data() + data.size(),
+                                             &length);
+    if (p == nullptr) return false;
+    uint64 compressed = data.data() + data.size() - p;
+    if (length > compressed * kMaxRatio) return false;
+    output->ensure(length);
+    uLongf size = length;
+    int rc = uncompress(reinterpret_cast<Bytef *>(output->end()), &size,
+                        reinterpret_cast<const Bytef *>(p), compressed);
+    if (rc != Z_OK || size != length) return false;
+    output->appended(size);
+    return true;
+  }
+};
+
+REGISTER_RECORD_CODEC("zlib", ZlibCodec);
+
 }  // namespace
 
+const RecordCodec *RecordCodec::Find(int type) {
+  auto *registry = RecordCodec::registry();
+  for (auto *c = registry->components; c != nullptr; c = c->next()) {
+    if (c->object()->type() == type) return c->object();
+  }
+  return nullptr;
+}
+
 RecordBuffer::~RecordBuffer() {
   free(floor_);
 }
@@ -162,20 +243,40 @@ int RecordFile::WriteHeader(const Header &header, char *data) {
 
 RecordReader::RecordReader(File *file, const RecordFileOptions &options)
     : file_(file) {
-  // Allocate input buffer.
-  CHECK_GE(options.buffer_size, sizeof(FileHeader));
-  input_.resize(options.buffer_size);
-
-  // Read record file header.
-  CHECK(Fill());
-  CHECK_GE(input_.size(), sizeof(FileHeader))
-      << "Record file truncated: " << file->filename();
-  memcpy(&info_, input_.begin(), sizeof(FileHeader));
+  CHECK(file_->GetSize(&size_));
+
+  // Try to memory-map the record file.
+  if (options.memory_map && size_ >= sizeof(FileHeader)) {
+    mapping_ = static_cast<char *>(file_->MapMemory(0, size_));
+    if (mapping_ != nullptr) {
+      mapped_size_ = size_;
+      readahead_ = options.buffer_size;
+      File::AdviseMappedMemory(mapping_, mapped_size_, File::SEQUENTIAL_ACCESS);
+    }
+  }
+
+  if (mapping_ != nullptr) {
+    // Read record file header from mapped file.
+    memcpy(&info_, mapping_, sizeof(FileHeader));
+  } else {
+    // Allocate input buffer.
+    CHECK_GE(options.buffer_size, sizeof(FileHeader));
+    input_.resize(options.buffer_size);
+
+    // Read record file header.
+    CHECK(Fill());
+    CHECK_GE(input_.size(), sizeof(FileHeader))
+        << "Record file truncated: " << file->filename();
+    memcpy(&info_, input_.begin(), sizeof(FileHeader));
+    input_.consumed(sizeof(FileHeader));
+  }
   CHECK_EQ(info_.magic, MAGIC)
       << "Not a record file: " << file->filename();
-  input_.consumed(sizeof(FileHeader));
   position_ = sizeof(FileHeader);
-  CHECK(file_->GetSize(&size_));
+  codec_ = RecordCodec::Find(info_.compression);
+
+  // The key index is not part of the records in the file.
+  if (info_.index != 0) size_ = info_.index;
 }
 
 RecordReader::RecordReader(const string &filename,
@@ -193,6 +294,11 @@ RecordReader::~RecordReader() {
 }
 
 Status RecordReader::Close() {
+  if (mapping_ != nullptr) {
+    Status s = File::FreeMappedMemory(mapping_, mapped_size_);
+    mapping_ = nullptr;
+    if (!s.ok()) return s;
+  }
   if (file_) {
     Status s = file_->Close();
     file_ = nullptr;
@@ -210,7 +316,52 @@ Status RecordReader::Fill() {
   return Status::OK;
 }
 
-Status RecordReader::Read(Record *record) {
+Status RecordReader::ReadMapped(Record *record) {
+  // Keep reading until we read a data record.
+  for (;;) {
+    // Read record header. Headers near the end of the file are copied to a
+    // padded buffer, so the header parser does not read beyond the mapping.
+    if (position_ >= mapped_size_) return Status(1, "End of record file");
+    const char *p = mapping_ + position_;
+    uint64 left = mapped_size_ - position_;
+    char padded[MAX_HEADER_LEN];
+    if (left < MAX_HEADER_LEN) {
+      memset(padded, 0, MAX_HEADER_LEN);
+      memcpy(padded, p, left);
+      p = padded;
+    }
+    Header hdr;
+    int hdrsize = ReadHeader(p, &hdr);
+    if (hdrsize < 0) return Status(1, "Corrupt record header");
+
+    // Skip filler records.
+    if (hdr.record_type == FILLER_RECORD) {
+      position_ += hdr.record_size;
+      continue;
+    }
+    if (hdrsize + hdr.record_size > left) return Status(1, "Record truncated");
+
+    // Return record key and value pointing into the mapped file.
+    const char *data = mapping_ + position_ + hdrsize;
+    record->key = Slice(data, hdr.key_size);
+    record->value = Slice(data + hdr.key_size, hdr.record_size - hdr.key_size);
+    position_ += hdrsize + hdr.record_size;
+
+    // Prefetch the next read-ahead window.
+    if (position_ > prefetched_ && position_ < mapped_size_) {
+      prefetched_ = std::min(position_ + readahead_, mapped_size_);
+      File::AdviseMappedMemory(mapping_ + position_, prefetched_ - position_,
+                               File::PREFETCH_ACCESS);
+    }
+
+    return Status::OK;
+  }
+}
+
+Status RecordReader::ReadRaw(Record *record) {
+  // Read record directly from memory-mapped file.
+  if (mapping_ != nullptr) return ReadMapped(record);
+
   // Keep reading until we read a data record.
   for (;;) {
     // Fill input buffer if it is nearly empty.
@@ -261,29 +412,37 @@ Status RecordReader::Read(Record *record) {
 
     // Get record value.
     size_t value_size = hdr.record_size - hdr.key_size;
-    if (info_.compression == SNAPPY) {
-      // Decompress record value.
-      decompressed_data_.clear();
-      snappy::ByteArraySource source(input_.begin(), value_size);
-      CHECK(snappy::Uncompress(&source, &decompressed_data_));
-      input_.consumed(value_size);
-      record->value =
-          Slice(decompressed_data_.begin(), decompressed_data_.end());
-    } else if (info_.compression == UNCOMPRESSED) {
-      record->value = Slice(input_.begin(), value_size);
-      input_.consumed(value_size);
-    } else {
-      return Status(1, "Unknown compression type");
-    }
+    record->value = Slice(input_.begin(), value_size);
+    input_.consumed(value_size);
 
     position_ += hdr.record_size;
     return Status::OK;
   }
 }
 
+Status RecordReader::Read(Record *record) {
+  Status s = ReadRaw(record);
+  if (!s.ok()) return s;
+
+  if (codec_ != nullptr) {
+    // Decompress record value.
+    decompressed_data_.clear();
+    if (!codec_->Decompress(record->value, &decompressed_data_)) {
+      return Status(1, "Corrupt compressed record");
+    }
+    record->value =
+        Slice(decompressed_data_.begin(), decompressed_data_.end());
+  } else if (info_.compression != UNCOMPRESSED) {
+    return Status(1, "Unknown compression type");
+  }
+
+  return Status::OK;
+}
+
 Status RecordReader::Skip(int64 n) {
   // Check if we can skip to position in input buffer.
   position_ += n;
+  if (mapping_ != nullptr) return Status::OK;
   char *ptr = input_.begin() + n;
   if (ptr >= input_.floor() && ptr < input_.end()) {
     input_.consumed(n);
@@ -300,6 +459,7 @@ Status RecordReader::Seek(uint64 pos) {
   // Check if we can skip to position in input buffer.
   int64 offset = pos - position_;
   position_ = pos;
+  if (mapping_ != nullptr) return Status::OK;
   char *ptr = input_.begin() + offset;
   if (ptr >= input_.floor() && ptr < input_.end()) {
     input_.consumed(offset);
@@ -311,8 +471,115 @@ Status RecordReader::Seek(uint64 pos) {
   return file_->Seek(pos);
 }
 
+Status RecordReader::ReadIndex() {
+  // Read header for index record.
+  char header[MAX_HEADER_LEN];
+  uint64 bytes;
+  Status s = file_->PRead(info_.index, header, MAX_HEADER_LEN, &bytes);
+  if (!s.ok()) return s;
+  Header hdr;
+  int hdrsize = ReadHeader(header, &hdr);
+  if (hdrsize < 0 || hdrsize > bytes || hdr.record_type != FILLER_RECORD) {
+    return Status(1, "Corrupt record index", file_->filename());
+  }
+
+  // Read index entries.
+  size_t size = hdr.record_size - hdrsize;
+  index_.resize(size / sizeof(IndexEntry));
+  char *data = reinterpret_cast<char *>(index_.data());
+  uint64 pos = info_.index + hdrsize;
+  while (size > 0) {
+    s = file_->PRead(pos, data, size, &bytes);
+    if (!s.ok()) return s;
+    if (bytes == 0) return Status(1, "Record index truncated");
+    pos += bytes;
+    data += bytes;
+    size -= bytes;
+  }
+
+  return Status::OK;
+}
+
+Status RecordReader::Load(uint64 pos) {
+  // Records are read directly from memory-mapped files.
+  if (mapping_ != nullptr) {
+    position_ = pos;
+    return Status::OK;
+  }
+
+  // Read record header.
+  input_.clear();
+  uint64 bytes;
+  Status s = file_->PRead(pos, input_.end(), MAX_HEADER_LEN, &bytes);
+  if (!s.ok()) return s;
+  Header hdr;
+  int hdrsize = ReadHeader(input_.end(), &hdr);
+  if (hdrsize < 0 || hdrsize > bytes) return Status(1, "Corrupt record header");
+
+  // Read the rest of the record.
+  uint64 size = hdrsize + hdr.record_size;
+  if (size > bytes) {
+    input_.ensure(size);
+    uint64 more;
+    s = file_->PRead(pos + bytes, input_.end() + bytes, size - bytes, &more);
+    if (!s.ok()) return s;
+    bytes += more;
+    if (bytes < size) return Status(1, "Record truncated");
+  }
+  input_.appended(bytes);
+
+  // Position the reader at the record.
+  position_ = pos;
+  return file_->Seek(pos + bytes);
+}
+
+Status RecordReader::FindKey(const Slice &key, Record *record, uint64 *pos) {
+  // Read key index on first lookup.
+  if (!Indexed()) return Status(1, "Record file has no index");
+  if (!index_loaded_) {
+    Status s = ReadIndex();
+    if (!s.ok()) return s;
+    index_loaded_ = true;
+    if (mapping_ != nullptr) {
+      File::AdviseMappedMemory(mapping_, mapped_size_, File::RANDOM_ACCESS);
+    }
+  }
+
+  // Check all the records with the same key fingerprint.
+  IndexEntry probe;
+  probe.fingerprint = Fingerprint(key.data(), key.size());
+  probe.position = 0;
+  auto it = std::lower_bound(index_.begin(), index_.end(), probe);
+  while (it != index_.end() && it->fingerprint == probe.fingerprint) {
+    Status s = Load(it->position);
+    if (!s.ok()) return s;
+    s = Read(record);
+    if (!s.ok()) return s;
+    if (record->key == key) {
+      *pos = it->position;
+      return Status::OK;
+    }
+    ++it;
+  }
+
+  return Status(ENOENT, "Key not found", key.str());
+}
+
+Status RecordReader::Lookup(const Slice &key, Record *record) {
+  uint64 pos;
+  return FindKey(key, record, &pos);
+}
+
+Status RecordReader::SeekToKey(const Slice &key) {
+  Record record;
+  uint64 pos;
+  Status s = FindKey(key, &record, &pos);
+  if (!s.ok()) return s;
+  return Seek(pos);
+}
+
 RecordWriter::RecordWriter(File *file, const RecordFileOptions &options)
-    : file_(file) {
+    : file_(file), indexed_(options.indexed) {
   // Allocate output buffer.
   output_.resize(options.buffer_size);
   position_ = 0;
@@ -322,10 +589,17 @@ RecordWriter::RecordWriter(File *file, const RecordFileOptions &options)
   info_.magic = MAGIC;
   info_.hdrlen = sizeof(info_);
   info_.compression = options.compression;
+  codec_ = RecordCodec::Find(options.compression);
   info_.chunk_size = options.chunk_size;
   memcpy(output_.end(), &info_, sizeof(info_));
   output_.appended(sizeof(info_));
   position_ += sizeof(info_);
+
+  // Start background writer in async mode.
+  buffer_size_ = options.buffer_size;
+  if (options.async) {
+    writer_ = new std::thread(&RecordWriter::Writer, this);
+  }
 }
 
 RecordWriter::RecordWriter(const string &filename,
@@ -346,10 +620,30 @@ Status RecordWriter::Close() {
   // Check if file has already been closed.
   if (file_ == nullptr) return Status::OK;
 
+  // Write the remaining records and stop the background writer.
+  if (writer_ != nullptr) {
+    Sync();
+    {
+      std::lock_guard<std::mutex> lock(mu_);
+      stop_ = true;
+    }
+    cv_.notify_all();
+    writer_->join();
+    delete writer_;
+    writer_ = nullptr;
+    if (!async_status_.ok()) return async_status_;
+  }
+
   // Flush output buffer.
   Status s = Flush();
   if (!s.ok()) return s;
 
+  // Write key index.
+  if (indexed_) {
+    s = WriteIndex();
+    if (!s.ok()) return s;
+  }
+
   // Close output file.
   s = file_->Close();
   file_ = nullptr;
@@ -365,14 +659,126 @@ Status RecordWriter::Flush() {
   return Status::OK;
 }
 
+Status RecordWriter::WriteIndex() {
+  // Sort index entries by key fingerprint.
+  std::sort(index_.begin(), index_.end());
+
+  // Write index as a filler record. For a filler record, the record size
+  // includes the header.
+  size_t size = index_.size() * sizeof(IndexEntry);
+  int hdrlen = 1 + Varint::Length64(size);
+  while (1 + Varint::Length64(size + hdrlen) > hdrlen) hdrlen++;
+  Header hdr;
+  hdr.record_type = FILLER_RECORD;
+  hdr.record_size = size + hdrlen;
+  hdr.key_size = 0;
+  output_.ensure(MAX_HEADER_LEN);
+  CHECK_EQ(WriteHeader(hdr, output_.end()), hdrlen);
+  output_.appended(hdrlen);
+  Status s = Flush();
+  if (!s.ok()) return s;
+  s = file_->Write(index_.data(), size);
+  if (!s.ok()) return s;
+  info_.index = position_;
+  position_ += hdr.record_size;
+
+  // Update file header with the index position.
+  s = file_->Seek(0);
+  if (!s.ok()) return s;
+  return file_->Write(&info_, sizeof(info_));
+}
+
 Status RecordWriter::Write(const Record &record) {
+  // Write record directly in sync mode.
+  if (writer_ == nullptr) return WriteRecord(record);
+
+  // Add record to producer buffer in async mode.
+  RecordBuffer &buffer = buffers_[producer_];
+  size_t size = record.key.size() + record.value.size();
+  buffer.ensure(2 * Varint::kMax64 + size);
+  char *p = Varint::Encode64(buffer.end(), record.key.size());
+  p = Varint::Encode64(p, record.value.size());
+  memcpy(p, record.key.data(), record.key.size());
+  p += record.key.size();
+  memcpy(p, record.value.data(), record.value.size());
+  p += record.value.size();
+  buffer.appended(p - buffer.end());
+
+  // Hand off the buffer to the background writer when it is full.
+  if (buffer.size() >= buffer_size_) return Handoff();
+  return Status::OK;
+}
+
+uint64 RecordWriter::Tell() {
+  if (writer_ != nullptr) Sync();
+  return position_;
+}
+
+Status RecordWriter::Handoff() {
+  // Wait until the background writer is done with the other buffer.
+  std::unique_lock<std::mutex> lock(mu_);
+  if (busy_) {
+    Clock clock;
+    clock.start();
+    cv_.wait(lock, [this]() { return !busy_; });
+    clock.stop();
+    blocked_ += clock.cycles();
+  }
+
+  // Switch buffers.
+  busy_ = true;
+  producer_ ^= 1;
+  cv_.notify_all();
+
+  // Report any error from the background writer.
+  return async_status_;
+}
+
+void RecordWriter::Sync() {
+  if (!buffers_[producer_].empty()) Handoff();
+  std::unique_lock<std::mutex> lock(mu_);
+  cv_.wait(lock, [this]() { return !busy_; });
+}
+
+void RecordWriter::Writer() {
+  std::unique_lock<std::mutex> lock(mu_);
+  for (;;) {
+    // Wait for the next buffer to be handed off.
+    cv_.wait(lock, [this]() { return busy_ || stop_; });
+    if (!busy_) break;
+
+    // Write all the records in the buffer without holding the lock.
+    RecordBuffer &buffer = buffers_[producer_ ^ 1];
+    lock.unlock();
+    const char *p = buffer.begin();
+    const char *end = buffer.end();
+    Status st;
+    while (p < end && st.ok()) {
+      uint64 key_size;
+      uint64 value_size;
+      p = Varint::Parse64(p, &key_size);
+      p = Varint::Parse64(p, &value_size);
+      Record record(Slice(p, key_size), Slice(p + key_size, value_size));
+      p += key_size + value_size;
+      st = WriteRecord(record);
+    }
+    buffer.clear();
+    lock.lock();
+
+    // Signal the producer that the buffer is free.
+    if (!st.ok() && async_status_.ok()) async_status_ = st;
+    busy_ = false;
+    cv_.notify_all();
+  }
+}
+
+Status RecordWriter::WriteRecord(const Record &record) {
   // Compress record value if requested.
   Slice value;
-  if (info_.compression == SNAPPY) {
+  if (codec_ != nullptr) {
     // Compress record value.
-    SliceSource source(record.value);
     compressed_data_.clear();
-    snappy::Compress(&source, &compressed_data_);
+    codec_->Compress(record.value, &compressed_data_);
     value = Slice(compressed_data_.begin(), compressed_data_.end());
   } else if (info_.compression == UNCOMPRESSED) {
     // Store uncompressed record value.
@@ -420,6 +826,14 @@ Status RecordWriter::Write(const Record &record) {
     }
   }
 
+  // Add record to key index.
+  if (indexed_ && record.key.size() > 0) {
+    IndexEntry entry;
+    entry.fingerprint = Fingerprint(record.key.data(), record.key.size());
+    entry.position = position_;
+    index_.push_back(entry);
+  }
+
   // Write record header.
   Header hdr;
   hdr.record_type = DATA_RECORD;
@@ -15,6 +15,13 @@
 #ifndef SLING_FILE_RECORDIO_H_
 #define SLING_FILE_RECORDIO_H_
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "sling/base/clock.h"
+#include "sling/base/registry.h"
 #include "sling/base/slice.h"
 #include "sling/base/status.h"
 #include "sling/base/types.h"
@@ -113,9 +120,12 @@ class RecordFile {
   enum CompressionType {
     UNCOMPRESSED = 0,
     SNAPPY = 1,
+    ZLIB = 2,
   };
 
-  // File header information.
+  // File header information. If the file has a key index, the index field is
+  // the position of the index record at the end of the file, otherwise it is
+  // zero.
   struct FileHeader {
     uint32 magic;
     uint8 hdrlen;
@@ -125,6 +135,21 @@ class RecordFile {
     uint64 chunk_size;
   };
 
+  // Key index entry. The key index is stored as a filler record at the end of
+  // the file, so readers that do not use the index will skip it. The index
+  // entries are sorted by key fingerprint.
+  struct IndexEntry {
+    uint64 fingerprint;  // key fingerprint
+    uint64 position;     // position of record in file
+
+    bool operator <(const IndexEntry &other) const {
+      if (fingerprint != other.fingerprint) {
+        return fingerprint < other.fingerprint;
+      }
+      return position < other.position;
+    }
+  };
+
   // Record header information.
   struct Header {
     RecordType record_type;
@@ -139,6 +164,30 @@ class RecordFile {
   static int WriteHeader(const Header &header, char *data);
 };
 
+// Codec for compressing record values. Codecs are registered by name and
+// each codec has a unique compression type which is stored in the file header.
+class RecordCodec : public Singleton<RecordCodec> {
+ public:
+  virtual ~RecordCodec() = default;
+
+  // Compression type for codec.
+  virtual RecordFile::CompressionType type() const = 0;
+
+  // Compress data and append it to the output buffer.
+  virtual void Compress(const Slice &data, RecordBuffer *output) const = 0;
+
+  // Decompress data and append it to the output buffer. Returns false if the
+  // compressed data is corrupt.
+  virtual bool Decompress(const Slice &data, RecordBuffer *output) const = 0;
+
+  // Find codec for compression type. Returns null for uncompressed records
+  // or if there is no codec for the compression type.
+  static const RecordCodec *Find(int type);
+};
+
+#define REGISTER_RECORD_CODEC(name, component) \
+  REGISTER_SINGLETON_TYPE(sling::RecordCodec, name, component)
+
 // Configuration options for record file.
 struct RecordFileOptions {
   // Input/output buffer size.
@@ -149,6 +198,20 @@ struct RecordFileOptions {
 
   // Record compression.
   RecordFile::CompressionType compression = RecordFile::SNAPPY;
+
+  // Write key index at the end of the file for looking up records by key.
+  bool indexed = false;
+
+  // Compress and write records in a background thread. The producer fills one
+  // buffer of buffer_size bytes with records while the records in the other
+  // buffer are compressed and written to the file.
+  bool async = false;
+
+  // Memory-map record file for reading. Record keys and uncompressed values
+  // point directly into the mapped file and compressed values are decompressed
+  // directly from the mapped file. The buffer size is used as the read-ahead
+  // window. Falls back to buffered reading if the file cannot be mapped.
+  bool memory_map = false;
 };
 
 // Reader for reading records from a record file.
@@ -170,6 +233,14 @@ class RecordReader : public RecordFile {
   // Read next record from record file.
   Status Read(Record *record);
 
+  // Read next record from record file without decompressing the record value.
+  Status ReadRaw(Record *record);
+
+  // Return compression type for record values.
+  CompressionType compression() const {
+    return static_cast<CompressionType>(info_.compression);
+  }
+
   // Return current position in record file.
   uint64 Tell() { return position_; }
 
@@ -179,10 +250,37 @@ class RecordReader : public RecordFile {
   // Skip bytes in input. The offset can be negative.
   Status Skip(int64 n);
 
+  // Check if the record file has a key index.
+  bool Indexed() const { return info_.index != 0; }
+
+  // Look up record by key using the key index. Returns an ENOENT error if
+  // there is no record with the key. If there are multiple records with the
+  // same key, the first record is returned. After the lookup, the reader is
+  // positioned after the record.
+  Status Lookup(const Slice &key, Record *record);
+
+  // Seek to the record with the key using the key index, so the record is
+  // returned by the next call to Read().
+  Status SeekToKey(const Slice &key);
+
  private:
   // Fill input buffer.
   Status Fill();
 
+  // Read key index from file.
+  Status ReadIndex();
+
+  // Read next record from memory-mapped file.
+  Status ReadMapped(Record *record);
+
+  // Read record at position into the input buffer. This only reads the record
+  // and not a full input buffer.
+  Status Load(uint64 pos);
+
+  // Find record with key using the key index and return the record and its
+  // position in the file.
+  Status FindKey(const Slice &key, Record *record, uint64 *pos);
+
   // Input file.
   File *file_;
 
@@ -198,8 +296,24 @@ class RecordReader : public RecordFile {
   // Input buffer.
   RecordBuffer input_;
 
+  // Codec for decompressing record values.
+  const RecordCodec *codec_;
+
+  // Memory-mapped record file. This is null if the file is not mapped.
+  char *mapping_ = nullptr;
+  uint64 mapped_size_ = 0;
+
+  // Read-ahead window size and end of the current read-ahead window for
+  // memory-mapped files.
+  uint64 readahead_ = 0;
+  uint64 prefetched_ = 0;
+
   // Buffer for decompressed record data.
   RecordBuffer decompressed_data_;
+
+  // Key index entries. The index is read on the first key lookup.
+  std::vector<IndexEntry> index_;
+  bool index_loaded_ = false;
 };
 
 // Writer for writing records to record file.
@@ -228,13 +342,34 @@ class RecordWriter : public RecordFile {
     return Write(Record(Slice(), value));
   }
 
-  // Return current position in record file.
-  uint64 Tell() const { return position_; }
+  // Return current position in record file. In async mode, this waits until
+  // all buffered records have been written.
+  uint64 Tell();
+
+  // Return the time in seconds the producer has been blocked waiting for the
+  // background thread in async mode.
+  double blocked_time() const { return blocked_ / Clock::hz(); }
 
  private:
+  // Compress record and add it to the output buffer.
+  Status WriteRecord(const Record &record);
+
   // Flush output buffer to disk.
   Status Flush();
 
+  // Hand the records in the producer buffer to the background thread. This
+  // waits until the background thread has written the previous buffer.
+  Status Handoff();
+
+  // Wait until the background thread has written all records handed off.
+  void Sync();
+
+  // Background thread for writing records in async mode.
+  void Writer();
+
+  // Write key index to the end of the file and update the file header.
+  Status WriteIndex();
+
   // Output file.
   File *file_;
 
@@ -247,8 +382,38 @@ class RecordWriter : public RecordFile {
   // Output buffer.
   RecordBuffer output_;
 
+  // Codec for compressing record values.
+  const RecordCodec *codec_;
+
   // Buffer for compressed record data.
   RecordBuffer compressed_data_;
+
+  // Write key index when the file is closed.
+  bool indexed_;
+
+  // Key index entries for all records with keys.
+  std::vector<IndexEntry> index_;
+
+  // Buffers with uncompressed records for async mode. The producer adds
+  // records to one buffer while the background thread writes the other.
+  RecordBuffer buffers_[2];
+  int producer_ = 0;
+  size_t buffer_size_;
+
+  // Background writer thread for async mode. This is null in sync mode.
+  std::thread *writer_ = nullptr;
+
+  // Signals between the producer and the background writer.
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool busy_ = false;
+  bool stop_ = false;
+
+  // First error reported by the background writer.
+  Status async_status_;
+
+  // Number of clock cycles the producer has been blocked.
+  Clock::Timestamp blocked_ = 0;
 };
 
 }  // namespace sling
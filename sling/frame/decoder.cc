@@ -14,13 +14,19 @@
 
 #include "sling/frame/decoder.h"
 
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "sling/base/logging.h"
 #include "sling/frame/object.h"
 #include "sling/frame/store.h"
 #include "sling/frame/wire.h"
 #include "sling/stream/input.h"
+#include "sling/stream/memory.h"
+#include "sling/util/thread-pool.h"
 
 namespace sling {
 
@@ -107,10 +113,25 @@ Handle Decoder::DecodeObject() {
           uint32 replace;
           CHECK(input_->ReadVarint32(&slots));
           CHECK(input_->ReadVarint32(&replace));
-          DCHECK_LT(replace, references_.length());
+          DCHECK_LT(segment_base_ + replace, references_.length());
           handle = DecodeFrame(slots, replace);
           break;
         }
+        case WIRE_SEGMENT: {
+          // Reference numbers are relative to the start of the segment. The
+          // references for earlier segments are kept for resolving references
+          // to shared objects.
+          uint32 size;
+          CHECK(input_->ReadVarint32(&size));
+          segment_base_ = references_.length();
+          segments_.push_back(segment_base_);
+          handle = DecodeObject();
+          break;
+        }
+        case WIRE_SHARED:
+          handle = DecodeShared();
+          *references_.push() = handle;
+          break;
         default: LOG(FATAL) << "Invalid tag value: " << tag;
       }
   }
@@ -129,7 +150,7 @@ Handle Decoder::DecodeFrame(int slots, int replace) {
     *references_.push() = handle;
   } else {
     handle = Reference(replace);
-    index = replace;
+    index = segment_base_ + replace;
   }
 
   // Decode slots for frame and store them temporarily on the stack.
@@ -210,6 +231,26 @@ Handle Decoder::DecodeFrame(int slots, int replace) {
   return handle;
 }
 
+Handle Decoder::DecodeShared() {
+  uint32 segment;
+  uint32 index;
+  CHECK(input_->ReadVarint32(&segment));
+  CHECK(input_->ReadVarint32(&index));
+
+  // Add placeholder for object if segments are decoded independently.
+  if (externals_ != nullptr) {
+    Handle placeholder = store_->AllocateFrame(0);
+    externals_->push_back({placeholder, segment, index});
+    return placeholder;
+  }
+
+  // Look up object in the references for the earlier segment.
+  CHECK_LT(segment + 1, segments_.size()) << "Invalid shared segment";
+  int ref = segments_[segment] + index;
+  CHECK_LT(ref, segments_[segment + 1]) << "Invalid shared reference";
+  return references_.base()[ref];
+}
+
 Handle Decoder::DecodeString(int size) {
   // Allocate string object; argument is the size of the string.
   Handle handle = store_->AllocateString(size);
@@ -241,6 +282,7 @@ Handle Decoder::DecodeArray() {
   ArrayDatum *array = store_->Deref(handle)->AsArray();
   Handle *dest = array->begin();
   while (source < end) *dest++ = *source++;
+  store_->WriteBarrier(array);
 
   // Remove elements from stack.
   Release(mark);
@@ -276,5 +318,115 @@ Handle Decoder::DecodeLink(int name_size) {
   }
 }
 
-}  // namespace sling
+// Reads varint from buffer. Returns false if the varint is truncated.
+static bool ReadVarint(const char **data, const char *end, uint64 *value) {
+  uint64 result = 0;
+  for (int shift = 0; shift < 64 && *data < end; shift += 7) {
+    uint8 byte = *(*data)++;
+    result |= static_cast<uint64>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+ParallelDecoder::ParallelDecoder(Store *store, int num_threads)
+    : store_(store), num_threads_(num_threads) {
+  CHECK(store->globals() == nullptr) << "Only global stores can be decoded "
+                                     << "in parallel";
+  if (num_threads_ <= 0) num_threads_ = ThreadPool::NumHardwareThreads();
+}
 
+bool ParallelDecoder::Segmented(const char *data, size_t size) {
+  const char *end = data + size;
+  if (data == end || *data != WIRE_BINARY_MARKER) return false;
+  data++;
+  uint64 tag;
+  return ReadVarint(&data, end, &tag) && tag == WIRE_SEGMENT_TAG;
+}
+
+void ParallelDecoder::DecodeAll(const char *data, size_t size) {
+  // Find segment boundaries from the segment headers.
+  struct Segment {
+    const char *data;    // segment data
+    size_t size;         // segment size
+    Store *store;        // store with decoded segment objects
+
+    // References to the decoded objects in the segment. These are translated
+    // to handles in the target store when the segment is merged.
+    std::vector<Handle> references;
+
+    // References to objects in earlier segments.
+    std::vector<Decoder::External> externals;
+  };
+  std::vector<Segment> segments;
+  const char *end = data + size;
+  if (data < end && *data == WIRE_BINARY_MARKER) data++;
+  while (data < end) {
+    uint64 tag;
+    uint64 length;
+    CHECK(ReadVarint(&data, end, &tag) && tag == WIRE_SEGMENT_TAG)
+        << "Invalid segment header";
+    CHECK(ReadVarint(&data, end, &length) && length <= end - data)
+        << "Segment truncated";
+    segments.emplace_back();
+    Segment &segment = segments.back();
+    segment.data = data;
+    segment.size = length;
+    segment.store = nullptr;
+    data += length;
+  }
+
+  // Decode segments in parallel into separate stores.
+  std::mutex mu;
+  std::condition_variable decoded;
+  ThreadPool pool(std::min<int>(num_threads_, segments.size()));
+  for (Segment &segment : segments) {
+    pool.Schedule([&segment, &mu, &decoded]() {
+      // The segment store is never garbage collected, since all the decoded
+      // objects are merged into the target store.
+      Store *store = new Store();
+      store->LockGC();
+      ArrayInputStream stream(segment.data, segment.size);
+      Input input(&stream);
+      Decoder decoder(store, &input);
+      decoder.set_externals(&segment.externals);
+      while (!decoder.done()) decoder.DecodeObject();
+      const HandleSpace &refs = decoder.references();
+      segment.references.assign(refs.base(), refs.end());
+
+      std::lock_guard<std::mutex> lock(mu);
+      segment.store = store;
+      decoded.notify_all();
+    });
+  }
+
+  // Merge the decoded stores into the target store in segment order while
+  // the remaining segments are being decoded. References to objects in
+  // earlier segments are resolved using the translated references for the
+  // segments that have already been merged.
+  store_->LockGC();
+  for (int i = 0; i < segments.size(); ++i) {
+    Segment &segment = segments[i];
+    Store *store;
+    {
+      std::unique_lock<std::mutex> lock(mu);
+      decoded.wait(lock, [&segment]() { return segment.store != nullptr; });
+      store = segment.store;
+    }
+    Store::Bindings bindings;
+    for (const Decoder::External &external : segment.externals) {
+      CHECK_LT(external.segment, i) << "Invalid shared segment";
+      const std::vector<Handle> &refs = segments[external.segment].references;
+      CHECK_LT(external.index, refs.size()) << "Invalid shared reference";
+      bindings.emplace_back(external.placeholder, refs[external.index]);
+    }
+    store_->Merge(store, &bindings, &segment.references);
+    delete store;
+  }
+  store_->UnlockGC();
+}
+
+}  // namespace sling
@@ -16,8 +16,10 @@
 #define SLING_FRAME_DECODER_H_
 
 #include <string>
+#include <vector>
 
 #include "sling/base/macros.h"
+#include "sling/base/types.h"
 #include "sling/frame/object.h"
 #include "sling/frame/store.h"
 #include "sling/stream/input.h"
@@ -27,6 +29,14 @@ namespace sling {
 // The decoder decodes objects in binary format and loads them into a store.
 class Decoder {
  public:
+  // Reference to an object in an earlier segment of a segmented encoding
+  // which has been decoded into a placeholder object.
+  struct External {
+    Handle placeholder;  // placeholder object for external reference
+    uint32 segment;      // segment with the referenced object
+    uint32 index;        // reference number of the object in the segment
+  };
+
   // Initializes decoder with store where objects should be stored and input
   // where objects are read from.
   Decoder(Store *store, Input *input);
@@ -46,6 +56,16 @@ class Decoder {
   // Skips frames in the input which are already in the store.
   void set_skip_known_frames(bool b) { skip_known_frames_ = b; }
 
+  // Decodes references to objects in earlier segments into placeholder
+  // objects which are added to the external references. This is used for
+  // decoding segments independently of each other.
+  void set_externals(std::vector<External> *externals) {
+    externals_ = externals;
+  }
+
+  // References to decoded objects in the current segment.
+  const HandleSpace &references() const { return references_; }
+
  private:
   // Decodes frame from input.
   Handle DecodeFrame(int slots, int replace);
@@ -77,9 +97,12 @@ class Decoder {
   // Pops elements off the stack.
   void Release(Word mark) { stack_.set_end(stack_.address(mark)); }
 
-  // Returns handle for reference.
+  // Decodes reference to object in an earlier segment.
+  Handle DecodeShared();
+
+  // Returns handle for reference in the current segment.
   Handle Reference(uint32 index) {
-    Handle *h = references_.base() + index;
+    Handle *h = references_.base() + segment_base_ + index;
     CHECK(h < references_.end());
     return *h;
   }
@@ -99,9 +122,46 @@ class Decoder {
   // Frames that already exist in the store can be skipped by the decoder.
   bool skip_known_frames_ = false;
 
+  // Start of the references for each segment in a segmented encoding.
+  std::vector<int> segments_;
+
+  // Start of the references for the current segment.
+  int segment_base_ = 0;
+
+  // External references to objects in earlier segments decoded into
+  // placeholders.
+  std::vector<External> *externals_ = nullptr;
+
   DISALLOW_IMPLICIT_CONSTRUCTORS(Decoder);
 };
 
+// The parallel decoder decodes segmented binary encodings using multiple
+// threads. Each segment is decoded into a separate store by a worker thread,
+// and these stores are merged into the target store in segment order. Only
+// global stores can be decoded in parallel.
+class ParallelDecoder {
+ public:
+  // Initializes parallel decoder for decoding objects into a global store
+  // using a number of threads. If the number of threads is zero or negative,
+  // one thread is used per hardware thread.
+  ParallelDecoder(Store *store, int num_threads);
+
+  // Decodes all segments in the encoded data.
+  void DecodeAll(const char *data, size_t size);
+
+  // Checks if data is a segmented binary encoding.
+  static bool Segmented(const char *data, size_t size);
+
+ private:
+  // Object store for storing decoded objects.
+  Store *store_;
+
+  // Number of decoder threads.
+  int num_threads_;
+
+  DISALLOW_IMPLICIT_CONSTRUCTORS(ParallelDecoder);
+};
+
 }  // namespace sling
 
 #endif  // SLING_FRAME_DECODER_H_
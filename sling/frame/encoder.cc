@@ -20,6 +20,7 @@
 #include "sling/frame/object.h"
 #include "sling/frame/store.h"
 #include "sling/frame/wire.h"
+#include "sling/stream/memory.h"
 #include "sling/stream/output.h"
 
 namespace sling {
@@ -27,16 +28,27 @@ namespace sling {
 Encoder::Encoder(const Store *store, Output *output)
     : store_(store), output_(output), global_(store->globals() == nullptr) {
   // Insert special values in reference mapping.
+  ResetReferences();
+
+  // Output binary encoding mark.
+  output_->WriteChar(WIRE_BINARY_MARKER);
+}
+
+void Encoder::ResetReferences() {
+  references_.clear();
   references_[Handle::nil()] = Reference(-WIRE_NIL);
   references_[Handle::id()] = Reference(-WIRE_ID);
   references_[Handle::isa()] = Reference(-WIRE_ISA);
   references_[Handle::is()] = Reference(-WIRE_IS);
-
-  // Output binary encoding mark.
-  output_->WriteChar(WIRE_BINARY_MARKER);
+  next_index_ = 0;
 }
 
 void Encoder::EncodeAll() {
+  if (segment_size_ > 0) {
+    EncodeSegments();
+    return;
+  }
+
   const MapDatum *map = store_->GetMap(store_->symbols());
   for (Handle *bucket = map->begin(); bucket < map->end(); ++bucket) {
     Handle h = *bucket;
@@ -50,6 +62,62 @@ void Encoder::EncodeAll() {
   }
 }
 
+void Encoder::EncodeSegments() {
+  // Encode frames into a segment buffer. The segment is written to the output
+  // when it is full, since the segment size is needed for the segment header.
+  string buffer;
+  StringOutputStream stream(&buffer);
+  Output segment(&stream);
+  Output *output = output_;
+  output_ = &segment;
+
+  auto flush = [&]() {
+    segment.Flush();
+    if (buffer.empty()) return;
+    output->WriteVarint64(WIRE_SEGMENT_TAG);
+    output->WriteVarint32(buffer.size());
+    output->Write(buffer.data(), buffer.size());
+    buffer.clear();
+    AddSharedObjects();
+    ResetReferences();
+    segment_++;
+  };
+
+  const MapDatum *map = store_->GetMap(store_->symbols());
+  for (Handle *bucket = map->begin(); bucket < map->end(); ++bucket) {
+    Handle h = *bucket;
+    while (!h.IsNil()) {
+      const SymbolDatum *symbol = store_->GetSymbol(h);
+      if (symbol->bound() && !store_->IsProxy(symbol->value)) {
+        // Start new segment when the current segment is full. Frames that have
+        // already been encoded in this or a previous segment are skipped.
+        Reference &ref = references_[symbol->value];
+        if (ref.status != ENCODED && shared_.count(symbol->value) == 0) {
+          EncodeObject(symbol->value);
+          segment.Flush();
+          if (buffer.size() >= static_cast<size_t>(segment_size_)) flush();
+        }
+      }
+      h = symbol->next;
+    }
+  }
+  flush();
+
+  output_ = output;
+}
+
+void Encoder::AddSharedObjects() {
+  for (const auto &it : references_) {
+    const Reference &ref = it.second;
+    if (ref.status != ENCODED || ref.index < 0) continue;
+    if (shared_.count(it.first) > 0) continue;
+    if (store_->GetObject(it.first)->IsSymbol()) continue;
+    Shared &shared = shared_[it.first];
+    shared.segment = segment_;
+    shared.index = ref.index;
+  }
+}
+
 void Encoder::EncodeObject(Handle handle) {
   if (handle.IsRef()) {
     // Check if object has already been output.
@@ -73,6 +141,19 @@ void Encoder::EncodeObject(Handle handle) {
         }
       }
     } else {
+      // Refer to object encoded in an earlier segment.
+      if (!shared_.empty()) {
+        auto f = shared_.find(handle);
+        if (f != shared_.end()) {
+          ref.index = next_index_++;
+          ref.status = ENCODED;
+          WriteTag(WIRE_SPECIAL, WIRE_SHARED);
+          output_->WriteVarint32(f->second.segment);
+          output_->WriteVarint32(f->second.index);
+          return;
+        }
+      }
+
       const Datum *datum = store_->GetObject(handle);
       switch (datum->type()) {
         case STRING: {
@@ -34,12 +34,15 @@ class Encoder {
   void Encode(const Object &object) { EncodeObject(object.handle()); }
   void Encode(Handle handle) { EncodeObject(handle); }
 
-  // Encodes all frames in the symbol table of the store.
+  // Encodes all frames in the symbol table of the store. If a segment size has
+  // been set, the frames are encoded in segments that can be decoded in
+  // parallel.
   void EncodeAll();
 
   // Configuration parameters.
   void set_shallow(bool shallow) { shallow_ = shallow; }
   void set_global(bool global) { global_ = global; }
+  void set_segment_size(int segment_size) { segment_size_ = segment_size; }
 
  private:
   // Object encoding states.
@@ -61,9 +64,24 @@ class Encoder {
     int index;      // reference number
   };
 
+  // Location of object encoded in an earlier segment.
+  struct Shared {
+    int segment;  // segment number
+    int index;    // reference number in segment
+  };
+
   // Encodes object for handle.
   void EncodeObject(Handle handle);
 
+  // Encodes all frames in the symbol table in segments.
+  void EncodeSegments();
+
+  // Adds the objects encoded in the current segment to the shared objects.
+  void AddSharedObjects();
+
+  // Clears all references to encoded objects except the special values.
+  void ResetReferences();
+
   // Encodes object link.
   void EncodeLink(Handle handle);
 
@@ -91,12 +109,24 @@ class Encoder {
   // Next available reference index.
   int next_index_ = 0;
 
+  // Objects encoded in earlier segments. These are not encoded again in later
+  // segments, but are referred to by their location in the earlier segment.
+  // Symbols are always encoded by name.
+  HandleMap<Shared> shared_;
+
+  // Current segment number for segmented encoding.
+  int segment_ = 0;
+
   // Output frames with public ids by reference.
   bool shallow_ = true;
 
   // Output frames in the global store by value.
   bool global_;
 
+  // Approximate segment size in bytes for segmented encoding. Segmentation is
+  // disabled if this is zero.
+  int segment_size_ = 0;
+
   DISALLOW_IMPLICIT_CONSTRUCTORS(Encoder);
 };
 
@@ -136,7 +136,7 @@ Frame &Frame::operator =(const Frame &other) {
 }
 
 bool Frame::Has(Handle name) const {
-  return frame()->has(name);
+  return store()->HasSlot(frame(), name);
 }
 
 bool Frame::Has(const Object &name) const {
@@ -152,7 +152,7 @@ bool Frame::Has(Text name) const {
 }
 
 Object Frame::Get(Handle name) const {
-  return Object(store(), frame()->get(name));
+  return Object(store(), store()->GetSlot(frame(), name));
 }
 
 Object Frame::Get(const Object &name) const {
@@ -168,7 +168,7 @@ Object Frame::Get(Text name) const {
 }
 
 Frame Frame::GetFrame(Handle name) const {
-  Handle value = frame()->get(name);
+  Handle value = store()->GetSlot(frame(), name);
   return Frame(store(), store()->Cast(value, FRAME));
 }
 
@@ -185,7 +185,7 @@ Frame Frame::GetFrame(Text name) const {
 }
 
 Symbol Frame::GetSymbol(Handle name) const {
-  Handle value = frame()->get(name);
+  Handle value = store()->GetSlot(frame(), name);
   return Symbol(store(), store()->Cast(value, SYMBOL));
 }
 
@@ -202,7 +202,7 @@ Symbol Frame::GetSymbol(Text name) const {
 }
 
 string Frame::GetString(Handle name) const {
-  Handle value = frame()->get(name);
+  Handle value = store()->GetSlot(frame(), name);
   if (value.IsRef() && !value.IsNil()) {
     Datum *datum = store()->Deref(value);
     if (datum->IsString()) return datum->AsString()->str().ToString();
@@ -223,7 +223,7 @@ string Frame::GetString(Text name) const {
 }
 
 Text Frame::GetText(Handle name) const {
-  Handle value = frame()->get(name);
+  Handle value = store()->GetSlot(frame(), name);
   if (value.IsRef() && !value.IsNil()) {
     Datum *datum = store()->Deref(value);
     if (datum->IsString()) return datum->AsString()->str();
@@ -244,7 +244,7 @@ Text Frame::GetText(Text name) const {
 }
 
 int Frame::GetInt(Handle name, int defval) const {
-  Handle value = frame()->get(name);
+  Handle value = store()->GetSlot(frame(), name);
   return value.IsInt() ? value.AsInt() : defval;
 }
 
@@ -261,7 +261,7 @@ int Frame::GetInt(Text name, int defval) const {
 }
 
 bool Frame::GetBool(Handle name) const {
-  Handle value = frame()->get(name);
+  Handle value = store()->GetSlot(frame(), name);
   return value.IsInt() ? value.IsTrue() : false;
 }
 
@@ -278,7 +278,7 @@ bool Frame::GetBool(Text name) const {
 }
 
 float Frame::GetFloat(Handle name) const {
-  Handle value = frame()->get(name);
+  Handle value = store()->GetSlot(frame(), name);
   return value.IsFloat() ? value.AsFloat() : 0.0;
 }
 
@@ -295,7 +295,7 @@ float Frame::GetFloat(Text name) const {
 }
 
 Handle Frame::GetHandle(Handle name) const {
-  return frame()->get(name);
+  return store()->GetSlot(frame(), name);
 }
 
 Handle Frame::GetHandle(const Object &name) const {
@@ -311,7 +311,7 @@ Handle Frame::GetHandle(Text name) const {
 }
 
 Handle Frame::Resolve(Handle name) const {
-  return store()->Resolve(frame()->get(name));
+  return store()->Resolve(store()->GetSlot(frame(), name));
 }
 
 Handle Frame::Resolve(const Object &name) const {
@@ -338,7 +338,11 @@ class Array : public Object {
   Handle get(int index) const { return array()->get(index); }
 
   // Sets element in array.
-  void set(int index, Handle value) const { *array()->at(index) = value; }
+  void set(int index, Handle value) const {
+    ArrayDatum *a = array();
+    *a->at(index) = value;
+    store_->WriteBarrier(a);
+  }
 
  private:
   // Dereferences array reference.
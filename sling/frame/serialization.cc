@@ -15,6 +15,9 @@
 #include "sling/frame/serialization.h"
 
 #include "sling/base/logging.h"
+#include "sling/file/file.h"
+#include "sling/frame/decoder.h"
+#include "sling/frame/snapshot.h"
 #include "sling/frame/wire.h"
 
 namespace sling {
@@ -90,7 +93,51 @@ string Encode(const Object &object) {
   return encoder.buffer();
 }
 
+// Decodes segmented store file in parallel. Returns false if the store file
+// is not segmented.
+static bool LoadSegmented(const string &filename, Store *store) {
+  // Check for segmented encoding.
+  File *file;
+  if (!File::Open(filename, "r", &file).ok()) return false;
+  char header[16];
+  uint64 read = 0;
+  uint64 size = 0;
+  if (!file->PRead(0, header, sizeof(header), &read).ok() ||
+      !ParallelDecoder::Segmented(header, read) ||
+      !file->GetSize(&size).ok()) {
+    file->Close();
+    return false;
+  }
+
+  // Memory-map the store file. Fall back to reading the file into memory if
+  // it cannot be memory-mapped.
+  ParallelDecoder decoder(store, 0);
+  void *mapping = file->MapMemory(0, size);
+  file->Close();
+  if (mapping != nullptr) {
+    decoder.DecodeAll(static_cast<const char *>(mapping), size);
+    CHECK(File::FreeMappedMemory(mapping, size));
+  } else {
+    string data;
+    CHECK(File::ReadContents(filename, &data));
+    decoder.DecodeAll(data.data(), data.size());
+  }
+  return true;
+}
+
 void LoadStore(const string &filename, Store *store) {
+  // Load store from snapshot if possible.
+  if (store->globals() == nullptr && store->Pristine() &&
+      Snapshot::Valid(filename)) {
+    Status st = Snapshot::Read(store, filename);
+    if (st.ok()) return;
+    LOG(WARNING) << "Cannot load snapshot for " << filename << ": " << st;
+  }
+
+  // Decode segmented store files in parallel into global stores.
+  if (store->globals() == nullptr && LoadSegmented(filename, store)) return;
+
+  // Decode store file.
   FileDecoder decoder(store, filename);
   store->LockGC();
   decoder.DecodeAll();
@@ -379,7 +379,10 @@ Object Decode(Store *store, Text encoded);
 string Encode(const Store *store, Handle handle);
 string Encode(const Object &object);
 
-// Load store from file.
+// Load store from file. If the store is a new global store and there is a
+// valid snapshot for the file, the store is loaded from the snapshot instead.
+// Please notice that the store is frozen when it is loaded from a snapshot.
+// Segmented store files are decoded in parallel into global stores.
 void LoadStore(const string &filename, Store *store);
 
 }  // namespace sling
@@ -0,0 +1,92 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmark for slot lookup in frames. This compares linear slot scanning
+// with the slot index for frames of increasing width to find the crossover
+// point for the slot_index_threshold store option.
+
+#include <stdio.h>
+#include <random>
+#include <vector>
+
+#include "sling/base/clock.h"
+#include "sling/base/flags.h"
+#include "sling/base/init.h"
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/frame/object.h"
+#include "sling/frame/store.h"
+#include "sling/string/strcat.h"
+
+DEFINE_int32(frames, 10000, "Number of frames per width");
+DEFINE_int32(lookups, 10000000, "Number of slot lookups per width");
+DEFINE_int32(max_slots, 1024, "Maximum number of slots per frame");
+
+using namespace sling;
+
+// Builds frames with the given number of slots and returns the average slot
+// lookup time in nanoseconds.
+double Benchmark(int width, bool indexed) {
+  // Build frames with random slot names. All frames are indexed when the
+  // store is frozen if the slot index is enabled.
+  Store::Options options;
+  options.slot_index_threshold = indexed ? 1 : 0;
+  Store store(&options);
+  std::vector<Handle> names;
+  for (int i = 0; i < width * 2; ++i) {
+    names.push_back(store.Lookup(StrCat("slot", i)));
+  }
+  std::mt19937 rnd(width);
+  Handles frames(&store);
+  for (int f = 0; f < FLAGS_frames; ++f) {
+    Builder b(&store);
+    for (int s = 0; s < width; ++s) b.Add(names[rnd() % names.size()], s);
+    frames.push_back(b.Create().handle());
+  }
+  store.Freeze();
+
+  // Generate random lookups.
+  std::vector<std::pair<const FrameDatum *, Handle>> lookups;
+  for (int i = 0; i < 1000000; ++i) {
+    const FrameDatum *frame = store.GetFrame(frames[rnd() % frames.size()]);
+    lookups.emplace_back(frame, names[rnd() % names.size()]);
+  }
+
+  // Time slot lookups.
+  Clock clock;
+  clock.start();
+  int64 checksum = 0;
+  for (int i = 0; i < FLAGS_lookups; ++i) {
+    auto &l = lookups[i % lookups.size()];
+    Handle value = store.GetSlot(l.first, l.second);
+    if (!value.IsNil()) checksum += value.AsInt();
+  }
+  clock.stop();
+  VLOG(1) << "checksum " << checksum;
+
+  return clock.ns() / FLAGS_lookups;
+}
+
+int main(int argc, char *argv[]) {
+  InitProgram(&argc, &argv);
+
+  printf("%8s %12s %12s\n", "slots", "scan (ns)", "index (ns)");
+  for (int width = 1; width <= FLAGS_max_slots; width *= 2) {
+    double scan = Benchmark(width, false);
+    double index = Benchmark(width, true);
+    printf("%8d %12.1f %12.1f\n", width, scan, index);
+  }
+
+  return 0;
+}
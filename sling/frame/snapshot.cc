@@ -0,0 +1,283 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/frame/snapshot.h"
+
+#include <string>
+#include <vector>
+
+#include "sling/base/logging.h"
+#include "sling/file/file.h"
+
+namespace sling {
+
+// Reads block from file at position. Large blocks can require multiple reads.
+static Status ReadBlock(File *file, uint64 pos, void *buffer, size_t size) {
+  char *data = static_cast<char *>(buffer);
+  while (size > 0) {
+    uint64 read;
+    Status st = file->PRead(pos, data, size, &read);
+    if (!st.ok()) return st;
+    if (read == 0) return Status(1, "Snapshot truncated", file->filename());
+    pos += read;
+    data += read;
+    size -= read;
+  }
+  return Status::OK;
+}
+
+string Snapshot::Filename(const string &filename) {
+  return filename + ".snap";
+}
+
+bool Snapshot::Valid(const string &filename) {
+  // Check that snapshot is not older than the store file.
+  string snapshot = Filename(filename);
+  FileStat snapstat;
+  if (!File::Stat(snapshot, &snapstat).ok()) return false;
+  FileStat filestat;
+  if (File::Stat(filename, &filestat).ok()) {
+    if (snapstat.mtime < filestat.mtime) return false;
+  }
+
+  // Check snapshot header.
+  File *file;
+  if (!File::Open(snapshot, "r", &file).ok()) return false;
+  Header hdr;
+  Status st = ReadBlock(file, 0, &hdr, sizeof(Header));
+  file->Close();
+  if (!st.ok()) return false;
+  return hdr.magic == kMagic && hdr.version == kVersion;
+}
+
+Status Snapshot::Read(Store *store, const string &filename) {
+  // Snapshots can only be loaded into new global stores.
+  if (store->globals() != nullptr || !store->Pristine()) {
+    return Status(1, "Snapshot can only be loaded into empty global store");
+  }
+
+  // Open snapshot file.
+  File *file;
+  Status st = File::Open(Filename(filename), "r", &file);
+  if (!st.ok()) return st;
+
+  // Read and check header.
+  Header hdr;
+  st = ReadBlock(file, 0, &hdr, sizeof(Header));
+  if (st.ok() && (hdr.magic != kMagic || hdr.version != kVersion)) {
+    st = Status(1, "Invalid snapshot", file->filename());
+  }
+  uint64 size;
+  if (st.ok()) st = file->GetSize(&size);
+  uint64 index_size = hdr.index_buckets * sizeof(SymbolIndex::Bucket);
+  uint64 slots_size = hdr.slot_buckets * sizeof(SlotIndex::Bucket);
+  uint64 image_size =
+      hdr.index_offset - hdr.heap_offset + index_size + slots_size;
+  if (st.ok() && hdr.heap_offset + image_size > size) {
+    st = Status(1, "Snapshot truncated", file->filename());
+  }
+  if (!st.ok()) {
+    file->Close();
+    return st;
+  }
+
+  // Read handle table. The handle table entries are heap image offsets until
+  // they have been relocated. The table is read into a separate region, so the
+  // store is left untouched if the snapshot cannot be read.
+  typedef Store::Reference Reference;
+  Space<Reference> table;
+  table.reserve(hdr.handles * sizeof(Reference));
+  Reference *refs = table.add(hdr.handles);
+  st = ReadBlock(file, sizeof(Header), refs, hdr.handles * sizeof(Reference));
+  if (!st.ok()) {
+    file->Close();
+    return st;
+  }
+
+  // Memory-map the heap image and the indices. Fall back to reading the heap
+  // image into memory if the file cannot be memory-mapped.
+  Heap image;
+  void *mapping = file->MapMemory(hdr.heap_offset, image_size);
+  if (mapping == nullptr) {
+    VLOG(1) << "Reading snapshot heap into memory for " << filename;
+    image.reserve(hdr.heap_size);
+    st = ReadBlock(file, hdr.heap_offset, image.alloc(hdr.heap_size),
+                   hdr.heap_size);
+    if (!st.ok()) {
+      file->Close();
+      return st;
+    }
+  }
+  file->Close();
+
+  // Transfer the handle table and heap image to the store.
+  Space<Reference> &handles = store->handles_;
+  handles.attach(table.base(), hdr.handles * sizeof(Reference));
+  table.detach();
+  Heap *heap = store->first_heap_;
+  if (mapping != nullptr) {
+    heap->attach(mapping, hdr.heap_size);
+    store->mapped_heap_ = mapping;
+    store->mapped_size_ = image_size;
+    Address index = static_cast<Address>(mapping) +
+                    (hdr.index_offset - hdr.heap_offset);
+    store->symbol_index_ = new SymbolIndex(
+        reinterpret_cast<SymbolIndex::Bucket *>(index), hdr.index_buckets);
+    if (hdr.slot_buckets > 0) {
+      store->slot_index_ = new SlotIndex(
+          reinterpret_cast<SlotIndex::Bucket *>(index + index_size),
+          hdr.slot_buckets, hdr.slot_min_slots);
+    }
+  } else {
+    heap->attach(image.base(), hdr.heap_size);
+    image.detach();
+  }
+
+  // Relocate handle table.
+  Address base = reinterpret_cast<Address>(heap->base());
+  for (Reference *ref = handles.base(); ref < handles.end(); ++ref) {
+    if (ref->bits == kNoObject) {
+      ref->object = nullptr;
+    } else {
+      ref->object = reinterpret_cast<Datum *>(base + ref->bits);
+    }
+  }
+
+  // Trap any attempt at dereferencing nil.
+  handles.base()->bits = 0xdeadbeefdeadbeef;
+
+  // Set up symbol table and global pool.
+  store->pools_[Handle::kGlobal] = reinterpret_cast<Address>(handles.base());
+  store->free_handle_ = nullptr;
+  store->symbols_ = Handle{hdr.symbols};
+  store->roots_.handle_ = store->symbols_;
+  store->num_symbols_ = hdr.num_symbols;
+  store->num_buckets_ = hdr.num_buckets;
+  store->num_dead_handles_ = hdr.num_dead_handles;
+
+  // Build indices if they were not memory-mapped.
+  if (store->symbol_index_ == nullptr) {
+    store->BuildSymbolIndex();
+    store->BuildSlotIndex();
+  }
+
+  // The young heap is not used by frozen stores.
+  if (store->young_ != nullptr) store->young_->reset();
+  store->ReleaseYoungHeap();
+  store->remembered_.reset();
+
+  // Store is now frozen.
+  store->ReleaseRoots();
+  store->frozen_ = true;
+
+  return Status::OK;
+}
+
+Status Snapshot::Write(Store *store, const string &filename) {
+  // Only frozen global stores can be written to snapshots.
+  if (store->globals() != nullptr || !store->frozen()) {
+    return Status(1, "Only frozen global stores can be snapshot");
+  }
+
+  // Compute the heap image offsets for all objects in the heaps. Handles for
+  // objects that have been reclaimed are marked with no object.
+  typedef Store::Reference Reference;
+  const Space<Reference> &handles = store->handles_;
+  std::vector<uint64> table(handles.length(), kNoObject);
+  uint64 heap_size = 0;
+  for (Heap *heap = store->first_heap_; heap != nullptr; heap = heap->next()) {
+    Address base = reinterpret_cast<Address>(heap->base());
+    Datum *object = heap->base();
+    Datum *end = heap->end();
+    while (object < end) {
+      if (!object->IsInvalid()) {
+        uint64 offset = heap_size + (reinterpret_cast<Address>(object) - base);
+        table[object->self.offset() / sizeof(Reference)] = offset;
+      }
+      object = object->next();
+    }
+    heap_size += heap->size();
+  }
+
+  // Initialize header.
+  Header hdr;
+  hdr.magic = kMagic;
+  hdr.version = kVersion;
+  hdr.handles = table.size();
+  uint64 handle_size = table.size() * sizeof(uint64);
+  hdr.heap_offset = sizeof(Header) + handle_size;
+  hdr.heap_offset = (hdr.heap_offset + kHeapAlign - 1) & ~(kHeapAlign - 1);
+  hdr.heap_size = heap_size;
+  hdr.symbols = store->symbols_.raw();
+  hdr.num_symbols = store->num_symbols_;
+  hdr.num_buckets = store->num_buckets_;
+  hdr.num_dead_handles = store->num_dead_handles_;
+  const SymbolIndex *index = store->symbol_index_;
+  uint64 index_size = index->num_buckets() * sizeof(SymbolIndex::Bucket);
+  hdr.index_offset = hdr.heap_offset + heap_size;
+  hdr.index_offset = (hdr.index_offset + kIndexAlign - 1) & ~(kIndexAlign - 1);
+  hdr.index_buckets = index->num_buckets();
+  const SlotIndex *slots = store->slot_index_;
+  uint64 slots_size = 0;
+  hdr.slot_buckets = 0;
+  hdr.slot_min_slots = 0;
+  if (slots != nullptr) {
+    slots_size = slots->num_buckets() * sizeof(SlotIndex::Bucket);
+    hdr.slot_buckets = slots->num_buckets();
+    hdr.slot_min_slots = slots->min_slots();
+  }
+
+  // Write header and handle table.
+  File *file;
+  Status st = File::Open(Filename(filename), "w", &file);
+  if (!st.ok()) return st;
+  st = file->Write(&hdr, sizeof(Header));
+  if (st.ok()) st = file->Write(table.data(), handle_size);
+
+  // Write padding to align heap image.
+  size_t padding = hdr.heap_offset - sizeof(Header) - handle_size;
+  if (st.ok() && padding > 0) {
+    string zeros(padding, 0);
+    st = file->Write(zeros.data(), zeros.size());
+  }
+
+  // Write heap image.
+  for (Heap *heap = store->first_heap_; heap != nullptr; heap = heap->next()) {
+    if (!st.ok()) break;
+    st = file->Write(heap->base(), heap->size());
+  }
+
+  // Write padding to align symbol index.
+  padding = hdr.index_offset - hdr.heap_offset - heap_size;
+  if (st.ok() && padding > 0) {
+    string zeros(padding, 0);
+    st = file->Write(zeros.data(), zeros.size());
+  }
+
+  // Write symbol and slot indices.
+  if (st.ok()) st = file->Write(index->buckets(), index_size);
+  if (st.ok() && slots != nullptr) {
+    st = file->Write(slots->buckets(), slots_size);
+  }
+
+  // Close snapshot file.
+  if (st.ok()) {
+    st = file->Close();
+  } else {
+    file->Close();
+  }
+  return st;
+}
+
+}  // namespace sling
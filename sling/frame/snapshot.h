@@ -0,0 +1,100 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_FRAME_SNAPSHOT_H_
+#define SLING_FRAME_SNAPSHOT_H_
+
+#include <string>
+
+#include "sling/base/status.h"
+#include "sling/base/types.h"
+#include "sling/frame/store.h"
+
+namespace sling {
+
+// A snapshot is an image of a frozen global store. The heaps, the handle table,
+// and the symbol table are written to the snapshot file as-is, so the store can
+// be restored without decoding any objects. When a snapshot is loaded, the heap
+// image is memory-mapped directly from the file, so the pages are shared
+// through the page cache by all processes that load the same snapshot. Only
+// the handle table needs to be relocated when the snapshot is loaded. The
+// symbol and slot indices are stored after the heap image and are mapped
+// together with it.
+//
+// The snapshot file layout is:
+//
+//   header       (see Snapshot::Header)
+//   handles      (one 64-bit heap image offset per handle)
+//   padding      (up to page boundary)
+//   heap image   (all the heaps of the store concatenated)
+//   padding      (up to symbol index bucket boundary)
+//   index        (symbol index buckets)
+//   slots        (slot index buckets, if any)
+//
+// Snapshots depend on the internal object layout of the store, so they are not
+// portable and should only be used as a cache for a store in some other format.
+class Snapshot {
+ public:
+  // Returns the snapshot file name for a store file.
+  static string Filename(const string &filename);
+
+  // Checks if there is a valid snapshot for a store file, i.e. the snapshot
+  // exists, has the right version, and is not older than the store file.
+  static bool Valid(const string &filename);
+
+  // Loads snapshot for store file into an empty global store. The heap is
+  // memory-mapped from the snapshot file if possible. The store is frozen after
+  // the snapshot has been loaded.
+  static Status Read(Store *store, const string &filename);
+
+  // Writes snapshot for frozen global store.
+  static Status Write(Store *store, const string &filename);
+
+ private:
+  // Snapshot file header.
+  struct Header {
+    uint32 magic;             // magic number for identifying snapshot
+    uint32 version;           // snapshot format version
+    uint64 handles;           // number of entries in handle table
+    uint64 heap_offset;       // file offset of heap image
+    uint64 heap_size;         // size of heap image in bytes
+    uint32 symbols;           // handle for symbol table
+    uint32 num_symbols;       // number of symbols in symbol table
+    uint32 num_buckets;       // number of buckets in symbol table
+    uint32 num_dead_handles;  // number of dead handles in handle table
+    uint64 index_offset;      // file offset of symbol index
+    uint64 index_buckets;     // number of buckets in symbol index
+    uint32 slot_buckets;      // number of buckets in slot index
+    uint32 slot_min_slots;    // minimum number of slots for indexed frames
+  };
+
+  // Magic number and version for snapshot files.
+  static const uint32 kMagic = 0x50414e53;  // "SNAP"
+  static const uint32 kVersion = 3;
+
+  // Handle table entry for handles without any object.
+  static const uint64 kNoObject = -1;
+
+  // Heap image alignment. The heap image is aligned to page boundary so it can
+  // be memory-mapped.
+  static const uint64 kHeapAlign = 4096;
+
+  // Symbol index alignment. The symbol index buckets are aligned to cache
+  // lines.
+  static const uint64 kIndexAlign = sizeof(SymbolIndex::Bucket);
+};
+
+}  // namespace sling
+
+#endif  // SLING_FRAME_SNAPSHOT_H_
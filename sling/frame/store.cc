@@ -14,7 +14,9 @@
 
 #include "sling/frame/store.h"
 
+#include <sys/mman.h>
 #include <string>
+#include <vector>
 
 #include "sling/base/clock.h"
 #include "sling/base/logging.h"
@@ -49,6 +51,13 @@ static const Word kInitialHeap[] = {
   STRING         |  2, 0x48, 'i' | ('s' << 8), 0,
 };
 
+// Number of objects in the initial heap.
+static const int kInitialObjects = 9;
+
+// Objects larger than this fraction of the young heap are allocated directly in
+// the old generation.
+static const int kPretenureFraction = 4;
+
 // Default store options.
 const Store::Options Store::kDefaultOptions;
 
@@ -107,7 +116,8 @@ Store::Store(const Options *options) : options_(options) {
   // Allocate initial heap.
   Heap *heap = new Heap();
   heap->reserve(options_->initial_heap_size);
-  first_heap_ = last_heap_ = current_heap_ = heap;
+  first_heap_ = last_heap_ = current_heap_ = old_heap_ = heap;
+  InitYoungHeap();
 
   // The symbol table will be allocated later.
   symbols_ = Handle::nil();
@@ -163,7 +173,8 @@ Store::Store(const Store *globals) : globals_(globals) {
   // Allocate initial heap.
   Heap *heap = new Heap();
   heap->reserve(options_->initial_heap_size);
-  first_heap_ = last_heap_ = current_heap_ = heap;
+  first_heap_ = last_heap_ = current_heap_ = old_heap_ = heap;
+  InitYoungHeap();
 
   // Initialize handle table.
   handles_.reserve(options_->initial_handles);
@@ -189,6 +200,12 @@ Store::~Store() {
   roots_.Unlink();
   externals_.Unlink();
 
+  // Release memory-mapped heap.
+  if (mapped_heap_ != nullptr) {
+    first_heap_->detach();
+    munmap(mapped_heap_, mapped_size_);
+  }
+
   // Delete all object heaps.
   Heap *heap = first_heap_;
   while (heap != nullptr) {
@@ -196,11 +213,43 @@ Store::~Store() {
     delete heap;
     heap = next;
   }
+  delete young_;
+  delete symbol_index_;
+  delete slot_index_;
 
   // Release reference to shared global store.
   if (globals_ != nullptr && globals_->shared()) globals_->Release();
 }
 
+void Store::InitYoungHeap() {
+  // Allocate young heap for generational garbage collection. New objects are
+  // allocated in the young heap.
+  if (options_->young_heap_size > 0) {
+    young_ = new Heap();
+    young_->reserve(options_->young_heap_size);
+    current_heap_ = young_;
+  }
+}
+
+void Store::ReleaseYoungHeap() {
+  // The young heap must be empty.
+  if (young_ == nullptr) return;
+  CHECK(young_->empty());
+  delete young_;
+  young_ = nullptr;
+  current_heap_ = first_heap_;
+}
+
+bool Store::Pristine() const {
+  // A new global store has handles for nil, the standard objects, and the
+  // symbol table. A new local store only has a handle for the symbol table.
+  int initial = globals_ == nullptr ? kInitialObjects + 2 : 1;
+  return !frozen_ &&
+         free_handle_ == nullptr &&
+         first_heap_ == last_heap_ &&
+         handles_.length() == initial;
+}
+
 void Store::Share() {
   CHECK(!shared()) << "Store is already shared";
   refs_ = 1;
@@ -328,6 +377,7 @@ Handle Store::AllocateFrame(Slot *begin, Slot *end, Handle original) {
 
         // Bind symbol to frame.
         symbol->value = handle;
+        WriteBarrier(symbol);
         frame->AddFlags(NAMED);
       } else if (id->IsProxy()) {
         // This proxy is not the one used for replacement, because otherwise the
@@ -368,6 +418,7 @@ void Store::UpdateFrame(Handle handle, Slot *begin, Slot *end) {
   CHECK(frame->IsAnonymous());
 
   // Copy new slots to the frame.
+  WriteBarrier(frame);
   Slot *t = frame->begin();
   for (Slot *s = begin; s < end; ++s, ++t) {
     // Get slot name and value.
@@ -397,6 +448,7 @@ void Store::UpdateFrame(Handle handle, Slot *begin, Slot *end) {
 
       // Bind symbol to frame.
       symbol->value = handle;
+      WriteBarrier(symbol);
       frame->AddFlags(NAMED);
     }
   }
@@ -438,6 +490,7 @@ void Store::Set(Handle frame, Handle name, Handle value) {
     if (s->name == name) {
       // Update slot and return.
       s->value = value;
+      WriteBarrier(datum);
       return;
     }
   }
@@ -602,14 +655,19 @@ Handle Store::AllocateSymbol(Text name, Handle hash) {
 
   // Allocate string object for symbol name.
   Handle str = AllocateString(name);
-  GetSymbol(sym)->name = str;
+  SymbolDatum *symbol = GetSymbol(sym);
+  symbol->name = str;
+  WriteBarrier(symbol);
 
   return sym;
 }
 
 void Store::InsertSymbol(SymbolDatum *symbol) {
   // Insert symbol in symbol table.
-  GetMap(symbols_)->insert(symbol);
+  MapDatum *symbols = GetMap(symbols_);
+  symbols->insert(symbol);
+  WriteBarrier(symbols);
+  WriteBarrier(symbol);
   num_symbols_++;
 
   // Resize symbol table if fill factor is more than 1:1, unless this would
@@ -624,13 +682,14 @@ void Store::InsertSymbol(SymbolDatum *symbol) {
     for (Handle *h = map->begin(); h < map->end(); ++h) *h = Handle::nil();
 
     // Move all the symbols to the new symbol map.
-    MapDatum *symbols = GetMap(symbols_);
+    symbols = GetMap(symbols_);
     for (Handle *bucket = symbols->begin(); bucket < symbols->end(); ++bucket) {
       Handle h = *bucket;
       while (!h.IsNil()) {
         SymbolDatum *symbol = GetSymbol(h);
         Handle next = symbol->next;
         map->insert(symbol);
+        WriteBarrier(symbol);
         h = next;
       }
     }
@@ -641,6 +700,23 @@ void Store::InsertSymbol(SymbolDatum *symbol) {
 }
 
 Handle Store::FindSymbol(Text name, Handle hash) const {
+  // Use symbol index for frozen stores.
+  if (symbol_index_ != nullptr) {
+    const SymbolIndex::Bucket *b = symbol_index_->bucket(hash.raw());
+    for (;;) {
+      for (const SymbolIndex::Entry &e : b->entries) {
+        if (e.symbol.IsNil()) return Handle::nil();
+        if (e.hash == hash) {
+          const Datum *symname = GetObject(e.name);
+          if (symname->IsString() && symname->AsString()->equals(name)) {
+            return e.symbol;
+          }
+        }
+      }
+      b = symbol_index_->next(b);
+    }
+  }
+
   const MapDatum *symbols = GetMap(symbols_);
   Handle h = *symbols->bucket(hash);
   while (!h.IsNil()) {
@@ -767,7 +843,9 @@ Handle Store::Lookup(Text name) {
 
   // Symbol is unbound. Bind it to a new proxy.
   Handle proxy = AllocateProxy(sym);
-  GetSymbol(sym)->value = proxy;
+  symbol = GetSymbol(sym);
+  symbol->value = proxy;
+  WriteBarrier(symbol);
   return proxy;
 }
 
@@ -786,7 +864,9 @@ Handle Store::Lookup(Handle name) {
 
   // Symbol is unbound. Bind it to a new proxy.
   Handle proxy = AllocateProxy(sym);
-  GetSymbol(sym)->value = proxy;
+  symbol = GetSymbol(sym);
+  symbol->value = proxy;
+  WriteBarrier(symbol);
   return proxy;
 }
 
@@ -851,6 +931,10 @@ void Store::ReplaceProxy(ProxyDatum *proxy, FrameDatum *frame) {
   Handle tmp = proxy->self;
   proxy->self = frame->self;
   frame->self = tmp;
+
+  // Old objects can refer to the proxy handle, so a young frame replacing the
+  // proxy must be kept alive until the next full garbage collection.
+  if (young_ != nullptr && IsYoung(frame)) *remembered_.push() = frame;
 }
 
 Datum *Store::AllocateDatumSlow(Type type, Word size) {
@@ -863,6 +947,25 @@ Datum *Store::AllocateDatumSlow(Type type, Word size) {
 
   // This is called when the current heap is full.
   Datum *object;
+  if (young_ != nullptr) {
+    // Collect the young generation unless the object is too big for the young
+    // heap.
+    if (bytes <= young_->capacity() / kPretenureFraction) {
+      MinorGC();
+      if (young_->consume(bytes, &object)) {
+        object->info = size | type;
+        return object;
+      }
+    }
+
+    // Allocate object directly in the old generation. The object is added to
+    // the remembered set since it can be initialized with young references.
+    object = AllocateOld(bytes);
+    object->info = size | type;
+    Remember(object);
+    return object;
+  }
+
   while (current_heap_->next() != nullptr) {
     // Switch to next heap.
     current_heap_ = current_heap_->next();
@@ -903,23 +1006,45 @@ Datum *Store::AllocateDatumSlow(Type type, Word size) {
     }
   }
 
-  // All heaps are still (nearly) full; compute size of new heap.
+  // All heaps are still (nearly) full; allocate object on new heap.
+  current_heap_ = AddHeap(bytes);
+  CHECK(current_heap_->consume(bytes, &object));
+  object->info = size | type;
+  return object;
+}
+
+Datum *Store::AllocateOld(Word bytes) {
+  // Try to allocate object in the current old generation heap or the heaps
+  // after it.
+  Datum *object;
+  while (old_heap_ != nullptr) {
+    if (old_heap_->consume(bytes, &object)) return object;
+    old_heap_ = old_heap_->next();
+  }
+
+  // The old generation is full. A garbage collection cannot be performed here,
+  // so the old generation is expanded and a full garbage collection is
+  // scheduled.
+  old_heap_ = AddHeap(bytes);
+  major_gc_pending_ = true;
+  CHECK(old_heap_->consume(bytes, &object));
+  return object;
+}
+
+Heap *Store::AddHeap(Word bytes) {
+  // Compute size of new heap.
   size_t heap_size = last_heap_->capacity() * 2;
   if (heap_size > options_->maximum_heap_size) {
     heap_size = options_->maximum_heap_size;
   }
   while (heap_size < bytes) heap_size *= 2;
 
-  // Allocate new heap.
-  current_heap_ = new Heap();
-  current_heap_->reserve(heap_size);
-  last_heap_->set_next(current_heap_);
-  last_heap_ = current_heap_;
-
-  // Allocate object on new heap.
-  CHECK(current_heap_->consume(bytes, &object));
-  object->info = size | type;
-  return object;
+  // Allocate new heap and add it to the heap list.
+  Heap *heap = new Heap();
+  heap->reserve(heap_size);
+  last_heap_->set_next(heap);
+  last_heap_ = heap;
+  return heap;
 }
 
 Handle Store::AllocateHandleSlow(Datum *object) {
@@ -1043,6 +1168,7 @@ void Store::Compact() {
 
             // Move it to the new location at the start of the unused section.
             memmove(unused, object, size);
+            gc_bytes_moved_ += size;
           }
           unused = Heap::address(unused, size);
         } else {
@@ -1057,13 +1183,166 @@ void Store::Compact() {
     heap->set_end(unused);
   }
 
-  // Start allocating from the first heap.
-  current_heap_ = first_heap_;
+  // Start allocating from the first heap. New objects are allocated in the
+  // young heap for generational stores.
+  if (young_ == nullptr) current_heap_ = first_heap_;
+  old_heap_ = first_heap_;
+
+  // Update the handle free list.
+  free_handle_ = fh;
+}
+
+void Store::MarkYoung() {
+  // The marking stack keeps track of memory regions with handles that have not
+  // yet been marked and traversed.
+  Space<Range> stack;
+
+  // Build table with all the roots.
+  Space<Handle> root_table;
+  const Root *root = &roots_;
+  do {
+    *root_table.push() = root->handle_;
+    root = root->next_;
+  } while (root != &roots_);
+
+  // Add root table to the marking stack.
+  Range *range = stack.push();
+  range->begin = root_table.base();
+  range->end = root_table.end();
+
+  // Add all external object references to the marking stack.
+  External *ext = &externals_;
+  do {
+    ext->GetReferences(stack.push());
+    ext = ext->next_;
+  } while (ext != &externals_);
+
+  // Add the remembered set to the marking stack. Old objects in the remembered
+  // set are scanned for references to young objects, and young objects in the
+  // remembered set are kept alive.
+  for (Datum **r = remembered_.base(); r < remembered_.end(); ++r) {
+    Datum *object = *r;
+    if (object->IsInvalid()) continue;
+    if (IsYoung(object)) {
+      if (object->marked()) continue;
+      object->mark();
+    } else {
+      if (!object->remembered()) continue;
+      object->forget();
+    }
+    if (!object->IsBinary()) object->range(stack.push());
+  }
+
+  // Traverse all the young objects reachable from the roots. Old objects are
+  // not traversed since all references from old objects to young objects are
+  // in the remembered set.
+  Word pool_tag = store_tag_;
+  Address pool = pools_[pool_tag];
+  while (!stack.empty()) {
+    Range *top = stack.top();
+    if (top->empty()) {
+      // Traversal of range has been completed.
+      stack.pop();
+    } else {
+      // Get next handle in range.
+      Handle h = *top->begin++;
+
+      // Only owned young objects need to be marked.
+      if (!h.IsNil() && h.tag() == pool_tag) {
+        Datum *object = *reinterpret_cast<Datum **>(pool + h.offset());
+        if (IsYoung(object) && !object->marked()) {
+          object->mark();
+          if (!object->IsBinary()) object->range(stack.push());
+        }
+      }
+    }
+  }
+}
+
+void Store::Promote() {
+  // The handles for the garbage collected objects are added to the handle
+  // free list.
+  Reference *fh = free_handle_;
+
+  // Move all the surviving young objects to the old generation.
+  Datum *object = young_->base();
+  Datum *end = young_->end();
+  while (object < end) {
+    Datum *next = object->next();
+    if (!object->IsInvalid()) {
+      if (object->marked()) {
+        // Object survived. Clear the mark and copy it to the old generation.
+        object->unmark();
+        size_t size = Region::size(object, next);
+        Datum *promoted = AllocateOld(size);
+        memcpy(promoted, object, size);
+        Assign(promoted->self, promoted);
+        gc_bytes_moved_ += size;
+        gc_bytes_promoted_ += size;
+      } else {
+        // Object is dead. Free the associated handle.
+        Reference *ref = handles_.address(object->self.offset());
+        ref->next = fh;
+        fh = ref;
+      }
+    }
+    object = next;
+  }
+
+  // The young heap and the remembered set are now empty.
+  young_->reset();
+  remembered_.reset();
 
   // Update the handle free list.
   free_handle_ = fh;
 }
 
+bool Store::OldGenerationFull() const {
+  int64 total = 0;
+  int64 free = 0;
+  for (Heap *heap = first_heap_; heap != nullptr; heap = heap->next()) {
+    total += heap->capacity();
+    free += heap->available();
+  }
+  return free * options_->expansion_free_fraction <= total;
+}
+
+void Store::MinorGC() {
+  // Perform full garbage collection if the store is not generational.
+  if (young_ == nullptr) {
+    GC();
+    return;
+  }
+
+  // Do not garbage collect a frozen store.
+  if (frozen_) return;
+
+  // Do not garbage collect a locked store, but indicate that GC is pending.
+  if (gc_locks_ > 0) {
+    gc_pending_ = true;
+    return;
+  }
+
+  // Mark all the young objects reachable from the roots and the remembered set
+  // and promote them to the old generation.
+  Clock timer;
+  timer.start();
+  MarkYoung();
+  Promote();
+  gc_pending_ = false;
+  timer.stop();
+
+  // Update statistics.
+  int64 time = timer.us();
+  minor_gc_time_ += time;
+  if (time > max_gc_pause_) max_gc_pause_ = time;
+  num_minor_gcs_++;
+  VLOG(15) << "Minor GC " << time << " us";
+
+  // Collect the old generation if it is (nearly) full.
+  if (major_gc_pending_ || OldGenerationFull()) GC();
+}
+
 void Store::GC() {
   Clock timer;
 
@@ -1076,8 +1355,14 @@ void Store::GC() {
     return;
   }
 
-  // Mark all the objects reachable from the roots.
+  // Promote all surviving young objects to the old generation.
   timer.start();
+  if (young_ != nullptr) {
+    MarkYoung();
+    Promote();
+  }
+
+  // Mark all the objects reachable from the roots.
   Mark();
   timer.stop();
   int64 mark_time = timer.us();
@@ -1089,9 +1374,17 @@ void Store::GC() {
   timer.stop();
   int64 compact_time = timer.us();
 
+  // Expand the old generation if it is still (nearly) full after garbage
+  // collection to prevent cascades of garbage collections.
+  if (young_ != nullptr) {
+    if (OldGenerationFull()) old_heap_ = AddHeap(young_->capacity());
+    major_gc_pending_ = false;
+  }
+
   // Update statistics.
   int64 total_time = mark_time + compact_time;
   gc_time_ += total_time;
+  if (total_time > max_gc_pause_) max_gc_pause_ = total_time;
   num_gcs_++;
 
   VLOG(15) << "GC " << total_time << " us, "
@@ -1152,7 +1445,7 @@ bool Store::IsValidReference(Handle handle) const {
 
 void Store::ReplaceHandle(Handle handle, Handle replacement) {
   // Scan the heaps and replace all instances of handle.
-  for (Heap *heap = first_heap_; heap != nullptr; heap = heap->next()) {
+  for (Heap *heap = first_heap_; heap != nullptr; heap = NextHeap(heap)) {
     Datum *object = heap->base();
     Datum *end = heap->end();
     while (object < end) {
@@ -1160,7 +1453,10 @@ void Store::ReplaceHandle(Handle handle, Handle replacement) {
         Handle *begin = reinterpret_cast<Handle *>(object->payload());
         Handle *end = reinterpret_cast<Handle *>(object->limit());
         for (Handle *h = begin; h < end; ++h) {
-          if (*h == handle) *h = replacement;
+          if (*h == handle) {
+            *h = replacement;
+            WriteBarrier(object);
+          }
         }
       }
       object = object->next();
@@ -1195,8 +1491,10 @@ void Store::Freeze() {
   // Local stores cannot be frozen.
   CHECK(globals_ == nullptr);
 
-  // Run garbage collection to free up unused space.
+  // Run garbage collection to free up unused space. All objects are in the
+  // old generation after this, so the young heap is no longer needed.
   GC();
+  ReleaseYoungHeap();
 
   // Shrink all the heaps to fit the allocated data. This will force slow case
   // in object memory allocation where we check for frozen store.
@@ -1238,8 +1536,260 @@ void Store::Freeze() {
   handles_.reserve(handles_.size());
   pools_[store_tag_] = reinterpret_cast<Address>(handles_.base());
 
+  // Build symbol index for fast symbol lookup and slot index for fast slot
+  // lookup in wide frames.
+  BuildSymbolIndex();
+  BuildSlotIndex();
+
   // Remove all roots from store. After the store has been frozen the roots no
   // longer need to be tracked.
+  ReleaseRoots();
+
+  // Store is now frozen.
+  frozen_ = true;
+}
+
+void Store::Merge(Store *other,
+                  const Bindings *bindings,
+                  std::vector<Handle> *handles) {
+  // Only unfrozen global stores can be merged.
+  CHECK(!frozen_ && !other->frozen_);
+  CHECK(globals_ == nullptr && other->globals_ == nullptr);
+
+  // Promote all young objects in both stores, so all the objects are in the
+  // heap lists. The merged objects can then be added to the old generation.
+  if (young_ != nullptr) {
+    MarkYoung();
+    Promote();
+  }
+  if (other->young_ != nullptr) {
+    other->MarkYoung();
+    other->Promote();
+  }
+  LockGC();
+
+  // The translation table maps handles in the other store to handles in this
+  // store. The pre-defined objects have the same handles in both stores.
+  std::vector<Handle> xlat(other->handles_.length(), Handle::nil());
+  std::vector<bool> adopted(xlat.size());
+  for (int i = 0; i <= kInitialObjects; ++i) {
+    xlat[i] = Handle::Ref(i * sizeof(Reference), Handle::kGlobalTag);
+  }
+  auto index = [](Handle h) { return h.offset() / sizeof(Reference); };
+  auto merged = [&](Datum *object) {
+    if (object->IsInvalid()) return false;
+    if (index(object->self) <= kInitialObjects) return false;
+    return object->self != other->symbols_;
+  };
+
+  // Replace bound placeholders with the objects in this store.
+  if (bindings != nullptr) {
+    for (const auto &binding : *bindings) {
+      xlat[index(binding.first)] = binding.second;
+      other->GetObject(binding.first)->invalidate();
+    }
+  }
+
+  // Map symbols in the other store to existing symbols in this store. Symbols
+  // not in this store are adopted.
+  std::vector<SymbolDatum *> symbols;
+  for (Heap *heap = other->first_heap_; heap != nullptr; heap = heap->next()) {
+    for (Datum *object = heap->base(); object < heap->end();
+         object = object->next()) {
+      if (!object->IsSymbol() || !merged(object)) continue;
+      SymbolDatum *symbol = object->AsSymbol();
+      int old = index(symbol->self);
+      Text name = other->GetString(symbol->name)->str();
+      Handle existing = FindSymbol(name, symbol->hash);
+      if (existing.IsNil()) {
+        xlat[old] = AllocateHandle(symbol);
+        adopted[old] = true;
+        symbols.push_back(symbol);
+      } else {
+        xlat[old] = existing;
+        symbol->invalidate();
+      }
+    }
+  }
+
+  // Allocate handles for frames, strings, and arrays. Frames with ids bound to
+  // existing objects in this store replace these.
+  for (Heap *heap = other->first_heap_; heap != nullptr; heap = heap->next()) {
+    for (Datum *object = heap->base(); object < heap->end();
+         object = object->next()) {
+      if (object->IsSymbol() || object->IsProxy() || !merged(object)) continue;
+      int old = index(object->self);
+      if (!object->IsFrame() || object->AsFrame()->IsAnonymous()) {
+        xlat[old] = AllocateHandle(object);
+        continue;
+      }
+
+      // Find existing object for frame in this store.
+      FrameDatum *frame = object->AsFrame();
+      Handle handle = Handle::nil();
+      for (Slot *s = frame->begin(); s < frame->end(); ++s) {
+        if (!s->name.IsId() || adopted[index(s->value)]) continue;
+        const SymbolDatum *symbol = GetSymbol(xlat[index(s->value)]);
+        if (symbol->bound()) {
+          handle = symbol->value;
+          break;
+        }
+      }
+
+      if (handle.IsNil()) {
+        handle = AllocateHandle(frame);
+      } else {
+        // Unbind existing frame and replace it with the merged frame.
+        FrameDatum *existing = GetFrame(handle);
+        if (!existing->IsProxy()) {
+          for (Slot *s = existing->begin(); s < existing->end(); ++s) {
+            if (s->name.IsId()) {
+              SymbolDatum *symbol = GetSymbol(s->value);
+              symbol->value = symbol->self;
+            }
+          }
+        }
+        Replace(handle, frame);
+      }
+      xlat[old] = handle;
+
+      // Bind existing symbols for the ids of the frame.
+      for (Slot *s = frame->begin(); s < frame->end(); ++s) {
+        if (!s->name.IsId() || adopted[index(s->value)]) continue;
+        SymbolDatum *symbol = GetSymbol(xlat[index(s->value)]);
+        if (symbol->value == handle) continue;
+        if (symbol->bound()) {
+          // The frame has multiple proxies in this store.
+          CHECK(GetObject(symbol->value)->IsProxy());
+          ReplaceHandle(symbol->value, handle);
+          LOG(WARNING) << "double proxies are expensive";
+        }
+        symbol->value = handle;
+        WriteBarrier(symbol);
+      }
+    }
+  }
+
+  // Map proxies to the objects bound to the symbols in this store.
+  for (Heap *heap = other->first_heap_; heap != nullptr; heap = heap->next()) {
+    for (Datum *object = heap->base(); object < heap->end();
+         object = object->next()) {
+      if (!object->IsProxy() || !merged(object)) continue;
+      ProxyDatum *proxy = object->AsProxy();
+      int old = index(proxy->self);
+      int sym = index(proxy->symbol);
+      if (adopted[sym]) {
+        xlat[old] = AllocateHandle(proxy);
+      } else {
+        SymbolDatum *symbol = GetSymbol(xlat[sym]);
+        if (symbol->bound()) {
+          xlat[old] = symbol->value;
+          proxy->invalidate();
+        } else {
+          xlat[old] = AllocateHandle(proxy);
+          symbol->value = xlat[old];
+          WriteBarrier(symbol);
+        }
+      }
+    }
+  }
+
+  // Translate all the handles in the merged objects. The pre-defined objects
+  // and the symbol table in the other store are discarded.
+  for (Heap *heap = other->first_heap_; heap != nullptr; heap = heap->next()) {
+    for (Datum *object = heap->base(); object < heap->end();
+         object = object->next()) {
+      if (object->IsInvalid()) continue;
+      if (GetObject(object->self) != object) {
+        object->invalidate();
+        continue;
+      }
+      if (object->IsBinary()) continue;
+      Range range;
+      object->range(&range);
+      for (Handle *h = range.begin; h < range.end; ++h) {
+        if (h->IsRef()) *h = xlat[index(*h)];
+      }
+    }
+  }
+
+  // Add adopted symbols to the symbol table.
+  for (SymbolDatum *symbol : symbols) InsertSymbol(symbol);
+
+  // Translate handles requested by the caller.
+  if (handles != nullptr) {
+    for (Handle &h : *handles) {
+      if (h.IsRef()) h = xlat[index(h)];
+    }
+  }
+
+  // Move the heaps from the other store to this store.
+  last_heap_->set_next(other->first_heap_);
+  last_heap_ = other->last_heap_;
+  Heap *empty = new Heap();
+  other->first_heap_ = other->last_heap_ = other->current_heap_ = empty;
+  other->handles_.reset();
+
+  UnlockGC();
+}
+
+void Store::BuildSymbolIndex() {
+  // Add all the symbols in the symbol table to the index.
+  SymbolIndex *index = new SymbolIndex(num_symbols_);
+  const MapDatum *symbols = GetMap(symbols_);
+  for (Handle *bucket = symbols->begin(); bucket < symbols->end(); ++bucket) {
+    Handle h = *bucket;
+    while (!h.IsNil()) {
+      const SymbolDatum *symbol = GetSymbol(h);
+      index->Insert(symbol->hash.raw(),
+                    SymbolIndexEntry{symbol->hash, symbol->name, h,
+                                     Handle::nil()});
+      h = symbol->next;
+    }
+  }
+
+  delete symbol_index_;
+  symbol_index_ = index;
+}
+
+void Store::BuildSlotIndex() {
+  // Check if slot index is enabled.
+  int min_slots = options_->slot_index_threshold;
+  if (min_slots <= 0) return;
+
+  // Count the number of slots in wide frames.
+  int64 num_slots = 0;
+  for (Heap *heap = first_heap_; heap != nullptr; heap = heap->next()) {
+    for (Datum *object = heap->base(); object < heap->end();
+         object = object->next()) {
+      if (object->IsFrame()) {
+        int slots = object->AsFrame()->slots();
+        if (slots >= min_slots) num_slots += slots;
+      }
+    }
+  }
+  if (num_slots == 0) return;
+
+  // Add the slots of all the wide frames to the index.
+  SlotIndex *index = new SlotIndex(num_slots, min_slots);
+  for (Heap *heap = first_heap_; heap != nullptr; heap = heap->next()) {
+    for (Datum *object = heap->base(); object < heap->end();
+         object = object->next()) {
+      if (object->IsFrame()) {
+        FrameDatum *frame = object->AsFrame();
+        if (frame->slots() < min_slots) continue;
+        for (Slot *s = frame->begin(); s < frame->end(); ++s) {
+          index->Insert(frame->self, s->name, s->value);
+        }
+      }
+    }
+  }
+
+  delete slot_index_;
+  slot_index_ = index;
+}
+
+void Store::ReleaseRoots() {
   const Root *root = &roots_;
   do {
     const Root *next = root->next_;
@@ -1253,9 +1803,6 @@ void Store::Freeze() {
     ext->prev_ = ext->next_ = ext;
     ext = next;
   } while (ext != &externals_);
-
-  // Store is now frozen.
-  frozen_ = true;
 }
 
 void Store::CoalesceStrings() {
@@ -1267,7 +1814,7 @@ void Store::CoalesceStrings() {
   StringDatum **cache = new StringDatum *[num_buckets]();
 
   // Scan the heaps to find all strings.
-  for (Heap *heap = first_heap_; heap != nullptr; heap = heap->next()) {
+  for (Heap *heap = first_heap_; heap != nullptr; heap = NextHeap(heap)) {
     Datum *object = heap->base();
     Datum *end = heap->end();
     while (object < end) {
@@ -1284,7 +1831,7 @@ void Store::CoalesceStrings() {
   // Run through all objects and replace references to strings that match the
   // strings in the buckets.
   int num_replaced = 0;
-  for (Heap *heap = first_heap_; heap != nullptr; heap = heap->next()) {
+  for (Heap *heap = first_heap_; heap != nullptr; heap = NextHeap(heap)) {
     Datum *object = heap->base();
     Datum *end = heap->end();
     while (object < end) {
@@ -1311,6 +1858,7 @@ void Store::CoalesceStrings() {
             // Replace string with the cached string. The original string will
             // be removed during the next GC.
             *cell = intern->self;
+            WriteBarrier(object);
             num_replaced++;
           }
         }
@@ -1366,7 +1914,7 @@ void Store::GetMemoryUsage(MemoryUsage *usage, bool quick) const {
   usage->total_heap_size = 0;
   usage->unused_heap_bytes = 0;
   usage->num_heaps = 0;
-  for (Heap *heap = first_heap_; heap != nullptr; heap = heap->next()) {
+  for (Heap *heap = first_heap_; heap != nullptr; heap = NextHeap(heap)) {
     usage->num_heaps++;
     usage->total_heap_size += heap->capacity();
     usage->unused_heap_bytes += heap->available();
@@ -1422,6 +1970,11 @@ void Store::GetMemoryUsage(MemoryUsage *usage, bool quick) const {
   // Garbage collection statistics.
   usage->num_gcs = num_gcs_;
   usage->gc_time = gc_time_;
+  usage->num_minor_gcs = num_minor_gcs_;
+  usage->minor_gc_time = minor_gc_time_;
+  usage->max_gc_pause = max_gc_pause_;
+  usage->gc_bytes_moved = gc_bytes_moved_;
+  usage->gc_bytes_promoted = gc_bytes_promoted_;
 }
 
 }  // namespace sling
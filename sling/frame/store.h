@@ -19,6 +19,7 @@
 #include <atomic>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "sling/base/bitcast.h"
 #include "sling/base/logging.h"
@@ -60,6 +61,18 @@ class Region {
   // Mark whole region as unused.
   void reset() { end_ = base_; }
 
+  // Makes the region use an external memory area, e.g. a memory-mapped file.
+  // The memory is not owned by the region, so the region must be detached from
+  // the memory before it is deallocated.
+  void attach(void *base, size_t bytes) {
+    free(base_);
+    base_ = static_cast<Address>(base);
+    end_ = limit_ = base_ + bytes;
+  }
+
+  // Detaches external memory from region.
+  void detach() { base_ = end_ = limit_ = nullptr; }
+
   // Returns the number of bytes used in the region.
   size_t size() const { return end_ - base_; }
 
@@ -384,6 +397,7 @@ struct HandleHash {
 };
 
 // Forward declarations.
+class Snapshot;
 class Store;
 struct StringDatum;
 struct FrameDatum;
@@ -402,11 +416,14 @@ struct Range {
 
 // The object type is stored in the upper bits of the size field in the object
 // preamble. The top-most bit is 1 for frames and 0 for other object types. For
-// frames, the lower three bits of the type are used for encoding identifier
+// frames, the lower two bits of the type are used for encoding identifier
 // information like whether the frame has an id and if the frame is a proxy.
+// The remaining bit is used for marking objects in the remembered set for
+// generational garbage collection.
 const Word kSizeBits = 28;
 const Word kSizeMask = (1 << kSizeBits) - 1;
-const Word kTypeMask = 0xF0000000;
+const Word kTypeMask = 0xB0000000;
+const Word kRememberedBit = 0x40000000;
 const Word kObjectSizeLimit = (1 << kSizeBits);
 const Word kMapSizeLimit = kObjectSizeLimit / sizeof(Handle);
 
@@ -429,7 +446,6 @@ enum Type : Word {
 enum FrameFlags : Word {
   PROXY   = 0x1UL << kSizeBits,  // frame is a proxy (i.e. only has an id slot)
   NAMED   = 0x2UL << kSizeBits,  // frame has an id
-  UNUSED_FRAME_FLAG = 0x4UL << kSizeBits,
 };
 
 // All heap objects starts with an 8 byte preamble that contains the handle for
@@ -439,7 +455,7 @@ enum FrameFlags : Word {
 //    33222222222211111111110000000000
 //    10987654321098765432109876543210
 //   +--------------------------------+
-//   |TTTT      payload size          | TTTT=type
+//   |TRTT      payload size          | TTT=type R=remembered
 //   +--------------------------------+
 //   |      object handle          MTT| M=mark TT=tag
 //   +--------------------------------+
@@ -475,11 +491,18 @@ struct Datum {
   void mark() { self = Handle{self.raw() | Handle::kMark}; }
   void unmark() { self = Handle{self.raw() & ~Handle::kMark}; }
 
+  // Returns true if heap object is in the remembered set.
+  bool remembered() const { return (info & kRememberedBit) != 0; }
+
+  // Adds/removes remembered set flag for heap object.
+  void remember() { info |= kRememberedBit; }
+  void forget() { info &= ~kRememberedBit; }
+
   // Invalidate heap object by setting the type to INVALID.
   void invalidate() { info = size() | INVALID; }
 
   // Resize object.
-  void resize(int size) { info = size | typebits(); }
+  void resize(int size) { info = size | (info & ~kSizeMask); }
 
   // Returns the next object in the heap.
   Datum *next() const {
@@ -744,6 +767,7 @@ class Root {
   bool locked() const { return prev_ != this; }
 
  protected:
+  friend class Snapshot;
   friend class Store;
 
   // Initialize root.
@@ -851,6 +875,12 @@ struct MemoryUsage {
 
   int num_gcs;              // number of garbage collections
   int64 gc_time;            // garbage collection time in microseconds
+
+  int num_minor_gcs;        // number of young generation collections
+  int64 minor_gc_time;      // young generation collection time in microseconds
+  int64 max_gc_pause;       // longest garbage collection pause in microseconds
+  int64 gc_bytes_moved;     // bytes moved by compaction and promotion
+  int64 gc_bytes_promoted;  // bytes promoted to the old generation
 };
 
 // The data for objects are stored in object heaps. An object heap is a
@@ -859,6 +889,14 @@ struct MemoryUsage {
 // garbage collection, the reachable objects in the heap are identified and the
 // objects that are still alive are compacted into the beginning of the heap
 // leaving a contiguous area at the end of the heap for allocating new objects.
+//
+// A store can optionally use generational garbage collection. New objects are
+// then allocated in a separate young heap. When the young heap is full, only
+// the young generation is collected, and the surviving objects are promoted to
+// the old generation. The old generation, i.e. the linked list of heaps, is
+// only collected when it is nearly full. Old objects with references to young
+// objects are tracked in a remembered set, which is updated by the write
+// barrier.
 class Heap : public Space<Datum> {
  public:
   Heap() : next_(nullptr) {}
@@ -874,6 +912,190 @@ class Heap : public Space<Datum> {
   DISALLOW_COPY_AND_ASSIGN(Heap);
 };
 
+// A hash index is a read-optimized hash table for frozen stores. It uses open
+// addressing with linear probing over buckets that each fill one cache line,
+// so a lookup normally only needs to check the entries in a single cache line.
+// The index is immutable once it has been built, so it can be read
+// concurrently from multiple threads without any synchronization. The entries
+// consist of four handles, and the entry type must have an empty() method for
+// checking if the entry is unused and a same() method for checking if two
+// entries have the same key.
+template<typename T> class HashIndex {
+ public:
+  typedef T Entry;
+
+  // Each bucket holds the entries for one cache line.
+  static const int kBucketSize = 4;
+  struct Bucket {
+    Entry entries[kBucketSize];
+  };
+
+  // Allocates empty index with room for the number of entries.
+  explicit HashIndex(int64 num_entries) : owned_(true) {
+    static_assert(sizeof(Entry) == 4 * sizeof(Handle),
+                  "Hash index entries must be four handles");
+
+    // Allocate enough buckets to keep the index at most half full.
+    num_buckets_ = 2;
+    shift_ = 31;
+    while (num_buckets_ * kBucketSize < num_entries * 2) {
+      num_buckets_ *= 2;
+      shift_--;
+    }
+    void *buckets;
+    size_t size = num_buckets_ * sizeof(Bucket);
+    CHECK_EQ(posix_memalign(&buckets, sizeof(Bucket), size), 0);
+    buckets_ = static_cast<Bucket *>(buckets);
+
+    // Clear all entries.
+    Handle *handles = reinterpret_cast<Handle *>(buckets_);
+    for (int i = 0; i < num_buckets_ * kBucketSize * 4; ++i) {
+      handles[i] = Handle::nil();
+    }
+  }
+
+  // Initializes index from existing bucket array, e.g. memory-mapped from a
+  // snapshot. The bucket array is not owned by the index.
+  HashIndex(Bucket *buckets, int num_buckets)
+      : buckets_(buckets), num_buckets_(num_buckets), owned_(false) {
+    shift_ = 32;
+    for (int n = num_buckets; n > 1; n >>= 1) shift_--;
+  }
+
+  ~HashIndex() {
+    if (owned_) free(buckets_);
+  }
+
+  // Adds entry with hash value to index unless the index already has an entry
+  // with the same key.
+  void Insert(Word hash, const Entry &entry) {
+    Bucket *b = const_cast<Bucket *>(bucket(hash));
+    for (;;) {
+      for (Entry &e : b->entries) {
+        if (e.empty()) {
+          e = entry;
+          return;
+        }
+        if (e.same(entry)) return;
+      }
+      b = const_cast<Bucket *>(next(b));
+    }
+  }
+
+  // Returns the first bucket to probe for hash value.
+  const Bucket *bucket(Word hash) const {
+    return buckets_ + ((hash * kHashMultiplier) >> shift_);
+  }
+
+  // Returns the next bucket in the probe sequence.
+  const Bucket *next(const Bucket *b) const {
+    return ++b == buckets_ + num_buckets_ ? buckets_ : b;
+  }
+
+  // Bucket array for index.
+  const Bucket *buckets() const { return buckets_; }
+  int num_buckets() const { return num_buckets_; }
+
+ protected:
+  // Multiplier for Fibonacci hashing of hash values into buckets.
+  static const Word kHashMultiplier = 0x9E3779B1;
+
+ private:
+  // Bucket array. The number of buckets is a power of two.
+  Bucket *buckets_;
+  int num_buckets_;
+
+  // Shift for mapping the product of the hash value and the multiplier to a
+  // bucket number.
+  int shift_;
+
+  // Whether the bucket array is owned by the index.
+  bool owned_;
+
+  DISALLOW_COPY_AND_ASSIGN(HashIndex);
+};
+
+// Symbol index entry. The symbol name is stored in the entry to avoid
+// dereferencing the symbol when checking for a match. Unused entries have a
+// nil symbol.
+struct SymbolIndexEntry {
+  Handle hash;
+  Handle name;
+  Handle symbol;
+  Handle unused;  // pads entry to 16 bytes
+
+  bool empty() const { return symbol.IsNil(); }
+  bool same(const SymbolIndexEntry &other) const {
+    return symbol == other.symbol;
+  }
+};
+
+// The symbol index is used for looking up symbols by name hash in a frozen
+// store.
+typedef HashIndex<SymbolIndexEntry> SymbolIndex;
+
+// Slot index entry. Unused entries have a nil frame.
+struct SlotIndexEntry {
+  Handle frame;
+  Handle name;
+  Handle value;
+  Handle unused;  // pads entry to 16 bytes
+
+  bool empty() const { return frame.IsNil(); }
+  bool same(const SlotIndexEntry &other) const {
+    return frame == other.frame && name == other.name;
+  }
+};
+
+// The slot index is used for looking up slot values in wide frames in a
+// frozen store. Looking up a slot in a frame requires a linear scan over the
+// slots, so frames with many slots are indexed by (frame, name) pairs. Only the
+// first slot with a given name is indexed.
+class SlotIndex : public HashIndex<SlotIndexEntry> {
+ public:
+  // Allocates empty slot index with room for the number of slots. Frames with
+  // at least min_slots slots are indexed.
+  SlotIndex(int64 num_slots, int min_slots)
+      : HashIndex(num_slots), min_slots_(min_slots) {}
+
+  // Initializes slot index from existing bucket array. The bucket array is
+  // not owned by the index.
+  SlotIndex(Bucket *buckets, int num_buckets, int min_slots)
+      : HashIndex(buckets, num_buckets), min_slots_(min_slots) {}
+
+  // Adds slot to index unless the frame already has an indexed slot with the
+  // same name.
+  void Insert(Handle frame, Handle name, Handle value) {
+    HashIndex::Insert(Hash(frame, name),
+                      SlotIndexEntry{frame, name, value, Handle::nil()});
+  }
+
+  // Looks up entry for slot in frame. Returns null if the frame has no slot
+  // with the name.
+  const Entry *Find(Handle frame, Handle name) const {
+    const Bucket *b = bucket(Hash(frame, name));
+    for (;;) {
+      for (const Entry &e : b->entries) {
+        if (e.frame == frame && e.name == name) return &e;
+        if (e.frame.IsNil()) return nullptr;
+      }
+      b = next(b);
+    }
+  }
+
+  // Minimum number of slots for frames in the index.
+  int min_slots() const { return min_slots_; }
+
+ private:
+  // Combines frame and name into hash value.
+  static Word Hash(Handle frame, Handle name) {
+    return (frame.raw() * kHashMultiplier) ^ name.raw();
+  }
+
+  // Minimum number of slots for frames in the index.
+  int min_slots_;
+};
+
 // An object store maintains heaps of objects that are automatically reclaimed
 // when they are no longer used. An object store can either be global or local.
 // Objects can be added in a local store, whereas a global store is read-only.
@@ -891,6 +1113,8 @@ class Store {
       map_buckets = 1024;
       string_buckets = 1 << 20;
       expansion_free_fraction = 20;
+      young_heap_size = 0;
+      slot_index_threshold = 0;
       symbol_rebinding = false;
       local = this;
     }
@@ -913,6 +1137,15 @@ class Store {
     // Minimum fraction of free memory after GC to skip expansion.
     int expansion_free_fraction;
 
+    // Size of young heap in bytes for generational garbage collection. If this
+    // is zero, all heaps are collected on every garbage collection.
+    int young_heap_size;
+
+    // Frames with at least this many slots are added to the slot index when
+    // the store is frozen. The slot index is disabled by default, i.e. when
+    // this is zero.
+    int slot_index_threshold;
+
     // Allow symbols to be bound.
     bool symbol_rebinding;
 
@@ -1002,10 +1235,48 @@ class Store {
   // Resolve handle by following is: chain.
   Handle Resolve(Handle handle);
 
+  // Returns the first value of named slot in frame, or nil if the frame does
+  // not have the slot. This uses the slot index for wide frames in frozen
+  // stores.
+  Handle GetSlot(const FrameDatum *frame, Handle name) const {
+    const SlotIndex *index = SlotIndexFor(frame->self);
+    if (index != nullptr && frame->slots() >= index->min_slots()) {
+      const SlotIndex::Entry *e = index->Find(frame->self, name);
+      return e != nullptr ? e->value : Handle::nil();
+    }
+    return frame->get(name);
+  }
+
+  // Checks if frame has named slot using the slot index for wide frames in
+  // frozen stores.
+  bool HasSlot(const FrameDatum *frame, Handle name) const {
+    const SlotIndex *index = SlotIndexFor(frame->self);
+    if (index != nullptr && frame->slots() >= index->min_slots()) {
+      return index->Find(frame->self, name) != nullptr;
+    }
+    return frame->has(name);
+  }
+
   // Freezes the store. This will convert all handles to global handles and make
   // the store read-only.
   void Freeze();
 
+  // Moves all the objects from another global store into this global store.
+  // The heaps of the other store are added to this store, so the objects are
+  // not copied, but the handles in the objects are translated to handles in
+  // this store. Symbols are unified with the symbols in this store, and frames
+  // in the other store replace proxies and existing frames with the same ids
+  // in this store. The other store is left empty and can only be deleted
+  // after the merge. Placeholder objects in the other store can be bound to
+  // objects in this store, in which case the placeholders are not merged, but
+  // the references to them are replaced with the bound objects. If handles is
+  // not null, these are translated from handles in the other store to handles
+  // in this store.
+  typedef std::vector<std::pair<Handle, Handle>> Bindings;
+  void Merge(Store *other,
+             const Bindings *bindings = nullptr,
+             std::vector<Handle> *handles = nullptr);
+
   // Merges occurrences of the same string. This saves memory by only keeping
   // one copy of each string value. This uses hashing, so it is not guaranteed
   // to find all identical strings.
@@ -1017,6 +1288,10 @@ class Store {
   // Returns true if the store has been frozen.
   bool frozen() const { return frozen_; }
 
+  // Returns true if no objects have been added to the store since it was
+  // created, i.e. it only contains the standard objects and the symbol table.
+  bool Pristine() const;
+
   // Global store for this store, or null if this is a global store.
   const Store *globals() const { return globals_; }
 
@@ -1140,11 +1415,29 @@ class Store {
 
   // Adds and removes GC locks.
   void LockGC() { ++gc_locks_; }
-  void UnlockGC() { if (--gc_locks_ == 0 && gc_pending_) GC(); }
+  void UnlockGC() { if (--gc_locks_ == 0 && gc_pending_) MinorGC(); }
 
-  // Performs garbage collection.
+  // Performs full garbage collection.
   void GC();
 
+  // Collects the young generation. Surviving young objects are promoted to the
+  // old generation. The old generation is also collected if it is nearly full.
+  // This is the same as a full garbage collection for non-generational stores.
+  void MinorGC();
+
+  // Returns true if the store uses generational garbage collection.
+  bool generational() const { return young_ != nullptr; }
+
+  // Write barrier for generational garbage collection. This must be called
+  // when a reference has been stored directly in an existing heap object, i.e.
+  // not through one of the store methods.
+  void WriteBarrier(Datum *object) {
+    if (young_ != nullptr && !object->remembered() && !IsYoung(object)) {
+      Remember(object);
+    }
+  }
+  void WriteBarrier(Handle handle) { WriteBarrier(Deref(handle)); }
+
   // Iterator for enumerating all objects in the heaps. This will also iterate
   // over invalidated object in the heaps. The iterator will be invalidated by
   // any GCs. Please use this with care. This is primarily intended for
@@ -1152,7 +1445,7 @@ class Store {
   // under normal circumstances.
   class Iterator {
    public:
-    explicit Iterator(const Store *store) {
+    explicit Iterator(const Store *store) : store_(store) {
       heap_ = store->first_heap_;
       current_ = heap_->base();
       end_ = heap_->end();
@@ -1160,7 +1453,7 @@ class Store {
 
     const Datum *next() {
       while (current_ == end_) {
-        heap_ = heap_->next();
+        heap_ = store_->NextHeap(heap_);
         if (heap_ == nullptr) return nullptr;
         current_ = heap_->base();
         end_ = heap_->end();
@@ -1171,12 +1464,15 @@ class Store {
     }
 
    private:
+    const Store *store_;
     const Heap *heap_;
     const Datum *current_;
     const Datum *end_;
   };
 
  private:
+  friend class Snapshot;
+
   // A reference in the handle table can be accessed as a heap object pointer or
   // as a pointer to the next element in the handle free list. Each element in
   // the handle table needs to be 8 bytes. This assumption is used in the
@@ -1206,6 +1502,37 @@ class Store {
   // heap.
   Datum *AllocateDatumSlow(Type type, Word size);
 
+  // Allocates memory in the old generation of a generational store. This never
+  // triggers a garbage collection.
+  Datum *AllocateOld(Word bytes);
+
+  // Adds new heap with room for at least the requested number of bytes.
+  Heap *AddHeap(Word bytes);
+
+  // Allocates young heap if the store uses generational garbage collection.
+  void InitYoungHeap();
+
+  // Deletes the young heap. This is used when the store is frozen.
+  void ReleaseYoungHeap();
+
+  // Returns the next heap after a heap. The young heap is returned after the
+  // last heap in the heap list.
+  Heap *NextHeap(const Heap *heap) const {
+    Heap *next = heap->next();
+    return next == nullptr && heap != young_ ? young_ : next;
+  }
+
+  // Checks if object is in the young generation.
+  bool IsYoung(const Datum *object) const {
+    return object >= young_->base() && object < young_->limit();
+  }
+
+  // Adds object to remembered set.
+  void Remember(Datum *object) {
+    object->remember();
+    *remembered_.push() = object;
+  }
+
   // Allocates handle for object.
   Handle AllocateHandle(Datum *object) {
     Reference *ref;
@@ -1241,6 +1568,10 @@ class Store {
 
     // Update self handle in object.
     object->self = handle;
+
+    // Old objects can refer to the handle, so a young replacement object must
+    // be kept alive until the next full garbage collection.
+    if (young_ != nullptr && IsYoung(object)) *remembered_.push() = object;
   }
 
   // Computes the hash value for a string and returns it as an integer handle.
@@ -1261,6 +1592,20 @@ class Store {
   Handle FindSymbol(Text name) const;
   Handle FindSymbol(Text name, Handle hash) const;
 
+  // Builds symbol index for frozen store.
+  void BuildSymbolIndex();
+
+  // Builds slot index for wide frames in frozen store.
+  void BuildSlotIndex();
+
+  // Returns slot index for the store that owns the frame.
+  const SlotIndex *SlotIndexFor(Handle frame) const {
+    if (frame.IsGlobalRef() && globals_ != nullptr) {
+      return globals_->slot_index_;
+    }
+    return slot_index_;
+  }
+
   // Inserts symbol in symbol table.
   void InsertSymbol(SymbolDatum *symbol);
 
@@ -1274,9 +1619,22 @@ class Store {
   // Mark reachable objects.
   void Mark();
 
+  // Mark reachable objects in the young generation.
+  void MarkYoung();
+
+  // Promote marked objects in the young generation to the old generation and
+  // free the young heap.
+  void Promote();
+
+  // Checks if the old generation is nearly full.
+  bool OldGenerationFull() const;
+
   // Compact heaps.
   void Compact();
 
+  // Removes all roots and externals from store.
+  void ReleaseRoots();
+
   // Pointers to the global and local handle tables. These must be first in
   // the store object for fast dereferencing of object handles. These will be
   // pointers to the handle tables of the global and local stores.
@@ -1301,6 +1659,21 @@ class Store {
   Heap *first_heap_;
   Heap *last_heap_;
 
+  // Young heap for generational garbage collection. This is null if the store
+  // does not use generational garbage collection. New objects are allocated in
+  // the young heap and the old generation heap is used for allocating promoted
+  // objects.
+  Heap *young_ = nullptr;
+  Heap *old_heap_;
+
+  // Remembered set with old objects that can have references to young objects
+  // and young objects that have replaced old objects.
+  Space<Datum *> remembered_;
+
+  // A full garbage collection is pending because the old generation has been
+  // expanded during promotion.
+  bool major_gc_pending_ = false;
+
   // The handle table is used for storing references to objects. All access to
   // objects go through the handle table, which provides a level of indirection
   // that allows object to move dynamically, e.g. during garbage collection and
@@ -1322,6 +1695,13 @@ class Store {
   // Number of hash buckets in the symbol table.
   int num_buckets_;
 
+  // Read-optimized symbol index for frozen stores. This is used instead of
+  // the symbol table for looking up symbols once the store has been frozen.
+  SymbolIndex *symbol_index_ = nullptr;
+
+  // Slot index for wide frames in frozen stores.
+  SlotIndex *slot_index_ = nullptr;
+
   // Reference count for shared stores. If the reference count is -1, the store
   // is not shared. Otherwise, the store is deleted when the reference count
   // goes to zero.
@@ -1338,9 +1718,26 @@ class Store {
   // Time spent on garbage collection in microseconds.
   int64 gc_time_ = 0;
 
+  // Number of young generation garbage collections and time spent on these.
+  int num_minor_gcs_ = 0;
+  int64 minor_gc_time_ = 0;
+
+  // Longest garbage collection pause in microseconds.
+  int64 max_gc_pause_ = 0;
+
+  // Number of bytes moved by compaction and promotion and number of bytes
+  // promoted to the old generation.
+  int64 gc_bytes_moved_ = 0;
+  int64 gc_bytes_promoted_ = 0;
+
   // Number of dead handles after store has been frozen.
   int num_dead_handles_ = 0;
 
+  // Memory-mapped heap for stores loaded from a snapshot. The mapped memory is
+  // attached to the first heap and is unmapped when the store is deleted.
+  void *mapped_heap_ = nullptr;
+  size_t mapped_size_ = 0;
+
   // Configuration options for store.
   const Options *options_;
 
@@ -0,0 +1,85 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmark for symbol lookup in large stores. This builds a store with many
+// symbols and times lookups of existing and missing symbol names, first in
+// the chained symbol table of the unfrozen store and then in the symbol index
+// that is built when the store is frozen.
+
+#include <stdio.h>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sling/base/clock.h"
+#include "sling/base/flags.h"
+#include "sling/base/init.h"
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/frame/store.h"
+#include "sling/string/strcat.h"
+
+DEFINE_int32(symbols, 10000000, "Number of symbols in store");
+DEFINE_int32(names, 1000000, "Number of distinct names looked up");
+DEFINE_int32(lookups, 10000000, "Number of symbol lookups per test");
+
+using namespace sling;
+
+// Returns the average time in nanoseconds for looking up the names in the
+// store.
+double Benchmark(const Store &store, const std::vector<string> &names) {
+  Clock clock;
+  clock.start();
+  int64 found = 0;
+  for (int i = 0; i < FLAGS_lookups; ++i) {
+    if (!store.ExistingSymbol(names[i % names.size()]).IsNil()) found++;
+  }
+  clock.stop();
+  VLOG(1) << found << " symbols found";
+
+  return clock.ns() / FLAGS_lookups;
+}
+
+int main(int argc, char *argv[]) {
+  InitProgram(&argc, &argv);
+
+  // Build store with symbols.
+  Store store;
+  for (int i = 0; i < FLAGS_symbols; ++i) {
+    store.Symbol(StrCat("/w/Q", i));
+  }
+
+  // Pick random names of existing and missing symbols for the lookups.
+  std::mt19937 rnd(FLAGS_symbols);
+  std::vector<string> existing;
+  std::vector<string> missing;
+  for (int i = 0; i < FLAGS_names; ++i) {
+    existing.push_back(StrCat("/w/Q", rnd() % FLAGS_symbols));
+    missing.push_back(StrCat("/w/P", rnd() % FLAGS_symbols));
+  }
+
+  printf("%d symbols\n", FLAGS_symbols);
+  printf("%-8s %12s %12s\n", "table", "hit (ns)", "miss (ns)");
+  double chained_hit = Benchmark(store, existing);
+  double chained_miss = Benchmark(store, missing);
+  printf("%-8s %12.1f %12.1f\n", "chained", chained_hit, chained_miss);
+
+  // Freezing the store builds the symbol index.
+  store.Freeze();
+  double index_hit = Benchmark(store, existing);
+  double index_miss = Benchmark(store, missing);
+  printf("%-8s %12.1f %12.1f\n", "index", index_hit, index_miss);
+
+  return 0;
+}
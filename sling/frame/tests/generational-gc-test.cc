@@ -0,0 +1,206 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Stress test for generational garbage collection. The test promotes a set of
+// frames, arrays, and proxies to the old generation and then stores references
+// to new young objects in them through each of the mutators that need the
+// write barrier. The young objects are only reachable through the old objects,
+// so they are lost if the remembered set misses an old object. The young heap
+// is small, so young collections also happen while the references are being
+// stored. The test checks that all the young objects survive a young
+// collection followed by a full collection.
+
+#include <string>
+
+#include "sling/base/flags.h"
+#include "sling/base/init.h"
+#include "sling/base/logging.h"
+#include "sling/frame/object.h"
+#include "sling/frame/store.h"
+#include "sling/string/strcat.h"
+
+DEFINE_int32(objects, 10000, "Number of old objects for each mutator");
+DEFINE_int32(young_heap_size, 64 * 1024, "Size of young heap in bytes");
+
+using namespace sling;
+
+// Old objects that are updated with references to young objects.
+struct OldObjects {
+  explicit OldObjects(Store *store)
+      : frames(store), arrays(store), anonymous(store), rebuilt(store) {}
+
+  Handles frames;     // named frames updated with Set() and Add()
+  Handles arrays;     // arrays updated with Array::set()
+  Handles anonymous;  // anonymous frames updated with UpdateFrame()
+  Handles rebuilt;    // anonymous frames updated with Builder::Update()
+};
+
+// Allocates anonymous frame with a value slot.
+static Frame YoungFrame(Store *store, int value) {
+  Builder b(store);
+  b.Add("value", value);
+  return b.Create();
+}
+
+// Allocates the old objects and promotes them to the old generation. The
+// named frames refer to proxies for frames that are only defined later.
+static void AllocateOldObjects(Store *store, OldObjects *old) {
+  for (int i = 0; i < FLAGS_objects; ++i) {
+    Builder b(store);
+    b.AddId(StrCat("old", i));
+    b.Add("value", i);
+    b.Add("set", Handle::nil());
+    b.Add("proxy", store->Lookup(StrCat("proxy", i)));
+    old->frames.push_back(b.Create().handle());
+
+    old->arrays.push_back(store->AllocateArray(1));
+
+    Builder u(store);
+    u.Add("update", Handle::nil());
+    old->anonymous.push_back(u.Create().handle());
+
+    Builder r(store);
+    r.Add("value", i);
+    old->rebuilt.push_back(r.Create().handle());
+  }
+  store->MinorGC();
+}
+
+// Stores references to young objects in the old objects. Each young object is
+// only kept alive by the Frame or String object until its reference has been
+// stored.
+static void StoreYoungReferences(Store *store, OldObjects *old) {
+  Handle n_set = store->Lookup("set");
+  Handle n_setnew = store->Lookup("setnew");
+  Handle n_add = store->Lookup("add");
+  Handle n_update = store->Lookup("update");
+  for (int i = 0; i < FLAGS_objects; ++i) {
+    // Update existing slot in old frame.
+    {
+      Frame young = YoungFrame(store, i);
+      store->Set(old->frames[i], n_set, young.handle());
+    }
+
+    // Add new slot to old frame with Set(), which replaces the frame.
+    {
+      String young(store, StrCat("young", i));
+      store->Set(old->frames[i], n_setnew, young.handle());
+    }
+
+    // Add slot to old frame with Add(), which replaces the frame.
+    {
+      Frame young = YoungFrame(store, i);
+      store->Add(old->frames[i], n_add, young.handle());
+    }
+
+    // Set element in old array.
+    {
+      Frame young = YoungFrame(store, i);
+      Array(store, old->arrays[i]).set(0, young.handle());
+    }
+
+    // Update the slots of old anonymous frame in place.
+    {
+      Frame young = YoungFrame(store, i);
+      Slot slot(n_update, young.handle());
+      store->UpdateFrame(old->anonymous[i], &slot, &slot + 1);
+    }
+
+    // Replace old anonymous frame with a builder.
+    {
+      Builder b(store, old->rebuilt[i]);
+      b.Add("young", YoungFrame(store, i));
+      b.Update();
+    }
+
+    // Define frame for old proxy, which replaces the proxy.
+    {
+      Builder b(store);
+      b.AddId(StrCat("proxy", i));
+      b.Add("value", i);
+      b.Add("name", StrCat("proxy", i));
+      b.Create();
+    }
+
+    // Add new symbol to the old symbol table and bind it to a young frame.
+    {
+      Builder b(store);
+      b.AddId(StrCat("new", i));
+      b.Add("value", i);
+      b.Create();
+    }
+  }
+}
+
+// Checks that all the young objects are reachable through the old objects.
+static void CheckObjects(Store *store, const OldObjects &old) {
+  for (int i = 0; i < FLAGS_objects; ++i) {
+    Frame frame(store, old.frames[i]);
+    CHECK_EQ(frame.Id().str(), StrCat("old", i));
+    CHECK_EQ(frame.GetInt("value"), i);
+    CHECK_EQ(frame.GetFrame("set").GetInt("value"), i) << i;
+    CHECK_EQ(frame.GetString("setnew"), StrCat("young", i)) << i;
+    CHECK_EQ(frame.GetFrame("add").GetInt("value"), i) << i;
+
+    Frame proxy = frame.GetFrame("proxy");
+    CHECK(!store->IsProxy(proxy.handle())) << i;
+    CHECK_EQ(proxy.GetInt("value"), i) << i;
+    CHECK_EQ(proxy.GetString("name"), StrCat("proxy", i)) << i;
+
+    Array array(store, old.arrays[i]);
+    CHECK_EQ(Frame(store, array.get(0)).GetInt("value"), i) << i;
+
+    Frame anonymous(store, old.anonymous[i]);
+    CHECK_EQ(anonymous.GetFrame("update").GetInt("value"), i) << i;
+
+    Frame rebuilt(store, old.rebuilt[i]);
+    CHECK_EQ(rebuilt.GetInt("value"), i) << i;
+    CHECK_EQ(rebuilt.GetFrame("young").GetInt("value"), i) << i;
+
+    Handle named = store->LookupExisting(StrCat("new", i));
+    CHECK(!named.IsNil()) << i;
+    CHECK(!store->IsProxy(named)) << i;
+    CHECK_EQ(Frame(store, named).GetInt("value"), i) << i;
+  }
+}
+
+int main(int argc, char *argv[]) {
+  InitProgram(&argc, &argv);
+
+  Store::Options options;
+  options.young_heap_size = FLAGS_young_heap_size;
+  Store store(&options);
+  CHECK(store.generational());
+
+  OldObjects old(&store);
+  AllocateOldObjects(&store, &old);
+  StoreYoungReferences(&store, &old);
+  CheckObjects(&store, old);
+
+  store.MinorGC();
+  CheckObjects(&store, old);
+
+  store.GC();
+  CheckObjects(&store, old);
+
+  MemoryUsage usage;
+  store.GetMemoryUsage(&usage);
+  CHECK_GT(usage.num_minor_gcs, 2);
+  LOG(INFO) << usage.num_minor_gcs << " young collections, "
+            << usage.num_gcs << " full collections, "
+            << usage.gc_bytes_promoted << " bytes promoted";
+
+  LOG(INFO) << "Generational GC test passed";
+  return 0;
+}
@@ -0,0 +1,132 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Round-trip test for segmented binary encoding. The test store has frames
+// that share anonymous objects, i.e. an anonymous frame, a string, and an
+// array. The frames are spread over many segments, and the test checks that
+// each shared object is decoded into a single object by both the sequential
+// and the parallel decoder.
+
+#include <string>
+
+#include "sling/base/flags.h"
+#include "sling/base/init.h"
+#include "sling/base/logging.h"
+#include "sling/frame/decoder.h"
+#include "sling/frame/encoder.h"
+#include "sling/frame/object.h"
+#include "sling/frame/serialization.h"
+#include "sling/frame/store.h"
+#include "sling/stream/memory.h"
+#include "sling/string/strcat.h"
+
+DEFINE_int32(frames, 10000, "Number of frames in test store");
+DEFINE_int32(segment_size, 4096, "Segment size for encoding");
+DEFINE_int32(threads, 4, "Number of threads for parallel decoding");
+
+using namespace sling;
+
+// Encodes all frames in store into segments.
+static string EncodeSegmented(Store *store, bool shallow) {
+  string encoded;
+  StringOutputStream stream(&encoded);
+  Output output(&stream);
+  Encoder encoder(store, &output);
+  encoder.set_shallow(shallow);
+  encoder.set_segment_size(FLAGS_segment_size);
+  encoder.EncodeAll();
+  output.Flush();
+  return encoded;
+}
+
+// Checks that the frames in the decoded store share the same objects.
+static void CheckSharing(Store *store) {
+  Frame first(store, "item0");
+  CHECK(first.valid());
+  Handle shared = first.GetHandle("shared");
+  Handle label = first.GetHandle("label");
+  Handle list = first.GetHandle("list");
+  CHECK(store->IsFrame(shared));
+  CHECK(store->IsString(label));
+  CHECK(store->IsType(list, ARRAY));
+  CHECK_EQ(Frame(store, shared).GetInt("value"), 42);
+  CHECK_EQ(String(store, label).value(), "shared label");
+
+  for (int i = 0; i < FLAGS_frames; ++i) {
+    Frame frame(store, StrCat("item", i));
+    CHECK(frame.valid()) << i;
+    CHECK_EQ(frame.GetInt("n"), i);
+    CHECK(frame.GetHandle("shared") == shared) << i;
+    CHECK(frame.GetHandle("label") == label) << i;
+    CHECK(frame.GetHandle("list") == list) << i;
+    Frame next = frame.GetFrame("next");
+    CHECK(next.valid()) << i;
+    CHECK_EQ(next.GetInt("n"), (i + 1) % FLAGS_frames);
+  }
+
+  Array array(store, list);
+  CHECK_EQ(array.length(), 2);
+  CHECK(array.get(0) == shared);
+  CHECK_EQ(Frame(store, array.get(1)).GetInt("n"), 0);
+}
+
+int main(int argc, char *argv[]) {
+  InitProgram(&argc, &argv);
+
+  // Build store where all frames share an anonymous frame, a string, and an
+  // array.
+  Store store;
+  Builder b(&store);
+  b.Add("value", 42);
+  Frame shared = b.Create();
+  String label(&store, "shared label");
+  Array list(&store, 2);
+  list.set(0, shared.handle());
+  list.set(1, store.Lookup("item0"));
+  for (int i = 0; i < FLAGS_frames; ++i) {
+    Builder b(&store);
+    b.AddId(StrCat("item", i));
+    b.Add("n", i);
+    b.Add("shared", shared);
+    b.Add("label", label);
+    b.Add("list", list);
+    b.Add("next", store.Lookup(StrCat("item", (i + 1) % FLAGS_frames)));
+    b.Create();
+  }
+  store.Freeze();
+
+  for (bool shallow : {true, false}) {
+    string encoded = EncodeSegmented(&store, shallow);
+    CHECK(ParallelDecoder::Segmented(encoded.data(), encoded.size()));
+    LOG(INFO) << "Encoded store with shallow=" << shallow << " into "
+              << encoded.size() << " bytes";
+
+    // Decode segments sequentially.
+    Store sequential;
+    StringDecoder decoder(&sequential, encoded);
+    decoder.DecodeAll();
+    CheckSharing(&sequential);
+
+    // Decode segments in parallel.
+    Store parallel;
+    ParallelDecoder pdecoder(&parallel, FLAGS_threads);
+    pdecoder.DecodeAll(encoded.data(), encoded.size());
+    CheckSharing(&parallel);
+    parallel.GC();
+    CheckSharing(&parallel);
+  }
+
+  LOG(INFO) << "Segmented encoding test passed";
+  return 0;
+}
@@ -38,6 +38,8 @@ enum WireSpecial {
   WIRE_ARRAY    = 5,  // array, followed by array size and the arguments
   WIRE_INDEX    = 6,  // index value, followed by varint32 encoded integer
   WIRE_RESOLVE  = 7,  // resolve link, followed by slots and replacement index
+  WIRE_SEGMENT  = 8,  // segment header, followed by segment size in bytes
+  WIRE_SHARED   = 9,  // object in earlier segment, followed by segment & index
 };
 
 // The binary marker (i.e. a nul character) is used for prefixing serialized
@@ -49,6 +51,15 @@ enum EncodingMarker {
   WIRE_BINARY_MARKER = 0,
 };
 
+// A binary encoding can be divided into segments that can be decoded
+// independently of each other. Each segment starts with a segment header with
+// the size of the segment, so the segments can be located without decoding
+// them. This allows segmented encodings to be decoded in parallel. Ordinary
+// references do not cross segment boundaries. Objects encoded in an earlier
+// segment are referred to by segment number and reference number in that
+// segment, so these can be resolved when the segments are merged.
+const int WIRE_SEGMENT_TAG = WIRE_SPECIAL | (WIRE_SEGMENT << 3);
+
 }  // namespace sling
 
 #endif  // SLING_FRAME_WIRE_H_
@@ -28,6 +28,7 @@
 #include "sling/myelin/cuda/cuda-runtime.h"
 #include "sling/myelin/kernel/cuda.h"
 #include "sling/myelin/kernel/dragnn.h"
+#include "sling/myelin/kernel/quantization.h"
 #include "sling/myelin/kernel/tensorflow.h"
 
 DEFINE_string(flow, "", "Myelin flow file");
@@ -45,8 +46,14 @@ DEFINE_string(graph, "", "DOT file name for flow");
 DEFINE_bool(consts, true, "Include constants in DOT graph");
 DEFINE_string(datagraph, "", "DOT file name prefix for data profile");
 DEFINE_int32(batch, 1, "Batch size");
+DEFINE_string(batch_funcs, "", "Comma-separated list of functions to batch");
+DEFINE_bool(quantize, false, "Quantize matrix multiplications to 8 bits");
+DEFINE_string(weight_type, "float",
+              "Storage type for weight matrices (float, float16, bfloat16)");
+DEFINE_string(save, "", "Save flow to file before analysis");
 DEFINE_string(o, "", "ELF object output file for generated code");
 DEFINE_bool(gendata, false, "Output tensor data to ELF object file");
+DEFINE_string(precompiled, "", "Save precompiled network to file");
 DEFINE_bool(gpu, false, "Run kernels on GPU");
 DEFINE_bool(argmax, false, "Use argmax for predictions");
 
@@ -102,6 +109,38 @@ int main(int argc, char *argv[]) {
   flow.set_batch_size(FLAGS_batch);
   CHECK(flow.Load(FLAGS_flow));
 
+  // Quantize weight matrices.
+  if (FLAGS_quantize) {
+    int quantized = QuantizeFlow(&flow);
+    LOG(INFO) << "Quantized " << quantized << " matrix multiplications";
+  }
+
+  // Store weight matrices with reduced precision.
+  if (FLAGS_weight_type != "float") {
+    Type type = TypeTraits::of(FLAGS_weight_type).type();
+    CHECK(type == DT_HALF || type == DT_BFLOAT16)
+        << "Unsupported weight type: " << FLAGS_weight_type;
+    int converted = ReduceWeightPrecision(&flow, type);
+    LOG(INFO) << "Reduced precision for " << converted << " matrices";
+  }
+
+  // Save transformed flow, e.g. for writing a smaller quantized model.
+  if (!FLAGS_save.empty()) {
+    LOG(INFO) << "Saving flow to " << FLAGS_save;
+    flow.Save(FLAGS_save);
+  }
+
+  // Compute functions in batches.
+  string funcs = FLAGS_batch_funcs;
+  while (!funcs.empty()) {
+    size_t comma = funcs.find(',');
+    string name = funcs.substr(0, comma);
+    funcs = comma == string::npos ? "" : funcs.substr(comma + 1);
+    Flow::Function *func = flow.Func(name);
+    CHECK(func != nullptr) << "Unknown function: " << name;
+    CHECK(flow.BatchFunction(func)) << "Cannot batch function: " << name;
+  }
+
   if (FLAGS_argmax) {
     for (auto *func : flow.funcs()) {
       auto *output = flow.Var(func->name + "/output");
@@ -164,6 +203,12 @@ int main(int argc, char *argv[]) {
       return 1;
     }
 
+    // Save precompiled network.
+    if (!FLAGS_precompiled.empty()) {
+      LOG(INFO) << "Saving precompiled network to " << FLAGS_precompiled;
+      CHECK(network.Save(FLAGS_precompiled));
+    }
+
     // Analyze cells.
     for (Cell *cell : network.cells()) {
       if (!FLAGS_cell.empty() && FLAGS_cell != cell->name()) continue;
@@ -0,0 +1,217 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/myelin/arena-runtime.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "sling/base/logging.h"
+
+namespace sling {
+namespace myelin {
+
+// Size of the smallest block. All blocks are aligned to this size.
+static const size_t kMinBlockSize = 64;
+
+// Each block has a header just before the data with the size class of the
+// block and the offset of the data from the start of the block.
+struct BlockHeader {
+  uint32 size_class;
+  uint32 offset;
+};
+
+static BlockHeader *Header(char *data) {
+  return reinterpret_cast<BlockHeader *>(data - sizeof(BlockHeader));
+}
+
+static size_t BlockSize(int size_class) {
+  return kMinBlockSize << size_class;
+}
+
+// Return the smallest size class with room for size bytes.
+static int SizeClass(size_t size) {
+  int size_class = 0;
+  while (BlockSize(size_class) < size) size_class++;
+  return size_class;
+}
+
+static char *AlignPointer(char *ptr, size_t alignment) {
+  uintptr_t p = reinterpret_cast<uintptr_t>(ptr);
+  return reinterpret_cast<char *>((p + alignment - 1) & ~(alignment - 1));
+}
+
+static char *SystemAlloc(size_t size) {
+  void *data;
+  int rc = posix_memalign(&data, kMinBlockSize, size);
+  CHECK_EQ(rc, 0) << "Cannot allocate memory, size: " << size;
+  return reinterpret_cast<char *>(data);
+}
+
+ArenaRuntime::ArenaRuntime(size_t chunk_size) : chunk_size_(chunk_size) {
+  CHECK_GE(chunk_size_, kMinBlockSize * 4);
+  chunk_size_ &= ~(kMinBlockSize - 1);
+}
+
+ArenaRuntime::~ArenaRuntime() {
+  for (char *chunk : chunks_) free(chunk);
+}
+
+char *ArenaRuntime::Allocate(size_t size, size_t alignment) {
+  // Determine the block size needed for the data, the header, and the
+  // alignment padding. Blocks are only aligned to the minimum block size, so
+  // larger alignments need extra padding.
+  if (alignment < sizeof(BlockHeader)) alignment = sizeof(BlockHeader);
+  size_t padding = sizeof(BlockHeader);
+  if (alignment <= kMinBlockSize) {
+    padding = (sizeof(BlockHeader) + alignment - 1) & ~(alignment - 1);
+  } else {
+    padding += alignment;
+  }
+  int size_class = SizeClass(size + padding);
+  CHECK_LT(size_class, kSizeClasses) << "Block too big: " << size;
+  size_t block_size = BlockSize(size_class);
+
+  // Try to reuse free block.
+  char *block;
+  std::vector<char *> &free_list = free_[size_class];
+  if (!free_list.empty()) {
+    block = free_list.back();
+    free_list.pop_back();
+    counters_.blocks_reused++;
+  } else if (block_size > chunk_size_ / 4) {
+    // Allocate large blocks separately.
+    block = SystemAlloc(block_size);
+    chunks_.push_back(block);
+    counters_.bytes_reserved += block_size;
+  } else {
+    // Allocate block from current chunk.
+    if (chunk_ptr_ + block_size > chunk_end_) {
+      RetireChunk();
+      chunk_ptr_ = SystemAlloc(chunk_size_);
+      chunk_end_ = chunk_ptr_ + chunk_size_;
+      chunks_.push_back(chunk_ptr_);
+      counters_.bytes_reserved += chunk_size_;
+    }
+    block = chunk_ptr_;
+    chunk_ptr_ += block_size;
+  }
+  counters_.bytes_in_use += block_size;
+
+  // Place data in block after header.
+  char *data = AlignPointer(block + sizeof(BlockHeader), alignment);
+  BlockHeader *header = Header(data);
+  header->size_class = size_class;
+  header->offset = data - block;
+  return data;
+}
+
+void ArenaRuntime::Free(char *data) {
+  BlockHeader *header = Header(data);
+  char *block = data - header->offset;
+  int size_class = header->size_class;
+  free_[size_class].push_back(block);
+  counters_.bytes_in_use -= BlockSize(size_class);
+}
+
+size_t ArenaRuntime::Capacity(char *data) {
+  BlockHeader *header = Header(data);
+  return BlockSize(header->size_class) - header->offset;
+}
+
+void ArenaRuntime::RetireChunk() {
+  // Split the remaining part of the chunk into the largest possible blocks.
+  while (chunk_ptr_ + kMinBlockSize <= chunk_end_) {
+    int size_class = 0;
+    while (chunk_ptr_ + BlockSize(size_class + 1) <= chunk_end_) size_class++;
+    free_[size_class].push_back(chunk_ptr_);
+    chunk_ptr_ += BlockSize(size_class);
+  }
+  chunk_ptr_ = chunk_end_ = nullptr;
+}
+
+void ArenaRuntime::AllocateInstance(Instance *instance) {
+  char *data;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    data = Allocate(instance->size(), instance->alignment());
+    counters_.instances_allocated++;
+  }
+  memset(data, 0, instance->size());
+  instance->set_data(data);
+}
+
+void ArenaRuntime::FreeInstance(Instance *instance) {
+  if (instance->data() == nullptr) return;
+  std::lock_guard<std::mutex> lock(mu_);
+  Free(instance->data());
+  counters_.instances_freed++;
+}
+
+void ArenaRuntime::ClearInstance(Instance *instance) {
+  memset(instance->data(), 0, instance->size());
+}
+
+char *ArenaRuntime::AllocateChannel(char *data, size_t old_size,
+                                    size_t new_size, size_t alignment,
+                                    Placement placement) {
+  DCHECK_EQ(placement, HOST) << "Arena runtime only supports host channels";
+  char *buffer;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (data == nullptr) {
+      // Allocate new channel buffer.
+      buffer = Allocate(new_size, alignment);
+      counters_.channels_allocated++;
+      return buffer;
+    }
+
+    // Resize buffer in place if there is room in the block.
+    if (new_size <= Capacity(data) && AlignPointer(data, alignment) == data) {
+      counters_.channels_grown++;
+      return data;
+    }
+
+    // Move channel to a new block with room for the channel to double in size
+    // before it needs to be moved again.
+    buffer = Allocate(new_size * 2, alignment);
+    counters_.channels_moved++;
+  }
+  memcpy(buffer, data, std::min(old_size, new_size));
+  std::lock_guard<std::mutex> lock(mu_);
+  Free(data);
+  return buffer;
+}
+
+void ArenaRuntime::ClearChannel(char *data, size_t pos, size_t size,
+                                Placement placement) {
+  memset(data + pos, 0, size);
+}
+
+void ArenaRuntime::FreeChannel(char *data, Placement placement) {
+  if (data == nullptr) return;
+  std::lock_guard<std::mutex> lock(mu_);
+  Free(data);
+  counters_.channels_freed++;
+}
+
+ArenaRuntime::Counters ArenaRuntime::counters() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  return counters_;
+}
+
+}  // namespace myelin
+}  // namespace sling
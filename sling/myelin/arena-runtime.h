@@ -0,0 +1,124 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_MYELIN_ARENA_RUNTIME_H_
+#define SLING_MYELIN_ARENA_RUNTIME_H_
+
+#include <mutex>
+#include <vector>
+
+#include "sling/base/types.h"
+#include "sling/myelin/compute.h"
+
+namespace sling {
+namespace myelin {
+
+// Myelin runtime for serial execution where instance data blocks and channel
+// buffers are allocated from a memory arena. Memory is obtained from the
+// system in large chunks which are split into blocks with power-of-two sizes.
+// Freed blocks are kept in free lists for each size class and are reused by
+// later allocations, so the system allocator is not used once the arena has
+// warmed up. Channel buffers are given room for growth when they are
+// reallocated, so most channel resizes are done in place without copying.
+class ArenaRuntime : public Runtime {
+ public:
+  // Allocation counters for monitoring the arena.
+  struct Counters {
+    int64 instances_allocated = 0;  // instance data blocks allocated
+    int64 instances_freed = 0;      // instance data blocks freed
+    int64 channels_allocated = 0;   // new channel buffers
+    int64 channels_grown = 0;       // channel buffers resized in place
+    int64 channels_moved = 0;       // channel buffers moved to larger blocks
+    int64 channels_freed = 0;       // channel buffers freed
+    int64 blocks_reused = 0;        // allocations served from free lists
+    int64 bytes_in_use = 0;         // bytes in blocks currently in use
+    int64 bytes_reserved = 0;       // bytes obtained from the system
+  };
+
+  // Initialize arena runtime. Memory is obtained from the system in chunks of
+  // the given size. Blocks larger than a quarter of the chunk size are
+  // allocated separately.
+  ArenaRuntime(size_t chunk_size = 1 << 20);
+  ~ArenaRuntime();
+  string Description() override { return "Arena"; }
+
+  // Instance data allocation.
+  void AllocateInstance(Instance *instance) override;
+  void FreeInstance(Instance *instance) override;
+  void ClearInstance(Instance *instance) override;
+
+  // Channel allocation.
+  char *AllocateChannel(char *data,
+                        size_t old_size,
+                        size_t new_size,
+                        size_t alignment,
+                        Placement placement) override;
+  void ClearChannel(char *data, size_t pos,
+                    size_t size,
+                    Placement placement) override;
+  void FreeChannel(char *data, Placement placement) override;
+
+  // Tasks are executed serially.
+  bool SupportsAsync() override { return false; }
+  TaskFunc StartTaskFunc() override { return StartTask; }
+  TaskFunc WaitTaskFunc() override { return WaitTask; }
+
+  // Return snapshot of allocation counters.
+  Counters counters() const;
+
+ private:
+  // Number of block size classes.
+  static const int kSizeClasses = 48;
+
+  // Allocate block with room for size bytes of data with the given alignment.
+  // Must be called with the lock held.
+  char *Allocate(size_t size, size_t alignment);
+
+  // Return block to free list. Must be called with the lock held.
+  void Free(char *data);
+
+  // Return the number of bytes available for data in block.
+  static size_t Capacity(char *data);
+
+  // Add the unused end of the current chunk to the free lists.
+  void RetireChunk();
+
+  // Serial task execution.
+  static void StartTask(Task *task) { task->func(task->arg); }
+  static void WaitTask(Task *task) {}
+
+  // Size of memory chunks obtained from the system.
+  size_t chunk_size_;
+
+  // Unused part of the current chunk.
+  char *chunk_ptr_ = nullptr;
+  char *chunk_end_ = nullptr;
+
+  // Free blocks for each size class.
+  std::vector<char *> free_[kSizeClasses];
+
+  // Memory obtained from the system.
+  std::vector<char *> chunks_;
+
+  // Allocation counters.
+  Counters counters_;
+
+  // Mutex for serializing access to the arena.
+  mutable std::mutex mu_;
+};
+
+}  // namespace myelin
+}  // namespace sling
+
+#endif  // SLING_MYELIN_ARENA_RUNTIME_H_
@@ -14,7 +14,12 @@
 
 #include "sling/myelin/compute.h"
 
+#include <elf.h>
+#include <link.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <algorithm>
 #include <list>
 #include <string>
@@ -622,6 +627,101 @@ void Instance::Clear() {
   cell_->runtime()->ClearInstance(this);
 }
 
+InstancePool::InstancePool(const Cell *cell, int limit)
+    : cell_(cell), limit_(limit) {}
+
+InstancePool::~InstancePool() {
+  for (Instance *instance : instances_) delete instance;
+  for (auto &it : channels_) {
+    for (Channel *channel : it.second) delete channel;
+  }
+}
+
+Instance *InstancePool::Acquire() {
+  Instance *instance = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (instances_.empty()) {
+      instances_allocated_++;
+    } else {
+      instance = instances_.back();
+      instances_.pop_back();
+      instances_reused_++;
+    }
+  }
+  if (instance == nullptr) return new Instance(cell_);
+  instance->Clear();
+  return instance;
+}
+
+void InstancePool::Release(Instance *instance) {
+  DCHECK(instance->cell() == cell_);
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (instances_.size() < limit_) {
+      instances_.push_back(instance);
+      return;
+    }
+  }
+  delete instance;
+}
+
+Channel *InstancePool::AcquireChannel(const Connector *connector) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    std::vector<Channel *> &free = channels_[connector];
+    if (!free.empty()) {
+      Channel *channel = free.back();
+      free.pop_back();
+      channels_reused_++;
+      return channel;
+    }
+    channels_allocated_++;
+  }
+  return new Channel(connector);
+}
+
+void InstancePool::ReleaseChannel(Channel *channel) {
+  channel->clear();
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    std::vector<Channel *> &free = channels_[channel->connector()];
+    if (free.size() < limit_) {
+      free.push_back(channel);
+      return;
+    }
+  }
+  delete channel;
+}
+
+void InstancePool::Trim() {
+  // Take the free instances and channels out of the pool and delete them
+  // without holding the lock.
+  std::vector<Instance *> instances;
+  std::vector<Channel *> channels;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    instances.swap(instances_);
+    for (auto &it : channels_) {
+      channels.insert(channels.end(), it.second.begin(), it.second.end());
+    }
+    channels_.clear();
+  }
+  for (Instance *instance : instances) delete instance;
+  for (Channel *channel : channels) delete channel;
+}
+
+int64 InstancePool::bytes_retained() const {
+  std::lock_guard<std::mutex> lock(mu_);
+  int64 bytes = instances_.size() * cell_->instance_size();
+  for (auto &it : channels_) {
+    for (Channel *channel : it.second) {
+      bytes += channel->capacity() * it.first->size();
+    }
+  }
+  return bytes;
+}
+
 string Instance::ToString(Tensor *param) const {
   // Locate parameter in instance.
   if (!param->shape().defined()) return "*";
@@ -762,6 +862,10 @@ Network::Network() {
 }
 
 Network::~Network() {
+  Clear();
+}
+
+void Network::Clear() {
   for (auto *m : memory_) MemFree(m);
   for (auto *t : parameters_) delete t;
   for (auto *t : constants_) {
@@ -775,6 +879,18 @@ Network::~Network() {
   for (auto *c : cells_) delete c;
   for (auto *s : steps_) delete s;
   for (auto *c : connectors_) delete c;
+  if (mapped_data_ != nullptr) {
+    File::FreeMappedMemory(mapped_data_, mapped_size_);
+  }
+  memory_.clear();
+  parameters_.clear();
+  constants_.clear();
+  cells_.clear();
+  steps_.clear();
+  connectors_.clear();
+  names_.clear();
+  mapped_data_ = nullptr;
+  mapped_size_ = 0;
 }
 
 Tensor *Network::GetParameter(const string &name) const {
@@ -806,6 +922,117 @@ static bool CompareUsage(const std::pair<int, Tensor *> &a,
   return a.first < b.first;
 }
 
+// Partition independent operations in a function into parallel tasks. The
+// operations are grouped into chains, where each operation in a chain only
+// depends on function inputs, constants, and earlier operations in the same
+// chain. Operations that depend on more than one chain are left in the main
+// task. This ensures that the main task only has to wait for a task before
+// consuming its outputs and that tasks never have to wait for each other. The
+// chain with the largest output is also computed by the main task and the
+// other chains are distributed over at most max_tasks parallel tasks. The
+// operations for the function are reordered in the schedule, so the steps for
+// each task come before the steps in the main task. Returns the number of
+// tasks added to the task map.
+static int PartitionTasks(Flow::Function *func, int max_tasks,
+                          std::vector<Flow::Operation *> *schedule,
+                          std::unordered_map<Flow::Operation *, int> *tasks) {
+  // Only partition functions without explicit task assignments.
+  std::vector<Flow::Operation *> ops;
+  std::vector<int> positions;
+  for (int i = 0; i < schedule->size(); ++i) {
+    Flow::Operation *op = (*schedule)[i];
+    if (op->func != func) continue;
+    if (op->task != 0) return 0;
+    ops.push_back(op);
+    positions.push_back(i);
+  }
+
+  // Assign operations to chains.
+  std::unordered_map<Flow::Operation *, int> chain;
+  std::vector<int64> cost;
+  for (Flow::Operation *op : ops) {
+    int c = -2;
+    for (Flow::Variable *input : op->inputs) {
+      Flow::Operation *producer = input->producer;
+      if (producer == nullptr || producer->func != func) continue;
+      if (input->constant()) continue;
+      auto f = chain.find(producer);
+      int pc = f != chain.end() ? f->second : -1;
+      if (c == -2 || c == pc) {
+        c = pc;
+      } else {
+        c = -1;
+      }
+    }
+    if (c == -2) {
+      // Start new chain.
+      c = cost.size();
+      cost.push_back(0);
+    }
+    chain[op] = c;
+
+    // Use the output size as an estimate of the cost of the operation.
+    if (c != -1) {
+      int64 size = 1;
+      for (Flow::Variable *output : op->outputs) {
+        if (output->elements() > size) size = output->elements();
+      }
+      cost[c] += size;
+    }
+  }
+  if (cost.size() < 2) return 0;
+
+  // Keep the most expensive chain in the main task and distribute the other
+  // chains over the tasks, assigning the next most expensive chain to the
+  // least loaded task.
+  std::vector<int> order(cost.size());
+  for (int i = 0; i < order.size(); ++i) order[i] = i;
+  std::sort(order.begin(), order.end(), [&cost](int a, int b) {
+    return cost[a] > cost[b];
+  });
+  int num_tasks = std::min<int>(max_tasks, order.size() - 1);
+  std::vector<int64> load(num_tasks);
+  std::vector<int> assignment(cost.size(), 0);
+  for (int i = 1; i < order.size(); ++i) {
+    int t = std::min_element(load.begin(), load.end()) - load.begin();
+    load[t] += cost[order[i]];
+    assignment[order[i]] = t + 1;
+  }
+
+  // Assign task ids to operations.
+  for (Flow::Operation *op : ops) {
+    int c = chain[op];
+    if (c != -1 && assignment[c] != 0) (*tasks)[op] = assignment[c];
+  }
+
+  // The ops were sorted before partitioning, so an operation that combines
+  // chains can come before later operations in a chain. Reorder the ops so
+  // the operations for each task come first, followed by the operations in
+  // the main chain, and finally the operations that combine the chains. This
+  // keeps the dependency order since chains only depend on themselves, and
+  // it ensures that all steps in a task have been started before the main
+  // task waits for it.
+  std::vector<Flow::Operation *> reordered;
+  for (int t = 1; t <= num_tasks; ++t) {
+    for (Flow::Operation *op : ops) {
+      int c = chain[op];
+      if (c != -1 && assignment[c] == t) reordered.push_back(op);
+    }
+  }
+  for (Flow::Operation *op : ops) {
+    int c = chain[op];
+    if (c != -1 && assignment[c] == 0) reordered.push_back(op);
+  }
+  for (Flow::Operation *op : ops) {
+    if (chain[op] == -1) reordered.push_back(op);
+  }
+  for (int i = 0; i < positions.size(); ++i) {
+    (*schedule)[positions[i]] = reordered[i];
+  }
+
+  return num_tasks;
+}
+
 bool Network::Compile(const Flow &flow, const Library &library) {
   // Fetch information about the CPU we are running on.
   jit::CPU::Probe();
@@ -887,9 +1114,20 @@ bool Network::Compile(const Flow &flow, const Library &library) {
   // Let linker configure network before compilation.
   linker_->BeginNetwork(this);
 
+  // Partition independent steps into parallel tasks.
+  std::vector<Flow::Operation *> schedule = flow.ops();
+  std::unordered_map<Flow::Operation *, int> autotasks;
+  if (options_.parallel_tasks > 0 && runtime_->SupportsAsync()) {
+    for (Flow::Function *func : flow.funcs()) {
+      int n = PartitionTasks(func, options_.parallel_tasks, &schedule,
+                             &autotasks);
+      if (n > 0) VLOG(3) << func->name << " partitioned into " << n << " tasks";
+    }
+  }
+
   // Find kernels for implementing each step.
   std::unordered_map<Flow::Function *, Cell *> cells;
-  for (Flow::Operation *op : flow.ops()) {
+  for (Flow::Operation *op : schedule) {
     // Create step for operation.
     Step *step = new Step();
     steps_.push_back(step);
@@ -947,11 +1185,16 @@ bool Network::Compile(const Flow &flow, const Library &library) {
     }
 
     // Assign task to step.
-    if (runtime_->SupportsAsync() && op->task != 0) {
+    int task = op->task;
+    if (task == 0) {
+      auto f = autotasks.find(op);
+      if (f != autotasks.end()) task = f->second;
+    }
+    if (runtime_->SupportsAsync() && task != 0) {
       // Add task to cell.
       int taskidx = -1;
       for (int i = 0; i < cell->tasks_.size(); ++i) {
-        if (cell->tasks_[i].task == op->task) {
+        if (cell->tasks_[i].task == task) {
           taskidx = i;
           break;
         }
@@ -959,7 +1202,7 @@ bool Network::Compile(const Flow &flow, const Library &library) {
       if (taskidx == -1) {
         // Add new task to cell.
         taskidx = cell->tasks_.size();
-        cell->tasks_.emplace_back(op->task);
+        cell->tasks_.emplace_back(task);
       }
       step->task_index_ = taskidx;
     }
@@ -1044,6 +1287,27 @@ bool Network::Compile(const Flow &flow, const Library &library) {
     step->kernel_->Adjust(step);
   }
 
+  // Add tensors for scratch space requested by kernels.
+  for (Step *step : steps_) {
+    if (step->scratch_size_ == 0) continue;
+    size_t size = (step->scratch_size_ + sizeof(float) - 1) / sizeof(float);
+    Tensor *scratch = new Tensor();
+    scratch->name_ = step->name_ + "/scratch";
+    scratch->cell_ = step->cell_;
+    scratch->type_ = DT_FLOAT;
+    scratch->shape_.assign(size);
+    scratch->size_ = scratch->space_ = size * sizeof(float);
+    scratch->aligned_ = scratch->shape_;
+    scratch->minalign_.assign(1);
+    scratch->stride_.assign(sizeof(float));
+    scratch->byte_alignment_ = jit::CPU::CacheLineSize();
+    scratch->placement_ = HOST;
+    scratch->current_placement_ = HOST;
+    parameters_.push_back(scratch);
+    tensors[scratch] = scratch;
+    step->scratch_ = scratch;
+  }
+
   // Propagate constraints between linked tensors.
   bool again = true;
   while (again) {
@@ -1610,6 +1874,9 @@ bool Network::Compile(const Flow &flow, const Library &library) {
     auto code_size = masm.pc_offset();
     masm.GenerateDataBlocks();
 
+    // Keep external references for relocation of precompiled code.
+    cell->externs_ = masm.externs();
+
     // Add generated code to linker.
     linker_->EndCell(cell, &masm, &cell->code_, masm.pc_offset() - code_size);
     VLOG(5) << cell->name()
@@ -1639,6 +1906,807 @@ bool Network::Compile(const string &flowfile, const Library &library) {
   return Compile(flow, library);
 }
 
+// A precompiled network file starts with a header with the magic number, the
+// version, and the sizes of the metadata and the constant data. The metadata
+// describes the tensors, steps, cells, and connectors, and holds the generated
+// code together with the external references that need to be relocated when
+// the code is loaded.
+//
+// Magic number and version for precompiled network files.
+static const int kPrecompiledMagic = 0x434e594d;  // "MYNC"
+static const int kPrecompiledVersion = 3;
+
+// The constant data in precompiled network files starts on a page boundary,
+// so it can be memory-mapped.
+static const int kPrecompiledPageSize = 4096;
+
+// Types of external references in precompiled code.
+enum ExternKind {
+  EXTERN_RUNTIME = 0,  // runtime support function
+  EXTERN_DATA = 1,     // data for constant tensor
+  EXTERN_TENSOR = 2,   // tensor object
+  EXTERN_IMAGE = 3,    // code or static data in executable or shared library
+};
+
+// Get address of runtime support function for symbol.
+static void *RuntimeSymbol(Runtime *runtime, const string &symbol) {
+  if (symbol == "MyelinStartTask") {
+    return reinterpret_cast<void *>(runtime->StartTaskFunc());
+  } else if (symbol == "MyelinWaitTask") {
+    return reinterpret_cast<void *>(runtime->WaitTaskFunc());
+  } else if (symbol == "MyelinSyncMain") {
+    return reinterpret_cast<void *>(runtime->SyncMainFunc());
+  } else if (symbol == "MyelinStartProfiler") {
+    return reinterpret_cast<void *>(runtime->StartProfilerFunc());
+  } else if (symbol == "MyelinStopProfiler") {
+    return reinterpret_cast<void *>(runtime->StopProfilerFunc());
+  }
+  return nullptr;
+}
+
+// An image is an object file loaded into the process, i.e. the executable or a
+// shared library. References to code and static data outside the generated
+// code are stored relative to the image base, since the base address changes
+// between processes.
+struct Image {
+  string name;      // image file name (empty for the main executable)
+  string id;        // build id or file signature for image
+  uint64 base = 0;  // base address for image
+};
+
+// Query for finding image by address or by name.
+struct ImageQuery {
+  const void *address = nullptr;  // find image containing address
+  const string *name = nullptr;   // find image with name
+  Image *image = nullptr;         // image found
+  bool found = false;
+};
+
+// Return build id for image or, if it has no build id, the size and
+// modification time of the image file.
+static string ImageId(struct dl_phdr_info *info) {
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+    if (phdr.p_type != PT_NOTE) continue;
+    const char *p = reinterpret_cast<const char *>(info->dlpi_addr +
+                                                   phdr.p_vaddr);
+    const char *end = p + phdr.p_memsz;
+    while (p + sizeof(ElfW(Nhdr)) <= end) {
+      auto *note = reinterpret_cast<const ElfW(Nhdr) *>(p);
+      const char *name = p + sizeof(ElfW(Nhdr));
+      const char *desc = name + Align(note->n_namesz, 4);
+      if (note->n_type == NT_GNU_BUILD_ID &&
+          note->n_namesz == 4 && memcmp(name, "GNU", 4) == 0) {
+        string id;
+        for (int j = 0; j < note->n_descsz; ++j) {
+          StringAppendF(&id, "%02x", static_cast<uint8>(desc[j]));
+        }
+        return id;
+      }
+      p = desc + Align(note->n_descsz, 4);
+    }
+  }
+
+  const char *filename = info->dlpi_name;
+  if (*filename == 0) filename = "/proc/self/exe";
+  struct stat st;
+  if (stat(filename, &st) != 0) return "";
+  return StringPrintf("%lld:%lld",
+                      static_cast<long long>(st.st_size),
+                      static_cast<long long>(st.st_mtime));
+}
+
+static int FindImageCallback(struct dl_phdr_info *info, size_t size,
+                             void *data) {
+  ImageQuery *query = static_cast<ImageQuery *>(data);
+  bool match = false;
+  if (query->name != nullptr) {
+    match = *query->name == info->dlpi_name;
+  } else {
+    uint64 address = reinterpret_cast<uint64>(query->address);
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+      const ElfW(Phdr) &phdr = info->dlpi_phdr[i];
+      if (phdr.p_type != PT_LOAD) continue;
+      uint64 start = info->dlpi_addr + phdr.p_vaddr;
+      if (address >= start && address < start + phdr.p_memsz) {
+        match = true;
+        break;
+      }
+    }
+  }
+  if (!match) return 0;
+
+  query->image->name = info->dlpi_name;
+  query->image->id = ImageId(info);
+  query->image->base = info->dlpi_addr;
+  query->found = true;
+  return 1;
+}
+
+// Find image containing address.
+static bool FindImage(const void *address, Image *image) {
+  ImageQuery query;
+  query.address = address;
+  query.image = image;
+  dl_iterate_phdr(FindImageCallback, &query);
+  return query.found && !image->id.empty();
+}
+
+// Find image by name.
+static bool FindImage(const string &name, Image *image) {
+  ImageQuery query;
+  query.name = &name;
+  query.image = image;
+  dl_iterate_phdr(FindImageCallback, &query);
+  return query.found && !image->id.empty();
+}
+
+// Writer for precompiled network metadata.
+class PrecompiledWriter {
+ public:
+  void Write(const void *data, size_t size) {
+    buffer_.append(static_cast<const char *>(data), size);
+  }
+
+  void WriteInt(int32 n) { Write(&n, sizeof(int32)); }
+
+  void WriteInt64(int64 n) { Write(&n, sizeof(int64)); }
+
+  void WriteString(const string &str) {
+    WriteInt(str.size());
+    Write(str.data(), str.size());
+  }
+
+  void WriteShape(const Shape &shape) {
+    WriteInt(shape.rank());
+    for (int d = 0; d < shape.rank(); ++d) WriteInt(shape.dim(d));
+  }
+
+  const string &buffer() const { return buffer_; }
+
+ private:
+  string buffer_;
+};
+
+// Reader for precompiled network metadata. Reading past the end of the input
+// sets the error flag instead of failing, so truncated or corrupt files just
+// fall back to compiling the network.
+class PrecompiledReader {
+ public:
+  PrecompiledReader(const char *ptr, const char *end) : ptr_(ptr), end_(end) {}
+
+  const char *Read(size_t size) {
+    if (size > end_ - ptr_) {
+      error_ = true;
+      ptr_ = end_;
+      return nullptr;
+    }
+    const char *p = ptr_;
+    ptr_ += size;
+    return p;
+  }
+
+  int32 ReadInt() {
+    const char *p = Read(sizeof(int32));
+    return p == nullptr ? 0 : *reinterpret_cast<const int32 *>(p);
+  }
+
+  int64 ReadInt64() {
+    const char *p = Read(sizeof(int64));
+    return p == nullptr ? 0 : *reinterpret_cast<const int64 *>(p);
+  }
+
+  string ReadString() {
+    int len = ReadInt();
+    if (len < 0) error_ = true;
+    const char *p = error_ ? nullptr : Read(len);
+    return p == nullptr ? string() : string(p, len);
+  }
+
+  void ReadShape(Shape *shape) {
+    shape->clear();
+    int rank = ReadInt();
+    for (int d = 0; d < rank && !error_; ++d) shape->add(ReadInt());
+  }
+
+  // Read count and check that it is within bounds.
+  int ReadCount(int limit) {
+    int n = ReadInt();
+    if (n < 0 || n > limit) {
+      error_ = true;
+      n = 0;
+    }
+    return n;
+  }
+
+  // Read index and check that it is valid or -1.
+  int ReadIndex(int size) {
+    int index = ReadInt();
+    if (index < -1 || index >= size) {
+      error_ = true;
+      index = -1;
+    }
+    return index;
+  }
+
+  bool error() const { return error_; }
+
+ private:
+  const char *ptr_;     // current position
+  const char *end_;     // end of input buffer
+  bool error_ = false;  // read error
+};
+
+// Write compiler options to precompiled network.
+static void WriteOptions(const Options &options, PrecompiledWriter *writer) {
+  writer->WriteInt(options.parameter_element_order);
+  writer->WriteInt(options.debug);
+  writer->WriteInt(options.profiling);
+  writer->WriteInt(options.external_profiler);
+  writer->WriteInt(options.dynamic_allocation);
+  writer->WriteInt(options.sync_steps);
+  writer->WriteInt(options.parallel_tasks);
+}
+
+// Check that compiler options match options in precompiled network.
+static bool CheckOptions(const Options &options, PrecompiledReader *reader) {
+  bool match = true;
+  if (reader->ReadInt() != options.parameter_element_order) match = false;
+  if (reader->ReadInt() != options.debug) match = false;
+  if (reader->ReadInt() != options.profiling) match = false;
+  if (reader->ReadInt() != options.external_profiler) match = false;
+  if (reader->ReadInt() != options.dynamic_allocation) match = false;
+  if (reader->ReadInt() != options.sync_steps) match = false;
+  if (reader->ReadInt() != options.parallel_tasks) match = false;
+  return match;
+}
+
+bool Network::Save(const string &filename, const string &signature) const {
+  // Number all the tensors. Constants come first, then the parameters, and
+  // finally the connector types.
+  std::vector<Tensor *> tensors;
+  for (Tensor *t : constants_) tensors.push_back(t);
+  for (Tensor *t : parameters_) tensors.push_back(t);
+  for (Connector *c : connectors_) tensors.push_back(c->type_);
+  std::unordered_map<const void *, int> tensor_index;
+  for (int i = 0; i < tensors.size(); ++i) tensor_index[tensors[i]] = i;
+  auto tensor_id = [&tensor_index](const Tensor *t) {
+    return t == nullptr ? -1 : tensor_index.at(t);
+  };
+  std::unordered_map<const void *, int> step_index;
+  for (int i = 0; i < steps_.size(); ++i) step_index[steps_[i]] = i;
+  std::unordered_map<const void *, int> cell_index;
+  for (int i = 0; i < cells_.size(); ++i) cell_index[cells_[i]] = i;
+  auto cell_id = [&cell_index](const Cell *c) {
+    return c == nullptr ? -1 : cell_index.at(c);
+  };
+
+  // Only networks running on the host can be saved.
+  for (Tensor *t : tensors) {
+    if ((t->placement_ & DEVICE) || t->device_data_ != DEVICE_NULL) {
+      LOG(ERROR) << "Cannot save network with tensor on device: " << t->name();
+      return false;
+    }
+  }
+
+  // Assign positions in the data section to the constants.
+  std::vector<int64> positions(tensors.size(), -1);
+  std::unordered_map<const void *, int> data_index;
+  int64 data_size = 0;
+  for (int i = 0; i < constants_.size(); ++i) {
+    Tensor *t = constants_[i];
+    if (t->shared_ != nullptr || t->data_ == nullptr) continue;
+    int alignment = t->byte_alignment_;
+    if (alignment < kMinDataAlignment) alignment = kMinDataAlignment;
+    if (alignment < jit::CPU::CacheLineSize()) {
+      alignment = jit::CPU::CacheLineSize();
+    }
+    if (alignment > kPrecompiledPageSize) {
+      LOG(ERROR) << "Cannot save constant with alignment " << alignment
+                 << ": " << t->name();
+      return false;
+    }
+    data_size = Align(data_size, alignment);
+    positions[i] = data_size;
+    data_size += t->size_;
+    data_index.emplace(t->data_, i);
+  }
+
+  // Write network header.
+  PrecompiledWriter meta;
+  meta.WriteString(signature);
+  meta.WriteInt(jit::CPU::SupportedFeatures());
+  meta.WriteInt(jit::CPU::CacheLineSize());
+  meta.WriteInt(jit::CPU::L1CacheSize());
+  meta.WriteInt(jit::CPU::L2CacheSize());
+  meta.WriteInt(jit::CPU::L3CacheSize());
+  meta.WriteInt(runtime_->SupportsAsync());
+  WriteOptions(options_, &meta);
+
+  // Write object counts.
+  meta.WriteInt(constants_.size());
+  meta.WriteInt(parameters_.size());
+  meta.WriteInt(connectors_.size());
+  meta.WriteInt(steps_.size());
+  meta.WriteInt(cells_.size());
+
+  // Write tensors.
+  for (int i = 0; i < tensors.size(); ++i) {
+    Tensor *t = tensors[i];
+    meta.WriteString(t->name_);
+    meta.WriteInt(t->type_);
+    meta.WriteInt(t->ref_);
+    meta.WriteShape(t->shape_);
+    meta.WriteShape(t->minalign_);
+    meta.WriteShape(t->aligned_);
+    meta.WriteShape(t->stride_);
+    meta.WriteInt64(t->size_);
+    meta.WriteInt64(t->space_);
+    meta.WriteInt(t->byte_alignment_);
+    meta.WriteInt(t->order_);
+    meta.WriteInt64(t->offset_);
+    meta.WriteInt(t->placement_);
+    meta.WriteInt(t->in_);
+    meta.WriteInt(t->out_);
+    meta.WriteInt(cell_id(t->cell_));
+    meta.WriteInt(tensor_id(t->shared_));
+    meta.WriteInt(tensor_id(t->link_));
+    meta.WriteInt64(positions[i]);
+  }
+
+  // Write steps.
+  for (Step *step : steps_) {
+    meta.WriteString(step->name_);
+    meta.WriteString(step->type_);
+    meta.WriteString(step->kernel_->Name());
+    meta.WriteString(step->variant_);
+    meta.WriteInt(step->attributes_.size());
+    for (auto &attr : step->attributes_) {
+      meta.WriteString(attr.name);
+      meta.WriteString(attr.value);
+    }
+    meta.WriteInt(step->noop_);
+    meta.WriteInt(step->task_index_);
+    meta.WriteInt(cell_id(step->cell_));
+    meta.WriteInt(step->inputs_.size());
+    for (Tensor *t : step->inputs_) meta.WriteInt(tensor_id(t));
+    meta.WriteInt(step->outputs_.size());
+    for (Tensor *t : step->outputs_) meta.WriteInt(tensor_id(t));
+  }
+
+  // Write cells.
+  for (Cell *cell : cells_) {
+    if (cell->device_instance_size_ > 0) {
+      LOG(ERROR) << "Cannot save cell with device instance: " << cell->name();
+      return false;
+    }
+    meta.WriteString(cell->name_);
+    meta.WriteInt(cell->steps_.size());
+    for (Step *step : cell->steps_) meta.WriteInt(step_index.at(step));
+    meta.WriteInt(cell->tasks_.size());
+    for (auto &task : cell->tasks_) {
+      meta.WriteInt(task.task);
+      meta.WriteInt64(task.offset);
+      meta.WriteInt(task.placement);
+    }
+    meta.WriteInt64(cell->instance_size_);
+    meta.WriteInt(cell->instance_alignment_);
+    meta.WriteInt64(cell->data_start_);
+    meta.WriteInt(runtime_->ExtraInstanceData(cell));
+    meta.WriteInt(tensor_id(cell->profile_));
+
+    // Write generated code.
+    meta.WriteInt(cell->code_.size());
+    meta.Write(cell->code_.begin(), cell->code_.size());
+
+    // Write external references for relocating the code.
+    meta.WriteInt(cell->externs_.size());
+    for (const jit::Extern &ext : cell->externs_) {
+      meta.WriteString(ext.symbol);
+      void *address = ext.address;
+      Image image;
+      if (address != nullptr &&
+          address == RuntimeSymbol(runtime_, ext.symbol)) {
+        meta.WriteInt(EXTERN_RUNTIME);
+      } else if (data_index.count(address) > 0) {
+        meta.WriteInt(EXTERN_DATA);
+        meta.WriteInt(data_index[address]);
+      } else if (tensor_index.count(address) > 0) {
+        meta.WriteInt(EXTERN_TENSOR);
+        meta.WriteInt(tensor_index[address]);
+      } else if (FindImage(address, &image)) {
+        meta.WriteInt(EXTERN_IMAGE);
+        meta.WriteString(image.name);
+        meta.WriteString(image.id);
+        meta.WriteInt64(reinterpret_cast<uint64>(address) - image.base);
+      } else {
+        LOG(ERROR) << "Cannot relocate external reference to " << ext.symbol
+                   << " in cell " << cell->name();
+        return false;
+      }
+      meta.WriteInt(ext.refs.size());
+      for (int ref : ext.refs) meta.WriteInt(ref);
+    }
+  }
+
+  // Write connectors.
+  for (Connector *connector : connectors_) {
+    meta.WriteInt(connector->links_.size());
+    for (Tensor *t : connector->links_) meta.WriteInt(tensor_id(t));
+    meta.WriteInt(connector->alignment_);
+    meta.WriteInt(connector->placement_);
+  }
+
+  // Write parameter names and aliases.
+  meta.WriteInt(names_.size());
+  for (auto &it : names_) {
+    meta.WriteString(it.first);
+    meta.WriteInt(tensor_id(it.second));
+  }
+
+  // Write the file under a temporary name and rename it when it is complete,
+  // so processes loading the network never see a partially written file.
+  string tmpfile = StringPrintf("%s.%d.tmp", filename.c_str(), getpid());
+  File *file;
+  Status st = File::Open(tmpfile, "w", &file);
+  if (!st.ok()) {
+    LOG(ERROR) << "Cannot create " << tmpfile << ": " << st;
+    return false;
+  }
+  int64 meta_size = meta.buffer().size();
+  int32 ints[] = {kPrecompiledMagic, kPrecompiledVersion};
+  int64 data_pos = Align(sizeof(ints) + 2 * sizeof(int64) + meta_size,
+                         kPrecompiledPageSize);
+  string header;
+  header.append(reinterpret_cast<const char *>(ints), sizeof(ints));
+  header.append(reinterpret_cast<const char *>(&meta_size), sizeof(int64));
+  header.append(reinterpret_cast<const char *>(&data_size), sizeof(int64));
+  header.append(meta.buffer());
+  header.resize(data_pos);
+  file->WriteOrDie(header.data(), header.size());
+  string padding;
+  int64 pos = 0;
+  for (int i = 0; i < constants_.size(); ++i) {
+    if (positions[i] == -1) continue;
+    Tensor *t = constants_[i];
+    padding.assign(positions[i] - pos, 0);
+    file->WriteOrDie(padding.data(), padding.size());
+    file->WriteOrDie(t->data_, t->size_);
+    pos = positions[i] + t->size_;
+  }
+  st = file->Close();
+  if (st.ok()) st = File::Rename(tmpfile, filename);
+  if (!st.ok()) {
+    LOG(ERROR) << "Error writing " << filename << ": " << st;
+    File::Delete(tmpfile);
+    return false;
+  }
+
+  return true;
+}
+
+bool Network::Load(const string &filename, const Library &library,
+                   const string &signature) {
+  CHECK(cells_.empty()) << "Network has already been compiled";
+  jit::CPU::Probe();
+
+  // Open precompiled network file.
+  File *file;
+  if (!File::Open(filename, "r", &file).ok()) return false;
+
+  // Read header.
+  int32 ints[2];
+  int64 sizes[2];
+  uint64 read;
+  bool ok = file->Read(ints, sizeof(ints), &read).ok() &&
+            read == sizeof(ints) &&
+            file->Read(sizes, sizeof(sizes), &read).ok() &&
+            read == sizeof(sizes) &&
+            ints[0] == kPrecompiledMagic &&
+            ints[1] == kPrecompiledVersion;
+  int64 meta_size = sizes[0];
+  int64 data_size = sizes[1];
+  int64 data_pos = Align(sizeof(ints) + sizeof(sizes) + meta_size,
+                         kPrecompiledPageSize);
+  if (!ok || meta_size < 0 || data_size < 0 ||
+      data_pos + data_size != file->Size()) {
+    LOG(WARNING) << "Invalid precompiled network file: " << filename;
+    file->Close();
+    return false;
+  }
+
+  // Read metadata.
+  string meta;
+  meta.resize(meta_size);
+  if (!file->Read(&meta[0], meta_size, &read).ok() || read != meta_size) {
+    LOG(WARNING) << "Error reading precompiled network file: " << filename;
+    file->Close();
+    return false;
+  }
+
+  // Map the constants into memory so the pages can be shared with other
+  // processes using the same network. Fall back to reading the constants if
+  // the file cannot be memory-mapped.
+  char *data = nullptr;
+  if (data_size > 0) {
+    data = static_cast<char *>(file->MapMemory(data_pos, data_size));
+    if (data != nullptr) {
+      mapped_data_ = data;
+      mapped_size_ = data_size;
+    } else {
+      data = AllocateMemory(data_size, kPrecompiledPageSize);
+      if (!file->PRead(data_pos, data, data_size, &read).ok() ||
+          read != data_size) {
+        LOG(WARNING) << "Error reading precompiled network file: " << filename;
+        file->Close();
+        Clear();
+        return false;
+      }
+    }
+  }
+  file->Close();
+
+  // Set up network from metadata.
+  if (!ReadPrecompiled(meta.data(), meta.size(), data, data_size,
+                       library, signature)) {
+    LOG(WARNING) << "Cannot use precompiled network " << filename;
+    Clear();
+    return false;
+  }
+
+  return true;
+}
+
+bool Network::ReadPrecompiled(const char *meta, size_t meta_size,
+                              const char *data, size_t data_size,
+                              const Library &library,
+                              const string &signature) {
+  PrecompiledReader reader(meta, meta + meta_size);
+
+  // Check that the network was compiled for the same signature, CPU, runtime,
+  // and options. The cache sizes are checked because kernels choose their
+  // blocking from them.
+  if (reader.ReadString() != signature) {
+    LOG(WARNING) << "Precompiled network signature mismatch";
+    return false;
+  }
+  if (reader.ReadInt() != jit::CPU::SupportedFeatures() ||
+      reader.ReadInt() != jit::CPU::CacheLineSize() ||
+      reader.ReadInt() != jit::CPU::L1CacheSize() ||
+      reader.ReadInt() != jit::CPU::L2CacheSize() ||
+      reader.ReadInt() != jit::CPU::L3CacheSize()) {
+    LOG(WARNING) << "Precompiled network is for a different CPU";
+    return false;
+  }
+  if (reader.ReadInt() != runtime_->SupportsAsync()) {
+    LOG(WARNING) << "Precompiled network is for a different runtime";
+    return false;
+  }
+  if (!CheckOptions(options_, &reader)) {
+    LOG(WARNING) << "Precompiled network has different compiler options";
+    return false;
+  }
+
+  // Create empty objects so they can be referenced by index.
+  int limit = meta_size;
+  int num_constants = reader.ReadCount(limit);
+  int num_parameters = reader.ReadCount(limit);
+  int num_connectors = reader.ReadCount(limit);
+  int num_steps = reader.ReadCount(limit);
+  int num_cells = reader.ReadCount(limit);
+  if (reader.error()) return false;
+  std::vector<Tensor *> tensors;
+  for (int i = 0; i < num_constants; ++i) {
+    constants_.push_back(new Tensor());
+    tensors.push_back(constants_.back());
+  }
+  for (int i = 0; i < num_parameters; ++i) {
+    parameters_.push_back(new Tensor());
+    tensors.push_back(parameters_.back());
+  }
+  for (int i = 0; i < num_connectors; ++i) {
+    Connector *connector = new Connector(this);
+    connector->type_ = new Tensor();
+    connectors_.push_back(connector);
+    tensors.push_back(connector->type_);
+  }
+  for (int i = 0; i < num_steps; ++i) steps_.push_back(new Step());
+  for (int i = 0; i < num_cells; ++i) {
+    Cell *cell = new Cell();
+    cell->network_ = this;
+    cells_.push_back(cell);
+  }
+  auto get_tensor = [&](int index) {
+    return index == -1 ? nullptr : tensors[index];
+  };
+  auto get_cell = [&](int index) {
+    return index == -1 ? nullptr : cells_[index];
+  };
+
+  // Read tensors.
+  for (int i = 0; i < tensors.size() && !reader.error(); ++i) {
+    Tensor *t = tensors[i];
+    t->name_ = reader.ReadString();
+    t->type_ = static_cast<Type>(reader.ReadInt());
+    t->ref_ = reader.ReadInt();
+    reader.ReadShape(&t->shape_);
+    reader.ReadShape(&t->minalign_);
+    reader.ReadShape(&t->aligned_);
+    reader.ReadShape(&t->stride_);
+    t->size_ = reader.ReadInt64();
+    t->space_ = reader.ReadInt64();
+    t->byte_alignment_ = reader.ReadInt();
+    t->order_ = static_cast<Order>(reader.ReadInt());
+    t->offset_ = reader.ReadInt64();
+    t->placement_ = static_cast<Placement>(reader.ReadInt());
+    t->in_ = reader.ReadInt();
+    t->out_ = reader.ReadInt();
+    t->cell_ = get_cell(reader.ReadIndex(num_cells));
+    t->shared_ = get_tensor(reader.ReadIndex(tensors.size()));
+    t->link_ = get_tensor(reader.ReadIndex(tensors.size()));
+    int64 position = reader.ReadInt64();
+    if (position != -1) {
+      if (position < 0 || position + t->size_ > data_size) return false;
+      t->data_ = data + position;
+    }
+  }
+  if (reader.error()) return false;
+
+  // Shared constants use the data of the tensor they are shared with.
+  for (Tensor *t : constants_) {
+    if (t->shared_ != nullptr) t->data_ = t->shared_->data_;
+    if (t->data_ == nullptr) return false;
+    t->current_placement_ = HOST;
+  }
+
+  // Read steps.
+  for (Step *step : steps_) {
+    step->name_ = reader.ReadString();
+    step->type_ = reader.ReadString();
+    string kernel = reader.ReadString();
+    step->variant_ = reader.ReadString();
+    int num_attrs = reader.ReadCount(limit);
+    for (int i = 0; i < num_attrs; ++i) {
+      string name = reader.ReadString();
+      string value = reader.ReadString();
+      step->attributes_.Set(name, value);
+    }
+    step->noop_ = reader.ReadInt();
+    step->task_index_ = reader.ReadInt();
+    step->cell_ = get_cell(reader.ReadIndex(num_cells));
+    int num_inputs = reader.ReadCount(limit);
+    for (int i = 0; i < num_inputs && !reader.error(); ++i) {
+      Tensor *input = get_tensor(reader.ReadIndex(tensors.size()));
+      if (input == nullptr) return false;
+      step->inputs_.push_back(input);
+      input->consumers_.push_back(step);
+    }
+    int num_outputs = reader.ReadCount(limit);
+    for (int i = 0; i < num_outputs && !reader.error(); ++i) {
+      Tensor *output = get_tensor(reader.ReadIndex(tensors.size()));
+      if (output == nullptr) return false;
+      step->outputs_.push_back(output);
+      output->producer_ = step;
+    }
+    if (reader.error()) return false;
+
+    // Find kernel in library.
+    for (Kernel *k : library.Lookup(step->type_)) {
+      if (k->Name() == kernel) step->kernel_ = k;
+    }
+    if (step->kernel_ == nullptr) {
+      LOG(WARNING) << "Kernel " << kernel << " for " << step->name_
+                   << " not found in library";
+      return false;
+    }
+  }
+
+  // Read cells.
+  for (Cell *cell : cells_) {
+    cell->name_ = reader.ReadString();
+    int num_cell_steps = reader.ReadCount(num_steps);
+    for (int i = 0; i < num_cell_steps; ++i) {
+      int index = reader.ReadIndex(num_steps);
+      if (index == -1) return false;
+      cell->steps_.push_back(steps_[index]);
+    }
+    int num_tasks = reader.ReadCount(limit);
+    for (int i = 0; i < num_tasks; ++i) {
+      cell->tasks_.emplace_back(reader.ReadInt());
+      auto &task = cell->tasks_.back();
+      task.state = COMPLETED;
+      task.offset = reader.ReadInt64();
+      task.placement = static_cast<Placement>(reader.ReadInt());
+    }
+    cell->instance_size_ = reader.ReadInt64();
+    cell->instance_alignment_ = reader.ReadInt();
+    cell->data_start_ = reader.ReadInt64();
+    int extra = reader.ReadInt();
+    cell->profile_ = get_tensor(reader.ReadIndex(tensors.size()));
+    if (reader.error()) return false;
+    if (extra != runtime_->ExtraInstanceData(cell)) {
+      LOG(WARNING) << "Runtime instance data mismatch for " << cell->name_;
+      return false;
+    }
+
+    // Read generated code.
+    int code_size = reader.ReadCount(limit);
+    const char *code = reader.Read(code_size);
+    if (code == nullptr) return false;
+    string buffer(code, code_size);
+
+    // Relocate external references in code.
+    int num_externs = reader.ReadCount(limit);
+    for (int i = 0; i < num_externs; ++i) {
+      string symbol = reader.ReadString();
+      void *address = nullptr;
+      switch (reader.ReadInt()) {
+        case EXTERN_RUNTIME:
+          address = RuntimeSymbol(runtime_, symbol);
+          break;
+        case EXTERN_DATA: {
+          Tensor *t = get_tensor(reader.ReadIndex(tensors.size()));
+          if (t != nullptr) address = const_cast<char *>(t->data_);
+          break;
+        }
+        case EXTERN_TENSOR:
+          address = get_tensor(reader.ReadIndex(tensors.size()));
+          break;
+        case EXTERN_IMAGE: {
+          string name = reader.ReadString();
+          string id = reader.ReadString();
+          uint64 offset = reader.ReadInt64();
+          Image image;
+          if (FindImage(name, &image) && image.id == id) {
+            address = reinterpret_cast<void *>(image.base + offset);
+          }
+          break;
+        }
+      }
+      if (address == nullptr || reader.error()) {
+        LOG(WARNING) << "Cannot resolve external reference to " << symbol
+                     << " in " << cell->name_;
+        return false;
+      }
+      cell->externs_.emplace_back(symbol, static_cast<jit::Address>(address));
+      int num_refs = reader.ReadCount(code_size);
+      for (int j = 0; j < num_refs; ++j) {
+        int ref = reader.ReadInt();
+        if (ref < 0 || ref + sizeof(void *) > code_size) return false;
+        memcpy(&buffer[ref], &address, sizeof(void *));
+        cell->externs_.back().refs.push_back(ref);
+      }
+    }
+    if (reader.error()) return false;
+
+    // Allocate executable code for cell.
+    cell->code_.Allocate(&buffer[0], buffer.size());
+  }
+
+  // Read connectors.
+  for (Connector *connector : connectors_) {
+    int num_links = reader.ReadCount(limit);
+    for (int i = 0; i < num_links; ++i) {
+      Tensor *link = get_tensor(reader.ReadIndex(tensors.size()));
+      if (link == nullptr) return false;
+      connector->links_.push_back(link);
+    }
+    connector->alignment_ = reader.ReadInt();
+    connector->placement_ = static_cast<Placement>(reader.ReadInt());
+  }
+
+  // Read parameter names and aliases.
+  int num_names = reader.ReadCount(limit);
+  for (int i = 0; i < num_names; ++i) {
+    string name = reader.ReadString();
+    Tensor *t = get_tensor(reader.ReadIndex(tensors.size()));
+    if (t == nullptr) return false;
+    names_[name] = t;
+  }
+
+  return !reader.error();
+}
+
 void Network::ComputeLiveRanges() {
   // Check that the network is not empty.
   if (steps_.empty()) return;
@@ -1661,6 +2729,37 @@ void Network::ComputeLiveRanges() {
       if (output->first_ == -1) output->first_ = i;
       if (!output->out_) output->last_ = i;
     }
+    if (step->scratch_ != nullptr) {
+      step->scratch_->first_ = i;
+      step->scratch_->last_ = i;
+    }
+  }
+
+  // Variables used by parallel tasks must be alive from the start of the task
+  // until the end of the cell computation, since the task can run concurrently
+  // with the steps following it in the main task.
+  for (Cell *cell : cells_) {
+    if (cell->tasks_.empty()) continue;
+    std::vector<int> start(cell->tasks_.size(), -1);
+    int end = -1;
+    for (int i = 0; i < steps_.size(); ++i) {
+      Step *step = steps_[i];
+      if (step->cell_ != cell) continue;
+      end = i;
+      int tidx = step->task_index_;
+      if (tidx != -1 && start[tidx] == -1) start[tidx] = i;
+    }
+    for (Step *step : cell->steps_) {
+      int tidx = step->task_index_;
+      if (tidx == -1) continue;
+      std::vector<Tensor *> params = step->inputs_;
+      for (Tensor *t : step->outputs_) params.push_back(t);
+      if (step->scratch_ != nullptr) params.push_back(step->scratch_);
+      for (Tensor *t : params) {
+        if (t->first_ > start[tidx]) t->first_ = start[tidx];
+        if (t->last_ < end) t->last_ = end;
+      }
+    }
   }
 
   // Extend live range for all shared variables.
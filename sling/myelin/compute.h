@@ -15,6 +15,7 @@
 #ifndef SLING_MYELIN_COMPUTE_H_
 #define SLING_MYELIN_COMPUTE_H_
 
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
@@ -660,6 +661,14 @@ class Step {
   char *AllocateKernelMemory(size_t size, int alignment);
   char *kernel_memory() const { return kernel_memory_; }
 
+  // Request scratch space in the instance for the kernel. The scratch space
+  // is only used while the step is executed. This should be called in the
+  // Adjust() method of the kernel.
+  void SetScratchSize(size_t size) { scratch_size_ = size; }
+
+  // Scratch tensor for kernel or null if no scratch space was requested.
+  Tensor *scratch() const { return scratch_; }
+
   // Cell that this step belongs to.
   Cell *cell() const { return cell_; }
 
@@ -715,6 +724,10 @@ class Step {
   // the network.
   char *kernel_memory_ = nullptr;
 
+  // Scratch space in instance for kernel.
+  size_t scratch_size_ = 0;
+  Tensor *scratch_ = nullptr;
+
   // Kernel variant. Only used for display purposes.
   string variant_;
 
@@ -808,6 +821,12 @@ class Channel {
   // Return the number of elements in the channel.
   int size() const { return size_; }
 
+  // Return the number of allocated elements in the channel.
+  int capacity() const { return capacity_; }
+
+  // Return connector for channel.
+  const Connector *connector() const { return connector_; }
+
   // Return runtime for channel.
   inline Runtime *runtime() const;
 
@@ -1025,6 +1044,77 @@ class Instance {
   const Cell *cell_;
 };
 
+// An instance pool keeps instances and channels for a cell for reuse, so the
+// instance data blocks and channel buffers do not have to be allocated for
+// each computation. Instances are cleared when they are acquired from the
+// pool, and channels are emptied but keep their capacity when they are
+// released. The pool is thread-safe.
+class InstancePool {
+ public:
+  // Initialize instance pool for cell. At most limit instances and limit
+  // channels for each connector are kept in the pool, so the limit should be
+  // the number of instances used concurrently.
+  InstancePool(const Cell *cell, int limit);
+
+  // Delete pool and all the pooled instances and channels.
+  ~InstancePool();
+
+  // Get cleared instance from the pool or allocate a new one.
+  Instance *Acquire();
+
+  // Return instance to the pool.
+  void Release(Instance *instance);
+
+  // Get empty channel for connector from the pool or allocate a new one.
+  Channel *AcquireChannel(const Connector *connector);
+
+  // Return channel to the pool.
+  void ReleaseChannel(Channel *channel);
+
+  // Delete all the free instances and channels in the pool.
+  void Trim();
+
+  // Return cell for pool.
+  const Cell *cell() const { return cell_; }
+
+  // Pool statistics.
+  int64 instances_allocated() const { return Stat(&instances_allocated_); }
+  int64 instances_reused() const { return Stat(&instances_reused_); }
+  int64 channels_allocated() const { return Stat(&channels_allocated_); }
+  int64 channels_reused() const { return Stat(&channels_reused_); }
+
+  // Return the number of bytes used by the free instances and channels.
+  int64 bytes_retained() const;
+
+ private:
+  // Read statistics counter.
+  int64 Stat(const int64 *counter) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return *counter;
+  }
+
+  // Cell for pooled instances.
+  const Cell *cell_;
+
+  // Maximum number of pooled instances and channels per connector.
+  int limit_;
+
+  // Free instances.
+  std::vector<Instance *> instances_;
+
+  // Free channels for each connector.
+  std::unordered_map<const Connector *, std::vector<Channel *>> channels_;
+
+  // Statistics.
+  int64 instances_allocated_ = 0;
+  int64 instances_reused_ = 0;
+  int64 channels_allocated_ = 0;
+  int64 channels_reused_ = 0;
+
+  // Mutex for serializing access to the pool.
+  mutable std::mutex mu_;
+};
+
 // A cell contains generated code for executing computation of a function.
 class Cell {
  public:
@@ -1123,6 +1213,10 @@ class Cell {
   // Tensor with profiling information.
   Tensor *profile_ = nullptr;
 
+  // External references in the generated code. These are needed for
+  // relocating the code when the network is saved in precompiled form.
+  std::vector<jit::Extern> externs_;
+
   friend class Network;
   friend class Step;
   friend class InstanceAllocator;
@@ -1136,6 +1230,7 @@ struct Options {
   bool external_profiler = false;            // external profiling buffer
   bool dynamic_allocation = false;           // dynamic instance allocation
   bool sync_steps = false;                   // synchronize all steps
+  int parallel_tasks = 0;                    // max tasks for parallel steps
 };
 
 // A network is a collection of cells and variables that are compiled as a unit.
@@ -1150,6 +1245,22 @@ class Network {
   // Load flow from file and compile all the cells.
   bool Compile(const string &flowfile, const Library &library);
 
+  // Save compiled network to a precompiled network file with the generated
+  // code, the constants, the tensor layout, and the cell metadata. The
+  // signature identifies the source of the network, e.g. the flow file and the
+  // flow transformations, and must match when the network is loaded. Returns
+  // false if the network cannot be saved, e.g. if it uses a device.
+  bool Save(const string &filename, const string &signature = "") const;
+
+  // Load network from precompiled network file. This skips flow analysis,
+  // kernel selection, and code generation. The constants are memory-mapped
+  // from the file, so they are shared between processes. Returns false if the
+  // file does not exist, or if it was compiled for a different CPU, runtime,
+  // kernel library, compiler options, or signature. The network is then left
+  // empty and can be compiled from the flow instead.
+  bool Load(const string &filename, const Library &library,
+            const string &signature = "");
+
   // Get compiled cell.
   Cell *GetCell(const string &name) const;
 
@@ -1190,6 +1301,11 @@ class Network {
     options_.dynamic_allocation = dynamic;
   }
 
+  // Enable automatic partitioning of independent steps into at most the
+  // given number of parallel tasks. This requires a runtime that supports
+  // asynchronous execution.
+  void set_parallel_tasks(int tasks) { options_.parallel_tasks = tasks; }
+
   // Network cells.
   const std::vector<Cell *> cells() const { return cells_; }
 
@@ -1209,6 +1325,14 @@ class Network {
   // Allocate aligned tensor from data in standard order.
   char *AllocateTensor(Tensor *tensor);
 
+  // Read network from precompiled network metadata.
+  bool ReadPrecompiled(const char *meta, size_t meta_size,
+                       const char *data, size_t data_size,
+                       const Library &library, const string &signature);
+
+  // Remove all cells, steps, tensors, and connectors from network.
+  void Clear();
+
   // Network cells.
   std::vector<Cell *> cells_;
 
@@ -1230,6 +1354,10 @@ class Network {
   // Memory blocks owned by network.
   std::vector<char *> memory_;
 
+  // Memory-mapped constants for precompiled network.
+  char *mapped_data_ = nullptr;
+  size_t mapped_size_ = 0;
+
   // Runtime support.
   Runtime *runtime_;
 
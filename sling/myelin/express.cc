@@ -1334,10 +1334,17 @@ bool Express::Rewrite(const Model &model, Express *rewritten) const {
 }
 
 int Express::AllocateRegisters() {
+  // Allocate registers for register inputs in id order, so register input !n
+  // is in register n when the inputs are numbered consecutively.
   RegisterAllocator regs;
+  std::vector<Var *> inputs;
   for (Var *var : vars_) {
-    if (var->type == REGISTER) regs.Allocate(var);
+    if (var->type == REGISTER) inputs.push_back(var);
   }
+  std::sort(inputs.begin(), inputs.end(), [](Var *a, Var *b) {
+    return a->id < b->id;
+  });
+  for (Var *var : inputs) regs.Allocate(var);
   for (Op *op : ops_) {
     if (op->type == MOV) {
       // Allocate destination register for move op.
@@ -555,6 +555,7 @@ Flow::~Flow() {
   for (auto *func : funcs_) delete func;
   for (auto *cnx : cnxs_) delete cnx;
   for (auto *ptr : memory_) free(ptr);
+  if (mapping_ != nullptr) File::FreeMappedMemory(mapping_, mapped_size_);
 }
 
 char *Flow::AllocateMemory(size_t size) {
@@ -579,6 +580,25 @@ Status Flow::Load(const string &filename) {
   return Status::OK;
 }
 
+Status Flow::Map(const string &filename) {
+  // Map flow file into memory.
+  CHECK(mapping_ == nullptr) << "Flow file already mapped";
+  File *file;
+  Status st = File::Open(filename, "r", &file);
+  if (!st.ok()) return st;
+  uint64 size;
+  CHECK(file->GetSize(&size));
+  void *mapping = size > 0 ? file->MapMemory(0, size) : nullptr;
+  st = file->Close();
+  if (mapping == nullptr) return st.ok() ? Load(filename) : st;
+  mapping_ = mapping;
+  mapped_size_ = size;
+  if (!st.ok()) return st;
+
+  Read(static_cast<const char *>(mapping), size);
+  return Status::OK;
+}
+
 void Flow::Read(const char *data, size_t size) {
   // Read header.
   Parser parser(data, data + size);
@@ -1510,6 +1530,72 @@ void Flow::DeleteOperation(Operation *op) {
   delete op;
 }
 
+bool Flow::BatchFunction(Function *func) {
+  // Find all non-constant variables used by the function and all the
+  // reshaping ops in the function.
+  std::vector<Variable *> vars;
+  std::vector<Operation *> reshapes;
+  std::unordered_set<Variable *> seen;
+  for (Operation *op : func->ops) {
+    for (Variable *var : op->inputs) {
+      if (!var->constant() && seen.insert(var).second) vars.push_back(var);
+    }
+    for (Variable *var : op->outputs) {
+      if (!var->constant() && seen.insert(var).second) vars.push_back(var);
+    }
+    if (op->type == "Reshape") reshapes.push_back(op);
+  }
+
+  // The leading dimension of a variable is the number of rows for one input,
+  // e.g. the output of a Collect op has a row for each feature. Reference
+  // inputs with an unspecified leading dimension point to a whole channel,
+  // so these are shared by all the inputs in the batch.
+  std::vector<Variable *> batched;
+  for (Variable *var : vars) {
+    if (var->ref && var->producer == nullptr &&
+        var->rank() >= 1 && var->dim(0) == -1) {
+      continue;
+    }
+    if (var->rank() < 1 || var->dim(0) < 1) {
+      VLOG(5) << "Cannot batch " << var->name << " in " << func->name;
+      return false;
+    }
+    batched.push_back(var);
+  }
+
+  // The shapes for the reshaping ops must be constant.
+  std::vector<std::vector<int>> shapes(reshapes.size());
+  for (int i = 0; i < reshapes.size(); ++i) {
+    Operation *op = reshapes[i];
+    std::vector<int> &shape = shapes[i];
+    if (op->indegree() != 2 || !op->inputs[1]->GetData(&shape) ||
+        shape.empty() || shape[0] < 1) {
+      VLOG(5) << "Cannot batch " << op->name << " in " << func->name;
+      return false;
+    }
+  }
+
+  // Stack the rows for the inputs in the batch by multiplying the leading
+  // dimensions with the batch size. The reshaping ops get new shapes, since
+  // the original shapes can be shared with other functions.
+  for (Variable *var : batched) {
+    var->shape.set(0, var->dim(0) * batch_size_);
+  }
+  for (int i = 0; i < reshapes.size(); ++i) {
+    Operation *op = reshapes[i];
+    std::vector<int> &dims = shapes[i];
+    dims[0] *= batch_size_;
+    Variable *shape = AddVariable(op->name + "/batch_shape", DT_INT32,
+                                  {static_cast<int>(dims.size())});
+    shape->size = dims.size() * sizeof(int);
+    char *data = AllocateMemory(shape->size);
+    memcpy(data, dims.data(), shape->size);
+    shape->data = data;
+    op->ReplaceInput(op->inputs[1], shape);
+  }
+  return true;
+}
+
 void Flow::DeleteFunction(Function *func) {
   auto f = std::find(funcs_.begin(), funcs_.end(), func);
   if (f != funcs_.end()) funcs_.erase(f);
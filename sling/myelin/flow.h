@@ -479,6 +479,12 @@ class Flow {
   // Load flow from file.
   Status Load(const string &filename);
 
+  // Map flow file into memory instead of reading it. Only the parts of the
+  // file that are accessed are read, so this is faster than Load() when only
+  // the data blocks or a few constants are used. The file is read with Load()
+  // if it cannot be memory-mapped.
+  Status Map(const string &filename);
+
   // Read flow from buffer. This does not take ownership of the buffer and it
   // must outlive the flow.
   void Read(const char *data, size_t size);
@@ -562,6 +568,14 @@ class Flow {
   int batch_size() const { return batch_size_; }
   void set_batch_size(int batch_size) { batch_size_ = batch_size; }
 
+  // Convert function to compute a batch of independent inputs in each
+  // invocation by multiplying the leading dimension of the non-constant
+  // variables and the reshaping shapes in the function by the batch size.
+  // Reference inputs with an unspecified leading dimension are shared by the
+  // batch. Returns false and leaves the flow unchanged if some variable cannot
+  // be batched.
+  bool BatchFunction(Function *func);
+
   // Fuse two operations into a combined op.
   Operation *Fuse(Operation *first,
                   Operation *second,
@@ -627,6 +641,10 @@ class Flow {
   // Data areas owned by flow.
   std::vector<char *> memory_;
 
+  // Memory-mapped flow file.
+  void *mapping_ = nullptr;
+  size_t mapped_size_ = 0;
+
   // Batch size.
   int batch_size_ = 1;
 };
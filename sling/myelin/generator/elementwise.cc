@@ -77,10 +77,16 @@ bool ElementwiseIndexGenerator::InitializeLocator(Tensor *var, Locator *loc) {
         loc->iterator = NewIterator(SIMPLE);
       } else {
         // Variable shape is a suffix of the output shape; use a repeated
-        // iterator.
+        // iterator. Repeated iterators over the same number of elements are
+        // shared, e.g. for bias vectors added to a batch of vectors.
         DCHECK(shape_.elements() % n == 0);
-        loc->iterator = NewIterator(REPEAT);
-        loc->iterator->size = n;
+        for (Iterator *it : iterators_) {
+          if (it->type == REPEAT && it->size == n) loc->iterator = it;
+        }
+        if (loc->iterator == nullptr) {
+          loc->iterator = NewIterator(REPEAT);
+          loc->iterator->size = n;
+        }
       }
     } else if (d1 >= 0 && d2 >= 0 && var->dim(d1) == 1 &&
                var->elements() * shape_.dim(d2) == shape_.elements()) {
@@ -165,9 +171,11 @@ bool ElementwiseIndexGenerator::AllocateLocatorRegisters(Locator *loc) {
         if (!loc->base.is_valid()) return false;
       }
 
-      // Allocate index register.
-      loc->iterator->offset = rr.try_alloc();
-      if (!loc->iterator->offset.is_valid()) return false;
+      // Allocate index register unless the iterator is shared.
+      if (!loc->iterator->offset.is_valid()) {
+        loc->iterator->offset = rr.try_alloc();
+        if (!loc->iterator->offset.is_valid()) return false;
+      }
       break;
     case BROADCAST:
       // Allocate block, index, and broadcast registers.
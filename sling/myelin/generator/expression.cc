@@ -28,6 +28,7 @@ ExpressionGenerator *CreateVectorFltSSEGenerator();
 ExpressionGenerator *CreateScalarFltAVXGenerator();
 ExpressionGenerator *CreateVectorFltAVX128Generator();
 ExpressionGenerator *CreateVectorFltAVX256Generator();
+ExpressionGenerator *CreateVectorFltAVX512Generator();
 ExpressionGenerator *CreateScalarIntGenerator();
 ExpressionGenerator *CreateVectorIntSSEGenerator();
 ExpressionGenerator *CreateVectorIntAVX128Generator();
@@ -96,7 +97,9 @@ ExpressionGenerator *ExpressionGenerator::Select(const Express &expr,
   ExpressionGenerator *generator = nullptr;
   switch (type) {
     case DT_FLOAT:
-      if (CPU::Enabled(AVX)) {
+      if (CPU::Enabled(AVX512F) && IsVector(size, 16)) {
+        generator = CreateVectorFltAVX512Generator();
+      } else if (CPU::Enabled(AVX)) {
         if (IsVector(size, 8)) {
           generator = CreateVectorFltAVX256Generator();
         } else if (IsVector(size, 4)) {
@@ -114,7 +117,12 @@ ExpressionGenerator *ExpressionGenerator::Select(const Express &expr,
       break;
 
     case DT_DOUBLE:
-      if (CPU::Enabled(AVX)) {
+      if (CPU::Enabled(AVX512F) && IsVector(size, 8) &&
+          (CPU::Enabled(AVX512DQ) || (!expr.Has(Express::CVTFLTINT) &&
+                                      !expr.Has(Express::CVTINTFLT)))) {
+        // Conversion between double and 64-bit integers requires AVX512DQ.
+        generator = CreateVectorFltAVX512Generator();
+      } else if (CPU::Enabled(AVX)) {
         if (IsVector(size, 4)) {
           generator = CreateVectorFltAVX256Generator();
         } else if (IsVector(size, 2)) {
@@ -334,10 +342,10 @@ void ExpressionGenerator::GenerateYMMMoveMemToReg(
     MacroAssembler *masm) {
   switch (type_) {
     case DT_FLOAT:
-      __ vmovaps(dst, src);
+      __ vmovups(dst, src);
       break;
     case DT_DOUBLE:
-      __ vmovapd(dst, src);
+      __ vmovupd(dst, src);
       break;
     default: UNSUPPORTED;
   }
@@ -364,10 +372,58 @@ void ExpressionGenerator::GenerateYMMVectorMove(
     // MOV [mem],reg
     switch (type_) {
       case DT_FLOAT:
-        __ vmovaps(addr(instr->result), ymm(instr->src));
+        __ vmovups(addr(instr->result), ymm(instr->src));
         break;
       case DT_DOUBLE:
-        __ vmovapd(addr(instr->result), ymm(instr->src));
+        __ vmovupd(addr(instr->result), ymm(instr->src));
+        break;
+      default: UNSUPPORTED;
+    }
+  } else {
+    UNSUPPORTED;
+  }
+}
+
+void ExpressionGenerator::GenerateZMMMoveMemToReg(
+    ZMMRegister dst,
+    const Operand &src,
+    MacroAssembler *masm) {
+  switch (type_) {
+    case DT_FLOAT:
+      __ vmovups(dst, src);
+      break;
+    case DT_DOUBLE:
+      __ vmovupd(dst, src);
+      break;
+    default: UNSUPPORTED;
+  }
+}
+
+void ExpressionGenerator::GenerateZMMVectorMove(
+    Express::Op *instr,
+    MacroAssembler *masm) {
+  if (instr->dst != -1 && instr->src != -1) {
+    // MOV reg,reg
+    switch (type_) {
+      case DT_FLOAT:
+        __ vmovaps(zmm(instr->dst), zmm(instr->src));
+        break;
+      case DT_DOUBLE:
+        __ vmovapd(zmm(instr->dst), zmm(instr->src));
+        break;
+      default: UNSUPPORTED;
+    }
+  } else if (instr->dst != -1 && instr->src == -1) {
+    // MOV reg,[mem]
+    GenerateZMMMoveMemToReg(zmm(instr->dst), addr(instr->args[0]), masm);
+  } else if (instr->dst == -1 && instr->src != -1) {
+    // MOV [mem],reg
+    switch (type_) {
+      case DT_FLOAT:
+        __ vmovups(addr(instr->result), zmm(instr->src));
+        break;
+      case DT_DOUBLE:
+        __ vmovupd(addr(instr->result), zmm(instr->src));
         break;
       default: UNSUPPORTED;
     }
@@ -757,6 +813,109 @@ void ExpressionGenerator::GenerateYMMFltOp(
   }
 }
 
+void ExpressionGenerator::GenerateZMMFltOp(
+    Express::Op *instr,
+    OpZMMRegReg fltopreg, OpZMMRegReg dblopreg,
+    OpZMMRegMem fltopmem, OpZMMRegMem dblopmem,
+    MacroAssembler *masm, int argnum) {
+  if (instr->dst != -1 && instr->src != -1) {
+    // OP reg,reg
+    switch (type_) {
+      case DT_FLOAT:
+        (masm->*fltopreg)(zmm(instr->dst), zmm(instr->src), nomask);
+        break;
+      case DT_DOUBLE:
+        (masm->*dblopreg)(zmm(instr->dst), zmm(instr->src), nomask);
+        break;
+      default: UNSUPPORTED;
+    }
+  } else if (instr->dst != -1 && instr->src == -1) {
+    // OP reg,[mem]
+    switch (type_) {
+      case DT_FLOAT:
+        (masm->*fltopmem)(zmm(instr->dst), addr(instr->args[argnum]), nomask);
+        break;
+      case DT_DOUBLE:
+        (masm->*dblopmem)(zmm(instr->dst), addr(instr->args[argnum]), nomask);
+        break;
+      default: UNSUPPORTED;
+    }
+  } else {
+    UNSUPPORTED;
+  }
+}
+
+void ExpressionGenerator::GenerateZMMFltOp(
+    Express::Op *instr,
+    OpZMMRegRegImm fltopreg, OpZMMRegRegImm dblopreg,
+    OpZMMRegMemImm fltopmem, OpZMMRegMemImm dblopmem,
+    int8 imm,
+    MacroAssembler *masm, int argnum) {
+  if (instr->dst != -1 && instr->src != -1) {
+    // OP reg,reg,imm
+    switch (type_) {
+      case DT_FLOAT:
+        (masm->*fltopreg)(zmm(instr->dst), zmm(instr->src), imm, nomask);
+        break;
+      case DT_DOUBLE:
+        (masm->*dblopreg)(zmm(instr->dst), zmm(instr->src), imm, nomask);
+        break;
+      default: UNSUPPORTED;
+    }
+  } else if (instr->dst != -1 && instr->src == -1) {
+    // OP reg,[mem],imm
+    switch (type_) {
+      case DT_FLOAT:
+        (masm->*fltopmem)(zmm(instr->dst), addr(instr->args[argnum]), imm,
+                          nomask);
+        break;
+      case DT_DOUBLE:
+        (masm->*dblopmem)(zmm(instr->dst), addr(instr->args[argnum]), imm,
+                          nomask);
+        break;
+      default: UNSUPPORTED;
+    }
+  } else {
+    UNSUPPORTED;
+  }
+}
+
+void ExpressionGenerator::GenerateZMMFltOp(
+    Express::Op *instr,
+    OpZMMRegRegReg fltopreg, OpZMMRegRegReg dblopreg,
+    OpZMMRegRegMem fltopmem, OpZMMRegRegMem dblopmem,
+    MacroAssembler *masm, int argnum) {
+  if (instr->dst != -1 && instr->src != -1 && instr->src2 != -1) {
+    // OP reg,reg,reg
+    switch (type_) {
+      case DT_FLOAT:
+        (masm->*fltopreg)(zmm(instr->dst), zmm(instr->src), zmm(instr->src2),
+                          nomask);
+        break;
+      case DT_DOUBLE:
+        (masm->*dblopreg)(zmm(instr->dst), zmm(instr->src), zmm(instr->src2),
+                          nomask);
+        break;
+      default: UNSUPPORTED;
+    }
+  } else if (instr->dst != -1 && instr->src != -1 && instr->src2 == -1) {
+    // OP reg,reg,[mem]
+    switch (type_) {
+      case DT_FLOAT:
+        (masm->*fltopmem)(zmm(instr->dst), zmm(instr->src),
+                          addr(instr->args[argnum]), nomask);
+        break;
+      case DT_DOUBLE:
+        (masm->*dblopmem)(zmm(instr->dst), zmm(instr->src),
+                          addr(instr->args[argnum]), nomask);
+        break;
+      default: UNSUPPORTED;
+    }
+  } else {
+    UNSUPPORTED;
+  }
+}
+
 void ExpressionGenerator::GenerateIntUnaryOp(
     Express::Op *instr,
     OpReg opregb, OpMem opmemb,
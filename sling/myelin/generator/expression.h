@@ -33,10 +33,13 @@ class ExpressionGenerator {
   typedef jit::Immediate Immediate;
   typedef jit::XMMRegister XMMRegister;
   typedef jit::YMMRegister YMMRegister;
+  typedef jit::ZMMRegister ZMMRegister;
+  typedef jit::Mask Mask;
 
   // Register sizes in bytes.
   const static int XMMRegSize = 16;
   const static int YMMRegSize = 32;
+  const static int ZMMRegSize = 64;
 
   virtual ~ExpressionGenerator() = default;
 
@@ -166,6 +169,29 @@ class ExpressionGenerator {
                                                const Operand &,
                                                int8);
 
+  typedef void (Assembler::*OpZMMRegReg)(ZMMRegister,
+                                         ZMMRegister,
+                                         Mask);
+  typedef void (Assembler::*OpZMMRegMem)(ZMMRegister,
+                                         const Operand &,
+                                         Mask);
+  typedef void (Assembler::*OpZMMRegRegImm)(ZMMRegister,
+                                            ZMMRegister,
+                                            int8,
+                                            Mask);
+  typedef void (Assembler::*OpZMMRegMemImm)(ZMMRegister,
+                                            const Operand &,
+                                            int8,
+                                            Mask);
+  typedef void (Assembler::*OpZMMRegRegReg)(ZMMRegister,
+                                            ZMMRegister,
+                                            ZMMRegister,
+                                            Mask);
+  typedef void (Assembler::*OpZMMRegRegMem)(ZMMRegister,
+                                            ZMMRegister,
+                                            const Operand &,
+                                            Mask);
+
   // Check if size is a multiple of the vector size.
   static bool IsVector(int size, int vecsize) {
     return size > 1 && size % vecsize == 0;
@@ -186,11 +212,13 @@ class ExpressionGenerator {
   Register reg(int idx) { return index_->reg(idx); }
   XMMRegister xmm(int idx) { return index_->xmm(idx); }
   YMMRegister ymm(int idx) { return index_->ymm(idx); }
+  ZMMRegister zmm(int idx) { return index_->zmm(idx); }
 
   // Return register for auxiliary variable.
   Register aux(int idx) { return index_->aux(idx); }
   XMMRegister xmmaux(int idx) { return index_->xmmaux(idx); }
   YMMRegister ymmaux(int idx) { return index_->ymmaux(idx); }
+  ZMMRegister zmmaux(int idx) { return index_->zmmaux(idx); }
 
   // Generate XMM scalar float move.
   void GenerateXMMScalarFltMove(Express::Op *instr, MacroAssembler *masm);
@@ -205,6 +233,13 @@ class ExpressionGenerator {
   // Generate YMM vector move.
   void GenerateYMMVectorMove(Express::Op *instr, MacroAssembler *masm);
 
+  // Generate move of ZMM vector operand to register.
+  void GenerateZMMMoveMemToReg(ZMMRegister dst, const Operand &src,
+                               MacroAssembler *masm);
+
+  // Generate ZMM vector move.
+  void GenerateZMMVectorMove(Express::Op *instr, MacroAssembler *masm);
+
   // Generate move of x64 operand to register.
   void GenerateIntMoveMemToReg(Register dst, const Operand &src,
                                MacroAssembler *masm);
@@ -282,6 +317,28 @@ class ExpressionGenerator {
       int8 imm,
       MacroAssembler *masm, int argnum = 1);
 
+  // Generate two-operand ZMM float op.
+  void GenerateZMMFltOp(
+      Express::Op *instr,
+      OpZMMRegReg fltopreg, OpZMMRegReg dblopreg,
+      OpZMMRegMem fltopmem, OpZMMRegMem dblopmem,
+      MacroAssembler *masm, int argnum = 0);
+
+  // Generate two-operand ZMM float op with immediate.
+  void GenerateZMMFltOp(
+      Express::Op *instr,
+      OpZMMRegRegImm fltopreg, OpZMMRegRegImm dblopreg,
+      OpZMMRegMemImm fltopmem, OpZMMRegMemImm dblopmem,
+      int8 imm,
+      MacroAssembler *masm, int argnum = 0);
+
+  // Generate three-operand ZMM float op.
+  void GenerateZMMFltOp(
+      Express::Op *instr,
+      OpZMMRegRegReg fltopreg, OpZMMRegRegReg dblopreg,
+      OpZMMRegRegMem fltopmem, OpZMMRegRegMem dblopmem,
+      MacroAssembler *masm, int argnum = 1);
+
   // Generate one-operand x64 int op.
   void GenerateIntUnaryOp(
       Express::Op *instr,
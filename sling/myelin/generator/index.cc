@@ -90,6 +90,14 @@ void IndexGenerator::ReserveAuxYMMRegisters(int count) {
   ReserveAuxXMMRegisters(count);
 }
 
+void IndexGenerator::ReserveZMMRegisters(int count) {
+  ReserveXMMRegisters(count);
+}
+
+void IndexGenerator::ReserveAuxZMMRegisters(int count) {
+  ReserveAuxXMMRegisters(count);
+}
+
 }  // namespace myelin
 }  // namespace sling
 
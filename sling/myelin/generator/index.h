@@ -52,6 +52,9 @@ class IndexGenerator {
   jit::YMMRegister ymm(int idx) {
     return jit::YMMRegister::from_code(mmregs_[idx]);
   }
+  jit::ZMMRegister zmm(int idx) {
+    return jit::ZMMRegister::from_code(mmregs_[idx]);
+  }
 
   // Return auxiliary register.
   jit::Register aux(int idx) { return aux_[idx]; }
@@ -61,6 +64,9 @@ class IndexGenerator {
   jit::YMMRegister ymmaux(int idx) {
     return jit::YMMRegister::from_code(mmaux_[idx]);
   }
+  jit::ZMMRegister zmmaux(int idx) {
+    return jit::ZMMRegister::from_code(mmaux_[idx]);
+  }
 
   // Reserve fixed register for generating instructions that operate on
   // special registers.
@@ -70,12 +76,14 @@ class IndexGenerator {
   void ReserveRegisters(int count);
   void ReserveXMMRegisters(int count);
   void ReserveAuxYMMRegisters(int count);
+  void ReserveAuxZMMRegisters(int count);
 
   // Reserve auxiliary registers for expression generators that need extra
   // registers for compiling expression operations.
   void ReserveAuxRegisters(int count);
   void ReserveAuxXMMRegisters(int count);
   void ReserveYMMRegisters(int count);
+  void ReserveZMMRegisters(int count);
 
  protected:
   MacroAssembler *masm_;              // macro assembler for code generation
@@ -83,7 +91,7 @@ class IndexGenerator {
  private:
   std::vector<jit::Register> fixed_;  // reserved fixed registers
   std::vector<jit::Register> regs_;   // reserved temporary registers
-  std::vector<int> mmregs_;           // reserved SIMD registers (xmm/ymm)
+  std::vector<int> mmregs_;           // reserved SIMD registers (xmm/ymm/zmm)
   std::vector<jit::Register> aux_;    // reserved auxiliary registers
   std::vector<int> mmaux_;            // reserved auxiliary SIMD registers
 };
@@ -0,0 +1,274 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/myelin/generator/expression.h"
+
+#define __ masm->
+
+namespace sling {
+namespace myelin {
+
+using namespace jit;
+
+// Generate vector float expression using AVX-512 and ZMM registers.
+class VectorFltAVX512Generator : public ExpressionGenerator {
+ public:
+  VectorFltAVX512Generator() {
+    model_.mov_reg_reg = true;
+    model_.mov_reg_imm = true;
+    model_.mov_reg_mem = true;
+    model_.mov_mem_reg = true;
+    model_.op_reg_reg_reg = true;
+    model_.op_reg_reg_imm = true;
+    model_.op_reg_reg_mem = true;
+    model_.func_reg_reg = true;
+    model_.func_reg_imm = true;
+    model_.func_reg_mem = true;
+    model_.fm_reg_reg_reg = true;
+    model_.fm_reg_reg_imm = true;
+    model_.fm_reg_reg_mem = true;
+  }
+
+  string Name() override { return "VFltAVX512"; }
+
+  int VectorSize() override { return ZMMRegSize; }
+
+  void Reserve() override {
+    // Reserve ZMM registers.
+    index_->ReserveZMMRegisters(instructions_.NumRegs());
+  }
+
+  void Generate(Express::Op *instr, MacroAssembler *masm) override {
+    switch (instr->type) {
+      case Express::MOV:
+        if (IsLoadZero(instr) && masm->Enabled(ZEROIDIOM)) {
+          // Use XOR to zero register instead of loading constant from memory.
+          // The floating point versions of xor require AVX512DQ.
+          ZMMRegister dst = zmm(instr->dst);
+          if (CPU::Enabled(AVX512DQ)) {
+            switch (type_) {
+              case DT_FLOAT: __ vxorps(dst, dst, dst); break;
+              case DT_DOUBLE: __ vxorpd(dst, dst, dst); break;
+              default: UNSUPPORTED;
+            }
+          } else {
+            __ vpxord(dst, dst, dst);
+          }
+        } else {
+          GenerateZMMVectorMove(instr, masm);
+        }
+        break;
+      case Express::ADD:
+        GenerateZMMFltOp(instr,
+            &Assembler::vaddps, &Assembler::vaddpd,
+            &Assembler::vaddps, &Assembler::vaddpd,
+            masm);
+        break;
+      case Express::SUB:
+        GenerateZMMFltOp(instr,
+            &Assembler::vsubps, &Assembler::vsubpd,
+            &Assembler::vsubps, &Assembler::vsubpd,
+            masm);
+        break;
+      case Express::MUL:
+        GenerateZMMFltOp(instr,
+            &Assembler::vmulps, &Assembler::vmulpd,
+            &Assembler::vmulps, &Assembler::vmulpd,
+            masm);
+        break;
+      case Express::DIV:
+        GenerateZMMFltOp(instr,
+            &Assembler::vdivps, &Assembler::vdivpd,
+            &Assembler::vdivps, &Assembler::vdivpd,
+            masm);
+        break;
+      case Express::MIN:
+        GenerateZMMFltOp(instr,
+            &Assembler::vminps, &Assembler::vminpd,
+            &Assembler::vminps, &Assembler::vminpd,
+            masm);
+        break;
+      case Express::MAX:
+        GenerateZMMFltOp(instr,
+            &Assembler::vmaxps, &Assembler::vmaxpd,
+            &Assembler::vmaxps, &Assembler::vmaxpd,
+            masm);
+        break;
+      case Express::MULADD132:
+        GenerateZMMFltOp(instr,
+            &Assembler::vfmadd132ps, &Assembler::vfmadd132pd,
+            &Assembler::vfmadd132ps, &Assembler::vfmadd132pd,
+            masm, 2);
+        break;
+      case Express::MULADD213:
+        GenerateZMMFltOp(instr,
+            &Assembler::vfmadd213ps, &Assembler::vfmadd213pd,
+            &Assembler::vfmadd213ps, &Assembler::vfmadd213pd,
+            masm, 2);
+        break;
+      case Express::MULADD231:
+        GenerateZMMFltOp(instr,
+            &Assembler::vfmadd231ps, &Assembler::vfmadd231pd,
+            &Assembler::vfmadd231ps, &Assembler::vfmadd231pd,
+            masm, 2);
+        break;
+      case Express::MULSUB132:
+        GenerateZMMFltOp(instr,
+            &Assembler::vfmsub132ps, &Assembler::vfmsub132pd,
+            &Assembler::vfmsub132ps, &Assembler::vfmsub132pd,
+            masm, 2);
+        break;
+      case Express::MULSUB213:
+        GenerateZMMFltOp(instr,
+            &Assembler::vfmsub213ps, &Assembler::vfmsub213pd,
+            &Assembler::vfmsub213ps, &Assembler::vfmsub213pd,
+            masm, 2);
+        break;
+      case Express::MULSUB231:
+        GenerateZMMFltOp(instr,
+            &Assembler::vfmsub231ps, &Assembler::vfmsub231pd,
+            &Assembler::vfmsub231ps, &Assembler::vfmsub231pd,
+            masm, 2);
+        break;
+      case Express::CMPEQOQ:
+        GenerateCompare(instr, masm, CMP_EQ_OQ);
+        break;
+      case Express::CMPLTOQ:
+        GenerateCompare(instr, masm, CMP_LT_OQ);
+        break;
+      case Express::CMPGTOQ:
+        GenerateCompare(instr, masm, CMP_GT_OQ);
+        break;
+      case Express::CMPNGEUQ:
+        GenerateCompare(instr, masm, CMP_NGE_UQ);
+        break;
+      case Express::AND:
+        GenerateZMMFltOp(instr,
+            &Assembler::vpandd, &Assembler::vpandq,
+            &Assembler::vpandd, &Assembler::vpandq,
+            masm);
+        break;
+      case Express::OR:
+        GenerateZMMFltOp(instr,
+            &Assembler::vpord, &Assembler::vporq,
+            &Assembler::vpord, &Assembler::vporq,
+            masm);
+        break;
+      case Express::ANDNOT:
+        GenerateZMMFltOp(instr,
+            &Assembler::vpandnd, &Assembler::vpandnq,
+            &Assembler::vpandnd, &Assembler::vpandnq,
+            masm);
+        break;
+      case Express::SHR23:
+        GenerateShift(instr, masm, false, 23);
+        break;
+      case Express::SHL23:
+        GenerateShift(instr, masm, true, 23);
+        break;
+      case Express::FLOOR:
+        GenerateZMMFltOp(instr,
+            &Assembler::vrndscaleps, &Assembler::vrndscalepd,
+            &Assembler::vrndscaleps, &Assembler::vrndscalepd,
+            kRoundDown, masm);
+        break;
+      case Express::CVTFLTINT:
+        GenerateZMMFltOp(instr,
+            &Assembler::vcvttps2dq, &Assembler::vcvttpd2qq,
+            &Assembler::vcvttps2dq, &Assembler::vcvttpd2qq,
+            masm);
+        break;
+      case Express::CVTINTFLT:
+        GenerateZMMFltOp(instr,
+            &Assembler::vcvtdq2ps, &Assembler::vcvtqq2pd,
+            &Assembler::vcvtdq2ps, &Assembler::vcvtqq2pd,
+            masm);
+        break;
+      case Express::SUBINT:
+        GenerateZMMFltOp(instr,
+            &Assembler::vpsubd, &Assembler::vpsubq,
+            &Assembler::vpsubd, &Assembler::vpsubq,
+            masm);
+        break;
+      default:
+        UNSUPPORTED;
+    }
+  }
+
+  // Generate left/right shift.
+  void GenerateShift(Express::Op *instr, MacroAssembler *masm,
+                     bool left, int bits) {
+    // Make sure source is in a register.
+    CHECK(instr->dst != -1);
+    int src = instr->src;
+    if (instr->src == -1) {
+      GenerateZMMMoveMemToReg(zmm(instr->dst), addr(instr->args[0]), masm);
+      src = instr->dst;
+    }
+
+    switch (type_) {
+      case DT_FLOAT:
+        if (left) {
+          __ vpslld(zmm(instr->dst), zmm(src), bits);
+        } else {
+          __ vpsrld(zmm(instr->dst), zmm(src), bits);
+        }
+        break;
+      case DT_DOUBLE:
+        if (left) {
+          __ vpsllq(zmm(instr->dst), zmm(src), bits);
+        } else {
+          __ vpsrlq(zmm(instr->dst), zmm(src), bits);
+        }
+        break;
+      default: UNSUPPORTED;
+    }
+  }
+
+  // Generate compare. AVX-512 compares set bits in an opmask register, so
+  // the mask is expanded to all ones or all zeros in each element to get the
+  // same result as the AVX compare instructions.
+  void GenerateCompare(Express::Op *instr, MacroAssembler *masm, int8 code) {
+    CHECK(instr->dst != -1);
+    CHECK(instr->src != -1);
+    ZMMRegister dst = zmm(instr->dst);
+    ZMMRegister src = zmm(instr->src);
+    switch (type_) {
+      case DT_FLOAT:
+        if (instr->src2 != -1) {
+          __ vcmpps(k1, src, zmm(instr->src2), code);
+        } else {
+          __ vcmpps(k1, src, addr(instr->args[1]), code);
+        }
+        __ vpternlogd(dst, dst, dst, 0xFF, Mask(k1, zeroing));
+        break;
+      case DT_DOUBLE:
+        if (instr->src2 != -1) {
+          __ vcmppd(k1, src, zmm(instr->src2), code);
+        } else {
+          __ vcmppd(k1, src, addr(instr->args[1]), code);
+        }
+        __ vpternlogq(dst, dst, dst, 0xFF, Mask(k1, zeroing));
+        break;
+      default: UNSUPPORTED;
+    }
+  }
+};
+
+ExpressionGenerator *CreateVectorFltAVX512Generator() {
+  return new VectorFltAVX512Generator();
+}
+
+}  // namespace myelin
+}  // namespace sling
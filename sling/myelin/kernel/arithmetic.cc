@@ -35,6 +35,9 @@ namespace myelin {
 
 using namespace jit;
 
+// reduction.cc
+void RegisterReductionKernels(Library *library);
+
 // Mapping from flow variables to expression variables.
 typedef std::map<Flow::Variable *, Express::Var *> VarMap;
 
@@ -74,12 +77,34 @@ static bool IsCalculateOp(Flow::Operation *op) {
   return op->type == "Calculate" || OpType(op->type) != Express::INVALID;
 }
 
+// Check if operation is a vector-matrix multiplication that can be fused with
+// element-wise operations on its result.
+static bool IsMatMulOp(Flow::Operation *op) {
+  return op->type == "MatMul" ||
+         op->type == "MatMulAdd" ||
+         op->type == "MatMulRelu" ||
+         op->type == "MatMulAddRelu" ||
+         op->type == "MatMulExpr";
+}
+
 // Initialize expression for flow operation.
 static void InitExpression(Flow::Operation *op, Express *expr, bool expand) {
-  if (op->type == "Calculate") {
+  if (op->type == "Calculate" || op->type == "MatMulExpr") {
     // Build expression from expression recipe attribute on op.
     const string &recipe = op->GetAttr("expr");
     if (!recipe.empty()) expr->Parse(recipe, expand);
+  } else if (IsMatMulOp(op)) {
+    // The product of the matrix multiplication is in register !0. The bias
+    // is the third input for the combined matmul ops.
+    if (op->type == "MatMul") {
+      expr->Parse("@0=Id(!0)", expand);
+    } else if (op->type == "MatMulAdd") {
+      expr->Parse("@0=Add(!0,%2)", expand);
+    } else if (op->type == "MatMulRelu") {
+      expr->Parse("@0=Relu(!0)", expand);
+    } else if (op->type == "MatMulAddRelu") {
+      expr->Parse("@0=Relu(Add(!0,%2))", expand);
+    }
   } else {
     // Add op with inputs and output.
     CHECK_EQ(op->outdegree(), 1);
@@ -124,7 +149,7 @@ static void InitExpression(Flow::Operation *op, Express *expr, bool expand) {
 
 // Initialize expression for step.
 void InitExpression(const Step *step, Express *expr, bool expand) {
-  if (step->type() == "Calculate") {
+  if (step->type() == "Calculate" || step->type() == "MatMulExpr") {
     // Build expression from expression recipe attribute on op.
     const string &recipe = step->GetAttr("expr");
     if (!recipe.empty()) expr->Parse(recipe, expand);
@@ -210,6 +235,153 @@ struct Expression {
   ExpressionGenerator *generator;
 };
 
+// Index generator for expressions computed on the result of a vector-matrix
+// multiplication. The product is in register !0 and the other inputs and the
+// outputs are addressed by the column offset of the current block. Inputs 0
+// and 1 are the operands of the multiplication and are not accessed by the
+// expression.
+class MatMulExprIndexGenerator : public IndexGenerator {
+ public:
+  MatMulExprIndexGenerator(MacroAssembler *masm) : IndexGenerator(masm) {}
+
+  // Add input or output tensor. The tensor is null for the operands of the
+  // multiplication.
+  void AddInput(Tensor *tensor) { input_.emplace_back(tensor); }
+  void AddOutput(Tensor *tensor) { output_.emplace_back(tensor); }
+
+  // Initialize index generator for vector size.
+  void Initialize(size_t vecsize) override { vecsize_ = vecsize; }
+
+  // Allocate registers. Return false in case of register overflow.
+  bool AllocateRegisters() override {
+    // Allocate temp vars.
+    if (!IndexGenerator::AllocateRegisters()) return false;
+
+    // Allocate base registers for non-instance variables.
+    for (auto &loc : input_) {
+      if (!AllocateLocatorRegisters(&loc)) return false;
+    }
+    for (auto &loc : output_) {
+      if (!AllocateLocatorRegisters(&loc)) return false;
+    }
+    return true;
+  }
+
+  // Load base addresses for non-instance variables.
+  void LoadAddresses() {
+    MacroAssembler *masm = masm_;
+    for (auto &loc : input_) {
+      if (loc.base.is_valid()) __ LoadTensorAddress(loc.base, loc.var);
+    }
+    for (auto &loc : output_) {
+      if (loc.base.is_valid()) __ LoadTensorAddress(loc.base, loc.var);
+    }
+  }
+
+  // Set offset register and displacement for the current block.
+  void SetBlock(Register offset, int disp) {
+    offset_ = offset;
+    disp_ = disp;
+  }
+
+  // Return operand for accessing memory variable.
+  Operand addr(Express::Var *var) override {
+    int repeat = vecsize_ / sizeof(float);
+    if (var->type == Express::NUMBER) {
+      // System-defined constant.
+      float number = Express::NumericFlt32(var->id);
+      return masm_->GetConstant(number, repeat)->address();
+    }
+
+    Locator *loc = GetLocator(var);
+    CHECK(loc->var != nullptr);
+    if (loc->var->elements() == 1) {
+      // Scalar constant in code block, vectorized.
+      DCHECK(loc->var->IsConstant());
+      return masm_->GetData(loc->var->data(), sizeof(float), repeat)->address();
+    } else if (loc->base.is_valid()) {
+      // Index block using base register and offset.
+      return Operand(loc->base, offset_, times_1, disp_);
+    } else {
+      // Index block using offset in instance.
+      return Operand(masm_->instance(), offset_, times_1,
+                     loc->var->offset() + disp_);
+    }
+  }
+
+  // Return pointer to constant data.
+  const void *data(Express::Var *var) override {
+    DCHECK_EQ(var->type, Express::CONST);
+    return GetLocator(var)->var->data();
+  }
+
+ private:
+  // Locator for generating address operands for variables.
+  struct Locator {
+    Locator(Tensor *var) : var(var) {}
+    Tensor *var;                        // variable to address
+    jit::Register base = jit::no_reg;   // base address register
+  };
+
+  // Get locator for variable.
+  Locator *GetLocator(Express::Var *var) {
+    return var->type == Express::OUTPUT ? &output_[var->id] : &input_[var->id];
+  }
+
+  // Allocate base register for locator if needed.
+  bool AllocateLocatorRegisters(Locator *loc) {
+    if (loc->var == nullptr || loc->var->elements() == 1) return true;
+    if (loc->var->offset() == -1 || loc->var->ref()) {
+      loc->base = masm_->rr().try_alloc();
+      if (!loc->base.is_valid()) return false;
+    }
+    return true;
+  }
+
+  // Vector size.
+  size_t vecsize_ = 1;
+
+  // Offset register and displacement for current block.
+  Register offset_ = no_reg;
+  int disp_ = 0;
+
+  // Input and output locators.
+  std::vector<Locator> input_;
+  std::vector<Locator> output_;
+};
+
+// Number of SIMD registers used by the vector-matrix multiplication in
+// MatMulExpr kernels in addition to the registers for the expression, i.e.
+// one accumulator, the broadcast input element, and a register for the partial
+// products if FMA is not supported.
+static const int kMatMulExprRegs = 3;
+
+// Number of general registers used for the vector-matrix multiplication in
+// MatMulExpr kernels, and the maximum number of base registers for expression
+// variables.
+static const int kMatMulExprGeneralRegs = 5;
+static const int kMatMulExprMaxBases = 8;
+
+// Check that an expression for a MatMulExpr op can be computed in the SIMD
+// registers left over by the vector-matrix multiplication.
+static bool MatMulExprFits(const string &recipe, int cols) {
+  Express expr;
+  expr.Parse(recipe, true);
+  ExpressionGenerator *generator =
+      ExpressionGenerator::Select(expr, DT_FLOAT, cols);
+  if (generator == nullptr) return false;
+
+  // Perform dry-run register allocation.
+  Options options;
+  MacroAssembler masm(nullptr, 0, options);
+  for (int i = 0; i < kMatMulExprRegs; ++i) masm.mm().alloc();
+  MatMulExprIndexGenerator index(&masm);
+  generator->Initalize(expr, DT_FLOAT, 0, &index);
+  bool fits = index.AllocateRegisters();
+  delete generator;
+  return fits;
+}
+
 // Convert division with constant c to multiplication with constant 1/c to
 // take advantage of mul being much faster than div.
 class DivToMulTransformer : public Transformer {
@@ -323,7 +495,8 @@ class ExpressionTransformer : public Transformer {
     return true;
   }
 
-  string FuseExpressions(Flow::Operation *first, Flow::Operation *second) {
+  static string FuseExpressions(Flow::Operation *first,
+                                Flow::Operation *second) {
     // Build first expression.
     Express expr1;
     InitExpression(first, &expr1, false);
@@ -406,6 +579,128 @@ class ExpressionTransformer : public Transformer {
   }
 };
 
+// Fuse vector-matrix multiplications with the element-wise expressions
+// computed on their results into MatMulExpr ops. The expression is computed on
+// the accumulated sums in registers before the result is stored, so the
+// product does not need to be written to and read back from instance memory.
+class MatMulExprTransformer : public Transformer {
+ public:
+  bool Transform(Flow *flow) override {
+    // MatMulExpr ops are only supported on CPUs with AVX.
+    if (!CPU::Enabled(AVX)) return false;
+
+    int num_combines = 0;
+    while (FuseOnce(flow)) num_combines++;
+    VLOG(3) << num_combines << " ops fused into matmuls";
+
+    return num_combines > 0;
+  }
+
+  // Try to fuse a matmul with a consumer of its output.
+  bool FuseOnce(Flow *flow) {
+    for (Flow::Operation *op : flow->ops()) {
+      if (!IsMatMulOp(op) || !Supported(op)) continue;
+      for (Flow::Variable *output : op->outputs) {
+        // The product of a plain matmul must only be used by the consumer.
+        if (op->type != "MatMulExpr") {
+          if (output->consumers.size() != 1 || output->out) continue;
+        }
+        for (Flow::Operation *consumer : output->consumers) {
+          if (Combine(flow, op, consumer)) return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  // Check that matmul is supported by the MatMulExpr kernel.
+  static bool Supported(Flow::Operation *op) {
+    if (op->indegree() < 2 || op->outdegree() < 1) return false;
+    if (op->GetAttr("transpose_a", false)) return false;
+    if (op->GetAttr("transpose_b", false)) return false;
+    if (op->GetAttr("strict", false)) return false;
+
+    // Only vector-matrix multiplication where the columns are a multiple of
+    // the vector size.
+    Flow::Variable *x = op->inputs[0];
+    Flow::Variable *W = op->inputs[1];
+    if (x->type != DT_FLOAT) return false;
+    if (W->type != DT_FLOAT && W->type != DT_HALF && W->type != DT_BFLOAT16) {
+      return false;
+    }
+    if (x->rank() != 2 || W->rank() != 2) return false;
+    if (!x->shape.defined() || !W->shape.defined()) return false;
+    if (x->dim(0) != 1 || x->dim(1) != W->dim(0)) return false;
+    if (W->dim(1) % 8 != 0) return false;
+    if (op->type == "MatMulAdd" || op->type == "MatMulAddRelu") {
+      if (op->indegree() != 3 || !Compatible(op->inputs[2], W->dim(1))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Check that variable can be an input or output of the expression.
+  static bool Compatible(Flow::Variable *var, int cols) {
+    if (var->type != DT_FLOAT || !var->shape.defined()) return false;
+    if (var->elements() == 1) return var->constant();
+    return var->elements() == cols;
+  }
+
+  // Check if a base register is needed for addressing variable.
+  static bool NeedsBase(Flow::Variable *var) {
+    return var->ref || (var->constant() && var->elements() > 1);
+  }
+
+  bool Combine(Flow *flow, Flow::Operation *first, Flow::Operation *second) {
+    // Check that second op is an element-wise operation on the product.
+    if (!IsCalculateOp(second)) return false;
+    if (second->GetAttr("strict", false)) return false;
+    if (second->task != first->task) return false;
+    if (second->indegree() < 1 || second->outdegree() < 1) return false;
+
+    // Check the inputs and outputs of the second op.
+    Flow::Variable *x = first->inputs[0];
+    Flow::Variable *W = first->inputs[1];
+    const Shape &shape = first->outputs[0]->shape;
+    int cols = W->dim(1);
+    int bases = 0;
+    for (int i = 2; i < first->indegree(); ++i) {
+      if (NeedsBase(first->inputs[i])) bases++;
+    }
+    for (auto *input : second->inputs) {
+      if (input == x || input == W) return false;
+      if (first->IsInput(input) || first->IsOutput(input)) continue;
+      if (!Compatible(input, cols)) return false;
+      if (NeedsBase(input)) bases++;
+    }
+    for (auto *output : first->outputs) {
+      if (output->ref) bases++;
+    }
+    for (auto *output : second->outputs) {
+      if (output->type != DT_FLOAT) return false;
+      if (output->shape != shape) return false;
+      if (output->ref) bases++;
+    }
+    if (bases > kMatMulExprMaxBases) return false;
+
+    // Check for indirect dependencies between ops.
+    for (auto *v : second->inputs) {
+      if (v->producer != first && v->DependsOn(first)) return false;
+    }
+
+    // Compute fused expression and check that it fits in the registers.
+    string fused_recipe = ExpressionTransformer::FuseExpressions(first, second);
+    if (!MatMulExprFits(fused_recipe, cols)) return false;
+
+    // Fuse the two ops and set expression recipe for the fused op.
+    Flow::Operation *fused = flow->Fuse(first, second, "MatMulExpr", true);
+    fused->SetAttr("expr", fused_recipe);
+
+    return true;
+  }
+};
+
 // Kernel for computing arithmetic expressions.
 class Calculate : public Kernel {
  public:
@@ -506,6 +801,265 @@ class Calculate : public Kernel {
   int arity_;         // number of inputs
 };
 
+// Kernel for vector-matrix multiplication with an element-wise expression
+// computed on the product for CPUs with AVX. The product is accumulated in
+// registers for each block of columns and the expression is computed on the
+// accumulated sums before the results are stored. ZMM registers are used on
+// CPUs with AVX-512 if the number of columns is a multiple of 16. The matrix
+// can be stored as half-precision or bfloat16 floats, which are converted to
+// single precision when loaded.
+class AVXFltVecMatMulExpr : public Kernel {
+ public:
+  // Maximum number of loop unrolls.
+  static const int kMaxUnrolls = 8;
+
+  string Name() override { return "AVXFltVecMatMulExpr"; }
+  string Operation() override { return "MatMulExpr"; }
+
+  bool Supports(Step *step) override {
+    // Requires CPU with AVX support.
+    if (!CPU::Enabled(AVX)) return false;
+
+    // Check matrix multiplication operands.
+    if (step->indegree() < 2 || step->outdegree() < 1) return false;
+    Tensor *x = step->input(0);
+    Tensor *W = step->input(1);
+    Tensor *y = step->output(0);
+    if (x->rank() != 2 || x->type() != DT_FLOAT) return false;
+    if (W->rank() != 2) return false;
+    if (y->rank() != 2 || y->type() != DT_FLOAT) return false;
+    if (x->dim(0) != 1 || x->dim(1) != W->dim(0)) return false;
+    if (y->dim(0) != 1 || y->dim(1) != W->dim(1)) return false;
+    if (!W->SupportsOrder(ROW_MAJOR)) return false;
+    if (!MacroAssembler::SupportsFloatType(W->type(), 256)) return false;
+
+    // Transpose and strict math not supported.
+    if (step->GetAttr("transpose_a", false)) return false;
+    if (step->GetAttr("transpose_b", false)) return false;
+    if (step->GetAttr("strict", false)) return false;
+
+    // Columns must be a multiple of the vector size.
+    int cols = W->dim(1);
+    if (cols % 8 != 0) return false;
+
+    // Expression inputs must be scalar constants or have one element per
+    // column, and all outputs must have the same shape.
+    for (int i = 2; i < step->indegree(); ++i) {
+      Tensor *input = step->input(i);
+      if (input->type() != DT_FLOAT) return false;
+      if (input->elements() == 1) {
+        if (!input->IsConstant()) return false;
+      } else if (input->elements() != cols) {
+        return false;
+      }
+    }
+    for (auto *output : step->outputs()) {
+      if (output->type() != DT_FLOAT) return false;
+      if (output->shape() != y->shape()) return false;
+    }
+
+    return true;
+  }
+
+  void Adjust(Step *step) override {
+    // Align to one SIMD register of the expression generator.
+    Express expr;
+    InitExpression(step, &expr, true);
+    ExpressionGenerator *generator =
+        ExpressionGenerator::Select(expr, DT_FLOAT, step->input(1)->dim(1));
+    int byte_alignment = generator->VectorSize();
+    delete generator;
+    Tensor *x = step->input(0);
+    Tensor *W = step->input(1);
+    x->SetMiniumAlignment(byte_alignment);
+    W->SetMiniumAlignment(byte_alignment);
+
+    // Rows must be aligned to vector boundaries to support aligned loads.
+    W->MinAlign({byte_alignment / static_cast<int>(sizeof(float)), 1});
+    W->SetRequiredOrder(ROW_MAJOR);
+
+    // Expression inputs and outputs are accessed in vector blocks.
+    int bases = 0;
+    for (int i = 2; i < step->indegree(); ++i) {
+      Tensor *input = step->input(i);
+      if (input->elements() == 1) continue;
+      input->SetMiniumAlignment(byte_alignment);
+      input->RequireDense();
+      input->RequireStandardOrder();
+      if (input->IsConstant() || input->ref()) bases++;
+    }
+    for (auto *output : step->outputs()) {
+      output->SetMiniumAlignment(byte_alignment);
+      output->RequireDense();
+      output->RequireStandardOrder();
+      if (output->ref()) bases++;
+    }
+
+    // Reserve registers.
+    step->SetRegisterUsage(kMatMulExprGeneralRegs + bases);
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    // Compile expression for computing the outputs from the product.
+    int cols = step->input(1)->dim(1);
+    Express expr;
+    InitExpression(step, &expr, true);
+    MatMulExprIndexGenerator index(masm);
+    for (int i = 0; i < step->indegree(); ++i) {
+      index.AddInput(i < 2 ? nullptr : step->input(i));
+    }
+    for (auto *output : step->outputs()) index.AddOutput(output);
+    ExpressionGenerator *generator =
+        ExpressionGenerator::Select(expr, DT_FLOAT, cols);
+    CHECK(generator != nullptr);
+    generator->Initalize(expr, DT_FLOAT, 0, &index);
+
+    // Generate code using the register size of the expression generator.
+    switch (generator->VectorSize()) {
+      case 32:
+        GenerateMatMul<YMMRegister>(step, masm, generator, &index);
+        break;
+      case 64:
+        GenerateMatMul<ZMMRegister>(step, masm, generator, &index);
+        break;
+      default:
+        LOG(FATAL) << "Unsupported vector size for " << generator->Name();
+    }
+    delete generator;
+  }
+
+  // Generate vector-matrix multiplication for SIMD register type.
+  template<class Reg> void GenerateMatMul(Step *step,
+                                          MacroAssembler *masm,
+                                          ExpressionGenerator *generator,
+                                          MatMulExprIndexGenerator *index) {
+    Registers &rr = masm->rr();
+    SIMDRegisters &mm = masm->mm();
+    Label l1, l2;
+
+    // Get input tensors.
+    Tensor *x = step->input(0);
+    Tensor *W = step->input(1);
+    bool fma = masm->Enabled(FMA3);
+
+    // Get matrix dimensions.
+    int vecsize = generator->VectorSize();
+    int veclen = vecsize / sizeof(float);
+    int rows = W->dim(0);
+    int cols = W->dim(1);
+
+    // Get matrix element type and the size of one vector block in the matrix.
+    Type wtype = W->type();
+    int wblock = veclen * W->element_size();
+
+    // Allocate general registers.
+    Register rowofs = rr.alloc();
+    Register colofs = rr.alloc();
+    Register m = rr.alloc();
+    Register matrix = rr.alloc();
+    Register input = rr.alloc();
+
+    // Allocate SIMD registers for the multiplication and the expression.
+    Reg elem = Reg::from_code(mm.alloc());
+    bool convert = wtype != DT_FLOAT;
+    Reg acc = Reg::from_code(fma && !convert ? -1 : mm.alloc());
+    CHECK(index->AllocateRegisters()) << "Register overflow";
+    Reg product = Reg::from_code(index->ymm(0).code());
+
+    // Use the remaining SIMD registers for unrolling.
+    std::vector<Reg> sum;
+    while (sum.size() < kMaxUnrolls) {
+      int r = mm.try_alloc();
+      if (r == -1) break;
+      sum.push_back(Reg::from_code(r));
+    }
+    int unrolls = 0;
+    for (int i = 1; i <= static_cast<int>(sum.size()); ++i) {
+      if (cols % (i * veclen) == 0) unrolls = i;
+    }
+    CHECK_GT(unrolls, 0) << "Register overflow";
+    step->set_variant(generator->Name() + "U" + std::to_string(unrolls));
+
+    // Load tensor locations.
+    __ LoadTensorAddress(input, x);
+    __ LoadTensorAddress(matrix, W);
+    index->LoadAddresses();
+    generator->GenerateInit(masm);
+
+    // Outer loop over matrix column blocks.
+    __ xorq(colofs, colofs);
+    __ LoopStart(&l1);
+    for (int i = 0; i < unrolls; ++i) {
+      Zero(sum[i], masm);
+    }
+    __ movq(m, matrix);
+    __ xorq(rowofs, rowofs);
+
+    // Inner loop over rows.
+    __ LoopStart(&l2);
+
+    // Load x[row].
+    __ vbroadcastss(elem, Operand(input, rowofs));
+
+    // Multiply x[row] with W[row,col:col+n] and add to sum.
+    for (int i = 0; i < unrolls; ++i) {
+      if (convert) {
+        __ LoadFloats(acc, Operand(m, i * wblock), wtype);
+        if (fma) {
+          __ vfmadd231ps(sum[i], elem, acc);
+        } else {
+          __ vmulps(acc, elem, acc);
+          __ vaddps(sum[i], sum[i], acc);
+        }
+      } else if (fma) {
+        __ vfmadd231ps(sum[i], elem, Operand(m, i * vecsize));
+      } else {
+        __ vmulps(acc, elem, Operand(m, i * vecsize));
+        __ vaddps(sum[i], sum[i], acc);
+      }
+    }
+
+    // Next row.
+    if (rows > 1) {
+      __ addq(m, Immediate(W->stride(0)));
+      __ addq(rowofs, Immediate(sizeof(float)));
+      __ cmpq(rowofs, Immediate(rows * sizeof(float)));
+      __ j(less, &l2);
+    }
+
+    // Compute expression on the sums and save the results. The sum is moved
+    // to the register for the product in the expression.
+    for (int i = 0; i < unrolls; ++i) {
+      __ vmovaps(product, sum[i]);
+      index->SetBlock(colofs, i * vecsize);
+      generator->GenerateBody(masm);
+    }
+
+    // Next matrix column block.
+    if (cols > unrolls * veclen) {
+      __ addq(matrix, Immediate(unrolls * wblock));
+      __ addq(colofs, Immediate(unrolls * vecsize));
+      __ cmpq(colofs, Immediate(cols * sizeof(float)));
+      __ j(less, &l1);
+    }
+  }
+
+  // Clear SIMD register.
+  static void Zero(YMMRegister reg, MacroAssembler *masm) {
+    __ vxorps(reg, reg, reg);
+  }
+  static void Zero(ZMMRegister reg, MacroAssembler *masm) {
+    __ vpxord(reg, reg, reg);
+  }
+
+  int64 Complexity(const Step *step) override {
+    Express expr;
+    InitExpression(step, &expr, true);
+    return step->input(1)->elements() * 2 +
+           step->output(0)->elements() * expr.Complexity();
+  }
+};
+
 // Register arithmetic library.
 void RegisterArithmeticLibrary(Library *library) {
   library->Register(new Calculate("AddExpr", "Add", 2));
@@ -529,11 +1083,16 @@ void RegisterArithmeticLibrary(Library *library) {
   library->Register(new Calculate("LogSigmoidExpr", "LogSigmoid", 1));
   library->Register(new Calculate("ReciprocalExpr", "Reciprocal", 1));
   library->Register(new Calculate("SquareExpr", "Square", 1));
+
+  library->Register(new AVXFltVecMatMulExpr());
+
+  RegisterReductionKernels(library);
 }
 
 // Register arithmetic transforms.
 void RegisterArithmeticTransforms(Library *library) {
   library->RegisterTransformer(new ExpressionTransformer());
+  library->RegisterTransformer(new MatMulExprTransformer());
   library->RegisterTransformer(new DivToMulTransformer());
 }
 
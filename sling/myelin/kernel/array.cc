@@ -425,48 +425,49 @@ class GeneralConcat : public Kernel {
 
     // Copy input tensors to output.
     Tensor *output = step->output(0);
+    int offset = 0;
     for (int i = 0; i < n; ++i) {
       Tensor *input = step->input(i);
-      int size = axis > 0 ? input->stride(axis - 1) : input->size();
+      int size = input->shape().inner(axis) * input->element_size();
       if (size > 0 && size < 16) {
         int disp = 0;
         int left = size;
         while (left >= 8) {
           __ movq(acc, Operand(in[i], disp));
-          __ movq(Operand(out, disp), acc);
+          __ movq(Operand(out, offset + disp), acc);
           disp += 8;
           left -= 8;
         }
         while (left >= 4) {
           __ movl(acc, Operand(in[i], disp));
-          __ movl(Operand(out, disp), acc);
+          __ movl(Operand(out, offset + disp), acc);
           disp += 4;
           left -= 4;
         }
         while (left >= 2) {
           __ movw(acc, Operand(in[i], disp));
-          __ movw(Operand(out, disp), acc);
+          __ movw(Operand(out, offset + disp), acc);
           disp += 2;
           left -= 2;
         }
         while (left >= 1) {
           __ movb(acc, Operand(in[i], disp));
-          __ movb(Operand(out, disp), acc);
+          __ movb(Operand(out, offset + disp), acc);
           disp += 1;
           left -= 1;
         }
       } else {
         __ movq(src, in[i]);
-        __ movq(dst, out);
+        __ leaq(dst, Operand(out, offset));
         __ movq(cnt, Immediate(size));
         __ repmovsb();
       }
-      __ addq(in[i], Immediate(size));
+      offset += size;
+      __ addq(in[i], Immediate(axis > 0 ? input->stride(axis - 1) : size));
     }
 
     // Next chunk.
-    int size = axis > 0 ? output->stride(axis - 1) : output->size();
-    __ addq(out, Immediate(size));
+    __ addq(out, Immediate(axis > 0 ? output->stride(axis - 1) : offset));
     __ incq(idx);
     __ cmpq(idx, Immediate(prefix));
     __ j(less, &l);
@@ -0,0 +1,770 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/myelin/kernel/avx.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "sling/myelin/compute.h"
+#include "sling/myelin/macro-assembler.h"
+
+#define __ masm_->
+
+namespace sling {
+namespace myelin {
+
+using namespace jit;
+
+// Blocked float matrix-matrix multiplication, C = A * B, for CPUs with AVX-512
+// or AVX2 and FMA3. The matrix multiplication is computed by a microkernel
+// that keeps an MR x NR tile of C in registers, where NR is two vector
+// registers wide. The operands are split into cache blocks and packed into
+// panels in a scratch area of the instance before they are multiplied:
+//
+//   for each block of KC rows in B:
+//     pack B[KC,N] into KC x NR panels (kept in L3 cache)
+//     for each block of MC rows in A:
+//       pack A[MC,KC] into MR x KC panels (kept in L2 cache)
+//       for each NR panel of B (kept in L1 cache):
+//         for each MR panel of A:
+//           C[MR,NR] += A panel * B panel
+//
+// The block sizes are computed from the cache sizes of the CPU. B can be
+// stored as half-precision or bfloat16 floats, which are converted to single
+// precision when B is packed. A constant float B, e.g. a weight matrix, is
+// packed once at compile time into a data block in the generated code, so
+// only A is packed when the kernel runs.
+class AVXFltGEMM : public Kernel {
+ public:
+  // Maximum number of rows in microkernel tile.
+  static const int kMaxTileRows = 6;
+
+  // Number of vector registers per row in microkernel tile.
+  static const int kTileVectors = 2;
+
+  // Number of general-purpose registers used by the kernel.
+  static const int kRegisters = 12;
+
+  string Name() override { return "AVXFltGEMM"; }
+  string Operation() override { return "MatMul"; }
+
+  bool Supports(Step *step) override {
+    // Requires CPU with AVX-512 or AVX2 and FMA3 support.
+    bool avx512 = CPU::Enabled(AVX512F);
+    bool avx2 = CPU::Enabled(AVX2) && CPU::Enabled(FMA3);
+    if (!avx512 && !avx2) return false;
+
+    // Two float 2D tensor inputs and one 2D tensor output.
+    if (step->indegree() != 2) return false;
+    if (step->outdegree() != 1) return false;
+    Tensor *A = step->input(0);
+    Tensor *B = step->input(1);
+    Tensor *C = step->output(0);
+    if (A->rank() != 2 || A->type() != DT_FLOAT) return false;
+    if (B->rank() != 2) return false;
+    if (C->rank() != 2 || C->type() != DT_FLOAT) return false;
+
+    // Check shape.
+    bool transpose_a = step->GetAttr("transpose_a", false);
+    bool transpose_b = step->GetAttr("transpose_b", false);
+    Shape a = A->shape();
+    Shape b = B->shape();
+    Shape c = C->shape();
+    if (transpose_a) a.transpose();
+    if (transpose_b) b.transpose();
+
+    if (a.dim(0) != c.dim(0)) return false;
+    if (a.dim(1) != b.dim(0)) return false;
+    if (b.dim(1) != c.dim(1)) return false;
+
+    // Vector-matrix multiplications are handled by other kernels.
+    if (c.dim(0) < 2) return false;
+
+    // The rows of B and C must be stored consecutively. A is packed element by
+    // element so any order is supported.
+    if (!B->SupportsOrder(transpose_b ? COLUMN_MAJOR : ROW_MAJOR)) return false;
+    if (!C->SupportsOrder(ROW_MAJOR)) return false;
+
+    // B with 16-bit floats must be row-major with whole ymm blocks in each row.
+    if (B->type() != DT_FLOAT) {
+      int bits = avx512 ? 512 : 256;
+      if (!MacroAssembler::SupportsFloatType(B->type(), bits)) return false;
+      if (transpose_b || c.dim(1) % 8 != 0) return false;
+    }
+
+    return true;
+  }
+
+  void Adjust(Step *step) override {
+    Tensor *B = step->input(1);
+    Tensor *C = step->output(0);
+    bool transpose_b = step->GetAttr("transpose_b", false);
+
+    // Set order requirements.
+    B->SetRequiredOrder(transpose_b ? COLUMN_MAJOR : ROW_MAJOR);
+    C->SetRequiredOrder(ROW_MAJOR);
+
+    // Reserve scratch space for packed panels.
+    Blocking blocking(step);
+    size_t scratch = blocking.a_size;
+    if (!blocking.packed) scratch += blocking.b_size;
+    step->SetScratchSize(scratch);
+    step->SetRegisterUsage(kRegisters);
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    Generator gen(step, masm);
+    gen.Generate();
+    step->set_variant(gen.Variant());
+  }
+
+  int64 Complexity(const Step *step) override {
+    Blocking blocking(step);
+    return 2LL * blocking.m * blocking.n * blocking.k;
+  }
+
+ private:
+  // Blocking parameters for matrix multiplication.
+  struct Blocking {
+    Blocking(const Step *step) {
+      // Get matrix dimensions.
+      bool transpose_a = step->GetAttr("transpose_a", false);
+      m = step->input(0)->dim(transpose_a ? 1 : 0);
+      k = step->input(0)->dim(transpose_a ? 0 : 1);
+      n = step->output(0)->dim(1);
+
+      // Determine microkernel tile size.
+      vl = CPU::Enabled(AVX512F) ? 16 : 8;
+      nr = kTileVectors * vl;
+      mr = std::min(kMaxTileRows, m);
+
+      // A KC x NR panel of B should fill half the L1 cache.
+      kc = CPU::L1CacheSize() / 2 / (nr * sizeof(float));
+      kc = std::max(kc & ~3, 16);
+      if (k <= kc) kc = k;
+
+      // An MC x KC block of A should fill half the L2 cache.
+      mc = CPU::L2CacheSize() / 2 / (kc * sizeof(float));
+      mc = std::max(mc / mr * mr, mr);
+      if (m <= mc) mc = m;
+
+      // Compute the size of the packed panels.
+      int align = CPU::CacheLineSize();
+      int mpad = (mc + mr - 1) / mr * mr;
+      npad = (n + nr - 1) / nr * nr;
+      a_size = (mpad * kc * sizeof(float) + align - 1) / align * align;
+      b_size = npad * kc * sizeof(float);
+
+      // Constant float B is packed at compile time.
+      const Tensor *B = step->input(1);
+      packed = B->IsConstant() && B->type() == DT_FLOAT;
+    }
+
+    int m, n, k;     // matrix dimensions
+    int npad;        // number of columns in B padded to whole panels
+    int vl;          // number of floats per vector register
+    int mr, nr;      // microkernel tile size
+    int mc, kc;      // cache block sizes
+    size_t a_size;   // size of packed A panels
+    size_t b_size;   // size of packed B panels
+    bool packed;     // B is packed at compile time
+  };
+
+  // Code generator for matrix multiplication.
+  class Generator {
+   public:
+    Generator(Step *step, MacroAssembler *masm)
+        : step_(step), masm_(masm), bl_(step) {
+      A_ = step->input(0);
+      B_ = step->input(1);
+      C_ = step->output(0);
+      scratch_ = step->scratch();
+      bool transpose_a = step->GetAttr("transpose_a", false);
+      bool transpose_b = step->GetAttr("transpose_b", false);
+      a_row_stride_ = A_->stride(transpose_a ? 1 : 0);
+      a_col_stride_ = A_->stride(transpose_a ? 0 : 1);
+      b_row_stride_ = B_->stride(transpose_b ? 1 : 0);
+      c_row_stride_ = C_->stride(0);
+      avx512_ = bl_.vl == 16;
+      vecsize_ = bl_.vl * sizeof(float);
+      b_type_ = B_->type();
+      b_element_size_ = B_->element_size();
+    }
+
+    // Kernel variant with instruction set and blocking parameters.
+    string Variant() const {
+      return string(avx512_ ? "AVX512" : "AVX2") +
+             "T" + std::to_string(bl_.mr) + "x" + std::to_string(bl_.nr) +
+             "M" + std::to_string(bl_.mc) + "K" + std::to_string(bl_.kc) +
+             (bl_.packed ? "P" : "");
+    }
+
+    void Generate() {
+      Registers &rr = masm_->rr();
+      SIMDRegisters &mm = masm_->mm();
+
+      // Allocate registers.
+      a_ = rr.alloc();
+      b_ = rr.alloc();
+      pc_ = rr.alloc();
+      ic_ = rr.alloc();
+      ablk_ = rr.alloc();
+      cblk_ = rr.alloc();
+      ap_ = rr.alloc();
+      bp_ = rr.alloc();
+      jr_ = rr.alloc();
+      ir_ = rr.alloc();
+      cp_ = rr.alloc();
+      k_ = rr.alloc();
+      for (int i = 0; i < kMaxTileRows * kTileVectors; ++i) {
+        acc_[i] = mm.alloc();
+      }
+      for (int i = 0; i < kTileVectors; ++i) elem_[i] = mm.alloc();
+      bcast_ = mm.alloc();
+
+      // Clear C if the result is accumulated over multiple blocks.
+      int kblocks = bl_.k / bl_.kc;
+      int krest = bl_.k % bl_.kc;
+      bool accumulate = bl_.k > bl_.kc;
+      if (accumulate) GenerateClear();
+
+      // Loop over blocks of rows in B. For B packed at compile time, the
+      // block pointer moves through the packed panels instead of B.
+      int b_block_stride = b_row_stride_;
+      __ LoadTensorAddress(a_, A_);
+      if (bl_.packed) {
+        __ leaq(b_, PackConstantB()->address());
+        b_block_stride = bl_.npad * sizeof(float);
+      } else {
+        __ LoadTensorAddress(b_, B_);
+      }
+      if (kblocks > 0) {
+        Label l;
+        if (kblocks > 1) {
+          __ movq(pc_, Immediate(kblocks));
+          __ bind(&l);
+        }
+        GenerateBlock(bl_.kc, accumulate);
+        if (kblocks > 1 || krest > 0) {
+          __ addq(a_, Immediate(bl_.kc * a_col_stride_));
+          __ addq(b_, Immediate(bl_.kc * b_block_stride));
+        }
+        if (kblocks > 1) {
+          __ decq(pc_);
+          __ j(not_zero, &l);
+        }
+      }
+      if (krest > 0) GenerateBlock(krest, accumulate);
+    }
+
+   private:
+    // Clear output matrix.
+    void GenerateClear() {
+      int size = C_->size();
+      int vecs = size / vecsize_;
+      __ LoadTensorAddress(cp_, C_);
+      Zero(bcast_);
+      if (vecs > 0) {
+        Label l;
+        __ movq(k_, Immediate(vecs));
+        __ bind(&l);
+        Store(Operand(cp_), bcast_);
+        __ addq(cp_, Immediate(vecsize_));
+        __ decq(k_);
+        __ j(not_zero, &l);
+      }
+      for (int i = 0; i < size % vecsize_; i += sizeof(float)) {
+        __ vmovss(Operand(cp_, i), xmm(bcast_));
+      }
+    }
+
+    // Pack constant B into panels at compile time. The panels for each block
+    // of KC rows are stored consecutively in a static data block with the
+    // same layout as the panels packed by GeneratePackB().
+    StaticData *PackConstantB() {
+      StaticData *data = masm_->CreateDataBlock(CPU::CacheLineSize());
+      std::vector<float> row(bl_.nr);
+      for (int k0 = 0; k0 < bl_.k; k0 += bl_.kc) {
+        int kc = std::min(bl_.kc, bl_.k - k0);
+        for (int j = 0; j < bl_.n; j += bl_.nr) {
+          int cols = std::min(bl_.nr, bl_.n - j);
+          for (int k = k0; k < k0 + kc; ++k) {
+            const float *src = reinterpret_cast<const float *>(
+                B_->data() + k * b_row_stride_) + j;
+            std::fill(row.begin(), row.end(), 0.0f);
+            std::copy(src, src + cols, row.begin());
+            data->AddData(row.data(), bl_.nr * sizeof(float));
+          }
+        }
+      }
+      return data;
+    }
+
+    // Generate code for multiplying A[:,kc] with B[kc,:].
+    void GenerateBlock(int kc, bool accumulate) {
+      // Pack B block into panels unless it was packed at compile time.
+      if (!bl_.packed) GeneratePackB(kc);
+
+      // Loop over blocks of rows in A.
+      int mblocks = bl_.m / bl_.mc;
+      int mrest = bl_.m % bl_.mc;
+      __ movq(ablk_, a_);
+      __ LoadTensorAddress(cblk_, C_);
+      if (mblocks > 0) {
+        Label l;
+        if (mblocks > 1) {
+          __ movq(ic_, Immediate(mblocks));
+          __ bind(&l);
+        }
+        GeneratePackA(bl_.mc, kc);
+        GenerateMultiply(bl_.mc, kc, accumulate);
+        if (mblocks > 1 || mrest > 0) {
+          __ addq(ablk_, Immediate(bl_.mc * a_row_stride_));
+          __ addq(cblk_, Immediate(bl_.mc * c_row_stride_));
+        }
+        if (mblocks > 1) {
+          __ decq(ic_);
+          __ j(not_zero, &l);
+        }
+      }
+      if (mrest > 0) {
+        GeneratePackA(mrest, kc);
+        GenerateMultiply(mrest, kc, accumulate);
+      }
+    }
+
+    // Pack kc rows of B into panels with NR columns. Each panel has kc rows of
+    // NR consecutive elements. The columns in the last panel are padded with
+    // zeros.
+    void GeneratePackB(int kc) {
+      Register src = cp_;
+      Register dst = bp_;
+      int panels = bl_.n / bl_.nr;
+      int rest = bl_.n % bl_.nr;
+      int bvecsize = bl_.vl * b_element_size_;
+      __ movq(src, b_);
+      __ LoadTensorAddress(dst, scratch_);
+      __ addq(dst, Immediate(bl_.a_size));
+      if (panels > 0) {
+        Label l1, l2;
+        if (panels > 1) {
+          __ movq(jr_, Immediate(panels));
+          __ bind(&l1);
+        }
+        __ movq(k_, Immediate(kc));
+        __ bind(&l2);
+        for (int v = 0; v < kTileVectors; ++v) {
+          LoadB(elem_[v], Operand(src, v * bvecsize));
+        }
+        for (int v = 0; v < kTileVectors; ++v) {
+          StoreAligned(Operand(dst, v * vecsize_), elem_[v]);
+        }
+        __ addq(src, Immediate(b_row_stride_));
+        __ addq(dst, Immediate(bl_.nr * sizeof(float)));
+        __ decq(k_);
+        __ j(not_zero, &l2);
+        if (panels > 1 || rest > 0) {
+          __ addq(src, Immediate(bl_.nr * b_element_size_ -
+                                 kc * b_row_stride_));
+        }
+        if (panels > 1) {
+          __ decq(jr_);
+          __ j(not_zero, &l1);
+        }
+      }
+      if (rest > 0) {
+        Label l;
+        if (rest % bl_.vl != 0) SetMask(rest % bl_.vl, jr_);
+        __ movq(k_, Immediate(kc));
+        __ bind(&l);
+        for (int v = 0; v < kTileVectors; ++v) {
+          int elements = std::min(std::max(rest - v * bl_.vl, 0), bl_.vl);
+          if (elements == bl_.vl) {
+            LoadB(elem_[v], Operand(src, v * bvecsize));
+          } else if (elements > 0) {
+            MaskedLoadB(elem_[v], Operand(src, v * bvecsize));
+          } else {
+            Zero(elem_[v]);
+          }
+        }
+        for (int v = 0; v < kTileVectors; ++v) {
+          StoreAligned(Operand(dst, v * vecsize_), elem_[v]);
+        }
+        __ addq(src, Immediate(b_row_stride_));
+        __ addq(dst, Immediate(bl_.nr * sizeof(float)));
+        __ decq(k_);
+        __ j(not_zero, &l);
+      }
+    }
+
+    // Pack mc x kc block of A into panels with MR rows. Each panel has kc
+    // columns of MR consecutive elements.
+    void GeneratePackA(int mc, int kc) {
+      Register src = cp_;
+      Register dst = ap_;
+      int mr = bl_.mr;
+      int panels = mc / mr;
+      int rest = mc % mr;
+      __ movq(src, ablk_);
+      __ LoadTensorAddress(dst, scratch_);
+      if (panels > 0) {
+        Label l;
+        if (panels > 1) {
+          __ movq(ir_, Immediate(panels));
+          __ bind(&l);
+        }
+        GeneratePackAPanel(mr, kc);
+        if (panels > 1 || rest > 0) {
+          __ addq(src, Immediate(mr * a_row_stride_ - kc * a_col_stride_));
+        }
+        if (panels > 1) {
+          __ decq(ir_);
+          __ j(not_zero, &l);
+        }
+      }
+      if (rest > 0) GeneratePackAPanel(rest, kc);
+    }
+
+    // Pack one panel of A with the given number of rows.
+    void GeneratePackAPanel(int rows, int kc) {
+      Register src = cp_;
+      Register dst = ap_;
+      Label l;
+      __ movq(k_, Immediate(kc));
+      __ bind(&l);
+      for (int i = 0; i < rows; ++i) {
+        XMMRegister t = xmm(i % 2 == 0 ? bcast_ : elem_[0]);
+        __ vmovss(t, Operand(src, i * a_row_stride_));
+        __ vmovss(Operand(dst, i * sizeof(float)), t);
+      }
+      __ addq(src, Immediate(a_col_stride_));
+      __ addq(dst, Immediate(bl_.mr * sizeof(float)));
+      __ decq(k_);
+      __ j(not_zero, &l);
+    }
+
+    // Multiply packed panels for mc x kc block of A with packed kc x N block
+    // of B and add the result to C.
+    void GenerateMultiply(int mc, int kc, bool accumulate) {
+      int panels = bl_.n / bl_.nr;
+      int rest = bl_.n % bl_.nr;
+      if (bl_.packed) {
+        __ movq(bp_, b_);
+      } else {
+        __ LoadTensorAddress(bp_, scratch_);
+        __ addq(bp_, Immediate(bl_.a_size));
+      }
+      __ movq(cp_, cblk_);
+      if (panels > 0) {
+        Label l;
+        if (panels > 1) {
+          __ movq(jr_, Immediate(panels));
+          __ bind(&l);
+        }
+        GenerateColumnPanel(mc, bl_.nr, kc, accumulate);
+        if (panels > 1 || rest > 0) {
+          __ addq(bp_, Immediate(bl_.nr * kc * sizeof(float)));
+        }
+        if (panels > 1) {
+          __ decq(jr_);
+          __ j(not_zero, &l);
+        }
+      }
+      if (rest > 0) GenerateColumnPanel(mc, rest, kc, accumulate);
+    }
+
+    // Multiply all panels of A with one panel of B. The C pointer is moved to
+    // the next column panel afterwards.
+    void GenerateColumnPanel(int mc, int cols, int kc, bool accumulate) {
+      int mr = bl_.mr;
+      int panels = mc / mr;
+      int rest = mc % mr;
+      __ LoadTensorAddress(ap_, scratch_);
+      if (panels > 0) {
+        Label l;
+        if (panels > 1) {
+          __ movq(ir_, Immediate(panels));
+          __ bind(&l);
+        }
+        GenerateTile(mr, cols, kc, accumulate);
+        __ addq(cp_, Immediate(mr * c_row_stride_));
+        if (panels > 1) {
+          __ decq(ir_);
+          __ j(not_zero, &l);
+        }
+      }
+      if (rest > 0) GenerateTile(rest, cols, kc, accumulate);
+      int disp = cols * sizeof(float) - panels * mr * c_row_stride_;
+      if (disp != 0) __ addq(cp_, Immediate(disp));
+    }
+
+    // Microkernel for computing a rows x cols tile of C from a packed panel
+    // of A and a packed panel of B. The A panel pointer is moved to the next
+    // panel and the B panel pointer is restored.
+    void GenerateTile(int rows, int cols, int kc, bool accumulate) {
+      int vecs = (cols + bl_.vl - 1) / bl_.vl;
+      int astep = bl_.mr * sizeof(float);
+      int bstep = bl_.nr * sizeof(float);
+
+      // Clear accumulators.
+      for (int i = 0; i < rows; ++i) {
+        for (int v = 0; v < vecs; ++v) Zero(acc(i, v));
+      }
+
+      // Compute outer products of the columns in the A panel and the rows in
+      // the B panel. The loop is unrolled four times.
+      const int unrolls = 4;
+      int loops = kc / unrolls;
+      int rest = kc % unrolls;
+      if (loops > 0) {
+        Label l;
+        __ movq(k_, Immediate(loops));
+        __ bind(&l);
+        for (int u = 0; u < unrolls; ++u) {
+          GenerateOuterProduct(rows, vecs, u * astep, u * bstep);
+        }
+        __ addq(ap_, Immediate(unrolls * astep));
+        __ addq(bp_, Immediate(unrolls * bstep));
+        __ decq(k_);
+        __ j(not_zero, &l);
+      }
+      for (int u = 0; u < rest; ++u) {
+        GenerateOuterProduct(rows, vecs, u * astep, u * bstep);
+      }
+      if (rest > 0) __ addq(ap_, Immediate(rest * astep));
+      __ subq(bp_, Immediate(loops * unrolls * bstep));
+
+      // Store tile in C.
+      for (int v = 0; v < vecs; ++v) {
+        int elements = std::min(cols - v * bl_.vl, bl_.vl);
+        if (elements != bl_.vl) SetMask(elements, k_);
+        for (int i = 0; i < rows; ++i) {
+          Operand c(cp_, i * c_row_stride_ + v * vecsize_);
+          if (elements == bl_.vl) {
+            if (accumulate) Add(acc(i, v), c);
+            Store(c, acc(i, v));
+          } else {
+            if (accumulate) MaskedAdd(acc(i, v), c);
+            MaskedStore(c, acc(i, v));
+          }
+        }
+      }
+    }
+
+    // Multiply column in A panel with row in B panel and add to tile.
+    void GenerateOuterProduct(int rows, int vecs, int adisp, int bdisp) {
+      for (int v = 0; v < vecs; ++v) {
+        LoadAligned(elem_[v], Operand(bp_, bdisp + v * vecsize_));
+      }
+      for (int i = 0; i < rows; ++i) {
+        Broadcast(bcast_, Operand(ap_, adisp + i * sizeof(float)));
+        for (int v = 0; v < vecs; ++v) {
+          MultiplyAdd(acc(i, v), elem_[v], bcast_);
+        }
+      }
+    }
+
+    // Accumulator register for tile element.
+    int acc(int row, int vec) const { return acc_[row * kTileVectors + vec]; }
+
+    // SIMD register views.
+    static XMMRegister xmm(int r) { return XMMRegister::from_code(r); }
+    static YMMRegister ymm(int r) { return YMMRegister::from_code(r); }
+    static ZMMRegister zmm(int r) { return ZMMRegister::from_code(r); }
+
+    // Vector instructions for AVX-512 (ZMM) and AVX2 (YMM) registers.
+    void Zero(int r) {
+      if (avx512_) {
+        __ vpxord(zmm(r), zmm(r), zmm(r));
+      } else {
+        __ vxorps(ymm(r), ymm(r), ymm(r));
+      }
+    }
+
+    void Load(int r, const Operand &src) {
+      if (avx512_) {
+        __ vmovups(zmm(r), src);
+      } else {
+        __ vmovups(ymm(r), src);
+      }
+    }
+
+    // Load vector from B converting 16-bit floats to single precision.
+    void LoadB(int r, const Operand &src) {
+      if (b_type_ == DT_FLOAT) {
+        Load(r, src);
+      } else if (avx512_) {
+        masm_->LoadFloats(zmm(r), src, b_type_);
+      } else {
+        masm_->LoadFloats(ymm(r), src, b_type_);
+      }
+    }
+
+    void LoadAligned(int r, const Operand &src) {
+      if (avx512_) {
+        __ vmovaps(zmm(r), src);
+      } else {
+        __ vmovaps(ymm(r), src);
+      }
+    }
+
+    void Store(const Operand &dst, int r) {
+      if (avx512_) {
+        __ vmovups(dst, zmm(r));
+      } else {
+        __ vmovups(dst, ymm(r));
+      }
+    }
+
+    void StoreAligned(const Operand &dst, int r) {
+      if (avx512_) {
+        __ vmovaps(dst, zmm(r));
+      } else {
+        __ vmovaps(dst, ymm(r));
+      }
+    }
+
+    void Broadcast(int r, const Operand &src) {
+      if (avx512_) {
+        __ vbroadcastss(zmm(r), src);
+      } else {
+        __ vbroadcastss(ymm(r), src);
+      }
+    }
+
+    void MultiplyAdd(int dst, int src1, int src2) {
+      if (avx512_) {
+        __ vfmadd231ps(zmm(dst), zmm(src1), zmm(src2));
+      } else {
+        __ vfmadd231ps(ymm(dst), ymm(src1), ymm(src2));
+      }
+    }
+
+    void Add(int r, const Operand &src) {
+      if (avx512_) {
+        __ vaddps(zmm(r), zmm(r), src);
+      } else {
+        __ vaddps(ymm(r), ymm(r), src);
+      }
+    }
+
+    // Masked vector instructions using the mask set by SetMask(). The
+    // masked-out elements are zero after loading.
+    void MaskedLoad(int r, const Operand &src) {
+      if (avx512_) {
+        __ vmovups(zmm(r), src, Mask(k1, zeroing));
+      } else {
+        __ vmaskmovps(ymm(r), ymm(bcast_), src);
+      }
+    }
+
+    void MaskedLoadB(int r, const Operand &src) {
+      if (b_type_ == DT_FLOAT) {
+        MaskedLoad(r, src);
+      } else {
+        // Only AVX-512 has partial vectors for B with 16-bit floats.
+        CHECK(avx512_);
+        masm_->LoadFloats(zmm(r), src, b_type_, Mask(k1, zeroing));
+      }
+    }
+
+    void MaskedStore(const Operand &dst, int r) {
+      if (avx512_) {
+        __ vmovups(dst, zmm(r), Mask(k1, merging));
+      } else {
+        __ vmaskmovps(dst, ymm(bcast_), ymm(r));
+      }
+    }
+
+    void MaskedAdd(int r, const Operand &src) {
+      if (avx512_) {
+        __ vaddps(zmm(r), zmm(r), src, Mask(k1, merging));
+      } else {
+        __ vmaskmovps(ymm(elem_[0]), ymm(bcast_), src);
+        __ vaddps(ymm(r), ymm(r), ymm(elem_[0]));
+      }
+    }
+
+    // Set mask for selecting the first n elements. AVX-512 uses the opmask
+    // register k1 and AVX2 keeps the mask in the broadcast register.
+    void SetMask(int n, Register tmp) {
+      if (avx512_) {
+        __ movq(tmp, Immediate((1 << n) - 1));
+        __ kmovw(k1, tmp);
+      } else {
+        int32 mask[8];
+        for (int i = 0; i < 8; ++i) mask[i] = i < n ? -1 : 0;
+        StaticData *data = masm_->GetData(mask, sizeof(mask));
+        __ vmovaps(ymm(bcast_), data->address());
+      }
+    }
+
+    Step *step_;
+    MacroAssembler *masm_;
+    Blocking bl_;
+
+    // Matrices and scratch space for packed panels.
+    Tensor *A_;
+    Tensor *B_;
+    Tensor *C_;
+    Tensor *scratch_;
+
+    // Byte strides for matrices.
+    int a_row_stride_;
+    int a_col_stride_;
+    int b_row_stride_;
+    int c_row_stride_;
+
+    // Vector instruction set.
+    bool avx512_;
+    int vecsize_;
+
+    // Element type and size for B.
+    Type b_type_;
+    int b_element_size_;
+
+    // General-purpose registers.
+    Register a_;     // current column block in A
+    Register b_;     // current row block in B or packed B
+    Register pc_;    // block counter for K
+    Register ic_;    // block counter for M
+    Register ablk_;  // current block in A
+    Register cblk_;  // current row block in C
+    Register ap_;    // packed A panel
+    Register bp_;    // packed B panel
+    Register jr_;    // panel counter for B
+    Register ir_;    // panel counter for A
+    Register cp_;    // current tile in C
+    Register k_;     // inner loop counter
+
+    // SIMD registers.
+    int acc_[kMaxTileRows * kTileVectors];  // accumulators for tile
+    int elem_[kTileVectors];                // row in B panel
+    int bcast_;                             // broadcast element from A panel
+  };
+};
+
+void RegisterAVXGEMM(Library *library) {
+  // Computes  : C = A * B
+  // Input     : A: float32[m,k]
+  //             B: float32[k,n] row-major
+  // Output    : C: float32[m,n] row-major
+  // Requires  : AVX512F or AVX2 and FMA3
+  library->Register(new AVXFltGEMM());
+}
+
+}  // namespace myelin
+}  // namespace sling
@@ -456,7 +456,9 @@ class AVXFltSigmoid : public AVXFltExpBase {
   string Operation() override { return "Sigmoid"; }
 };
 
-// Compute argmax of input using AVX.
+// Compute argmax of input using AVX. If there is a second input, it is a bit
+// mask with the elements that can be selected. The mask bits for eight
+// elements at a time are expanded to a lane mask for the comparison.
 class AVXFltArgMax : public Kernel {
  public:
   string Name() override { return "AVXFltArgMax"; }
@@ -467,7 +469,7 @@ class AVXFltArgMax : public Kernel {
     if (!CPU::Enabled(AVX2)) return false;
 
     // Check inputs and outputs.
-    if (step->inputs().size() != 1) return false;
+    if (step->inputs().size() != 1 && step->inputs().size() != 2) return false;
     if (step->outputs().size() != 1) return false;
     Tensor *x = step->input(0);
     Tensor *y = step->output(0);
@@ -477,6 +479,13 @@ class AVXFltArgMax : public Kernel {
     if (y->type() != DT_INT32 && y->type() != DT_INT64) return false;
     if (y->elements() != 1) return false;
 
+    // Check mask.
+    if (step->inputs().size() == 2) {
+      Tensor *m = step->input(1);
+      if (m->type() != DT_INT64) return false;
+      if (m->elements() * 64 < x->elements()) return false;
+    }
+
     return true;
   }
 
@@ -484,6 +493,7 @@ class AVXFltArgMax : public Kernel {
     // Get input and output.
     Tensor *x = step->input(0);
     Tensor *y = step->output(0);
+    Tensor *m = step->inputs().size() == 2 ? step->input(1) : nullptr;
     int main_elements = (x->elements() / 8) * 8;
 
     // Assign registers.
@@ -502,6 +512,11 @@ class AVXFltArgMax : public Kernel {
     // Load tensor locations.
     __ LoadTensorAddress(input, x);
     __ LoadTensorAddress(output, y);
+    Register bitmask = no_reg;
+    if (m != nullptr) {
+      bitmask = masm->rr().alloc();
+      __ LoadTensorAddress(bitmask, m);
+    }
 
     if (main_elements > 0) {
       // Initialize variables.
@@ -516,12 +531,44 @@ class AVXFltArgMax : public Kernel {
       __ vmovaps(best0, Operand(negone->address()));
       __ xorq(ofs, ofs);
 
+      // Initialize lane bits for expanding mask.
+      Register bits = no_reg;
+      Register maskptr = no_reg;
+      YMMRegister lanes = no_ymm_reg;
+      YMMRegister selector = no_ymm_reg;
+      if (m != nullptr) {
+        static int bits_init[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+        auto *lane_bits = masm->GetData(bits_init, sizeof(bits_init));
+        bits = masm->rr().alloc();
+        maskptr = masm->rr().alloc();
+        lanes = masm->mm().allocy();
+        selector = masm->mm().allocy();
+        __ vmovaps(selector, Operand(lane_bits->address()));
+        __ movq(maskptr, bitmask);
+      }
+
       // Find argmax for main elements, eight elements at a time.
+      const static int CMP_LT = 1;
       const static int CMP_LE = 2;
       Label loop1;
       __ LoopStart(&loop1);
       __ vmovaps(value, Operand(input, ofs));
-      __ vcmpps(mask, maxval0, value, CMP_LE);
+      if (m != nullptr) {
+        // Expand the mask bits for the elements to lane masks.
+        __ movzxbl(bits, Operand(maskptr));
+        __ vmovd(lanes.xmm(), bits);
+        __ vbroadcastss(lanes, lanes);  // requires avx2
+        __ vpand(lanes, lanes, selector);
+        __ vpcmpeqd(lanes, lanes, selector);
+        __ incq(maskptr);
+
+        // Only select allowed elements that are greater than the current
+        // maximum, so the first maximum element is selected in each lane.
+        __ vcmpps(mask, maxval0, value, CMP_LT);
+        __ vandps(mask, mask, lanes);
+      } else {
+        __ vcmpps(mask, maxval0, value, CMP_LE);
+      }
       __ vblendvps(maxval0, maxval0, value, mask);
       __ vblendvps(best0, best0, index, mask);
       __ vpaddd(index, index, eight);  // requires avx2
@@ -570,8 +617,12 @@ class AVXFltArgMax : public Kernel {
       __ movq(idx, Immediate(main_elements));
       Label loop2;
       __ LoopStart(&loop2);
-      __ vmovss(value.xmm(), Operand(input, idx, times_4));
       Label l2;
+      if (m != nullptr) {
+        __ bt(Operand(bitmask), idx);
+        __ j(not_carry, &l2);
+      }
+      __ vmovss(value.xmm(), Operand(input, idx, times_4));
       __ vucomiss(value.xmm(), maxval);
       __ j(below_equal, &l2);
       __ vmovss(maxval, maxval, value.xmm());
@@ -617,8 +668,9 @@ void RegisterAVXMath(Library *library) {
   // Supports  : FMA3
   library->Register(new AVXFltSigmoid());
 
-  // Computes  : y = argmax(x)
+  // Computes  : y = argmax(x) for elements in the optional mask m
   // Input     : x: float32[d1,...,dn]
+  //             m: int64[(n + 63) / 64] (bit mask, optional)
   // Output    : y: int32/int64
   // Requires  : AVX
   library->Register(new AVXFltArgMax());
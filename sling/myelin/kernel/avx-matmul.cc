@@ -43,7 +43,7 @@ class AVXVecMatMulBase : public Kernel {
     Tensor *W = step->input(1);
     Tensor *y = step->output(0);
     if (x->rank() != 2 || x->type() != itype_) return false;
-    if (W->rank() != 2 || W->type() != itype_) return false;
+    if (W->rank() != 2 || !SupportsMatrix(W)) return false;
     if (y->rank() != 2 || y->type() != otype_) return false;
 
     // Check shape. First input must be a row vector.
@@ -73,6 +73,9 @@ class AVXVecMatMulBase : public Kernel {
     return true;
   }
 
+  // Check if the kernel supports the element type of the matrix.
+  virtual bool SupportsMatrix(Tensor *W) { return W->type() == itype_; }
+
   int64 Complexity(const Step *step) override {
     int64 ops = step->input(1)->elements() * 2;
     if (bias_) ops += step->input(2)->elements();
@@ -88,7 +91,9 @@ class AVXVecMatMulBase : public Kernel {
   Type otype_;   // output type
 };
 
-// Vertical float vector-matrix multiplication for CPUs with AVX.
+// Vertical float vector-matrix multiplication for CPUs with AVX. The matrix
+// can be stored as half-precision or bfloat16 floats, which are converted to
+// single precision when loaded.
 class AVXFltVecMatMulVBase : public AVXVecMatMulBase {
  public:
   // Maximum number of loop unrolls.
@@ -97,6 +102,14 @@ class AVXFltVecMatMulVBase : public AVXVecMatMulBase {
   AVXFltVecMatMulVBase(bool bias, bool relu)
       : AVXVecMatMulBase(bias, relu, ROW_MAJOR, DT_FLOAT, DT_FLOAT) {}
 
+  bool SupportsMatrix(Tensor *W) override {
+    if (W->type() == DT_FLOAT) return true;
+
+    // Matrices with 16-bit floats must have whole ymm blocks in each row.
+    if (W->dim(1) % 8 != 0) return false;
+    return MacroAssembler::SupportsFloatType(W->type(), 256);
+  }
+
   void Adjust(Step *step) override {
     // Get input and output tensors.
     Tensor *x = step->input(0);
@@ -141,6 +154,10 @@ class AVXFltVecMatMulVBase : public AVXVecMatMulBase {
     int main_cols = (cols  / 8) * 8;
     int remaining_cols = cols - main_cols;
 
+    // Get matrix element type and the size of one ymm block in the matrix.
+    Type wtype = W->type();
+    int wblock = 8 * W->element_size();
+
     // Compute the number of unrolls.
     int unrolls = 0;
     for (int i = 1; i <= kMaxUnrolls; ++i) {
@@ -212,7 +229,15 @@ class AVXFltVecMatMulVBase : public AVXVecMatMulBase {
 
       // Multiply x[row] with W[row,col:col+n] and add to sum.
       for (int i = 0; i < unrolls; ++i) {
-        if (fma) {
+        if (wtype != DT_FLOAT) {
+          __ LoadFloats(acc[i % 4], Operand(m, i * wblock), wtype);
+          if (fma) {
+            __ vfmadd231ps(sum[i], elem, acc[i % 4]);
+          } else {
+            __ vmulps(acc[i % 4], elem, acc[i % 4]);
+            __ vaddps(sum[i], sum[i], acc[i % 4]);
+          }
+        } else if (fma) {
           __ vfmadd231ps(sum[i], elem, Operand(m, i * 32));
         } else {
           __ vmulps(acc[i % 4], elem, Operand(m, i * 32));
@@ -244,7 +269,7 @@ class AVXFltVecMatMulVBase : public AVXVecMatMulBase {
 
       // Next matrix column block.
       if (main_cols > unrolls * 8 || remaining_cols > 0) {
-        __ addq(matrix, Immediate(unrolls * 32));
+        __ addq(matrix, Immediate(unrolls * wblock));
       }
       if (main_cols > unrolls * 8) {
         __ addq(colofs, Immediate(unrolls * 32));
@@ -743,7 +768,7 @@ class AVXFltMatMatMul : public Kernel {
   void Generate(Step *step, MacroAssembler *masm) override {
     Registers &rr = masm->rr();
     SIMDRegisters &mm = masm->mm();
-    Label l1, l2, l3;
+    Label l1, l2;
 
     // Get input and output tensors.
     Tensor *A = step->input(0);
@@ -757,6 +782,7 @@ class AVXFltMatMatMul : public Kernel {
     int a_col_dim = transpose_a ? 0 : 1;
     int b_row_dim = transpose_b ? 1 : 0;
     int b_col_dim = transpose_b ? 0 : 1;
+    int c_row_dim = 0;
     int c_col_dim = 1;
 
     // Compute the number of unrolls and adders.
@@ -769,6 +795,8 @@ class AVXFltMatMatMul : public Kernel {
 
     // Allocate general registers.
     Register a = rr.alloc();
+    Register a_row = rr.alloc();
+    Register a_end = rr.alloc();
     Register b = rr.alloc();
     Register b_row = rr.alloc();
     Register b_end = rr.alloc();
@@ -777,41 +805,121 @@ class AVXFltMatMatMul : public Kernel {
     Register k = rr.alloc();
 
     // Allocate SIMD registers.
-    std::vector<YMMRegister> elem;
+    Dot dot;
     for (int n = 0; n < unrolls; ++n) {
-      elem.push_back(mm.allocy());
+      dot.elem.push_back(mm.allocy());
     }
-    std::vector<YMMRegister> sum;
     for (int n = 0; n < adders; ++n) {
-      sum.push_back(mm.allocy());
+      dot.sum.push_back(mm.allocy());
     }
-    YMMRegister acc = mm.allocy();
+    dot.acc = mm.allocy();
+    dot.k = k;
+    dot.size = A->dim(a_col_dim);
 
     // Load tensor locations.
     __ LoadTensorAddress(a, A);
     __ LoadTensorAddress(b, B);
     __ LoadTensorAddress(c, C);
 
-    // Compute end of B and C.
+    // Compute end of B.
     __ movq(b_end, b);
     __ addq(b_end, Immediate(B->size()));
-    __ movq(c_end, c);
-    __ addq(c_end, Immediate(C->size()));
 
-    // Loop over all rows in C.
-    __ LoopStart(&l1);
-    __ movq(b_row, b);
+    if (A->size() < B->size()) {
+      // The first matrix is the smallest, e.g. a batch of input vectors
+      // multiplied with a weight matrix. Each column in B is multiplied with
+      // all the rows in A, so B is only streamed through the cache once.
+      __ movq(a_end, a);
+      __ addq(a_end, Immediate(A->dim(a_row_dim) * A->stride(a_row_dim)));
 
-    // Loop over all columns in C.
-    __ LoopStart(&l2);
+      // Loop over all columns in C.
+      __ LoopStart(&l1);
+      __ movq(a_row, a);
+      __ movq(c_end, c);
+
+      // Loop over all rows in C.
+      __ LoopStart(&l2);
+      GenerateDot(dot, a_row, b, masm);
+
+      // Save to C[i,j].
+      __ vmovss(Operand(c_end), dot.sum[0]);
+      __ addq(c_end, Immediate(C->stride(c_row_dim)));
+
+      // Move to next row in A.
+      __ addq(a_row, Immediate(A->stride(a_row_dim)));
+      __ cmpq(a_row, a_end);
+      __ j(less, &l2);
+
+      // Move to next column in B and C.
+      __ addq(c, Immediate(C->stride(c_col_dim)));
+      __ addq(b, Immediate(B->stride(b_col_dim)));
+      __ cmpq(b, b_end);
+      __ j(less, &l1);
+    } else {
+      // Compute end of C.
+      __ movq(c_end, c);
+      __ addq(c_end, Immediate(C->size()));
+
+      // Loop over all rows in C.
+      __ LoopStart(&l1);
+      __ movq(b_row, b);
+
+      // Loop over all columns in C.
+      __ LoopStart(&l2);
+      GenerateDot(dot, a, b_row, masm);
+
+      // Save to C[i,j].
+      __ vmovss(Operand(c), dot.sum[0]);
+      __ addq(c, Immediate(C->stride(c_col_dim)));
+
+      // Move to next column in B
+      __ addq(b_row, Immediate(B->stride(b_col_dim)));
+      __ cmpq(b_row, b_end);
+      __ j(less, &l2);
+
+      // Move to next row in A.
+      __ addq(a, Immediate(A->stride(a_row_dim)));
+
+      // Move to next row in C.
+      if (C->padding(1) != 0) {
+        __ addq(c, Immediate(C->padding(c_col_dim)));
+      }
+      __ cmpq(c, c_end);
+      __ j(less, &l1);
+    }
+  }
+
+  int64 Complexity(const Step *step) override {
+    return step->input(0)->dim(0) * step->input(1)->elements() * 2;
+  }
+
+ private:
+  // Registers for computing dot products.
+  struct Dot {
+    std::vector<YMMRegister> elem;    // elements from row in A
+    std::vector<YMMRegister> sum;     // partial sums
+    YMMRegister acc;                  // accumulator for horizontal sum
+    Register k;                       // index into row and column
+    int size;                         // number of elements in dot product
+  };
+
+  // Compute dot product of row in A and column in B. The result is returned
+  // in the lowest element of the first sum register.
+  void GenerateDot(const Dot &dot, Register a, Register b,
+                   MacroAssembler *masm) {
+    Label l;
+    int unrolls = dot.elem.size();
+    int adders = dot.sum.size();
+    auto &elem = dot.elem;
+    auto &sum = dot.sum;
+    Register k = dot.k;
     __ xorq(k, k);
     for (int n = 0; n < adders; ++n) {
       __ vxorps(sum[n], sum[n], sum[n]);
     }
 
-    // Compute dot product of row in A and column in B.
     // C[i,j] = sum_k A[i,k] * B[k,j].
-    __ LoopStart(&l3);
+    __ LoopStart(&l);
     for (int n = 0; n < unrolls; ++n) {
       // Load A[i,k:k+8].
       int disp = 8 * n * sizeof(float);
@@ -823,16 +931,16 @@ class AVXFltMatMatMul : public Kernel {
       int disp = 8 * n * sizeof(float);
       if (masm->Enabled(FMA3)) {
         __ vfmadd231ps(sum[n % adders], elem[n],
-                       Operand(b_row, k, times_4, disp));
+                       Operand(b, k, times_4, disp));
       } else {
-        __ vmulps(elem[n], elem[n], Operand(b_row, k, times_4, disp));
+        __ vmulps(elem[n], elem[n], Operand(b, k, times_4, disp));
         __ vaddps(sum[n % adders], sum[n % adders], elem[n]);
       }
     }
 
     __ addq(k, Immediate(8 * unrolls));
-    __ cmpq(k, Immediate(A->dim(a_col_dim)));
-    __ j(less, &l3);
+    __ cmpq(k, Immediate(dot.size));
+    __ j(less, &l);
 
     // Sum adders in sum[0].
     if (adders == 4) {
@@ -846,33 +954,10 @@ class AVXFltMatMatMul : public Kernel {
     }
 
     // Add elements in sum[0] horizontally.
-    __ vperm2f128(acc, sum[0], sum[0], 1);
-    __ vhaddps(sum[0], sum[0], acc);
+    __ vperm2f128(dot.acc, sum[0], sum[0], 1);
+    __ vhaddps(sum[0], sum[0], dot.acc);
     __ vhaddps(sum[0], sum[0], sum[0]);
     __ vhaddps(sum[0], sum[0], sum[0]);
-
-    // Save to C[i,j].
-    __ vmovss(Operand(c), sum[0]);
-    __ addq(c, Immediate(C->stride(c_col_dim)));
-
-    // Move to next column in B
-    __ addq(b_row, Immediate(B->stride(b_col_dim)));
-    __ cmpq(b_row, b_end);
-    __ j(less, &l2);
-
-    // Move to next row in A.
-    __ addq(a, Immediate(A->stride(a_row_dim)));
-
-    // Move to next row in C.
-    if (C->padding(1) != 0) {
-      __ addq(c, Immediate(C->padding(c_col_dim)));
-    }
-    __ cmpq(c, c_end);
-    __ j(less, &l1);
-  }
-
-  int64 Complexity(const Step *step) override {
-    return step->input(0)->dim(0) * step->input(1)->elements() * 2;
   }
 };
 
@@ -19,6 +19,9 @@
 namespace sling {
 namespace myelin {
 
+// avx-gemm.cc
+void RegisterAVXGEMM(Library *library);
+
 // avx-math.cc
 void RegisterAVXMath(Library *library);
 
@@ -28,11 +31,16 @@ void RegisterAVXMatMul(Library *library);
 // avx-operators.cc
 void RegisterAVXOperators(Library *library);
 
+// avx512-matmul.cc
+void RegisterAVX512MatMul(Library *library);
+
 // Register AVX library.
 void RegisterAVXLibrary(Library *library) {
   RegisterAVXMath(library);
   RegisterAVXMatMul(library);
   RegisterAVXOperators(library);
+  RegisterAVX512MatMul(library);
+  RegisterAVXGEMM(library);
 }
 
 }  // namespace myelin
@@ -0,0 +1,634 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/myelin/kernel/avx.h"
+
+#include <string>
+
+#include "sling/myelin/compute.h"
+#include "sling/myelin/macro-assembler.h"
+
+#define __ masm->
+
+namespace sling {
+namespace myelin {
+
+using namespace jit;
+
+// Base class for vector-matrix multiplication for CPUs with AVX-512.
+class AVX512VecMatMulBase : public Kernel {
+ public:
+  AVX512VecMatMulBase(bool bias, bool relu, Order order)
+      : bias_(bias), relu_(relu), order_(order) {}
+
+  bool Supports(Step *step) override {
+    // Requires CPU with AVX-512 support.
+    if (!CPU::Enabled(AVX512F)) return false;
+
+    // Two or three 2D tensor inputs and one 2D tensor output.
+    if (step->inputs().size() != (bias_ ? 3 : 2)) return false;
+    if (step->outputs().size() != 1) return false;
+    Tensor *x = step->input(0);
+    Tensor *W = step->input(1);
+    Tensor *y = step->output(0);
+    if (x->rank() != 2 || x->type() != DT_FLOAT) return false;
+    if (W->rank() != 2 || !SupportsMatrix(W)) return false;
+    if (y->rank() != 2 || y->type() != DT_FLOAT) return false;
+
+    // Check shape. First input must be a row vector.
+    if (x->dim(0) != 1 || x->dim(1) != W->dim(0)) return false;
+    if (y->dim(0) != x->dim(0) || y->dim(1) != W->dim(1)) return false;
+
+    // The matrix must support required order.
+    if (!W->SupportsOrder(order_)) return false;
+
+    // Transpose not supported.
+    if (step->GetAttr("transpose_a", false)) return false;
+    if (step->GetAttr("transpose_b", false)) return false;
+
+    // Check bias vector.
+    if (bias_) {
+      Tensor *b = step->input(2);
+      if (b->type() != DT_FLOAT) return false;
+      if (b->rank() == 1) {
+        if (b->dim(0) != y->dim(1)) return false;
+      } else if (b->rank() == 2) {
+        if (b->dim(0) != 1 || b->dim(1) != y->dim(1)) return false;
+      } else {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  void Adjust(Step *step) override {
+    // Get input and output tensors.
+    Tensor *x = step->input(0);
+    Tensor *W = step->input(1);
+    Tensor *b = bias_ ? step->input(2) : nullptr;
+    Tensor *y = step->output(0);
+
+    // Align to one zmm register (512 bits, 64 bytes).
+    int byte_alignment = 512 / 8;
+    x->SetMiniumAlignment(byte_alignment);
+    W->SetMiniumAlignment(byte_alignment);
+    y->SetMiniumAlignment(byte_alignment);
+    if (bias_) b->SetMiniumAlignment(byte_alignment);
+
+    W->SetRequiredOrder(order_);
+  }
+
+  // Check if the kernel supports the element type of the matrix.
+  virtual bool SupportsMatrix(Tensor *W) { return W->type() == DT_FLOAT; }
+
+  int64 Complexity(const Step *step) override {
+    int64 ops = step->input(1)->elements() * 2;
+    if (bias_) ops += step->input(2)->elements();
+    if (relu_) ops += step->output(0)->elements();
+    return ops;
+  }
+
+ protected:
+  bool bias_;    // add bias vector to result, y=Wx+b
+  bool relu_;    // apply rectified linear unit, y=max(0,Wx+b)
+  Order order_;  // required order for matrix
+};
+
+// Vertical float vector-matrix multiplication for CPUs with AVX-512. The
+// remaining columns that do not fill a whole zmm register are computed using
+// masked instructions. The matrix can be stored as half-precision or bfloat16
+// floats, which are converted to single precision when loaded.
+class AVX512FltVecMatMulVBase : public AVX512VecMatMulBase {
+ public:
+  // Maximum number of loop unrolls.
+  static const int kMaxUnrolls = 8;
+
+  AVX512FltVecMatMulVBase(bool bias, bool relu)
+      : AVX512VecMatMulBase(bias, relu, ROW_MAJOR) {}
+
+  bool SupportsMatrix(Tensor *W) override {
+    return MacroAssembler::SupportsFloatType(W->type(), 512);
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    Registers &rr = masm->rr();
+    SIMDRegisters &mm = masm->mm();
+    Label l1, l2, l3;
+
+    // Get input and output tensors.
+    Tensor *x = step->input(0);
+    Tensor *W = step->input(1);
+    Tensor *b = bias_ ? step->input(2) : nullptr;
+    Tensor *y = step->output(0);
+
+    // FMA is not strict math compatible.
+    bool fma = true;
+    bool strict = step->GetAttr("strict", false);
+    if (strict) {
+      fma = false;
+      step->set_variant("strict");
+    }
+
+    // Get matrix dimensions.
+    int rows = W->dim(0);
+    int cols = W->dim(1);
+    int main_cols = (cols  / 16) * 16;
+    int remaining_cols = cols - main_cols;
+
+    // Get matrix element type and the size of one zmm block in the matrix.
+    Type wtype = W->type();
+    int wblock = 16 * W->element_size();
+
+    // Compute the number of unrolls.
+    int unrolls = 0;
+    for (int i = 1; i <= kMaxUnrolls; ++i) {
+      int batch_size = i * 16;
+      if (main_cols >= batch_size && main_cols % batch_size == 0) unrolls = i;
+    }
+    if (step->variant().empty()) {
+      string variant = "U" + std::to_string(unrolls);
+      if (remaining_cols > 0) variant += "R" + std::to_string(remaining_cols);
+      step->set_variant(variant);
+    }
+
+    // Allocate general registers.
+    Register rowofs = rr.alloc();
+    Register colofs = rr.alloc();
+    Register m = rr.alloc();
+    Register matrix = rr.alloc();
+    Register input = rr.alloc();
+    Register output = rr.alloc();
+    Register vector = bias_ ? rr.alloc() : no_reg;
+
+    // Allocate SIMD registers.
+    std::vector<ZMMRegister> sum;
+    for (int i = 0; i < std::max(unrolls, 1); ++i) {
+      sum.push_back(mm.allocz());
+    }
+    std::vector<ZMMRegister> acc;
+    for (int i = 0; i < 4; ++i) {
+      acc.push_back(mm.allocz());
+    }
+    ZMMRegister elem = mm.allocz();
+    ZMMRegister zero = relu_ ? mm.allocz() : no_zmm_reg;
+
+    // Load tensor locations.
+    __ LoadTensorAddress(input, x);
+    __ LoadTensorAddress(matrix, W);
+    if (bias_) {
+      __ LoadTensorAddress(vector, b);
+    }
+    __ LoadTensorAddress(output, y);
+
+    // Initialize SIMD register to zero for relu.
+    if (relu_) {
+      __ vpxord(zero, zero, zero);
+    }
+
+    // Compute main columns.
+    if (unrolls > 0) {
+      // Outer loop over matrix column blocks.
+      __ xorq(colofs, colofs);
+      __ LoopStart(&l1);
+
+      // Initialize block with bias or zero.
+      for (int i = 0; i < unrolls; ++i) {
+        if (bias_ && !strict) {
+          __ vmovaps(sum[i], Operand(vector, colofs, times_1, i * 64));
+        } else {
+          __ vpxord(sum[i], sum[i], sum[i]);
+        }
+      }
+      __ movq(m, matrix);
+      __ xorq(rowofs, rowofs);
+
+      // Inner loop over rows.
+      __ LoopStart(&l2);
+
+      // Load x[row].
+      __ vbroadcastss(elem, Operand(input, rowofs));
+
+      // Multiply x[row] with W[row,col:col+n] and add to sum.
+      for (int i = 0; i < unrolls; ++i) {
+        if (wtype != DT_FLOAT) {
+          __ LoadFloats(acc[i % 4], Operand(m, i * wblock), wtype);
+          if (fma) {
+            __ vfmadd231ps(sum[i], elem, acc[i % 4]);
+          } else {
+            __ vmulps(acc[i % 4], elem, acc[i % 4]);
+            __ vaddps(sum[i], sum[i], acc[i % 4]);
+          }
+        } else if (fma) {
+          __ vfmadd231ps(sum[i], elem, Operand(m, i * 64));
+        } else {
+          __ vmulps(acc[i % 4], elem, Operand(m, i * 64));
+          __ vaddps(sum[i], sum[i], acc[i % 4]);
+        }
+      }
+
+      // Next row.
+      if (rows > 1) {
+        __ addq(m, Immediate(W->stride(0)));
+        __ addq(rowofs, Immediate(sizeof(float)));
+        __ cmpq(rowofs, Immediate(rows * sizeof(float)));
+        __ j(less, &l2);
+      }
+
+      // Save to y[col:col+n].
+      for (int i = 0; i < unrolls; ++i) {
+        // Add bias last in strict mode.
+        if (bias_ && strict) {
+          __ vaddps(sum[i], sum[i], Operand(vector, colofs, times_1, i * 64));
+        }
+
+        // Compute relu.
+        if (relu_) {
+          __ vmaxps(sum[i], sum[i], zero);
+        }
+        __ vmovaps(Operand(output, colofs, times_1, i * 64), sum[i]);
+      }
+
+      // Next matrix column block.
+      if (main_cols > unrolls * 16 || remaining_cols > 0) {
+        __ addq(matrix, Immediate(unrolls * wblock));
+      }
+      if (main_cols > unrolls * 16) {
+        __ addq(colofs, Immediate(unrolls * 64));
+        __ cmpq(colofs, Immediate(main_cols * sizeof(float)));
+        __ j(less, &l1);
+      }
+    }
+
+    // Compute remaining columns using a mask for the remaining elements.
+    if (remaining_cols > 0) {
+      CHECK_LE(remaining_cols, 15);
+      __ movq(rowofs, Immediate((1 << remaining_cols) - 1));
+      __ kmovw(k1, rowofs);
+      Mask mask(k1);
+      Mask zeromask(k1, zeroing);
+
+      // Initialize remaining columns with bias or zero.
+      int coldisp = main_cols * sizeof(float);
+      if (bias_ && !strict) {
+        __ vmovaps(sum[0], Operand(vector, coldisp), zeromask);
+      } else {
+        __ vpxord(sum[0], sum[0], sum[0]);
+      }
+
+      // Loop over rows.
+      __ movq(m, matrix);
+      __ xorq(rowofs, rowofs);
+      __ LoopStart(&l3);
+
+      // Multiply x[row] with remaining columns of W[row] and add to sum.
+      __ vbroadcastss(elem, Operand(input, rowofs));
+      if (wtype != DT_FLOAT) {
+        __ LoadFloats(acc[0], Operand(m), wtype, zeromask);
+        if (fma) {
+          __ vfmadd231ps(sum[0], elem, acc[0]);
+        } else {
+          __ vmulps(acc[0], elem, acc[0]);
+          __ vaddps(sum[0], sum[0], acc[0]);
+        }
+      } else if (fma) {
+        __ vfmadd231ps(sum[0], elem, Operand(m), mask);
+      } else {
+        __ vmulps(acc[0], elem, Operand(m), zeromask);
+        __ vaddps(sum[0], sum[0], acc[0]);
+      }
+
+      // Next row.
+      if (rows > 1) {
+        __ addq(m, Immediate(W->stride(0)));
+        __ addq(rowofs, Immediate(sizeof(float)));
+        __ cmpq(rowofs, Immediate(rows * sizeof(float)));
+        __ j(less, &l3);
+      }
+
+      // Compute relu and save remaining columns.
+      if (bias_ && strict) {
+        __ vaddps(sum[0], sum[0], Operand(vector, coldisp), zeromask);
+      }
+      if (relu_) {
+        __ vmaxps(sum[0], sum[0], zero);
+      }
+      __ vmovaps(Operand(output, coldisp), sum[0], mask);
+    }
+  }
+};
+
+class AVX512FltVecMatMulV : public AVX512FltVecMatMulVBase {
+ public:
+  AVX512FltVecMatMulV() : AVX512FltVecMatMulVBase(false, false) {}
+
+  string Name() override { return "AVX512FltVecMatMulV"; }
+  string Operation() override { return "MatMul"; }
+};
+
+class AVX512FltVecMatMulAddV : public AVX512FltVecMatMulVBase {
+ public:
+  AVX512FltVecMatMulAddV() : AVX512FltVecMatMulVBase(true, false) {}
+
+  string Name() override { return "AVX512FltVecMatMulAddV"; }
+  string Operation() override { return "MatMulAdd"; }
+};
+
+class AVX512FltVecMatMulReluV : public AVX512FltVecMatMulVBase {
+ public:
+  AVX512FltVecMatMulReluV() : AVX512FltVecMatMulVBase(false, true) {}
+
+  string Name() override { return "AVX512FltVecMatMulReluV"; }
+  string Operation() override { return "MatMulRelu"; }
+};
+
+class AVX512FltVecMatMulAddReluV : public AVX512FltVecMatMulVBase {
+ public:
+  AVX512FltVecMatMulAddReluV() : AVX512FltVecMatMulVBase(true, true) {}
+
+  string Name() override { return "AVX512FltVecMatMulAddReluV"; }
+  string Operation() override { return "MatMulAddRelu"; }
+};
+
+// Horizontal float vector-matrix multiplication for CPUs with AVX-512.
+class AVX512FltVecMatMulHBase : public AVX512VecMatMulBase {
+ public:
+  // Maximum number of loop unrolls.
+  static const int kMaxUnrolls = 4;
+
+  // Maximum number of adder registers.
+  static const int kMaxAdders = 4;
+
+  AVX512FltVecMatMulHBase(bool bias, bool relu)
+      : AVX512VecMatMulBase(bias, relu, COLUMN_MAJOR) {}
+
+  bool Supports(Step *step) override {
+    if (!AVX512VecMatMulBase::Supports(step)) return false;
+
+    // Horizontal summation is not strict math compatible.
+    if (step->GetAttr("strict", false)) return false;
+
+    return true;
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    Registers &rr = masm->rr();
+    SIMDRegisters &mm = masm->mm();
+    Label l1, l2;
+
+    // Get input and output tensors.
+    Tensor *x = step->input(0);
+    Tensor *W = step->input(1);
+    Tensor *b = bias_ ? step->input(2) : nullptr;
+    Tensor *y = step->output(0);
+
+    // Get matrix dimensions.
+    int rows = W->dim(0);
+    int cols = W->dim(1);
+    int main_rows = (rows  / 16) * 16;
+    int remaining_rows = rows - main_rows;
+    int row_size = W->stride(1);
+
+    // Compute the number of unrolls and adders.
+    int unrolls = 0;
+    for (int i = 1; i <= kMaxUnrolls; ++i) {
+      int batch_size = i * 16;
+      if (main_rows >= batch_size && main_rows % batch_size == 0) unrolls = i;
+    }
+    int adders = unrolls;
+    if (adders < 1) adders = 1;
+    if (adders > kMaxAdders) adders = kMaxAdders;
+    string variant = "U" + std::to_string(unrolls);
+    variant += "A" + std::to_string(adders);
+    if (remaining_rows > 0) variant += "R" + std::to_string(remaining_rows);
+    step->set_variant(variant);
+
+    // Allocate general registers.
+    Register row = rr.alloc();
+    Register col = rr.alloc();
+    Register matrix = rr.alloc();
+    Register input = rr.alloc();
+    Register output = rr.alloc();
+    Register vector = bias_ ? rr.alloc() : no_reg;
+
+    // Allocate SIMD registers.
+    std::vector<ZMMRegister> elem;
+    for (int i = 0; i < std::max(unrolls, 1); ++i) {
+      elem.push_back(mm.allocz());
+    }
+    std::vector<ZMMRegister> sum;
+    for (int i = 0; i < adders; ++i) {
+      sum.push_back(mm.allocz());
+    }
+    ZMMRegister acc = mm.allocz();
+    ZMMRegister zero = relu_ ? mm.allocz() : no_zmm_reg;
+
+    // Load tensor locations.
+    __ LoadTensorAddress(input, x);
+    __ LoadTensorAddress(matrix, W);
+    if (bias_) {
+      __ LoadTensorAddress(vector, b);
+    }
+    __ LoadTensorAddress(output, y);
+    __ xorq(col, col);
+    if (relu_) {
+      __ vpxord(zero, zero, zero);
+    }
+
+    // Set mask for remaining rows.
+    Mask mask(k1);
+    Mask zeromask(k1, zeroing);
+    if (remaining_rows > 0) {
+      __ movq(row, Immediate((1 << remaining_rows) - 1));
+      __ kmovw(k1, row);
+    }
+
+    // Outer loop over columns.
+    __ LoopStart(&l1);
+
+    // Initialize sum with bias or zero. Loading the bias with a scalar move
+    // clears the remaining elements of the zmm register.
+    if (bias_) {
+      __ vmovss(sum[0].xmm(), Operand(vector, col, times_4));
+    } else {
+      __ vpxord(sum[0], sum[0], sum[0]);
+    }
+    for (int i = 1; i < adders; ++i) {
+      __ vpxord(sum[i], sum[i], sum[i]);
+    }
+
+    // Inner loop over main rows.
+    if (unrolls > 0) {
+      __ xorq(row, row);
+      __ LoopStart(&l2);
+      for (int i = 0; i < unrolls; ++i) {
+        // Load x[row:row+16].
+        int disp = 16 * i * sizeof(float);
+        __ vmovaps(elem[i], Operand(input, row, times_4, disp));
+      }
+      for (int i = 0; i < unrolls; ++i) {
+        // Multiply x[row:row+16] with W[row:row+16,col] and add to sum.
+        int disp = 16 * i * sizeof(float);
+        __ vfmadd231ps(sum[i % adders], elem[i],
+                       Operand(matrix, row, times_4, disp));
+      }
+
+      // Move to next row batch.
+      if (main_rows > 16 * unrolls) {
+        __ addq(row, Immediate(16 * unrolls));
+        __ cmpq(row, Immediate(main_rows));
+        __ j(less, &l2);
+      }
+    }
+
+    // Add remaining rows using masked multiply.
+    if (remaining_rows > 0) {
+      int disp = main_rows * sizeof(float);
+      __ vmovaps(elem[0], Operand(input, disp), zeromask);
+      __ vfmadd231ps(sum[0], elem[0], Operand(matrix, disp), mask);
+    }
+
+    // Sum adders in sum[0].
+    if (adders == 4) {
+      __ vaddps(sum[0], sum[0], sum[2]);
+      __ vaddps(sum[1], sum[1], sum[3]);
+      __ vaddps(sum[0], sum[0], sum[1]);
+    } else {
+      for (int i = 1; i < adders; ++i) {
+        __ vaddps(sum[0], sum[0], sum[i]);
+      }
+    }
+
+    // Add elements in sum[0] horizontally.
+    __ vextractf64x4(acc.ymm(), sum[0], 1);
+    __ vaddps(sum[0].ymm(), sum[0].ymm(), acc.ymm());
+    __ vperm2f128(acc.ymm(), sum[0].ymm(), sum[0].ymm(), 1);
+    __ vhaddps(sum[0].ymm(), sum[0].ymm(), acc.ymm());
+    __ vhaddps(sum[0].ymm(), sum[0].ymm(), sum[0].ymm());
+    __ vhaddps(sum[0].ymm(), sum[0].ymm(), sum[0].ymm());
+
+    // Compute relu.
+    if (relu_) {
+      __ vmaxss(sum[0].xmm(), sum[0].xmm(), zero.xmm());
+    }
+
+    // Save to y[col].
+    __ vmovss(Operand(output, col, times_4), sum[0].xmm());
+
+    // Move to next column.
+    if (cols > 1) {
+      __ addq(col, Immediate(1));
+      __ addq(matrix, Immediate(row_size));
+      __ cmpq(col, Immediate(cols));
+      __ j(less, &l1);
+    }
+  }
+};
+
+class AVX512FltVecMatMulH : public AVX512FltVecMatMulHBase {
+ public:
+  AVX512FltVecMatMulH() : AVX512FltVecMatMulHBase(false, false) {}
+
+  string Name() override { return "AVX512FltVecMatMulH"; }
+  string Operation() override { return "MatMul"; }
+};
+
+class AVX512FltVecMatMulAddH : public AVX512FltVecMatMulHBase {
+ public:
+  AVX512FltVecMatMulAddH() : AVX512FltVecMatMulHBase(true, false) {}
+
+  string Name() override { return "AVX512FltVecMatMulAddH"; }
+  string Operation() override { return "MatMulAdd"; }
+};
+
+class AVX512FltVecMatMulReluH : public AVX512FltVecMatMulHBase {
+ public:
+  AVX512FltVecMatMulReluH() : AVX512FltVecMatMulHBase(false, true) {}
+
+  string Name() override { return "AVX512FltVecMatMulReluH"; }
+  string Operation() override { return "MatMulRelu"; }
+};
+
+class AVX512FltVecMatMulAddReluH : public AVX512FltVecMatMulHBase {
+ public:
+  AVX512FltVecMatMulAddReluH() : AVX512FltVecMatMulHBase(true, true) {}
+
+  string Name() override { return "AVX512FltVecMatMulAddReluH"; }
+  string Operation() override { return "MatMulAddRelu"; }
+};
+
+void RegisterAVX512MatMul(Library *library) {
+  // Computes  : y = x * W
+  // Input     : x: float32[1,n]
+  //             W: float32[n,m] column-major
+  // Output    : y: float32[1,m]
+  // Requires  : AVX512F
+  library->Register(new AVX512FltVecMatMulH());
+
+  // Computes  : y = x * W + b
+  // Input     : x: float32[1,n]
+  //             W: float32[n,m] column-major
+  //             b: float32[1,n]
+  // Output    : y: float32[1,m]
+  // Requires  : AVX512F
+  library->Register(new AVX512FltVecMatMulAddH());
+
+  // Computes  : y = max(0, x * W)
+  // Input     : x: float32[1,n]
+  //             W: float32[n,m] column-major
+  // Output    : y: float32[1,m]
+  // Requires  : AVX512F
+  library->Register(new AVX512FltVecMatMulReluH());
+
+  // Computes  : y = max(0, x * W + b)
+  // Input     : x: float32[1,n]
+  //             W: float32[n,m] column-major
+  //             b: float32[1,n]
+  // Output    : y: float32[1,m]
+  // Requires  : AVX512F
+  library->Register(new AVX512FltVecMatMulAddReluH());
+
+  // Computes  : y = x * W
+  // Input     : x: float32[1,n]
+  //             W: float32[n,m] row-major
+  // Output    : y: float32[1,m]
+  // Requires  : AVX512F
+  library->Register(new AVX512FltVecMatMulV());
+
+  // Computes  : y = x * W + b
+  // Input     : x: float32[1,n]
+  //             W: float32[n,m] row-major
+  //             b: float32[1,n]
+  // Output    : y: float32[1,m]
+  // Requires  : AVX512F
+  library->Register(new AVX512FltVecMatMulAddV());
+
+  // Computes  : y = max(0, x * W)
+  // Input     : x: float32[1,n]
+  //             W: float32[n,m] row-major
+  // Output    : y: float32[1,m]
+  // Requires  : AVX512F
+  library->Register(new AVX512FltVecMatMulReluV());
+
+  // Computes  : y = max(0, x * W + b)
+  // Input     : x: float32[1,n]
+  //             W: float32[n,m] row-major
+  //             b: float32[1,n]
+  // Output    : y: float32[1,m]
+  // Requires  : AVX512F
+  library->Register(new AVX512FltVecMatMulAddReluV());
+}
+
+}  // namespace myelin
+}  // namespace sling
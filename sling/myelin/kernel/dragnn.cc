@@ -39,7 +39,8 @@ class DragnnInitializer : public Kernel {
 };
 
 // Dragnn feature collect operation for recurrent features mapped through an
-// embedding matrix.
+// embedding matrix. For batched inputs, the output has a row for each feature
+// in each row of the input.
 class DragnnCollect : public Kernel {
  public:
   string Name() override { return "DragnnCollect"; }
@@ -57,7 +58,7 @@ class DragnnCollect : public Kernel {
     if (M->type() != DT_FLOAT || M->rank() != 2) return false;
     if (R->type() != DT_FLOAT || R->rank() != 2) return false;
 
-    if (f->dim(0) != 1 || f->dim(1) != R->dim(0)) return false;
+    if (f->rank() != 2 || f->elements() != R->dim(0)) return false;
     if (R->dim(1) != M->dim(1) + 1) return false;
 
     return true;
@@ -81,7 +82,7 @@ class DragnnCollect : public Kernel {
     int dims = M->dim(1);
 
     // Get number input features.
-    int num_features = f->dim(1);
+    int num_features = f->elements();
 
     // Allocate registers.
     rr.use(rsi);
@@ -148,7 +149,9 @@ class DragnnCollect : public Kernel {
 };
 
 // Dragnn feature lookup operation for fixed features mapped through an
-// embedding matrix.
+// embedding matrix. For batched inputs, each row of features is summed into
+// the corresponding row of the output. The embedding matrix can be stored as
+// half-precision or bfloat16 floats.
 class DragnnLookup : public Kernel {
  public:
   string Name() override { return "DragnnLookup"; }
@@ -163,9 +166,13 @@ class DragnnLookup : public Kernel {
     Tensor *M = step->input(1);
     Tensor *v = step->output(0);
     if (f->type() != DT_INT32) return false;
-    if (M->type() != DT_FLOAT || M->rank() != 2) return false;
+    if (M->rank() != 2) return false;
+    if (!MacroAssembler::SupportsFloatType(M->type(), 32)) return false;
     if (v->type() != DT_FLOAT || v->rank() != 2) return false;
-    if (v->dim(0) != 1 || v->dim(1) != M->dim(1)) return false;
+    if (v->dim(1) != M->dim(1)) return false;
+
+    // Each row of the feature input is looked up separately for batches.
+    if (f->rank() != 2 || f->dim(0) != v->dim(0)) return false;
 
     return true;
   }
@@ -178,7 +185,7 @@ class DragnnLookup : public Kernel {
   void Generate(Step *step, MacroAssembler *masm) override {
     Registers &rr = masm->rr();
     SIMDRegisters &mm = masm->mm();
-    Label l1, l2, l3, l4;
+    Label l0, l1, l2, l3, l4;
 
     // Get inputs and outputs.
     Tensor *f = step->input(0);
@@ -189,8 +196,9 @@ class DragnnLookup : public Kernel {
     int embedding_size = M->dim(0) - 1;
     int embedding_dims = v->dim(1);
 
-    // Get number input features.
+    // Get number input features and batch size.
     int num_features = f->dim(1);
+    int batch_size = v->dim(0);
 
     // Allocate registers.
     Register acc = rr.alloc();
@@ -200,15 +208,25 @@ class DragnnLookup : public Kernel {
     Register col = rr.alloc();
     Register row = rr.alloc();
     Register oov = rr.alloc();
+    Register batch = batch_size > 1 ? rr.alloc() : no_reg;
     XMMRegister elem = mm.allocx();
+    Type mtype = M->type();
+    XMMRegister value = mtype != DT_FLOAT ? mm.allocx() : no_xmm_reg;
+    ScaleFactor mscale = mtype == DT_FLOAT ? times_4 : times_2;
 
     // Load tensor locations.
     __ LoadTensorAddress(input, f);
     __ LoadTensorAddress(embeddings, M);
     __ LoadTensorAddress(output, v);
 
-    // Loop over input features.
+    // Loop over batch.
     __ movq(oov, Immediate(embedding_size));
+    if (batch_size > 1) {
+      __ xorq(batch, batch);
+      __ LoopStart(&l0);
+    }
+
+    // Loop over input features.
     __ xorq(col, col);
     __ LoopStart(&l1);
 
@@ -231,7 +249,12 @@ class DragnnLookup : public Kernel {
     __ xorq(row, row);
     __ LoopStart(&l3);
     __ movss(elem, Operand(output, row, times_4));
-    __ addss(elem, Operand(acc, row, times_4));
+    if (mtype == DT_FLOAT) {
+      __ addss(elem, Operand(acc, row, times_4));
+    } else {
+      __ LoadFloat(value, Operand(acc, row, mscale), mtype);
+      __ addss(elem, value);
+    }
     __ movss(Operand(output, row, times_4), elem);
     __ incq(row);
     __ cmpq(row, Immediate(embedding_dims));
@@ -242,6 +265,15 @@ class DragnnLookup : public Kernel {
     __ incq(col);
     __ cmpq(col, Immediate(num_features));
     __ j(not_equal, &l1);
+
+    // Next batch element.
+    if (batch_size > 1) {
+      __ addq(input, Immediate(f->stride(0)));
+      __ addq(output, Immediate(v->stride(0)));
+      __ incq(batch);
+      __ cmpq(batch, Immediate(batch_size));
+      __ j(not_equal, &l0);
+    }
   }
 
   int64 Complexity(const Step *step) override {
@@ -329,7 +361,8 @@ class DragnnLookupSingle : public Kernel {
 
 // Dragnn feature lookup operation for fixed features mapped through an
 // embedding matrix. This can be used when the size of the embedding is small
-// enough to fit into registers.
+// enough to fit into registers. The embedding matrix can be stored as
+// half-precision or bfloat16 floats.
 class DragnnLookupUnrolled : public Kernel {
  public:
   string Name() override { return "DragnnLookupUnrolled"; }
@@ -350,13 +383,16 @@ class DragnnLookupUnrolled : public Kernel {
     Tensor *M = step->input(1);
     Tensor *v = step->output(0);
     if (f->type() != DT_INT32) return false;
-    if (M->type() != DT_FLOAT || M->rank() != 2) return false;
+    if (M->rank() != 2) return false;
+    if (!MacroAssembler::SupportsFloatType(M->type(), 256)) return false;
     if (v->type() != DT_FLOAT || v->rank() != 2) return false;
     if (v->dim(0) != 1 || v->dim(1) != M->dim(1)) return false;
 
     // Check if embedding dimension allows us to unroll.
     int embedding_dims = M->dim(1);
-    if (embedding_dims > kMaxEmbeddingDim) return false;
+    int max_dims = kMaxEmbeddingDim;
+    if (M->type() != DT_FLOAT) max_dims -= kBlockSize;
+    if (embedding_dims > max_dims) return false;
     if (embedding_dims % kBlockSize != 0) return false;
 
     return true;
@@ -399,10 +435,14 @@ class DragnnLookupUnrolled : public Kernel {
     Register col = rr.alloc();
     Register oov = rr.alloc();
 
-    // Allocate registers for summing embedding vectors.
+    // Allocate registers for summing embedding vectors. Embeddings with
+    // 16-bit floats need an extra register for conversion.
     std::vector<YMMRegister> sum;
     int blocks = embedding_dims / kBlockSize;
     for (int i = 0; i < blocks; ++i) sum.push_back(mm.allocy());
+    Type mtype = M->type();
+    int mblock = kBlockSize * M->element_size();
+    YMMRegister value = mtype != DT_FLOAT ? mm.allocy() : no_ymm_reg;
 
     // Load tensor locations.
     __ LoadTensorAddress(input, f);
@@ -436,7 +476,12 @@ class DragnnLookupUnrolled : public Kernel {
 
     // Add embedding vector to sum.
     for (int i = 0; i < blocks; ++i) {
-      __ vaddps(sum[i], sum[i], Operand(acc, i * kBlockSize * sizeof(float)));
+      if (mtype == DT_FLOAT) {
+        __ vaddps(sum[i], sum[i], Operand(acc, i * mblock));
+      } else {
+        __ LoadFloats(value, Operand(acc, i * mblock), mtype);
+        __ vaddps(sum[i], sum[i], value);
+      }
     }
 
     // Next feature.
@@ -481,7 +526,7 @@ class DragnnTyper : public Typer {
         Flow::Variable *result = op->outputs[0];
         if (features->rank() == 2 && embeddings->rank() == 2) {
           // Add extra element for OOV indicator.
-          result->shape.assign(features->dim(1), embeddings->dim(1) + 1);
+          result->shape.assign(features->elements(), embeddings->dim(1) + 1);
           return true;
         }
       }
@@ -535,6 +580,9 @@ class PrecomputedEmbeddings : public Transformer {
       Flow::Variable *embedding = lookup->inputs[1];
       Flow::Variable *transform = matmul->inputs[1];
       if (embedding->type != transform->type) continue;
+      if (embedding->type == DT_HALF || embedding->type == DT_BFLOAT16) {
+        continue;
+      }
       if (embedding->rank() != 2 || transform->rank() != 2) continue;
 
       // Multiply the embeddings with the linear transform.
@@ -216,7 +216,8 @@ class GenericFltRelu : public GenericFltMathFunction {
   string FunctionSymbol() override { return "relu"; }
 };
 
-// Compute argmax of input.
+// Compute argmax of input. If there is a second input, it is a bit mask with
+// the elements that can be selected.
 class GenericFltArgMax : public Kernel {
  public:
   string Name() override { return "GenFltArgMax"; }
@@ -224,7 +225,7 @@ class GenericFltArgMax : public Kernel {
 
   bool Supports(Step *step) override {
     // Check inputs and outputs.
-    if (step->inputs().size() != 1) return false;
+    if (step->inputs().size() != 1 && step->inputs().size() != 2) return false;
     if (step->outputs().size() != 1) return false;
     Tensor *x = step->input(0);
     Tensor *y = step->output(0);
@@ -234,6 +235,13 @@ class GenericFltArgMax : public Kernel {
     if (y->type() != DT_INT32 && y->type() != DT_INT64) return false;
     if (y->elements() != 1) return false;
 
+    // Check mask.
+    if (step->inputs().size() == 2) {
+      Tensor *m = step->input(1);
+      if (m->type() != DT_INT64) return false;
+      if (m->elements() * 64 < x->elements()) return false;
+    }
+
     return true;
   }
 
@@ -241,6 +249,7 @@ class GenericFltArgMax : public Kernel {
     // Get input and output.
     Tensor *x = step->input(0);
     Tensor *y = step->output(0);
+    Tensor *m = step->inputs().size() == 2 ? step->input(1) : nullptr;
 
     // Assign registers.
     Register input = masm->rr().alloc();
@@ -253,6 +262,11 @@ class GenericFltArgMax : public Kernel {
     // Load tensor locations.
     __ LoadTensorAddress(input, x);
     __ LoadTensorAddress(output, y);
+    Register bitmask = no_reg;
+    if (m != nullptr) {
+      bitmask = masm->rr().alloc();
+      __ LoadTensorAddress(bitmask, m);
+    }
 
     // Initialize max value.
     __ movq(best, Immediate(-1));
@@ -263,11 +277,17 @@ class GenericFltArgMax : public Kernel {
     Label loop;
     __ LoopStart(&loop);
 
+    // Skip elements that are not in the mask.
+    Label l1;
+    if (m != nullptr) {
+      __ bt(Operand(bitmask), idx);
+      __ j(not_carry, &l1);
+    }
+
     // Get next input value.
     __ movss(value, Operand(input, idx, times_4));
 
     // Check if value is greater than current max value.
-    Label l1;
     __ ucomiss(value, maxval);
     __ j(below_equal, &l1);
     __ movss(maxval, value);
@@ -353,8 +373,9 @@ void RegisterGenericMath(Library *library) {
   // Output    : y: float32[d1,...,dn]
   library->Register(new GenericFltRelu());
 
-  // Computes  : y = argmax(x)
+  // Computes  : y = argmax(x) for elements in the optional mask m
   // Input     : x: float32[d1,...,dn]
+  //             m: int64[(n + 63) / 64] (bit mask, optional)
   // Output    : y: int32/int64
   library->Register(new GenericFltArgMax());
 }
@@ -372,9 +372,10 @@ class StandardTyper : public Typer {
       }
     }
 
-    // Infer shape for argmax operation.
+    // Infer shape for argmax operation. The optional second input is a mask.
     if (op->type == "ArgMax") {
-      if (op->indegree() == 1 && op->outdegree() == 1) {
+      if (op->indegree() >= 1 && op->indegree() <= 2 &&
+          op->outdegree() == 1) {
         Flow::Variable *y = op->outputs[0];
         if (y->type == DT_INVALID) y->type = DT_INT32;
         y->shape.redim(0);
@@ -382,6 +383,53 @@ class StandardTyper : public Typer {
       }
     }
 
+    // Infer shape for reduction operations. The reduction axes are given by an
+    // optional second input and all axes are reduced if it is omitted.
+    if (op->type == "Sum" ||
+        op->type == "Max" ||
+        op->type == "Min" ||
+        op->type == "Mean") {
+      if (op->indegree() >= 1 && op->indegree() <= 2 &&
+          op->outdegree() == 1) {
+        Flow::Variable *x = op->inputs[0];
+        Flow::Variable *y = op->outputs[0];
+        int rank = x->rank();
+        std::vector<bool> reduced(rank, op->indegree() == 1);
+        if (op->indegree() == 2) {
+          std::vector<int> axes;
+          if (!op->inputs[1]->GetData(&axes)) return false;
+          for (int axis : axes) {
+            if (axis < 0) axis += rank;
+            if (axis < 0 || axis >= rank) return false;
+            reduced[axis] = true;
+          }
+        }
+        bool keep_dims = op->GetAttr("keep_dims", false);
+        Shape shape;
+        for (int d = 0; d < rank; ++d) {
+          if (!reduced[d]) {
+            shape.add(x->dim(d));
+          } else if (keep_dims) {
+            shape.add(1);
+          }
+        }
+        y->shape = shape;
+        if (y->type == DT_INVALID) y->type = x->type;
+        return true;
+      }
+    }
+
+    // Infer shape for softmax operations.
+    if (op->type == "Softmax" || op->type == "LogSoftmax") {
+      if (op->indegree() == 1 && op->outdegree() == 1) {
+        Flow::Variable *x = op->inputs[0];
+        Flow::Variable *y = op->outputs[0];
+        y->shape = x->shape;
+        if (y->type == DT_INVALID) y->type = x->type;
+        return true;
+      }
+    }
+
     // Infer shape for tf.fill(dims, value).
     if (op->type == "Fill") {
       std::vector<int> dims;
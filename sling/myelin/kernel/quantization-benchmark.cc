@@ -0,0 +1,177 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmark for quantized matrix multiplication. This compiles a dense layer
+// with float weights and with int8 weights converted by QuantizeFlow() for
+// square layers of increasing width, and reports the throughput of both and
+// the error of the quantized output relative to the float output. The layers
+// are compiled both with the AVX-512 kernels and with the AVX2 kernels if the
+// CPU supports them.
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "sling/base/clock.h"
+#include "sling/base/flags.h"
+#include "sling/base/init.h"
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/myelin/builder.h"
+#include "sling/myelin/compute.h"
+#include "sling/myelin/flow.h"
+#include "sling/myelin/kernel/quantization.h"
+#include "sling/myelin/kernel/tensorflow.h"
+#include "third_party/jit/cpu.h"
+
+DEFINE_int32(rows, 1, "Number of input rows for each layer");
+DEFINE_int32(min_width, 256, "Width of the smallest layer");
+DEFINE_int32(max_width, 1024, "Width of the largest layer");
+DEFINE_int64(flops, 2000000000, "Number of operations timed per layer");
+
+using namespace sling;
+using namespace sling::myelin;
+
+// Dense layer y = x * W + b compiled with float or quantized weights.
+class Layer {
+ public:
+  Layer(int width, const std::vector<float> &weights,
+        const std::vector<float> &bias, bool quantize) {
+    Builder f(&flow_, "f");
+    auto *x = f.Var("f/x", DT_FLOAT, {FLAGS_rows, width});
+    auto *w = f.Constant(weights.data(), DT_FLOAT, {width, width});
+    auto *b = f.Constant(bias.data(), DT_FLOAT, {1, width});
+    auto *z = f.MatMul(x, w);
+    z->type = DT_FLOAT;
+    z->shape.assign(FLAGS_rows, width);
+    auto *y = f.Add(z, b);
+    y->type = DT_FLOAT;
+    y->shape.assign(FLAGS_rows, width);
+    output_ = y->name;
+    if (quantize) CHECK_EQ(QuantizeFlow(&flow_), 1);
+
+    RegisterTensorflowLibrary(&library_);
+    flow_.Analyze(library_);
+    CHECK(network_.Compile(flow_, library_));
+    cell_ = network_.GetCell("f");
+    x_ = network_.GetParameter("f/x");
+    y_ = network_.GetParameter(output_);
+    data_ = new Instance(cell_);
+  }
+
+  ~Layer() { delete data_; }
+
+  // Compute layer for input and return the output.
+  const float *Compute(const std::vector<float> &input) {
+    int width = x_->dim(1);
+    for (int r = 0; r < FLAGS_rows; ++r) {
+      float *x = data_->Get<float>(x_, r);
+      std::copy(&input[r * width], &input[(r + 1) * width], x);
+    }
+    data_->Compute();
+    return data_->Get<float>(y_);
+  }
+
+  // Return the number of operations per second for computing the layer.
+  double GigaFlops() {
+    int width = x_->dim(1);
+    double flops = 2.0 * FLAGS_rows * width * width;
+    int64 repeat = std::max<int64>(FLAGS_flops / flops, 10);
+    Clock clock;
+    clock.start();
+    for (int64 i = 0; i < repeat; ++i) data_->Compute();
+    clock.stop();
+    return flops * repeat / clock.secs() / 1e9;
+  }
+
+  // Return name of matrix multiplication kernel.
+  string Kernel() const {
+    for (Step *step : cell_->steps()) {
+      const string &name = step->kernel()->Name();
+      if (name.find("MatMul") != string::npos) return name;
+    }
+    return "?";
+  }
+
+ private:
+  Flow flow_;
+  Library library_;
+  Network network_;
+  Cell *cell_;
+  Tensor *x_;
+  Tensor *y_;
+  string output_;
+  Instance *data_;
+};
+
+// Benchmark float and quantized layers with the enabled CPU features.
+void Benchmark(const char *isa) {
+  for (int width = FLAGS_min_width; width <= FLAGS_max_width; width *= 2) {
+    // Generate random weights scaled to keep the output range independent of
+    // the layer width.
+    std::mt19937 rnd(width);
+    std::normal_distribution<float> normal(0.0, 1.0 / sqrt(width));
+    std::uniform_real_distribution<float> uniform(-1.0, 1.0);
+    std::vector<float> weights(width * width);
+    std::vector<float> bias(width);
+    std::vector<float> input(FLAGS_rows * width);
+    for (float &w : weights) w = normal(rnd);
+    for (float &b : bias) b = uniform(rnd);
+    for (float &x : input) x = uniform(rnd);
+
+    // Compute float and quantized layers.
+    Layer flt(width, weights, bias, false);
+    Layer q8(width, weights, bias, true);
+    const float *expected = flt.Compute(input);
+    const float *actual = q8.Compute(input);
+
+    // Compare outputs. The error is relative to the largest float output.
+    double max_error = 0.0;
+    double max_value = 0.0;
+    double sum_error = 0.0;
+    int n = FLAGS_rows * width;
+    for (int i = 0; i < n; ++i) {
+      double error = fabs(actual[i] - expected[i]);
+      max_error = std::max(max_error, error);
+      max_value = std::max<double>(max_value, fabs(expected[i]));
+      sum_error += error;
+    }
+
+    double float_gflops = flt.GigaFlops();
+    double int8_gflops = q8.GigaFlops();
+    printf("%-8s %6d %5d %10.1f %10.1f %8.2f %10.4f %10.4f  %s\n",
+           isa, width, FLAGS_rows, float_gflops, int8_gflops,
+           int8_gflops / float_gflops, max_error / max_value,
+           sum_error / n / max_value, q8.Kernel().c_str());
+  }
+}
+
+int main(int argc, char *argv[]) {
+  InitProgram(&argc, &argv);
+  CHECK(jit::CPU::Enabled(jit::AVX2)) << "Quantization requires AVX2";
+
+  printf("%-8s %6s %5s %10s %10s %8s %10s %10s  %s\n",
+         "isa", "width", "rows", "float", "int8", "speedup",
+         "max error", "avg error", "kernel");
+  if (jit::CPU::Enabled(jit::AVX512F)) {
+    Benchmark("avx512");
+    jit::CPU::Disable(jit::AVX512F);
+  }
+  Benchmark("avx2");
+
+  return 0;
+}
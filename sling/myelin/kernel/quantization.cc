@@ -0,0 +1,877 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/myelin/kernel/quantization.h"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/myelin/compute.h"
+#include "sling/myelin/flow.h"
+#include "sling/myelin/macro-assembler.h"
+
+#define __ masm->
+
+namespace sling {
+namespace myelin {
+
+using namespace jit;
+
+// The quantized matrices are stored in panels of 16 columns. Each panel is
+// divided into blocks of four rows, and each block holds the four weights for
+// the first column followed by the four weights for the second column and so
+// on. This matches the 32-bit lanes of the vpdpbusd instruction, so a block
+// can be multiplied with four broadcast input values in one instruction.
+static const int kPanelColumns = 16;
+static const int kBlockRows = 4;
+static const int kBlockSize = kPanelColumns * kBlockRows;
+
+// The quantized inputs are offset by 128 to make them unsigned.
+static const int kInputOffset = 128;
+
+// Quantized matrix with scales and offset corrections for each column.
+struct QuantizedMatrix {
+  Flow::Variable *weights;  // int8 weights in panel layout
+  Flow::Variable *scales;   // float scale for each column
+  Flow::Variable *offsets;  // input offset times the column sum
+};
+
+// Quantize float matrix to int8 with a scale for each column.
+static QuantizedMatrix QuantizeMatrix(Flow *flow, Flow::Variable *matrix) {
+  int rows = matrix->dim(0);
+  int cols = matrix->dim(1);
+  int blocks = (rows + kBlockRows - 1) / kBlockRows;
+  int panels = (cols + kPanelColumns - 1) / kPanelColumns;
+  int width = panels * kPanelColumns;
+  const float *data = reinterpret_cast<const float *>(matrix->data);
+
+  // Allocate quantized matrix. Padding rows and columns are zero.
+  QuantizedMatrix q;
+  q.weights = flow->AddVariable(matrix->name + "/quantized", DT_INT8,
+                                {panels, blocks, kBlockSize});
+  q.scales = flow->AddVariable(matrix->name + "/scales", DT_FLOAT, {width});
+  q.offsets = flow->AddVariable(matrix->name + "/offsets", DT_INT32, {width});
+  int weights_size = panels * blocks * kBlockSize;
+  int8 *weights =
+      reinterpret_cast<int8 *>(flow->AllocateMemory(weights_size));
+  float *scales = reinterpret_cast<float *>(
+      flow->AllocateMemory(width * sizeof(float)));
+  int32 *offsets = reinterpret_cast<int32 *>(
+      flow->AllocateMemory(width * sizeof(int32)));
+  memset(weights, 0, weights_size);
+  memset(scales, 0, width * sizeof(float));
+  memset(offsets, 0, width * sizeof(int32));
+
+  for (int col = 0; col < cols; ++col) {
+    // Scale column so the largest weight is mapped to 127.
+    float max = 0.0;
+    for (int row = 0; row < rows; ++row) {
+      max = std::max(max, fabsf(data[row * cols + col]));
+    }
+    float scale = max / 127.0;
+
+    // Quantize column.
+    int32 sum = 0;
+    int8 *panel = weights + (col / kPanelColumns) * blocks * kBlockSize;
+    int lane = (col % kPanelColumns) * kBlockRows;
+    for (int row = 0; row < rows; ++row) {
+      int value = 0;
+      if (scale > 0.0) {
+        value = lrintf(data[row * cols + col] / scale);
+        value = std::min(std::max(value, -127), 127);
+      }
+      int block = row / kBlockRows;
+      panel[block * kBlockSize + lane + row % kBlockRows] = value;
+      sum += value;
+    }
+    scales[col] = scale;
+    offsets[col] = kInputOffset * sum;
+  }
+
+  q.weights->SetData(weights, weights_size);
+  q.scales->SetData(scales, width * sizeof(float));
+  q.offsets->SetData(offsets, width * sizeof(int32));
+  return q;
+}
+
+int QuantizeFlow(Flow *flow, int min_weights) {
+  // Find matrix multiplications with constant float matrices.
+  std::vector<Flow::Operation *> matmuls;
+  for (Flow::Operation *op : flow->ops()) {
+    if (op->type != "MatMul" || op->func == nullptr) continue;
+    if (op->indegree() != 2 || op->outdegree() != 1) continue;
+    if (op->GetAttr("transpose_a", false)) continue;
+    if (op->GetAttr("transpose_b", false)) continue;
+    Flow::Variable *x = op->inputs[0];
+    Flow::Variable *W = op->inputs[1];
+    if (!W->constant() || W->type != DT_FLOAT || W->rank() != 2) continue;
+    if (x->type != DT_FLOAT || x->rank() != 2 || x->dim(0) < 1) continue;
+    if (x->dim(1) != W->dim(0)) continue;
+    if (W->elements() < min_weights) continue;
+
+    // Leave embedding lookups for the precomputed embedding transformation.
+    Flow::Operation *reshape = x->producer;
+    if (reshape != nullptr && reshape->type == "Reshape" &&
+        reshape->indegree() > 0) {
+      Flow::Operation *lookup = reshape->inputs[0]->producer;
+      if (lookup != nullptr && lookup->type == "Lookup") continue;
+    }
+
+    matmuls.push_back(op);
+  }
+
+  // Replace matrix multiplications with quantized matrix multiplications. A
+  // matrix is only quantized once if it is used by more than one op, and an
+  // input is only quantized once if it is multiplied with more than one matrix.
+  std::unordered_map<Flow::Variable *, QuantizedMatrix> quantized;
+  std::unordered_map<Flow::Variable *, Flow::Operation *> inputs;
+  for (Flow::Operation *op : matmuls) {
+    Flow::Function *func = op->func;
+    string name = op->name;
+    Flow::Variable *x = op->inputs[0];
+    Flow::Variable *W = op->inputs[1];
+    Flow::Variable *y = op->outputs[0];
+
+    auto f = quantized.find(W);
+    if (f == quantized.end()) {
+      f = quantized.emplace(W, QuantizeMatrix(flow, W)).first;
+    }
+    const QuantizedMatrix &q = f->second;
+
+    int batch = x->dim(0);
+    int depth = q.weights->dim(1) * kBlockRows;
+    int width = q.weights->dim(0) * kPanelColumns;
+    flow->RemoveOperation(op);
+
+    Flow::Operation *&quantize = inputs[x];
+    if (quantize == nullptr || quantize->func != func) {
+      auto *xq = flow->AddVariable(name + "/quantized", DT_UINT8,
+                                   {batch, depth});
+      auto *xs = flow->AddVariable(name + "/scale", DT_FLOAT, {batch, 1});
+      quantize = flow->AddOperation(func, name + "/Quantize", "Quantize",
+                                    {x}, {xq, xs});
+    }
+    Flow::Variable *xq = quantize->outputs[0];
+    Flow::Variable *xs = quantize->outputs[1];
+
+    auto *acc = flow->AddVariable(name + "/accumulator", DT_INT32,
+                                  {batch, width});
+    flow->AddOperation(func, name + "/QuantizedMatMul", "QuantizedMatMul",
+                       {xq, q.weights}, {acc});
+    flow->AddOperation(func, name + "/Dequantize", "Dequantize",
+                       {acc, xs, q.scales, q.offsets}, {y});
+
+    // Remove float matrix when it is no longer used.
+    if (W->consumers.empty()) {
+      quantized.erase(W);
+      flow->DeleteVariable(W);
+    }
+  }
+
+  VLOG(3) << "Quantized " << matmuls.size() << " matrix multiplications";
+  return matmuls.size();
+}
+
+// Convert float to half-precision float with rounding to nearest even.
+static uint16 FloatToHalf(float value) {
+  uint32 bits;
+  memcpy(&bits, &value, sizeof(float));
+  uint16 sign = (bits >> 16) & 0x8000;
+  uint32 magnitude = bits & 0x7fffffff;
+
+  // Infinity and NaN.
+  if (magnitude >= 0x7f800000) {
+    return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0);
+  }
+
+  // Values that round to more than the largest half are mapped to infinity.
+  if (magnitude >= 0x477ff000) return sign | 0x7c00;
+
+  // Values below the smallest normal half are stored as subnormals, which
+  // have a fixed exponent of -24.
+  if (magnitude < 0x38800000) {
+    return sign | static_cast<uint16>(lrintf(fabsf(value) * 16777216.0f));
+  }
+
+  // Rebias exponent and round mantissa to ten bits.
+  magnitude -= (127 - 15) << 23;
+  magnitude += 0xfff + ((magnitude >> 13) & 1);
+  return sign | (magnitude >> 13);
+}
+
+// Convert float to bfloat16 with rounding to nearest even.
+static uint16 FloatToBfloat16(float value) {
+  uint32 bits;
+  memcpy(&bits, &value, sizeof(float));
+  if ((bits & 0x7fffffff) > 0x7f800000) return (bits >> 16) | 0x40;
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return bits >> 16;
+}
+
+// Check if the matrix can be stored with reduced precision for the consumer.
+static bool SupportsReducedPrecision(Flow::Operation *op,
+                                     Flow::Variable *matrix, Type type) {
+  if (op->indegree() != 2 || op->outdegree() != 1) return false;
+  if (op->inputs[1] != matrix || op->inputs[0] == matrix) return false;
+  Flow::Variable *input = op->inputs[0];
+  Flow::Variable *output = op->outputs[0];
+
+  // Embedding lookups sum the embedding vectors into a float vector.
+  if (op->type == "Lookup") {
+    // Leave embedding lookups for the precomputed embedding transformation.
+    for (Flow::Operation *reshape : output->consumers) {
+      if (reshape->type != "Reshape" || reshape->outdegree() != 1) continue;
+      for (Flow::Operation *matmul : reshape->outputs[0]->consumers) {
+        if (matmul->type == "MatMul" && matmul->indegree() == 2 &&
+            matmul->inputs[1]->constant()) {
+          return false;
+        }
+      }
+    }
+    return MacroAssembler::SupportsFloatType(type, 32);
+  }
+
+  // The matrix multiplication kernels convert blocks of eight weights, so the
+  // matrix must be row-major with whole blocks in each row.
+  if (op->type == "MatMul") {
+    if (op->GetAttr("transpose_a", false)) return false;
+    if (op->GetAttr("transpose_b", false)) return false;
+    if (input->type != DT_FLOAT || input->rank() != 2) return false;
+    if (!input->shape.defined() || input->dim(1) != matrix->dim(0)) {
+      return false;
+    }
+    if (matrix->dim(1) % 8 != 0) return false;
+
+    // Leave embedding lookups for the precomputed embedding transformation.
+    Flow::Operation *reshape = input->producer;
+    if (reshape != nullptr && reshape->type == "Reshape" &&
+        reshape->indegree() > 0) {
+      Flow::Operation *lookup = reshape->inputs[0]->producer;
+      if (lookup != nullptr && lookup->type == "Lookup") return false;
+    }
+
+    // Matrix-matrix multiplications need the GEMM kernel, which requires
+    // AVX-512 or AVX2 with FMA3.
+    if (input->dim(0) != 1) {
+      if (!CPU::Enabled(AVX512F) &&
+          !(CPU::Enabled(AVX2) && CPU::Enabled(FMA3))) {
+        return false;
+      }
+    }
+    int bits = CPU::Enabled(AVX512F) ? 512 : 256;
+    return MacroAssembler::SupportsFloatType(type, bits);
+  }
+
+  return false;
+}
+
+int ReduceWeightPrecision(Flow *flow, Type type, int min_weights) {
+  CHECK(type == DT_HALF || type == DT_BFLOAT16) << "Invalid type: " << type;
+
+  // Find constant float matrices where all consumers support the reduced
+  // precision.
+  std::vector<Flow::Variable *> matrices;
+  for (Flow::Variable *var : flow->vars()) {
+    if (!var->constant() || var->type != DT_FLOAT || var->rank() != 2) continue;
+    if (var->elements() < min_weights || var->consumers.empty()) continue;
+    if (var->size != var->elements() * sizeof(float)) continue;
+    bool supported = true;
+    for (Flow::Operation *op : var->consumers) {
+      if (!SupportsReducedPrecision(op, var, type)) {
+        supported = false;
+        break;
+      }
+    }
+    if (supported) matrices.push_back(var);
+  }
+
+  // Convert the matrices.
+  for (Flow::Variable *matrix : matrices) {
+    int elements = matrix->elements();
+    const float *data = reinterpret_cast<const float *>(matrix->data);
+    size_t size = elements * sizeof(uint16);
+    uint16 *converted =
+        reinterpret_cast<uint16 *>(flow->AllocateMemory(size));
+    for (int i = 0; i < elements; ++i) {
+      if (type == DT_HALF) {
+        converted[i] = FloatToHalf(data[i]);
+      } else {
+        converted[i] = FloatToBfloat16(data[i]);
+      }
+    }
+    matrix->type = type;
+    matrix->SetData(converted, size);
+  }
+
+  VLOG(3) << "Reduced precision for " << matrices.size() << " matrices";
+  return matrices.size();
+}
+
+// Quantize float input rows to uint8 for quantized matrix multiplication.
+// Each row is scaled so the element with the largest magnitude is mapped to
+// +/-127, and the offset is added to make the values unsigned. The scale is
+// output for each row. The padding at the end of each row is set to the
+// quantized zero value.
+class AVXQuantize : public Kernel {
+ public:
+  string Name() override { return "AVXQuantize"; }
+  string Operation() override { return "Quantize"; }
+
+  bool Supports(Step *step) override {
+    // Requires CPU with AVX2 support.
+    if (!CPU::Enabled(AVX2)) return false;
+
+    // Check inputs and outputs.
+    if (step->indegree() != 1 || step->outdegree() != 2) return false;
+    Tensor *x = step->input(0);
+    Tensor *xq = step->output(0);
+    Tensor *xs = step->output(1);
+    if (x->type() != DT_FLOAT || x->rank() != 2) return false;
+    if (xq->type() != DT_UINT8 || xq->rank() != 2) return false;
+    if (xs->type() != DT_FLOAT || xs->rank() != 2) return false;
+
+    // Check shapes.
+    if (xq->dim(0) != x->dim(0) || xq->dim(1) < x->dim(1)) return false;
+    if (xs->dim(0) != x->dim(0) || xs->dim(1) != 1) return false;
+
+    return true;
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    Registers &rr = masm->rr();
+    SIMDRegisters &mm = masm->mm();
+    Label lrow, l1, l2;
+
+    // Get input and output tensors.
+    Tensor *x = step->input(0);
+    Tensor *xq = step->output(0);
+    Tensor *xs = step->output(1);
+    int batch = x->dim(0);
+    int size = x->dim(1);
+    int padded = xq->dim(1);
+    int main = (size / 8) * 8;
+
+    // Allocate registers.
+    Register input = rr.alloc();
+    Register output = rr.alloc();
+    Register scale = rr.alloc();
+    Register ofs = rr.alloc();
+    Register value = rr.alloc();
+    Register rows = rr.alloc();
+    YMMRegister mask = mm.allocy();
+    YMMRegister max = mm.allocy();
+    YMMRegister factor = mm.allocy();
+    YMMRegister elem = mm.allocy();
+    YMMRegister high = mm.allocy();
+
+    // Load tensor locations.
+    __ LoadTensorAddress(input, x);
+    __ LoadTensorAddress(output, xq);
+    __ LoadTensorAddress(scale, xs);
+    __ vmovaps(mask, masm->GetConstant<int32>(0x7FFFFFFF, 8)->address());
+
+    // Loop over rows.
+    if (batch > 1) {
+      __ movq(rows, Immediate(batch));
+      __ LoopStart(&lrow);
+    }
+
+    // Find the largest absolute value in the row.
+    __ vxorps(max, max, max);
+    if (main > 0) {
+      __ xorq(ofs, ofs);
+      __ LoopStart(&l1);
+      __ vandps(elem, mask, Operand(input, ofs, times_4));
+      __ vmaxps(max, max, elem);
+      __ addq(ofs, Immediate(8));
+      __ cmpq(ofs, Immediate(main));
+      __ j(less, &l1);
+    }
+    for (int i = main; i < size; ++i) {
+      __ vmovss(elem.xmm(), Operand(input, i * sizeof(float)));
+      __ vandps(elem, elem, mask);
+      __ vmaxps(max, max, elem);
+    }
+    __ vperm2f128(elem, max, max, 1);
+    __ vmaxps(max, max, elem);
+    __ vpermilps(elem, max, 0x0E);
+    __ vmaxps(max, max, elem);
+    __ vpermilps(elem, max, 0x01);
+    __ vmaxps(max, max, elem);
+
+    // Output scale for row and compute quantization factor. The maximum is
+    // clamped to avoid division by zero for rows with all zeros.
+    __ vmulss(elem.xmm(), max.xmm(),
+              masm->GetConstant<float>(1.0 / 127.0)->address());
+    __ vmovss(Operand(scale), elem.xmm());
+    __ vmaxss(max.xmm(), max.xmm(),
+              masm->GetConstant<float>(1e-30)->address());
+    __ vmovss(factor.xmm(), masm->GetConstant<float>(127.0)->address());
+    __ vdivss(factor.xmm(), factor.xmm(), max.xmm());
+    __ vbroadcastss(factor, factor);
+
+    // Quantize eight elements at a time.
+    Operand offset = masm->GetConstant<int32>(kInputOffset, 8)->address();
+    if (main > 0) {
+      __ xorq(ofs, ofs);
+      __ LoopStart(&l2);
+      __ vmulps(elem, factor, Operand(input, ofs, times_4));
+      __ vcvtps2dq(elem, elem);
+      __ vpaddd(elem, elem, offset);
+      __ vextractf128(high.xmm(), elem, 1);
+      __ vpackssdw(elem.xmm(), elem.xmm(), high.xmm());
+      __ vpackuswb(elem.xmm(), elem.xmm(), elem.xmm());
+      __ vmovsd(Operand(output, ofs), elem.xmm());
+      __ addq(ofs, Immediate(8));
+      __ cmpq(ofs, Immediate(main));
+      __ j(less, &l2);
+    }
+
+    // Quantize remaining elements.
+    for (int i = main; i < size; ++i) {
+      __ vmulss(elem.xmm(), factor.xmm(), Operand(input, i * sizeof(float)));
+      __ vcvtps2dq(elem.xmm(), elem.xmm());
+      __ vmovd(value, elem.xmm());
+      __ addl(value, Immediate(kInputOffset));
+      __ movb(Operand(output, i), value);
+    }
+
+    // Clear padding.
+    for (int i = size; i < padded; ++i) {
+      __ movb(Operand(output, i), Immediate(kInputOffset));
+    }
+
+    // Next row.
+    if (batch > 1) {
+      __ addq(input, Immediate(x->stride(0)));
+      __ addq(output, Immediate(xq->stride(0)));
+      __ addq(scale, Immediate(xs->stride(0)));
+      __ decq(rows);
+      __ j(not_zero, &lrow);
+    }
+  }
+
+  int64 Complexity(const Step *step) override {
+    return step->input(0)->elements() * 3;
+  }
+};
+
+// Base class for quantized matrix multiplication of uint8 input rows with an
+// int8 matrix in panel layout, producing int32 results. The panels are
+// computed in groups, so each input value is loaded once for all the panels
+// in the group.
+class QuantizedMatMulBase : public Kernel {
+ public:
+  string Operation() override { return "QuantizedMatMul"; }
+
+  bool Supports(Step *step) override {
+    // Check inputs and outputs.
+    if (step->indegree() != 2 || step->outdegree() != 1) return false;
+    Tensor *x = step->input(0);
+    Tensor *W = step->input(1);
+    Tensor *y = step->output(0);
+    if (x->type() != DT_UINT8 || x->rank() != 2) return false;
+    if (W->type() != DT_INT8 || W->rank() != 3) return false;
+    if (y->type() != DT_INT32 || y->rank() != 2) return false;
+
+    // Check shapes.
+    if (W->dim(2) != kBlockSize) return false;
+    if (x->dim(1) != W->dim(1) * kBlockRows) return false;
+    if (y->dim(0) != x->dim(0)) return false;
+    if (y->dim(1) != W->dim(0) * kPanelColumns) return false;
+
+    return true;
+  }
+
+  void Adjust(Step *step) override {
+    // Align panels to cache lines.
+    step->input(1)->SetMiniumAlignment(kBlockSize);
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    Registers &rr = masm->rr();
+    Label lrow, l1;
+
+    // Get input and output tensors.
+    Tensor *x = step->input(0);
+    Tensor *W = step->input(1);
+    Tensor *y = step->output(0);
+    int batch = x->dim(0);
+    int panels = W->dim(0);
+    int unrolls = std::min(panels, MaxPanels());
+    int groups = panels / unrolls;
+    int remaining = panels % unrolls;
+    step->set_variant("P" + std::to_string(unrolls));
+
+    // Allocate registers.
+    Register input = rr.alloc();
+    Register matrix = rr.alloc();
+    Register output = rr.alloc();
+    Register xofs = rr.alloc();
+    Register wofs = rr.alloc();
+    Register group = rr.alloc();
+    Register rows = rr.alloc();
+    Allocate(unrolls, masm);
+
+    // Load tensor locations.
+    __ LoadTensorAddress(input, x);
+    __ LoadTensorAddress(output, y);
+
+    // Loop over rows.
+    if (batch > 1) {
+      __ movq(rows, Immediate(batch));
+      __ LoopStart(&lrow);
+    }
+    __ LoadTensorAddress(matrix, W);
+
+    // Compute groups of panels.
+    Args args;
+    args.input = input;
+    args.matrix = matrix;
+    args.output = output;
+    args.xofs = xofs;
+    args.wofs = wofs;
+    args.depth = x->dim(1);
+    args.panel_size = W->stride(0);
+    if (groups > 1) {
+      __ movq(group, Immediate(groups));
+      __ LoopStart(&l1);
+    }
+    if (groups > 0) {
+      GeneratePanels(args, unrolls, masm);
+      __ addq(matrix, Immediate(unrolls * args.panel_size));
+      __ addq(output, Immediate(unrolls * kPanelColumns * sizeof(int32)));
+    }
+    if (groups > 1) {
+      __ decq(group);
+      __ j(not_zero, &l1);
+    }
+
+    // Compute remaining panels.
+    if (remaining > 0) {
+      GeneratePanels(args, remaining, masm);
+      __ addq(output, Immediate(remaining * kPanelColumns * sizeof(int32)));
+    }
+
+    // Next row.
+    if (batch > 1) {
+      int skip = y->stride(0) - panels * kPanelColumns * sizeof(int32);
+      __ addq(input, Immediate(x->stride(0)));
+      if (skip > 0) __ addq(output, Immediate(skip));
+      __ decq(rows);
+      __ j(not_zero, &lrow);
+    }
+  }
+
+  int64 Complexity(const Step *step) override {
+    return step->input(0)->dim(0) * step->input(1)->elements() * 2;
+  }
+
+ protected:
+  // Registers and dimensions for generating code for a group of panels.
+  struct Args {
+    Register input;   // address of input row
+    Register matrix;  // address of first panel in group
+    Register output;  // address of output for first panel in group
+    Register xofs;    // offset in input row
+    Register wofs;    // offset in panels
+    int depth;        // size of input row
+    int panel_size;   // size of each panel in bytes
+  };
+
+  // Maximum number of panels computed together.
+  virtual int MaxPanels() = 0;
+
+  // Allocate SIMD registers for computing groups of panels.
+  virtual void Allocate(int unrolls, MacroAssembler *masm) = 0;
+
+  // Generate code for computing a group of panels for one input row.
+  virtual void GeneratePanels(const Args &args, int count,
+                              MacroAssembler *masm) = 0;
+};
+
+// Quantized matrix multiplication for CPUs with AVX2. The inputs are zero
+// extended and the weights sign extended to 16 bits, and pairs of products are
+// summed into 32-bit lanes with vpmaddwd. Each 32-bit lane holds the sum for
+// two of the four rows in a block, so the lane pairs are added horizontally
+// after the loop. All the intermediate results are exact.
+class AVXQuantizedMatMul : public QuantizedMatMulBase {
+ public:
+  string Name() override { return "AVXQuantizedMatMul"; }
+
+  bool Supports(Step *step) override {
+    // Requires CPU with AVX2 support.
+    if (!CPU::Enabled(AVX2)) return false;
+    return QuantizedMatMulBase::Supports(step);
+  }
+
+ protected:
+  int MaxPanels() override { return 2; }
+
+  void Allocate(int unrolls, MacroAssembler *masm) override {
+    SIMDRegisters &mm = masm->mm();
+    sum_.clear();
+    for (int i = 0; i < unrolls * 4; ++i) sum_.push_back(mm.allocy());
+    input_ = mm.allocy();
+    for (int i = 0; i < 2; ++i) elem_[i] = mm.allocy();
+  }
+
+  void GeneratePanels(const Args &args, int count,
+                      MacroAssembler *masm) override {
+    Label l;
+
+    // Clear sums. Each ymm register holds the sums for four columns.
+    for (int i = 0; i < count * 4; ++i) {
+      __ vpxor(sum_[i], sum_[i], sum_[i]);
+    }
+
+    // Loop over blocks of four rows.
+    __ xorq(args.xofs, args.xofs);
+    __ xorq(args.wofs, args.wofs);
+    __ LoopStart(&l);
+    __ vbroadcastss(input_.xmm(), Operand(args.input, args.xofs));
+    __ vpmovzxbw(input_, input_.xmm());
+    for (int p = 0; p < count; ++p) {
+      for (int i = 0; i < 4; ++i) {
+        YMMRegister elem = elem_[i % 2];
+        int disp = p * args.panel_size + i * 16;
+        __ vpmovsxbw(elem, Operand(args.matrix, args.wofs, times_1, disp));
+        __ vpmaddwd(elem, elem, input_);
+        __ vpaddd(sum_[p * 4 + i], sum_[p * 4 + i], elem);
+      }
+    }
+    __ addq(args.xofs, Immediate(kBlockRows));
+    __ addq(args.wofs, Immediate(kBlockSize));
+    __ cmpq(args.xofs, Immediate(args.depth));
+    __ j(less, &l);
+
+    // Add lane pairs and store results.
+    for (int p = 0; p < count; ++p) {
+      for (int i = 0; i < 4; i += 2) {
+        YMMRegister s = sum_[p * 4 + i];
+        __ vphaddd(s, s, sum_[p * 4 + i + 1]);
+        __ vpermq(s, s, 0xD8);
+        __ vmovdqu(Operand(args.output, p * 64 + i * 16), s);
+      }
+    }
+  }
+
+ private:
+  std::vector<YMMRegister> sum_;
+  YMMRegister input_;
+  YMMRegister elem_[2];
+};
+
+// Quantized matrix multiplication for CPUs with AVX-512 VNNI. Each vpdpbusd
+// instruction multiplies four broadcast input values with a block of the
+// panel and adds the sums to the 16 columns of the panel.
+class AVX512QuantizedMatMul : public QuantizedMatMulBase {
+ public:
+  string Name() override { return "AVX512QuantizedMatMul"; }
+
+  bool Supports(Step *step) override {
+    // Requires CPU with AVX-512 VNNI support.
+    if (!CPU::Enabled(AVX512F) || !CPU::Enabled(AVX512VNNI)) return false;
+    return QuantizedMatMulBase::Supports(step);
+  }
+
+ protected:
+  int MaxPanels() override { return 8; }
+
+  void Allocate(int unrolls, MacroAssembler *masm) override {
+    SIMDRegisters &mm = masm->mm();
+    sum_.clear();
+    for (int i = 0; i < unrolls; ++i) sum_.push_back(mm.allocz());
+    input_ = mm.allocz();
+  }
+
+  void GeneratePanels(const Args &args, int count,
+                      MacroAssembler *masm) override {
+    Label l;
+
+    // Clear sums. Each zmm register holds the sums for one panel.
+    for (int i = 0; i < count; ++i) {
+      __ vpxord(sum_[i], sum_[i], sum_[i]);
+    }
+
+    // Loop over blocks of four rows.
+    __ xorq(args.xofs, args.xofs);
+    __ xorq(args.wofs, args.wofs);
+    __ LoopStart(&l);
+    __ vbroadcastss(input_, Operand(args.input, args.xofs));
+    for (int p = 0; p < count; ++p) {
+      int disp = p * args.panel_size;
+      __ vpdpbusd(sum_[p], input_,
+                  Operand(args.matrix, args.wofs, times_1, disp));
+    }
+    __ addq(args.xofs, Immediate(kBlockRows));
+    __ addq(args.wofs, Immediate(kBlockSize));
+    __ cmpq(args.xofs, Immediate(args.depth));
+    __ j(less, &l);
+
+    // Store results.
+    for (int p = 0; p < count; ++p) {
+      __ vmovups(Operand(args.output, p * 64), sum_[p]);
+    }
+  }
+
+ private:
+  std::vector<ZMMRegister> sum_;
+  ZMMRegister input_;
+};
+
+// Convert the int32 results of quantized matrix multiplication to float by
+// subtracting the correction for the input offset and multiplying with the
+// input row scale and the column scales. The results for the padding columns
+// are not stored.
+class AVXDequantize : public Kernel {
+ public:
+  string Name() override { return "AVXDequantize"; }
+  string Operation() override { return "Dequantize"; }
+
+  bool Supports(Step *step) override {
+    // Requires CPU with AVX2 support.
+    if (!CPU::Enabled(AVX2)) return false;
+
+    // Check inputs and outputs.
+    if (step->indegree() != 4 || step->outdegree() != 1) return false;
+    Tensor *acc = step->input(0);
+    Tensor *xs = step->input(1);
+    Tensor *ws = step->input(2);
+    Tensor *wo = step->input(3);
+    Tensor *y = step->output(0);
+    if (acc->type() != DT_INT32 || acc->rank() != 2) return false;
+    if (xs->type() != DT_FLOAT || xs->rank() != 2) return false;
+    if (ws->type() != DT_FLOAT || ws->rank() != 1) return false;
+    if (wo->type() != DT_INT32 || wo->rank() != 1) return false;
+    if (y->type() != DT_FLOAT || y->rank() != 2) return false;
+
+    // Check shapes. The input width must be padded to whole ymm registers.
+    int width = acc->dim(1);
+    if (width % 8 != 0) return false;
+    if (xs->dim(0) != acc->dim(0) || xs->dim(1) != 1) return false;
+    if (ws->dim(0) != width || wo->dim(0) != width) return false;
+    if (y->dim(0) != acc->dim(0) || y->dim(1) > width) return false;
+
+    return true;
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    Registers &rr = masm->rr();
+    SIMDRegisters &mm = masm->mm();
+    Label lrow, l1;
+
+    // Get input and output tensors.
+    Tensor *acc = step->input(0);
+    Tensor *xs = step->input(1);
+    Tensor *ws = step->input(2);
+    Tensor *wo = step->input(3);
+    Tensor *y = step->output(0);
+    int batch = y->dim(0);
+    int size = y->dim(1);
+    int main = (size / 8) * 8;
+    int remaining = size - main;
+
+    // Allocate registers.
+    Register input = rr.alloc();
+    Register scale = rr.alloc();
+    Register scales = rr.alloc();
+    Register offsets = rr.alloc();
+    Register output = rr.alloc();
+    Register ofs = rr.alloc();
+    Register rows = rr.alloc();
+    YMMRegister factor = mm.allocy();
+    YMMRegister elem = mm.allocy();
+    YMMRegister mask = mm.allocy();
+
+    // Load tensor locations.
+    __ LoadTensorAddress(input, acc);
+    __ LoadTensorAddress(scale, xs);
+    __ LoadTensorAddress(scales, ws);
+    __ LoadTensorAddress(offsets, wo);
+    __ LoadTensorAddress(output, y);
+
+    // Load mask for storing remaining elements.
+    if (remaining > 0) {
+      int32 bits[8];
+      for (int i = 0; i < 8; ++i) bits[i] = i < remaining ? -1 : 0;
+      __ vmovdqu(mask, masm->GetData(bits, sizeof(bits))->address());
+    }
+
+    // Loop over rows.
+    if (batch > 1) {
+      __ movq(rows, Immediate(batch));
+      __ LoopStart(&lrow);
+    }
+    __ vbroadcastss(factor, Operand(scale));
+
+    // Dequantize eight elements at a time. All the inputs and outputs have
+    // four-byte elements so they share the offset.
+    if (main > 0) {
+      __ xorq(ofs, ofs);
+      __ LoopStart(&l1);
+      __ vmovdqu(elem, Operand(input, ofs));
+      __ vpsubd(elem, elem, Operand(offsets, ofs));
+      __ vcvtdq2ps(elem, elem);
+      __ vmulps(elem, elem, Operand(scales, ofs));
+      __ vmulps(elem, elem, factor);
+      __ vmovups(Operand(output, ofs), elem);
+      __ addq(ofs, Immediate(8 * sizeof(float)));
+      __ cmpq(ofs, Immediate(main * sizeof(float)));
+      __ j(less, &l1);
+    }
+
+    // Dequantize remaining elements with masked store.
+    if (remaining > 0) {
+      int disp = main * sizeof(float);
+      __ vmovdqu(elem, Operand(input, disp));
+      __ vpsubd(elem, elem, Operand(offsets, disp));
+      __ vcvtdq2ps(elem, elem);
+      __ vmulps(elem, elem, Operand(scales, disp));
+      __ vmulps(elem, elem, factor);
+      __ vmaskmovps(Operand(output, disp), mask, elem);
+    }
+
+    // Next row.
+    if (batch > 1) {
+      __ addq(input, Immediate(acc->stride(0)));
+      __ addq(scale, Immediate(xs->stride(0)));
+      __ addq(output, Immediate(y->stride(0)));
+      __ decq(rows);
+      __ j(not_zero, &lrow);
+    }
+  }
+
+  int64 Complexity(const Step *step) override {
+    return step->output(0)->elements() * 4;
+  }
+};
+
+// Register quantization library.
+void RegisterQuantizationLibrary(Library *library) {
+  library->Register(new AVXQuantize());
+  library->Register(new AVXQuantizedMatMul());
+  library->Register(new AVX512QuantizedMatMul());
+  library->Register(new AVXDequantize());
+}
+
+}  // namespace myelin
+}  // namespace sling
+
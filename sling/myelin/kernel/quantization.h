@@ -0,0 +1,49 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_MYELIN_KERNEL_QUANTIZATION_H_
+#define SLING_MYELIN_KERNEL_QUANTIZATION_H_
+
+#include "sling/myelin/compute.h"
+#include "sling/myelin/flow.h"
+
+namespace sling {
+namespace myelin {
+
+// Convert matrix multiplications with constant float matrices in the flow to
+// 8-bit integer arithmetic. Each matrix column is quantized to int8 with its
+// own scale. The input rows are quantized to uint8 with a dynamic scale by a
+// Quantize op, multiplied with the matrix by a QuantizedMatMul op, and the
+// 32-bit integer results are converted back to float by a Dequantize op.
+// Matrices with fewer than min_weights elements are left as float. Returns the
+// number of converted matrix multiplications.
+int QuantizeFlow(Flow *flow, int min_weights = 4096);
+
+// Store constant float matrices in the flow with reduced precision, i.e.
+// half-precision (DT_HALF) or bfloat16 (DT_BFLOAT16) floats. This halves the
+// memory used for the weights, and the kernels convert the weights back to
+// single precision when they are loaded. Only embedding matrices for Lookup
+// ops and weight matrices for MatMul ops are converted, and only if all the
+// consumers of the matrix can use the reduced precision on this CPU. Matrices
+// with fewer than min_weights elements are left as float. Returns the number
+// of converted matrices.
+int ReduceWeightPrecision(Flow *flow, Type type, int min_weights = 4096);
+
+// Register quantization library.
+void RegisterQuantizationLibrary(Library *library);
+
+}  // namespace myelin
+}  // namespace sling
+
+#endif  // SLING_MYELIN_KERNEL_QUANTIZATION_H_
@@ -0,0 +1,836 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/myelin/compute.h"
+#include "sling/myelin/express.h"
+#include "sling/myelin/macro-assembler.h"
+#include "sling/myelin/generator/expression.h"
+#include "sling/myelin/generator/index.h"
+
+#define __ masm_->
+
+namespace sling {
+namespace myelin {
+
+using namespace jit;
+
+// Code generator for float operations on SIMD registers of a fixed size. The
+// vector size is 64 (ZMM), 32 (YMM) or 16 (XMM) bytes, or 4 bytes for scalar
+// operations on the lowest element of XMM registers. SSE instructions are used
+// for XMM registers if the CPU does not support AVX. Registers are identified
+// by their register codes.
+class FltVectorOps {
+ public:
+  FltVectorOps(MacroAssembler *masm, int vecsize)
+      : masm_(masm), vecsize_(vecsize), avx_(CPU::Enabled(AVX)) {}
+
+  // Vector size in bytes and number of elements.
+  int vecsize() const { return vecsize_; }
+  int veclen() const { return vecsize_ / sizeof(float); }
+
+  // Name of instruction set and register type.
+  string Name() const {
+    switch (vecsize_) {
+      case 64: return "AVX512";
+      case 32: return "AVX256";
+      case 16: return avx_ ? "AVX128" : "SSE";
+      default: return avx_ ? "AVXScalar" : "SSEScalar";
+    }
+  }
+
+  // Load vector from memory.
+  void Load(int dst, const Operand &src) const {
+    switch (vecsize_) {
+      case 64: __ vmovups(zmm(dst), src); break;
+      case 32: __ vmovups(ymm(dst), src); break;
+      case 16:
+        if (avx_) {
+          __ vmovups(xmm(dst), src);
+        } else {
+          __ movups(xmm(dst), src);
+        }
+        break;
+      default:
+        if (avx_) {
+          __ vmovss(xmm(dst), src);
+        } else {
+          __ movss(xmm(dst), src);
+        }
+    }
+  }
+
+  // Store vector in memory.
+  void Store(const Operand &dst, int src) const {
+    switch (vecsize_) {
+      case 64: __ vmovups(dst, zmm(src)); break;
+      case 32: __ vmovups(dst, ymm(src)); break;
+      case 16:
+        if (avx_) {
+          __ vmovups(dst, xmm(src));
+        } else {
+          __ movups(dst, xmm(src));
+        }
+        break;
+      default:
+        if (avx_) {
+          __ vmovss(dst, xmm(src));
+        } else {
+          __ movss(dst, xmm(src));
+        }
+    }
+  }
+
+  // Clear vector register.
+  void Zero(int dst) const {
+    switch (vecsize_) {
+      case 64: __ vpxord(zmm(dst), zmm(dst), zmm(dst)); break;
+      case 32: __ vxorps(ymm(dst), ymm(dst), ymm(dst)); break;
+      default:
+        if (avx_) {
+          __ vxorps(xmm(dst), xmm(dst), xmm(dst));
+        } else {
+          __ xorps(xmm(dst), xmm(dst));
+        }
+    }
+  }
+
+  // Compute dst = op(dst, src) for ADD, SUB, MUL, DIV, MIN, and MAX.
+  void Op(Express::OpType op, int dst, int src) const {
+    switch (vecsize_) {
+      case 64: VexPacked(op, zmm(dst), zmm(src)); break;
+      case 32: VexPacked(op, ymm(dst), ymm(src)); break;
+      case 16:
+        if (avx_) {
+          VexPacked(op, xmm(dst), xmm(src));
+        } else {
+          SSEPacked(op, xmm(dst), xmm(src));
+        }
+        break;
+      default:
+        if (avx_) {
+          VexScalar(op, xmm(dst), xmm(src));
+        } else {
+          SSEScalar(op, xmm(dst), xmm(src));
+        }
+    }
+  }
+
+  // Compute dst = op(dst, [src]). SSE instructions require aligned memory
+  // operands, so the vector is loaded into the auxiliary register first.
+  void Op(Express::OpType op, int dst, const Operand &src, int aux) const {
+    switch (vecsize_) {
+      case 64: VexPacked(op, zmm(dst), src); break;
+      case 32: VexPacked(op, ymm(dst), src); break;
+      case 16:
+        if (avx_) {
+          VexPacked(op, xmm(dst), src);
+        } else {
+          __ movups(xmm(aux), src);
+          SSEPacked(op, xmm(dst), xmm(aux));
+        }
+        break;
+      default:
+        if (avx_) {
+          VexScalar(op, xmm(dst), src);
+        } else {
+          SSEScalar(op, xmm(dst), src);
+        }
+    }
+  }
+
+  // Reduce the elements of a vector register with a horizontal operation. The
+  // result is in the lowest element of the register. The upper elements are
+  // overwritten.
+  void Reduce(Express::OpType op, int acc, int aux) const {
+    if (vecsize_ == 64) {
+      __ vextractf64x4(ymm(aux), zmm(acc), 1);
+      VexPacked(op, ymm(acc), ymm(aux));
+    }
+    if (vecsize_ >= 32) {
+      __ vextractf128(xmm(aux), ymm(acc), 1);
+      VexPacked(op, xmm(acc), xmm(aux));
+    }
+    if (vecsize_ >= 16) {
+      if (avx_) {
+        __ vpermilps(xmm(aux), xmm(acc), 0x0E);
+        VexPacked(op, xmm(acc), xmm(aux));
+        __ vpermilps(xmm(aux), xmm(acc), 0x01);
+        VexScalar(op, xmm(acc), xmm(aux));
+      } else {
+        __ movaps(xmm(aux), xmm(acc));
+        __ shufps(xmm(aux), xmm(aux), 0x0E);
+        SSEPacked(op, xmm(acc), xmm(aux));
+        __ movaps(xmm(aux), xmm(acc));
+        __ shufps(xmm(aux), xmm(aux), 0x01);
+        SSEScalar(op, xmm(acc), xmm(aux));
+      }
+    }
+  }
+
+  // Broadcast the lowest element of a register to all elements of a vector
+  // register.
+  void Broadcast(int dst, int src) const {
+    switch (vecsize_) {
+      case 64:
+        __ vbroadcastss(zmm(dst), xmm(src));
+        break;
+      case 32:
+        if (CPU::Enabled(AVX2)) {
+          __ vbroadcastss(ymm(dst), ymm(src));
+        } else {
+          __ vpermilps(xmm(dst), xmm(src), 0);
+          __ vinsertf128(ymm(dst), ymm(dst), xmm(dst), 1);
+        }
+        break;
+      case 16:
+        if (avx_) {
+          __ vpermilps(xmm(dst), xmm(src), 0);
+        } else {
+          if (dst != src) __ movaps(xmm(dst), xmm(src));
+          __ shufps(xmm(dst), xmm(dst), 0);
+        }
+        break;
+      default:
+        if (dst == src) break;
+        if (avx_) {
+          __ vmovaps(xmm(dst), xmm(src));
+        } else {
+          __ movaps(xmm(dst), xmm(src));
+        }
+    }
+  }
+
+ private:
+  static XMMRegister xmm(int r) { return XMMRegister::from_code(r); }
+  static YMMRegister ymm(int r) { return YMMRegister::from_code(r); }
+  static ZMMRegister zmm(int r) { return ZMMRegister::from_code(r); }
+
+  template<class R, class S>
+  void VexPacked(Express::OpType op, R dst, S src) const {
+    switch (op) {
+      case Express::ADD: __ vaddps(dst, dst, src); break;
+      case Express::SUB: __ vsubps(dst, dst, src); break;
+      case Express::MUL: __ vmulps(dst, dst, src); break;
+      case Express::DIV: __ vdivps(dst, dst, src); break;
+      case Express::MIN: __ vminps(dst, dst, src); break;
+      case Express::MAX: __ vmaxps(dst, dst, src); break;
+      default: LOG(FATAL) << "Unsupported reduction op " << op;
+    }
+  }
+
+  template<class S>
+  void VexScalar(Express::OpType op, XMMRegister dst, S src) const {
+    switch (op) {
+      case Express::ADD: __ vaddss(dst, dst, src); break;
+      case Express::SUB: __ vsubss(dst, dst, src); break;
+      case Express::MUL: __ vmulss(dst, dst, src); break;
+      case Express::DIV: __ vdivss(dst, dst, src); break;
+      case Express::MIN: __ vminss(dst, dst, src); break;
+      case Express::MAX: __ vmaxss(dst, dst, src); break;
+      default: LOG(FATAL) << "Unsupported reduction op " << op;
+    }
+  }
+
+  template<class S>
+  void SSEPacked(Express::OpType op, XMMRegister dst, S src) const {
+    switch (op) {
+      case Express::ADD: __ addps(dst, src); break;
+      case Express::SUB: __ subps(dst, src); break;
+      case Express::MUL: __ mulps(dst, src); break;
+      case Express::DIV: __ divps(dst, src); break;
+      case Express::MIN: __ minps(dst, src); break;
+      case Express::MAX: __ maxps(dst, src); break;
+      default: LOG(FATAL) << "Unsupported reduction op " << op;
+    }
+  }
+
+  template<class S>
+  void SSEScalar(Express::OpType op, XMMRegister dst, S src) const {
+    switch (op) {
+      case Express::ADD: __ addss(dst, src); break;
+      case Express::SUB: __ subss(dst, src); break;
+      case Express::MUL: __ mulss(dst, src); break;
+      case Express::DIV: __ divss(dst, src); break;
+      case Express::MIN: __ minss(dst, src); break;
+      case Express::MAX: __ maxss(dst, src); break;
+      default: LOG(FATAL) << "Unsupported reduction op " << op;
+    }
+  }
+
+  MacroAssembler *masm_;  // macro assembler for code generation
+  int vecsize_;           // vector size in bytes
+  bool avx_;              // use AVX instructions
+};
+
+#undef __
+#define __ masm->
+
+// Index generator for expressions computed on a row of a tensor by kernels
+// that control the loop structure themselves. Inputs and outputs are addressed
+// relative to base registers for the current input and output row.
+class RowIndexGenerator : public IndexGenerator {
+ public:
+  RowIndexGenerator(MacroAssembler *masm, Register input, Register output)
+      : IndexGenerator(masm), input_(input), output_(output) {}
+
+  void Initialize(size_t vecsize) override { vecsize_ = vecsize; }
+
+  // Set offset register and displacement for the current block. The offset
+  // register can be no_reg for fixed positions.
+  void SetBlock(Register offset, int disp) {
+    offset_ = offset;
+    disp_ = disp;
+  }
+
+  Operand addr(Express::Var *var) override {
+    if (var->type == Express::NUMBER) {
+      // System-defined constant.
+      float number = Express::NumericFlt32(var->id);
+      int repeat = vecsize_ / sizeof(float);
+      return masm_->GetConstant(number, repeat)->address();
+    }
+    Register base = var->type == Express::OUTPUT ? output_ : input_;
+    if (offset_.is_valid()) {
+      return Operand(base, offset_, times_1, disp_);
+    } else {
+      return Operand(base, disp_);
+    }
+  }
+
+  const void *data(Express::Var *var) override {
+    LOG(FATAL) << "Constants not supported in row expressions";
+    return nullptr;
+  }
+
+ private:
+  Register input_;           // base register for input row
+  Register output_;          // base register for output row
+  Register offset_ = no_reg;  // offset register for current block
+  int disp_ = 0;             // displacement for current block
+  size_t vecsize_ = 1;       // vector size
+};
+
+// Expression computed on a row of a tensor with a generator that matches the
+// register size of the kernel.
+struct RowExpression {
+  RowExpression(const string &recipe, int elements, MacroAssembler *masm,
+                Register input, Register output)
+      : index(masm, input, output) {
+    expr.Parse(recipe, true);
+    generator = ExpressionGenerator::Select(expr, DT_FLOAT, elements);
+    CHECK(generator != nullptr);
+    generator->Initalize(expr, DT_FLOAT, 0, &index);
+  }
+  ~RowExpression() { delete generator; }
+
+  // Compute expression on block.
+  void Generate(Register offset, int disp, MacroAssembler *masm) {
+    index.SetBlock(offset, disp);
+    generator->GenerateBody(masm);
+  }
+
+  Express expr;
+  RowIndexGenerator index;
+  ExpressionGenerator *generator;
+};
+
+// Allocate registers for row expressions. The expressions are evaluated one at
+// a time, so they share the same SIMD registers. This also means that
+// register inputs (!n) of the expressions are in the same registers.
+static void AllocateSharedRegisters(MacroAssembler *masm,
+                                    const std::vector<RowExpression *> &exprs) {
+  SIMDRegisters initial = masm->mm();
+  SIMDRegisters used = initial;
+  for (RowExpression *e : exprs) {
+    masm->mm() = initial;
+    CHECK(e->index.AllocateRegisters()) << "Register overflow";
+    for (int r = 0; r < SIMDRegisters::kNumRegisters; ++r) {
+      if (masm->mm().used(r)) used.use(r);
+    }
+  }
+  masm->mm() = used;
+}
+
+// Select vector size in bytes for rows with n float elements. Returns 4 if the
+// row is too short for vector operations.
+static int RowVectorSize(int n) {
+  if (CPU::Enabled(AVX512F) && n >= 16) return 64;
+  if (CPU::Enabled(AVX) && n >= 8) return 32;
+  if (n >= 4) return 16;
+  return 4;
+}
+
+// Select vector size in bytes for expressions computed on rows with n float
+// elements. The 128-bit expression generators use aligned loads and stores, so
+// for these all the rows must start on a vector boundary. The AVX and AVX-512
+// generators use unaligned loads and stores.
+static int RowExpressionVectorSize(int n, int rows) {
+  int vecsize = RowVectorSize(n);
+  if (vecsize == 16 && rows > 1 && n % 4 != 0) vecsize = sizeof(float);
+  return vecsize;
+}
+
+// Get the length of the rows reduced by a reduction op. Reductions over the
+// last axis reduce rows of the size of the last dimension, and reductions over
+// all axes reduce the whole tensor as one row. The optional second input is a
+// constant with the reduction axes like in Tensorflow. Returns zero if the
+// reduction is not supported.
+static int ReductionLength(Step *step) {
+  Tensor *x = step->input(0);
+  if (step->indegree() == 1 || x->rank() == 0) return x->elements();
+  Tensor *axes = step->input(1);
+  if (!axes->IsConstant() || axes->type() != DT_INT32) return 0;
+  int rank = x->rank();
+  int n = axes->elements();
+  const int *axis = reinterpret_cast<const int *>(axes->data());
+  std::vector<bool> reduced(rank);
+  for (int i = 0; i < n; ++i) {
+    int a = axis[i] < 0 ? axis[i] + rank : axis[i];
+    if (a < 0 || a >= rank) return 0;
+    reduced[a] = true;
+  }
+  bool all = true;
+  for (int d = 0; d < rank; ++d) all &= reduced[d];
+  if (all) return x->elements();
+  if (n == 1 && reduced[rank - 1]) return x->dim(rank - 1);
+  return 0;
+}
+
+// Number of accumulators used for hiding the latency of the reduction
+// instructions.
+static const int kReductionAccumulators = 4;
+
+// Generate code for reducing a row of n elements starting at the input
+// register. The result is left in the lowest element of acc[0]. The vector
+// registers in acc are used as accumulators and aux is used as a scratch
+// register. The offset register is used for looping over long rows.
+static void GenerateRowReduction(MacroAssembler *masm,
+                                 Express::OpType op,
+                                 const FltVectorOps &vec,
+                                 Register input, Register offset,
+                                 const std::vector<int> &acc, int aux,
+                                 int n) {
+  FltVectorOps scalar(masm, sizeof(float));
+  int vecsize = vec.vecsize();
+  int vectors = vecsize == sizeof(float) ? 0 : n / vec.veclen();
+  int start = 0;
+  if (vectors > 0) {
+    // Initialize accumulators with the first vectors.
+    int k = std::min<int>(acc.size(), vectors);
+    for (int i = 0; i < k; ++i) vec.Load(acc[i], Operand(input, i * vecsize));
+
+    // Accumulate groups of k vectors.
+    int groups = vectors / k;
+    int stride = k * vecsize;
+    if (groups > 2) {
+      Label l;
+      __ movq(offset, Immediate(stride));
+      __ LoopStart(&l);
+      for (int i = 0; i < k; ++i) {
+        vec.Op(op, acc[i], Operand(input, offset, times_1, i * vecsize), aux);
+      }
+      __ addq(offset, Immediate(stride));
+      __ cmpq(offset, Immediate(groups * stride));
+      __ j(less, &l);
+    } else if (groups == 2) {
+      for (int i = 0; i < k; ++i) {
+        vec.Op(op, acc[i], Operand(input, stride + i * vecsize), aux);
+      }
+    }
+
+    // Accumulate the remaining vectors.
+    for (int i = 0; i < vectors % k; ++i) {
+      int disp = groups * stride + i * vecsize;
+      vec.Op(op, acc[i], Operand(input, disp), aux);
+    }
+
+    // Combine the accumulators and reduce the vector to a scalar.
+    for (int i = 1; i < k; ++i) vec.Op(op, acc[0], acc[i]);
+    vec.Reduce(op, acc[0], aux);
+    start = vectors * vec.veclen();
+  } else {
+    scalar.Load(acc[0], Operand(input));
+    start = 1;
+  }
+
+  // Reduce the residual elements.
+  for (int i = start; i < n; ++i) {
+    scalar.Op(op, acc[0], Operand(input, i * sizeof(float)), aux);
+  }
+}
+
+// Reduction of a float tensor over the last axis or over all axes with
+// vectorized accumulation. The reductions use AVX-512, AVX or SSE depending on
+// the CPU and the length of the reduced rows.
+class FltReduce : public Kernel {
+ public:
+  FltReduce(const string &name, const string &operation,
+            Express::OpType op, bool mean = false)
+      : name_(name), operation_(operation), op_(op), mean_(mean) {}
+
+  string Name() override { return name_; }
+  string Operation() override { return operation_; }
+
+  bool Supports(Step *step) override {
+    // Requires CPU with SSE support.
+    if (!CPU::Enabled(SSE)) return false;
+
+    // Check inputs and outputs.
+    if (step->indegree() != 1 && step->indegree() != 2) return false;
+    if (step->outdegree() != 1) return false;
+    Tensor *x = step->input(0);
+    Tensor *y = step->output(0);
+    if (x->type() != DT_FLOAT || y->type() != DT_FLOAT) return false;
+
+    // Check that the reduction is over the last axis or over all axes.
+    int n = ReductionLength(step);
+    if (n == 0) return false;
+    if (y->elements() * n != x->elements()) return false;
+
+    return true;
+  }
+
+  void Adjust(Step *step) override {
+    Tensor *x = step->input(0);
+    Tensor *y = step->output(0);
+    x->RequireDense();
+    x->RequireStandardOrder();
+    y->RequireDense();
+    y->RequireStandardOrder();
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    Tensor *x = step->input(0);
+    Tensor *y = step->output(0);
+    int n = ReductionLength(step);
+    int rows = y->elements();
+    FltVectorOps vec(masm, RowVectorSize(n));
+    FltVectorOps scalar(masm, sizeof(float));
+    step->set_variant(vec.Name());
+
+    // Allocate registers.
+    Register input = masm->rr().alloc();
+    Register output = masm->rr().alloc();
+    Register offset = masm->rr().alloc();
+    Register row = masm->rr().alloc();
+    std::vector<int> acc;
+    for (int i = 0; i < kReductionAccumulators; ++i) {
+      acc.push_back(masm->mm().alloc());
+    }
+    int aux = masm->mm().alloc();
+
+    // Load tensor locations.
+    __ LoadTensorAddress(input, x);
+    __ LoadTensorAddress(output, y);
+
+    // Loop over rows.
+    Label l;
+    if (rows > 1) {
+      __ xorq(row, row);
+      __ LoopStart(&l);
+    }
+
+    // Reduce row.
+    GenerateRowReduction(masm, op_, vec, input, offset, acc, aux, n);
+    if (mean_) {
+      auto *scale = masm->GetConstant<float>(1.0 / n);
+      scalar.Op(Express::MUL, acc[0], scale->address(), aux);
+    }
+    scalar.Store(Operand(output), acc[0]);
+
+    // Next row.
+    if (rows > 1) {
+      __ addq(input, Immediate(n * sizeof(float)));
+      __ addq(output, Immediate(sizeof(float)));
+      __ incq(row);
+      __ cmpq(row, Immediate(rows));
+      __ j(less, &l);
+    }
+  }
+
+  int64 Complexity(const Step *step) override {
+    int64 elements = step->input(0)->elements();
+    return mean_ ? elements + step->output(0)->elements() : elements;
+  }
+
+ private:
+  string name_;        // kernel name
+  string operation_;   // kernel operation
+  Express::OpType op_;  // operation for combining elements
+  bool mean_;          // divide sum by number of elements
+};
+
+// Numerically stable softmax and log-softmax over the last axis of a float
+// tensor. For each row, the maximum m is subtracted before exponentiation:
+//   softmax(x) = exp(x - m) / sum(exp(x - m))
+//   logsoftmax(x) = x - (m + log(sum(exp(x - m))))
+// The exponential and logarithm are computed with the expression generators.
+// The main part of each row is processed in vectors and the residual elements
+// with scalar instructions.
+class FltSoftmax : public Kernel {
+ public:
+  FltSoftmax(bool log) : log_(log) {}
+
+  string Name() override { return log_ ? "FltLogSoftmax" : "FltSoftmax"; }
+  string Operation() override { return log_ ? "LogSoftmax" : "Softmax"; }
+
+  bool Supports(Step *step) override {
+    // Requires CPU with SSE support.
+    if (!CPU::Enabled(SSE)) return false;
+
+    // Check inputs and outputs.
+    if (step->indegree() != 1 || step->outdegree() != 1) return false;
+    Tensor *x = step->input(0);
+    Tensor *y = step->output(0);
+    if (x->type() != DT_FLOAT || y->type() != DT_FLOAT) return false;
+    if (x->rank() < 1 || x->elements() == 0) return false;
+    if (x->shape() != y->shape()) return false;
+
+    return true;
+  }
+
+  void Adjust(Step *step) override {
+    Tensor *x = step->input(0);
+    Tensor *y = step->output(0);
+    x->RequireDense();
+    x->RequireStandardOrder();
+    y->RequireDense();
+    y->RequireStandardOrder();
+    int n = x->dim(x->rank() - 1);
+    int alignment = RowExpressionVectorSize(n, x->elements() / n);
+    x->SetMiniumAlignment(alignment);
+    y->SetMiniumAlignment(alignment);
+
+    // Softmax can be computed in place. Log-softmax needs the input after the
+    // exponentials have been stored in the output.
+    if (!log_) step->AllowInPlace(0, 0);
+  }
+
+  void Generate(Step *step, MacroAssembler *masm) override {
+    Tensor *x = step->input(0);
+    Tensor *y = step->output(0);
+    int n = x->dim(x->rank() - 1);
+    int rows = x->elements() / n;
+    FltVectorOps vec(masm, RowExpressionVectorSize(n, rows));
+    FltVectorOps scalar(masm, sizeof(float));
+    int veclen = vec.veclen();
+    int vecsize = vec.vecsize();
+    int vectors = vecsize == sizeof(float) ? 0 : n / veclen;
+    int main = vectors * veclen;
+
+    // Allocate general registers.
+    Register input = masm->rr().alloc();
+    Register output = masm->rr().alloc();
+    Register offset = masm->rr().alloc();
+    Register row = masm->rr().alloc();
+
+    // Allocate SIMD registers for the kernel.
+    std::vector<int> acc;
+    for (int i = 0; i < 2; ++i) acc.push_back(masm->mm().alloc());
+    int aux = masm->mm().alloc();
+    int sum = masm->mm().alloc();
+    int value = masm->mm().alloc();
+
+    // Compile expressions for exp(x - m) on vectors and scalars, and for
+    // m + log(sum). The register input !0 holds the maximum and !1 holds the
+    // sum. The results are stored in the output.
+    const char *exp_recipe = "@0=Exp(Sub(%0,!0))";
+    std::vector<RowExpression *> exprs;
+    RowExpression *vexp = nullptr;
+    RowExpression *sexp = nullptr;
+    RowExpression *slog = nullptr;
+    if (main > 0) {
+      vexp = new RowExpression(exp_recipe, main, masm, input, output);
+      CHECK_EQ(vexp->generator->VectorSize(), vecsize);
+      exprs.push_back(vexp);
+    }
+    if (main < n) {
+      sexp = new RowExpression(exp_recipe, 1, masm, input, output);
+      exprs.push_back(sexp);
+    }
+    if (log_) {
+      slog = new RowExpression("@0=Add(!0,Log(!1))", 1, masm, input, output);
+      exprs.push_back(slog);
+    }
+    AllocateSharedRegisters(masm, exprs);
+    int maximum = exprs[0]->index.xmm(0).code();
+    for (auto *e : exprs) CHECK_EQ(e->index.xmm(0).code(), maximum);
+    step->set_variant(exprs[0]->generator->Name());
+
+    // Load tensor locations.
+    __ LoadTensorAddress(input, x);
+    __ LoadTensorAddress(output, y);
+
+    // Loop over rows.
+    Label l;
+    if (rows > 1) {
+      __ xorq(row, row);
+      __ LoopStart(&l);
+    }
+
+    // Find maximum for row and broadcast it to the expression register.
+    GenerateRowReduction(masm, Express::MAX, vec, input, offset, acc, aux, n);
+    vec.Broadcast(maximum, acc[0]);
+
+    // Compute exp(x - m) for main part of row and sum the results.
+    if (main > 0) {
+      vec.Zero(sum);
+      if (vectors > 1) {
+        Label l1;
+        __ xorq(offset, offset);
+        __ LoopStart(&l1);
+        vexp->Generate(offset, 0, masm);
+        vec.Op(Express::ADD, sum, Operand(output, offset), aux);
+        __ addq(offset, Immediate(vecsize));
+        __ cmpq(offset, Immediate(main * sizeof(float)));
+        __ j(less, &l1);
+      } else {
+        vexp->Generate(no_reg, 0, masm);
+        vec.Op(Express::ADD, sum, Operand(output), aux);
+      }
+      vec.Reduce(Express::ADD, sum, aux);
+    } else {
+      scalar.Zero(sum);
+    }
+
+    // Compute exp(x - m) for residual elements.
+    for (int i = main; i < n; ++i) {
+      int disp = i * sizeof(float);
+      sexp->Generate(no_reg, disp, masm);
+      scalar.Op(Express::ADD, sum, Operand(output, disp), aux);
+    }
+
+    if (log_) {
+      // Compute m + log(sum) and store it temporarily in the first output
+      // element. Then subtract it from the inputs.
+      scalar.Broadcast(slog->index.xmm(1).code(), sum);
+      slog->Generate(no_reg, 0, masm);
+      scalar.Load(value, Operand(output));
+      if (main > 0) vec.Broadcast(value, value);
+      GenerateRowUpdate(masm, Express::SUB, vec, input, output, offset,
+                        value, acc[0], aux, n);
+    } else {
+      // Multiply the exponentials by 1/sum.
+      auto *one = masm->GetConstant<float>(1.0);
+      scalar.Load(value, one->address());
+      scalar.Op(Express::DIV, value, sum);
+      if (main > 0) vec.Broadcast(value, value);
+      GenerateRowUpdate(masm, Express::MUL, vec, output, output, offset,
+                        value, acc[0], aux, n);
+    }
+
+    // Next row.
+    if (rows > 1) {
+      __ addq(input, Immediate(n * sizeof(float)));
+      __ addq(output, Immediate(n * sizeof(float)));
+      __ incq(row);
+      __ cmpq(row, Immediate(rows));
+      __ j(less, &l);
+    }
+
+    for (auto *e : exprs) delete e;
+  }
+
+  // Generate code for computing dst[i] = op(src[i], value) for a row of n
+  // elements, where value is a broadcast register.
+  static void GenerateRowUpdate(MacroAssembler *masm, Express::OpType op,
+                                const FltVectorOps &vec,
+                                Register src, Register dst, Register offset,
+                                int value, int tmp, int aux, int n) {
+    FltVectorOps scalar(masm, sizeof(float));
+    int vecsize = vec.vecsize();
+    int vectors = vecsize == sizeof(float) ? 0 : n / vec.veclen();
+    if (vectors > 1) {
+      Label l;
+      __ xorq(offset, offset);
+      __ LoopStart(&l);
+      vec.Load(tmp, Operand(src, offset));
+      vec.Op(op, tmp, value);
+      vec.Store(Operand(dst, offset), tmp);
+      __ addq(offset, Immediate(vecsize));
+      __ cmpq(offset, Immediate(vectors * vecsize));
+      __ j(less, &l);
+    } else if (vectors == 1) {
+      vec.Load(tmp, Operand(src));
+      vec.Op(op, tmp, value);
+      vec.Store(Operand(dst), tmp);
+    }
+    for (int i = vectors * vec.veclen(); i < n; ++i) {
+      int disp = i * sizeof(float);
+      scalar.Load(tmp, Operand(src, disp));
+      scalar.Op(op, tmp, value);
+      scalar.Store(Operand(dst, disp), tmp);
+    }
+  }
+
+  int64 Complexity(const Step *step) override {
+    // Maximum, exponential, sum, and normalization for each element.
+    return step->input(0)->elements() * 25;
+  }
+
+ private:
+  bool log_;  // compute log-softmax
+};
+
+// Register reduction kernels.
+void RegisterReductionKernels(Library *library) {
+  // Computes  : y = sum(x, axis)
+  // Input     : x: float32[d1,...,dn]
+  //             axis: int32 (optional, last axis or all axes)
+  // Output    : y: float32[d1,...,dn-1] or float32
+  // Supports  : SSE, AVX, AVX512
+  library->Register(new FltReduce("FltSum", "Sum", Express::ADD));
+
+  // Computes  : y = max(x, axis)
+  // Input     : x: float32[d1,...,dn]
+  //             axis: int32 (optional, last axis or all axes)
+  // Output    : y: float32[d1,...,dn-1] or float32
+  // Supports  : SSE, AVX, AVX512
+  library->Register(new FltReduce("FltMax", "Max", Express::MAX));
+
+  // Computes  : y = min(x, axis)
+  // Input     : x: float32[d1,...,dn]
+  //             axis: int32 (optional, last axis or all axes)
+  // Output    : y: float32[d1,...,dn-1] or float32
+  // Supports  : SSE, AVX, AVX512
+  library->Register(new FltReduce("FltMin", "Min", Express::MIN));
+
+  // Computes  : y = mean(x, axis)
+  // Input     : x: float32[d1,...,dn]
+  //             axis: int32 (optional, last axis or all axes)
+  // Output    : y: float32[d1,...,dn-1] or float32
+  // Supports  : SSE, AVX, AVX512
+  library->Register(new FltReduce("FltMean", "Mean", Express::ADD, true));
+
+  // Computes  : y = exp(x - max(x)) / sum(exp(x - max(x))) over last axis
+  // Input     : x: float32[d1,...,dn]
+  // Output    : y: float32[d1,...,dn]
+  // Supports  : SSE, AVX, AVX512
+  library->Register(new FltSoftmax(false));
+
+  // Computes  : y = x - max(x) - log(sum(exp(x - max(x)))) over last axis
+  // Input     : x: float32[d1,...,dn]
+  // Output    : y: float32[d1,...,dn]
+  // Supports  : SSE, AVX, AVX512
+  library->Register(new FltSoftmax(true));
+}
+
+}  // namespace myelin
+}  // namespace sling
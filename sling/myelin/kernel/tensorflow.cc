@@ -20,6 +20,7 @@
 #include "sling/myelin/kernel/generic.h"
 #include "sling/myelin/kernel/sse.h"
 #include "sling/myelin/kernel/precompute.h"
+#include "sling/myelin/kernel/quantization.h"
 
 namespace sling {
 namespace myelin {
@@ -32,6 +33,7 @@ void RegisterTensorflowLibrary(Library *library) {
   RegisterAVXLibrary(library);
   RegisterArithmeticLibrary(library);
   RegisterPrecomputeLibrary(library);
+  RegisterQuantizationLibrary(library);
 }
 
 }  // namespace myelin
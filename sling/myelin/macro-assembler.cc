@@ -404,6 +404,90 @@ void MacroAssembler::StoreInteger(jit::Register base, jit::Register index,
   }
 }
 
+bool MacroAssembler::SupportsFloatType(Type type, int bits) {
+  switch (type) {
+    case DT_FLOAT:
+      return true;
+
+    case DT_HALF:
+      if (bits > 256) return CPU::Enabled(AVX512F);
+      return CPU::Enabled(F16C);
+
+    case DT_BFLOAT16:
+      if (bits > 256) return CPU::Enabled(AVX512F);
+      if (bits > 32) return CPU::Enabled(AVX2);
+      return CPU::Enabled(AVX);
+
+    default:
+      return false;
+  }
+}
+
+void MacroAssembler::LoadFloats(jit::YMMRegister dst, const jit::Operand &src,
+                                Type type) {
+  switch (type) {
+    case DT_FLOAT:
+      vmovups(dst, src);
+      break;
+
+    case DT_HALF:
+      vcvtph2ps(dst, src);
+      break;
+
+    case DT_BFLOAT16:
+      // A bfloat16 value is the upper half of a single precision float.
+      vpmovzxwd(dst, src);
+      vpslld(dst, dst, 16);
+      break;
+
+    default:
+      LOG(FATAL) << "Invalid float type: " << type;
+  }
+}
+
+void MacroAssembler::LoadFloats(jit::ZMMRegister dst, const jit::Operand &src,
+                                Type type, jit::Mask mask) {
+  switch (type) {
+    case DT_FLOAT:
+      vmovups(dst, src, mask);
+      break;
+
+    case DT_HALF:
+      vcvtph2ps(dst, src, mask);
+      break;
+
+    case DT_BFLOAT16:
+      vpmovzxwd(dst, src, mask);
+      vpslld(dst, dst, 16);
+      break;
+
+    default:
+      LOG(FATAL) << "Invalid float type: " << type;
+  }
+}
+
+void MacroAssembler::LoadFloat(jit::XMMRegister dst, const jit::Operand &src,
+                               Type type) {
+  switch (type) {
+    case DT_FLOAT:
+      vmovss(dst, src);
+      break;
+
+    case DT_HALF:
+      vpinsrw(dst, dst, src, 0);
+      vcvtph2ps(dst, dst);
+      break;
+
+    case DT_BFLOAT16:
+      vpxor(dst, dst, dst);
+      vpinsrw(dst, dst, src, 1);
+      break;
+
+    default:
+      LOG(FATAL) << "Invalid float type: " << type;
+  }
+}
+
 void MacroAssembler::Multiply(jit::Register reg, int64 scalar) {
   if (scalar == 0) {
     xorq(reg, reg);
@@ -141,6 +141,12 @@ class SIMDRegisters {
     return jit::YMMRegister::from_code(try_alloc());
   }
 
+  // Allocate 512-bit ZMM register.
+  jit::ZMMRegister allocz() { return jit::ZMMRegister::from_code(alloc()); }
+  jit::ZMMRegister try_allocz() {
+    return jit::ZMMRegister::from_code(try_alloc());
+  }
+
   // Allocate SIMD register.
   int try_alloc();
   int alloc();
@@ -149,16 +155,19 @@ class SIMDRegisters {
   void use(int r) { used_regs_ |= (1 << r); }
   void use(jit::XMMRegister r) { use(r.code()); }
   void use(jit::YMMRegister r) { use(r.code()); }
+  void use(jit::ZMMRegister r) { use(r.code()); }
 
   // Mark register as being free.
   void release(int r) { used_regs_ &= ~(1 << r); }
   void release(jit::XMMRegister r) { release(r.code()); }
   void release(jit::YMMRegister r) { release(r.code()); }
+  void release(jit::ZMMRegister r) { release(r.code()); }
 
   // Check if register is used.
   bool used(int r) const { return ((1 << r) & used_regs_) != 0; }
   bool used(jit::XMMRegister r) { return used(r.code()); }
   bool used(jit::YMMRegister r) { return used(r.code()); }
+  bool used(jit::ZMMRegister r) { return used(r.code()); }
 
   // Reset allocated registers.
   void reset() { used_regs_ = 0; }
@@ -267,6 +276,20 @@ class MacroAssembler : public jit::Assembler {
   void StoreInteger(jit::Register base, jit::Register index, jit::Register src,
                     Type type);
 
+  // Check if floats stored as type can be loaded with LoadFloats() into
+  // vector registers with the given size in bits (256 for ymm, 512 for zmm, or
+  // 32 for scalar loads) on this CPU.
+  static bool SupportsFloatType(Type type, int bits);
+
+  // Load floats stored as type into register. Half-precision (DT_HALF) and
+  // bfloat16 (DT_BFLOAT16) values are converted to single precision.
+  void LoadFloats(jit::YMMRegister dst, const jit::Operand &src, Type type);
+  void LoadFloats(jit::ZMMRegister dst, const jit::Operand &src, Type type,
+                  jit::Mask mask = jit::nomask);
+
+  // Load single float stored as type into the lowest element of register.
+  void LoadFloat(jit::XMMRegister dst, const jit::Operand &src, Type type);
+
   // Multiply register with constant.
   void Multiply(jit::Register reg, int64 scalar);
 
@@ -15,108 +15,240 @@
 #include "sling/myelin/multi-process.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <thread>
 
 #include "sling/base/logging.h"
 
 namespace sling {
 namespace myelin {
 
-// Worker thread for multi-processor runtime.
-class Worker {
+// Number of times an idle worker polls the task queues before going to sleep.
+static const int kWorkerSpinCount = 20000;
+
+// Number of times the main task polls a running task before yielding.
+static const int kWaitSpinCount = 1000;
+
+// Pause processor in spin loop.
+static inline void CPUPause() {
+  asm volatile("pause");
+}
+
+// Task queue for worker.
+struct TaskQueue {
+  std::mutex mu;
+  std::deque<Task *> tasks;
+};
+
+// Runtime status for parallel task. This is stored in the state field of the
+// task structure in the instance.
+struct TaskStatus {
+  // Task status.
+  enum Status {IDLE = 0, QUEUED = 1, RUNNING = 2};
+
+  TaskStatus(WorkerPool *pool) : pool(pool) {}
+
+  WorkerPool *pool;                // worker pool for executing task
+  std::atomic<int> status{IDLE};   // current status for task
+  int queue = -1;                  // queue for task when it is queued
+};
+
+// Pool of worker threads with work-stealing task queues.
+class WorkerPool {
  public:
-  // Start worker.
-  Worker() : thread_(&Worker::Run, this) {}
+  // Start worker threads.
+  WorkerPool(int workers) {
+    for (int i = 0; i < workers; ++i) queues_.push_back(new TaskQueue());
+    for (int i = 0; i < workers; ++i) {
+      threads_.emplace_back(&WorkerPool::Run, this, i);
+    }
+  }
 
-  // Stop worker.
-  ~Worker() {
-    DCHECK_EQ(state_, IDLE);
+  // Stop worker threads.
+  ~WorkerPool() {
     mu_.lock();
-    state_ = STOP;
+    stop_ = true;
     mu_.unlock();
     cv_.notify_all();
-    thread_.join();
+    for (auto &t : threads_) t.join();
+    for (auto *q : queues_) delete q;
   }
 
-  // Attach worker to task.
-  void Attach(Task *task) {
-    DCHECK_EQ(state_, IDLE);
-    mu_.lock();
-    task->state = this;
-    task_ = task;
-    state_ = READY;
-    mu_.unlock();
-    cv_.notify_all();
+  // Add task to queue. Tasks started from a worker thread are added to the
+  // queue for the worker. Otherwise, the queues are used in round-robin order.
+  void Submit(Task *task) {
+    TaskStatus *state = reinterpret_cast<TaskStatus *>(task->state);
+    DCHECK(state->status == TaskStatus::IDLE);
+    int q;
+    if (current_pool_ == this) {
+      q = current_worker_;
+    } else {
+      q = next_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+    }
+    TaskQueue *queue = queues_[q];
+    queue->mu.lock();
+    state->queue = q;
+    state->status = TaskStatus::QUEUED;
+    queue->tasks.push_back(task);
+    queue->mu.unlock();
+
+    // Wake up a sleeping worker.
+    pending_++;
+    if (sleeping_ > 0) {
+      mu_.lock();
+      mu_.unlock();
+      cv_.notify_one();
+    }
   }
 
-  // Detach worker from current task.
-  void Detach() {
-    DCHECK_EQ(state_, READY);
-    state_ = IDLE;
+  // Wait for task to complete. If the task has not been started by a worker
+  // yet, it is removed from its queue and executed directly.
+  void Wait(Task *task) {
+    TaskStatus *state = reinterpret_cast<TaskStatus *>(task->state);
+    if (state->status == TaskStatus::QUEUED) {
+      TaskQueue *queue = queues_[state->queue];
+      bool claimed = false;
+      queue->mu.lock();
+      if (state->status == TaskStatus::QUEUED) {
+        auto &tasks = queue->tasks;
+        tasks.erase(std::find(tasks.begin(), tasks.end(), task));
+        state->status = TaskStatus::RUNNING;
+        pending_--;
+        claimed = true;
+      }
+      queue->mu.unlock();
+      if (claimed) {
+        Execute(task);
+        return;
+      }
+    }
+
+    // Wait for worker to complete the task.
+    int spins = 0;
+    while (state->status != TaskStatus::IDLE) {
+      if (++spins < kWaitSpinCount) {
+        CPUPause();
+      } else {
+        std::this_thread::yield();
+      }
+    }
   }
 
-  // Start task in worker thread.
-  static void Start(Task *task) {
-    Worker *worker = reinterpret_cast<Worker *>(task->state);
-    DCHECK_EQ(worker->state_, READY);
-    worker->state_ = RUN;
+ private:
+  // Execute task and mark it as completed.
+  static void Execute(Task *task) {
+    TaskStatus *state = reinterpret_cast<TaskStatus *>(task->state);
+    task->func(task->arg);
+    state->status = TaskStatus::IDLE;
   }
 
-  // Wait for worker thread to complete.
-  static void Wait(Task *task) {
-    Worker *worker = reinterpret_cast<Worker *>(task->state);
-    while (worker->state_ != READY);
+  // Take task from queue. The worker takes the newest task from its own queue
+  // and steals the oldest task from other queues.
+  Task *Take(int q, bool own) {
+    TaskQueue *queue = queues_[q];
+    std::lock_guard<std::mutex> lock(queue->mu);
+    if (queue->tasks.empty()) return nullptr;
+    Task *task;
+    if (own) {
+      task = queue->tasks.back();
+      queue->tasks.pop_back();
+    } else {
+      task = queue->tasks.front();
+      queue->tasks.pop_front();
+    }
+    reinterpret_cast<TaskStatus *>(task->state)->status = TaskStatus::RUNNING;
+    pending_--;
+    return task;
+  }
+
+  // Find task to run, first from own queue and then from other queues.
+  Task *Find(int index) {
+    if (pending_ == 0) return nullptr;
+    int n = queues_.size();
+    for (int i = 0; i < n; ++i) {
+      int q = (index + i) % n;
+      Task *task = Take(q, q == index);
+      if (task != nullptr) return task;
+    }
+    return nullptr;
   }
 
- private:
   // Worker thread.
-  void Run() {
-    std::unique_lock<std::mutex> lock(mu_);
-    for (;;) {
-      switch (state_) {
-        case READY:
-          // Spin waiting for task;
-          break;
-
-        case RUN:
-          // Run task.
-          task_->func(task_->arg);
-
-          // Signal completion of task.
-          state_ = READY;
-          break;
-
-        case IDLE:
-          // Wait for task to attach to worker (or stop).
-          cv_.wait(lock);
-          break;
-
-        case STOP:
-          // Terminate worker.
-          return;
+  void Run(int index) {
+    current_pool_ = this;
+    current_worker_ = index;
+    int spins = 0;
+    while (!stop_) {
+      // Run next task.
+      Task *task = Find(index);
+      if (task != nullptr) {
+        Execute(task);
+        spins = 0;
+        continue;
       }
+
+      // Spin waiting for new tasks before going to sleep.
+      if (++spins < kWorkerSpinCount) {
+        CPUPause();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(mu_);
+      sleeping_++;
+      while (pending_ == 0 && !stop_) cv_.wait(lock);
+      sleeping_--;
+      spins = 0;
     }
   }
 
-  // Worker states.
-  enum State {READY = 0, RUN = 1, IDLE = 2, STOP = 3};
+  // Task queues for workers.
+  std::vector<TaskQueue *> queues_;
+
+  // Worker threads.
+  std::vector<std::thread> threads_;
+
+  // Number of queued tasks.
+  std::atomic<int> pending_{0};
+
+  // Number of sleeping workers.
+  std::atomic<int> sleeping_{0};
+
+  // Next queue for tasks submitted from outside the worker pool.
+  std::atomic<int> next_{0};
 
-  // Signal for waking up worker.
+  // Signal for waking up sleeping workers.
   std::mutex mu_;
   std::condition_variable cv_;
+  std::atomic<bool> stop_{false};
 
-  // Worker state.
-  volatile State state_ = IDLE;
+  // Worker pool and worker index for the current thread.
+  static thread_local WorkerPool *current_pool_;
+  static thread_local int current_worker_;
+};
 
-  // Current task for worker.
-  Task *task_ = nullptr;
+thread_local WorkerPool *WorkerPool::current_pool_ = nullptr;
+thread_local int WorkerPool::current_worker_ = -1;
 
-  // Worker thread.
-  std::thread thread_;
-};
+// Runtime functions for starting and waiting for tasks.
+static void StartTask(Task *task) {
+  reinterpret_cast<TaskStatus *>(task->state)->pool->Submit(task);
+}
+
+static void WaitTask(Task *task) {
+  reinterpret_cast<TaskStatus *>(task->state)->pool->Wait(task);
+}
+
+MultiProcessorRuntime::MultiProcessorRuntime(int workers) : workers_(workers) {
+  if (workers_ <= 0) workers_ = std::thread::hardware_concurrency() - 1;
+  if (workers_ <= 0) workers_ = 1;
+}
 
 MultiProcessorRuntime::~MultiProcessorRuntime() {
   // Stop all workers.
-  for (auto *w : workers_) delete w;
+  delete pool_;
 }
 
 void MultiProcessorRuntime::AllocateInstance(Instance *instance) {
@@ -124,35 +256,26 @@ void MultiProcessorRuntime::AllocateInstance(Instance *instance) {
   void *data;
   int rc = posix_memalign(&data, instance->alignment(), instance->size());
   CHECK_EQ(rc, 0);
+  memset(data, 0, instance->size());
   instance->set_data(reinterpret_cast<char *>(data));
 
-  // Allocate workers for instance.
+  // Set up task state for instance.
   int n = instance->num_tasks();
   if (n > 0) {
-    std::lock_guard<std::mutex> lock(mu_);
+    std::call_once(started_, [this]() { pool_ = new WorkerPool(workers_); });
     for (int i = 0; i < n; ++i) {
-      Worker *worker;
-      if (workers_.empty()) {
-        worker = new Worker();
-      } else {
-        worker = workers_.back();
-        workers_.pop_back();
-      }
-      worker->Attach(instance->task(i));
+      instance->task(i)->state = new TaskStatus(pool_);
     }
   }
 }
 
 void MultiProcessorRuntime::FreeInstance(Instance *instance) {
-  // Detach instance from workers and return them to worker pool.
+  // Release task state for instance.
   int n = instance->num_tasks();
-  if (n > 0) {
-    std::lock_guard<std::mutex> lock(mu_);
-    for (int i = n - 1; i >= 0; --i) {
-      Worker *worker = reinterpret_cast<Worker *>(instance->task(i)->state);
-      worker->Detach();
-      workers_.push_back(worker);
-    }
+  for (int i = 0; i < n; ++i) {
+    auto *state = reinterpret_cast<TaskStatus *>(instance->task(i)->state);
+    DCHECK(state->status == TaskStatus::IDLE);
+    delete state;
   }
 
   // Deallocate instance memory.
@@ -187,11 +310,11 @@ void MultiProcessorRuntime::FreeChannel(char *data, Placement placement) {
 }
 
 Runtime::TaskFunc MultiProcessorRuntime::StartTaskFunc() {
-  return Worker::Start;
+  return StartTask;
 }
 
 Runtime::TaskFunc MultiProcessorRuntime::WaitTaskFunc() {
-  return Worker::Wait;
+  return WaitTask;
 }
 
 }  // namespace myelin
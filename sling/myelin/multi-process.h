@@ -17,18 +17,23 @@
 
 #include "sling/myelin/compute.h"
 
-#include <condition_variable>
 #include <mutex>
-#include <thread>
 
 namespace sling {
 namespace myelin {
 
-class Worker;
+class WorkerPool;
 
-// Myelin runtime for multi-processor execution.
+// Myelin runtime for multi-processor execution. Parallel tasks are executed by
+// a pool of worker threads shared by all instances. Each worker has its own
+// task queue and idle workers steal tasks from the queues of other workers. A
+// task that has not been picked up by a worker when the main task needs its
+// results is run directly by the main task.
 class MultiProcessorRuntime : public Runtime {
  public:
+  // Initialize runtime with the number of worker threads. If the number of
+  // workers is zero, one worker is used for each additional CPU core.
+  MultiProcessorRuntime(int workers = 0);
   ~MultiProcessorRuntime();
   string Description() override { return "Multi-processor"; }
 
@@ -54,11 +59,13 @@ class MultiProcessorRuntime : public Runtime {
   TaskFunc WaitTaskFunc() override;
 
  private:
-  // Mutex for synchronizing access to worker pool.
-  std::mutex mu_;
+  // Number of worker threads.
+  int workers_;
 
-  // Worker pool.
-  std::vector<Worker *> workers_;
+  // Worker pool. This is started when the first instance with parallel tasks
+  // is allocated.
+  WorkerPool *pool_ = nullptr;
+  std::once_flag started_;
 };
 
 }  // namespace myelin
@@ -99,6 +99,23 @@ void Profile::Initialize(int64 *data, Order order) {
   sort(steps_.begin(), steps_.end());
 }
 
+double Profile::task_time(int tidx) const {
+  double t = 0.0;
+  for (int i = 0; i < steps(); ++i) {
+    if (step(i)->task_index() == tidx) t += time(i);
+  }
+  return t;
+}
+
+double Profile::main_time() const {
+  double t = 0.0;
+  for (int i = 0; i < tasks(); ++i) t += start_time(i) + wait_time(i);
+  for (int i = 0; i < steps(); ++i) {
+    if (step(i)->task_index() == -1) t += time(i);
+  }
+  return t;
+}
+
 string Profile::ASCIIReport() const {
   // Check if profiling has been enabled.
   if (!enabled()) return "No profile";
@@ -195,30 +212,37 @@ string Profile::ASCIIReport() const {
   if (tasks() > 0) {
     double total_start = 0.0;
     double total_wait = 0.0;
+    double total_compute = 0.0;
     report.append("\n");
-    report.append("+-------|---------------+---------------+\n");
-    report.append("|  task |    start time |     wait time |\n");
-    report.append("+-------|---------------+---------------+\n");
+    report.append("+-------+---------------+---------------+"
+                  "---------------+-------------+\n");
+    report.append("|  task |    start time |     wait time |"
+                  "  compute time | utilization |\n");
+    report.append("+-------+---------------+---------------+"
+                  "---------------+-------------+\n");
     for (int i = 0; i < tasks(); ++i) {
       total_start += start_time(i);
       total_wait += wait_time(i);
-      StringAppendF(&report, "| %5d | %s | %s |\n",
+      total_compute += task_time(i);
+      StringAppendF(&report, "| %5d | %s | %s | %s |     %6.2f%% |\n",
                     cell()->task(i),
                     TimeStr(start_time(i)).c_str(),
-                    TimeStr(wait_time(i)).c_str());
+                    TimeStr(wait_time(i)).c_str(),
+                    TimeStr(task_time(i)).c_str(),
+                    utilization(i));
     }
-    report.append("+-------|---------------+---------------+\n");
-    StringAppendF(&report, "| TOTAL | %s | %s |\n",
+    double compute_time = main_time();
+    double average = compute_time > 0 ?
+        total_compute / compute_time * 100 / tasks() : 0.0;
+    report.append("+-------+---------------+---------------+"
+                  "---------------+-------------+\n");
+    StringAppendF(&report, "| TOTAL | %s | %s | %s |     %6.2f%% |\n",
                   TimeStr(total_start).c_str(),
-                  TimeStr(total_wait).c_str());
-    report.append("+-------|---------------+---------------+\n");
-
-    double compute_time = total_start + total_wait;
-    for (int i = 0; i < steps(); ++i) {
-      if (step(i)->task_index() == -1) {
-        compute_time += time(i);
-      }
-    }
+                  TimeStr(total_wait).c_str(),
+                  TimeStr(total_compute).c_str(),
+                  average);
+    report.append("+-------+---------------+---------------+"
+                  "---------------+-------------+\n");
 
     double parallelism = time() / compute_time;
     double efficiency = parallelism / (tasks() + 1);
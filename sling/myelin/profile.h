@@ -133,6 +133,20 @@ class Profile {
     return tasks_[tidx].wait / (Clock::mhz() * invocations_);
   }
 
+  // Time per invocation in microseconds used by the steps in task.
+  double task_time(int tidx) const;
+
+  // Time per invocation in microseconds for the main task, i.e. the steps in
+  // the main task plus the time for starting and waiting for tasks. This is
+  // the elapsed time for the cell computation.
+  double main_time() const;
+
+  // Percentage of elapsed time for the cell computation used by task.
+  double utilization(int tidx) const {
+    double elapsed = main_time();
+    return elapsed > 0 ? task_time(tidx) / elapsed * 100 : 0;
+  }
+
   // Timing profile report in ASCII format.
   string ASCIIReport() const;
 
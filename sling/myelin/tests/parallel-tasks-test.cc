@@ -0,0 +1,124 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Test for automatic partitioning of independent steps into parallel tasks.
+// The test flow has more chains than tasks and an operation that combines
+// chains before the chains are complete. The output of the network computed
+// with parallel tasks is checked against the output computed serially.
+
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include "sling/base/flags.h"
+#include "sling/base/init.h"
+#include "sling/base/logging.h"
+#include "sling/myelin/builder.h"
+#include "sling/myelin/compute.h"
+#include "sling/myelin/flow.h"
+#include "sling/myelin/kernel/tensorflow.h"
+#include "sling/myelin/multi-process.h"
+
+DEFINE_int32(chains, 6, "Number of independent chains in test flow");
+DEFINE_int32(tasks, 2, "Maximum number of parallel tasks");
+DEFINE_int32(dim, 64, "Dimension of chain layers");
+DEFINE_int32(repeat, 100, "Number of computations per test");
+
+using namespace sling;
+using namespace sling::myelin;
+
+// Adds op for concatenating variables into a vector with the given width.
+static Flow::Variable *Concat(Builder *f, std::vector<Flow::Variable *> args,
+                              int width) {
+  int n = args.size();
+  args.push_back(f->Constant(1));
+  auto *concat = f->Op("ConcatV2", args);
+  concat->producer->SetAttr("N", n);
+  concat->type = DT_FLOAT;
+  concat->shape.assign(1, width);
+  return concat;
+}
+
+// Builds flow with chains of two layers. The first layer outputs of the first
+// two chains are concatenated before the second layers are computed, and the
+// outputs of all chains are concatenated. Returns the name of the output
+// variable.
+static string BuildFlow(Flow *flow) {
+  Builder f(flow, "f");
+  int d = FLAGS_dim;
+  std::vector<Flow::Variable *> layer1;
+  std::vector<Flow::Variable *> outputs;
+  for (int k = 0; k < FLAGS_chains; ++k) {
+    auto *x = f.Var("f/x" + std::to_string(k), DT_FLOAT, {1, d});
+    x->in = true;
+    std::vector<float> w(d * d);
+    for (int i = 0; i < w.size(); ++i) w[i] = sin(k * 1000 + i) / d;
+    auto *W = f.Constant(w.data(), DT_FLOAT, {d, d});
+    auto *h = f.Tanh(f.MatMul(x, W));
+    layer1.push_back(h);
+    outputs.push_back(f.Tanh(f.MatMul(h, W)));
+  }
+  outputs.push_back(f.Tanh(Concat(&f, {layer1[0], layer1[1]}, 2 * d)));
+  auto *y = f.Tanh(Concat(&f, outputs, (FLAGS_chains + 2) * d));
+  y->out = true;
+  return y->name;
+}
+
+// Computes the test flow and returns the output.
+static std::vector<float> Compute(int tasks) {
+  Library library;
+  RegisterTensorflowLibrary(&library);
+  Flow flow;
+  string output = BuildFlow(&flow);
+  flow.Analyze(library);
+
+  Network network;
+  MultiProcessorRuntime runtime;
+  if (tasks > 0) {
+    network.set_runtime(&runtime);
+    network.set_parallel_tasks(tasks);
+  }
+  CHECK(network.Compile(flow, library));
+  Cell *cell = network.GetCell("f");
+  LOG(INFO) << "Cell with " << cell->num_tasks() << " tasks";
+  CHECK_LE(cell->num_tasks(), tasks);
+
+  Instance data(cell);
+  for (int r = 0; r < FLAGS_repeat; ++r) {
+    for (int k = 0; k < FLAGS_chains; ++k) {
+      Tensor *input = cell->GetParameter("f/x" + std::to_string(k));
+      float *x = data.Get<float>(input);
+      for (int i = 0; i < FLAGS_dim; ++i) x[i] = cos(r + k * 100 + i);
+    }
+    data.Compute();
+  }
+  Tensor *y = cell->GetParameter(output);
+  float *result = data.Get<float>(y);
+  return std::vector<float>(result, result + y->elements());
+}
+
+int main(int argc, char *argv[]) {
+  InitProgram(&argc, &argv);
+  CHECK_GT(FLAGS_chains, FLAGS_tasks);
+
+  std::vector<float> expected = Compute(0);
+  std::vector<float> actual = Compute(FLAGS_tasks);
+  CHECK_EQ(expected.size(), actual.size());
+  for (int i = 0; i < expected.size(); ++i) {
+    CHECK_LT(fabs(expected[i] - actual[i]), 1e-5) << "Output " << i;
+  }
+
+  LOG(INFO) << "Parallel tasks test passed";
+  return 0;
+}
@@ -19,6 +19,7 @@
 #include "sling/base/logging.h"
 #include "sling/base/macros.h"
 #include "sling/file/file.h"
+#include "sling/file/parallel-recordio.h"
 #include "sling/file/recordio.h"
 #include "sling/frame/object.h"
 #include "sling/frame/serialization.h"
@@ -99,23 +100,28 @@ class ZipDocumentSource : public DocumentSource {
 
 // Iterator implementation for SLING recordio files.
 // Assumes that each encoded document is a separate record in the recordio file.
+// The file pattern can match multiple record files, which are read one after
+// another. If parallel reading is enabled, the files are read ahead and
+// decompressed in parallel. The records are returned in the same order in both
+// cases.
 class RecordIODocumentSource : public DocumentSource {
  public:
-  RecordIODocumentSource(const string &file) {
-    reader_ = new RecordReader(file);
-    file_ = file;
+  RecordIODocumentSource(const string &file_pattern, bool parallel)
+      : file_pattern_(file_pattern), parallel_(parallel) {
+    if (!parallel_) {
+      CHECK(File::Match(file_pattern, &files_));
+      CHECK(!files_.empty()) << "No record files match " << file_pattern;
+    }
+    Open();
   }
 
   ~RecordIODocumentSource() override {
-    if (reader_ != nullptr) reader_->Close();
-    delete reader_;
+    Close();
   }
 
   bool NextSerialized(string *name, string *contents) override {
-    if (reader_->Done()) return false;
-
     Record record;
-    CHECK(reader_->Read(&record));
+    if (!ReadRecord(&record)) return false;
 
     *name = record.key.str();
     *contents = record.value.str();
@@ -124,10 +130,8 @@ class RecordIODocumentSource : public DocumentSource {
   }
 
   Document *Next(Store *store, string *name) override {
-    if (reader_->Done()) return nullptr;
-
     Record record;
-    CHECK(reader_->Read(&record));
+    if (!ReadRecord(&record)) return nullptr;
     *name = record.key.str();
 
     StringDecoder decoder(store, record.value.data(), record.value.size());
@@ -135,15 +139,61 @@ class RecordIODocumentSource : public DocumentSource {
   }
 
   void Rewind() override {
-    if (reader_ != nullptr) {
+    Close();
+    Open();
+  }
+
+ private:
+  // Starts reading from the first record file.
+  void Open() {
+    if (parallel_) {
+      parallel_reader_ = new ParallelRecordReader(file_pattern_);
+    } else {
+      next_file_ = 0;
+    }
+  }
+
+  // Closes the record readers.
+  void Close() {
+    delete parallel_reader_;
+    parallel_reader_ = nullptr;
+    delete reader_;
+    reader_ = nullptr;
+  }
+
+  // Reads the next record. Returns false when all records have been read.
+  bool ReadRecord(Record *record) {
+    if (parallel_) {
+      if (parallel_reader_->Done()) return false;
+      CHECK(parallel_reader_->Read(record));
+      return true;
+    }
+
+    while (reader_ == nullptr || reader_->Done()) {
       delete reader_;
-      reader_ = new RecordReader(file_);
+      reader_ = nullptr;
+      if (next_file_ == files_.size()) return false;
+      reader_ = new RecordReader(files_[next_file_++]);
     }
+    CHECK(reader_->Read(record));
+    return true;
   }
 
- private:
+  // File pattern for record files.
+  string file_pattern_;
+
+  // Read record files in parallel.
+  bool parallel_;
+
+  // Record files and the next file to be read by the sequential reader.
+  std::vector<string> files_;
+  int next_file_ = 0;
+
+  // Sequential reader for the current record file.
   RecordReader *reader_ = nullptr;
-  string file_;
+
+  // Parallel reader for all the record files.
+  ParallelRecordReader *parallel_reader_ = nullptr;
 };
 
 Document *DocumentSource::Next(Store *store) {
@@ -171,12 +221,13 @@ bool HasSuffix(const string &s, const string &suffix) {
 
 }  // namespace
 
-DocumentSource *DocumentSource::Create(const string &file_pattern) {
+DocumentSource *DocumentSource::Create(const string &file_pattern,
+                                       bool parallel) {
   // TODO: Add more formats as needed.
   if (HasSuffix(file_pattern, ".zip")) {
     return new ZipDocumentSource(file_pattern);
   } else if (HasSuffix(file_pattern, ".rec")) {
-    return new RecordIODocumentSource(file_pattern);
+    return new RecordIODocumentSource(file_pattern, parallel);
   } else {
     std::vector<string> files;
     CHECK(File::Match(file_pattern, &files));
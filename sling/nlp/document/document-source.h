@@ -45,8 +45,11 @@ class DocumentSource {
   // Rewinds to the start of the corpus.
   virtual void Rewind() = 0;
 
-  // Returns an iterator implementation depending on 'file_pattern'.
-  static DocumentSource *Create(const string &file_pattern);
+  // Returns an iterator implementation depending on 'file_pattern'. If
+  // 'parallel' is true, record files are read ahead and decompressed in
+  // parallel.
+  static DocumentSource *Create(const string &file_pattern,
+                                bool parallel = false);
 };
 
 }  // namespace nlp
@@ -0,0 +1,198 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Microbenchmark for lexical feature extraction. This tokenizes a text file,
+// or synthetic text if no input file is given, builds a lexicon with affixes
+// from the most frequent words, and reports the feature extraction throughput
+// in tokens per second with and without the word feature cache.
+
+#include <ctype.h>
+#include <stdio.h>
+#include <algorithm>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "sling/base/clock.h"
+#include "sling/base/flags.h"
+#include "sling/base/init.h"
+#include "sling/base/logging.h"
+#include "sling/base/types.h"
+#include "sling/file/file.h"
+#include "sling/frame/store.h"
+#include "sling/nlp/document/affix.h"
+#include "sling/nlp/document/document.h"
+#include "sling/nlp/document/document-tokenizer.h"
+#include "sling/nlp/document/features.h"
+#include "sling/nlp/document/lexicon.h"
+#include "sling/stream/memory.h"
+
+DEFINE_string(input, "", "Text file with one document per line");
+DEFINE_int32(documents, 10000, "Number of synthetic documents");
+DEFINE_int32(words, 10000, "Number of words in lexicon");
+DEFINE_int32(affix_length, 3, "Maximum prefix and suffix length");
+DEFINE_bool(normalize_digits, true, "Normalize digits in lexicon lookups");
+DEFINE_int32(repeat, 5, "Number of extraction rounds per configuration");
+
+using namespace sling;
+using namespace sling::nlp;
+
+// Generates synthetic text with Zipf-distributed words. The vocabulary has a
+// mix of lowercase, capitalized, numeric, hyphenated, and non-ASCII words.
+static string SyntheticText(std::mt19937 *rnd, int num_words) {
+  static std::vector<string> vocabulary;
+  static std::vector<double> cumulative;
+  if (vocabulary.empty()) {
+    static const char *syllables[] = {
+      "ka", "to", "ri", "men", "sa", "lo", "ve", "nu", "der", "pi", "ga",
+      "sch", "ön", "ré", "ta", "mi", "ko", "ple",
+    };
+    std::mt19937 vrnd(1);
+    double total = 0.0;
+    for (int i = 0; i < 50000; ++i) {
+      string word;
+      int n = 1 + vrnd() % 4;
+      for (int j = 0; j < n; ++j) word += syllables[vrnd() % 18];
+      switch (vrnd() % 20) {
+        case 0: if (islower(word[0])) word[0] = toupper(word[0]); break;
+        case 1: word = std::to_string(vrnd() % 10000); break;
+        case 2: word += "-" + word; break;
+        case 3: word += std::to_string(vrnd() % 100); break;
+      }
+      vocabulary.push_back(word);
+      total += 1.0 / (i + 1);
+      cumulative.push_back(total);
+    }
+    for (double &c : cumulative) c /= total;
+  }
+
+  static const char *punctuation[] = {",", ".", "\"", "(", ")", ";", "'"};
+  string text;
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  for (int i = 0; i < num_words; ++i) {
+    if (i > 0) text.push_back(' ');
+    if ((*rnd)() % 8 == 0) {
+      text.append(punctuation[(*rnd)() % 7]);
+      text.push_back(' ');
+    }
+    double u = uniform(*rnd);
+    int w = std::lower_bound(cumulative.begin(), cumulative.end(), u) -
+            cumulative.begin();
+    if (w >= vocabulary.size()) w = vocabulary.size() - 1;
+    text.append(vocabulary[w]);
+  }
+  text.append(" .");
+  return text;
+}
+
+// Returns serialized affix table for lexicon words.
+static string AffixData(AffixTable::Type type, const string &words) {
+  AffixTable affixes(type, FLAGS_affix_length);
+  size_t start = 0;
+  while (start < words.size()) {
+    size_t end = words.find('\n', start);
+    affixes.AddAffixesForWord(Text(words.data() + start, end - start));
+    start = end + 1;
+  }
+  string data;
+  {
+    StringOutputStream stream(&data);
+    affixes.Write(&stream);
+  }
+  return data;
+}
+
+int main(int argc, char *argv[]) {
+  InitProgram(&argc, &argv);
+
+  // Tokenize documents.
+  Store store;
+  DocumentTokenizer tokenizer;
+  std::vector<Document *> documents;
+  int64 num_tokens = 0;
+  auto add = [&](Text text) {
+    Document *document = new Document(&store);
+    tokenizer.Tokenize(document, text);
+    document->Update();
+    num_tokens += document->num_tokens();
+    documents.push_back(document);
+  };
+  if (!FLAGS_input.empty()) {
+    string contents;
+    CHECK(File::ReadContents(FLAGS_input, &contents));
+    size_t start = 0;
+    while (start < contents.size()) {
+      size_t end = contents.find('\n', start);
+      if (end == string::npos) end = contents.size();
+      if (end > start) add(Text(contents.data() + start, end - start));
+      start = end + 1;
+    }
+  } else {
+    std::mt19937 rnd(7);
+    for (int i = 0; i < FLAGS_documents; ++i) {
+      add(SyntheticText(&rnd, 50 + rnd() % 200));
+    }
+  }
+  printf("%lu documents, %lld tokens\n", documents.size(), num_tokens);
+
+  // Build lexicon from the most frequent words.
+  std::unordered_map<string, int64> counts;
+  for (Document *document : documents) {
+    for (int i = 0; i < document->num_tokens(); ++i) {
+      counts[document->token(i).text()]++;
+    }
+  }
+  std::vector<std::pair<int64, string>> ranked;
+  for (auto &it : counts) ranked.emplace_back(-it.second, it.first);
+  std::sort(ranked.begin(), ranked.end());
+  if (ranked.size() > FLAGS_words) ranked.resize(FLAGS_words);
+  string words = "<UNKNOWN>\n";
+  for (auto &it : ranked) words.append(it.second).push_back('\n');
+  string prefixes = AffixData(AffixTable::PREFIX, words);
+  string suffixes = AffixData(AffixTable::SUFFIX, words);
+
+  Lexicon lexicon;
+  lexicon.InitWords(words.data(), words.size());
+  lexicon.set_oov(0);
+  lexicon.set_normalize_digits(FLAGS_normalize_digits);
+  lexicon.InitPrefixes(prefixes.data(), prefixes.size());
+  lexicon.InitSuffixes(suffixes.data(), suffixes.size());
+
+  // Time feature extraction with and without the word feature cache.
+  printf("%-10s %16s\n", "cache", "tokens/sec");
+  for (bool cache : {false, true}) {
+    Clock clock;
+    clock.start();
+    int64 checksum = 0;
+    for (int r = 0; r < FLAGS_repeat; ++r) {
+      for (Document *document : documents) {
+        DocumentFeatures features(&lexicon, cache);
+        features.Extract(*document);
+        for (int i = 0; i < document->num_tokens(); ++i) {
+          checksum += features.word(i) + features.capitalization(i) +
+                      features.quote(i) + features.digit(i);
+        }
+      }
+    }
+    clock.stop();
+    VLOG(1) << "checksum " << checksum;
+
+    double tps = num_tokens * FLAGS_repeat / clock.secs();
+    printf("%-10s %16.0f\n", cache ? "yes" : "no", tps);
+  }
+
+  for (Document *document : documents) delete document;
+  return 0;
+}
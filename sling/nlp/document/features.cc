@@ -14,141 +14,251 @@
 
 #include "sling/nlp/document/features.h"
 
+#include <vector>
+
 #include "sling/base/types.h"
 #include "sling/nlp/document/document.h"
+#include "sling/util/city.h"
 #include "sling/util/unicode.h"
 
 namespace sling {
 namespace nlp {
 
+// Character flags for computing token features. The quote feature for the
+// character is stored in the upper bits.
+enum CharFlags {
+  CHAR_HYPHEN = 0x01,
+  CHAR_UPPER = 0x02,
+  CHAR_LOWER = 0x04,
+  CHAR_PUNCTUATION = 0x08,
+  CHAR_DIGIT = 0x10,
+  CHAR_QUOTE_SHIFT = 5,
+};
+
+// Returns character flags for Unicode code point.
+static int GetCharFlags(int code) {
+  int flags = 0;
+  int cat = Unicode::Category(code);
+  if (cat == CHARCAT_DASH_PUNCTUATION) flags |= CHAR_HYPHEN;
+  if (Unicode::IsUpper(code)) flags |= CHAR_UPPER;
+  if (Unicode::IsLower(code)) flags |= CHAR_LOWER;
+  if (Unicode::IsPunctuation(code)) flags |= CHAR_PUNCTUATION;
+  if (Unicode::IsDigit(code)) flags |= CHAR_DIGIT;
+
+  DocumentFeatures::Quote quote = DocumentFeatures::NO_QUOTE;
+  switch (cat) {
+    case CHARCAT_INITIAL_QUOTE_PUNCTUATION:
+      quote = DocumentFeatures::OPEN_QUOTE;
+      break;
+    case CHARCAT_FINAL_QUOTE_PUNCTUATION:
+      quote = DocumentFeatures::CLOSE_QUOTE;
+      break;
+    case CHARCAT_OTHER_PUNCTUATION:
+      if (code == '\'' || code == '"') quote = DocumentFeatures::UNKNOWN_QUOTE;
+      break;
+    case CHARCAT_MODIFIER_SYMBOL:
+      if (code == '`') quote = DocumentFeatures::UNKNOWN_QUOTE;
+      break;
+  }
+  flags |= quote << CHAR_QUOTE_SHIFT;
+
+  return flags;
+}
+
+// Character flags for ASCII characters. These are computed from the Unicode
+// tables, so ASCII characters do not need to be decoded and classified.
+static struct AsciiFlags {
+  AsciiFlags() {
+    for (int c = 0; c < 128; ++c) flags[c] = GetCharFlags(c);
+  }
+  uint8 flags[128];
+} ascii_chars;
+
+// Cache mapping word hashes to word features. The cache is organized
+// as a set-associative cache where each set is kept in least recently used
+// order, so lookups and updates do not allocate memory.
+class DocumentFeatures::WordCache {
+ public:
+  WordCache() : entries_(kSets * kWays) {}
+
+  // Returns the cache for the current thread.
+  static WordCache *Get() {
+    static thread_local WordCache cache;
+    return &cache;
+  }
+
+  // Looks up features for word hash and makes it the most recently used
+  // entry in its set. Returns null if the word is not in the cache.
+  const TokenFeatures *Lookup(uint64 hash) {
+    Entry *set = &entries_[(hash % kSets) * kWays];
+    for (int i = 0; i < kWays; ++i) {
+      if (set[i].hash == hash) {
+        if (i > 0) {
+          Entry entry = set[i];
+          for (int j = i; j > 0; --j) set[j] = set[j - 1];
+          set[0] = entry;
+        }
+        return &set[0].features;
+      }
+    }
+    return nullptr;
+  }
+
+  // Adds features for word hash, replacing the least recently used
+  // entry in its set.
+  void Insert(uint64 hash, const TokenFeatures &features) {
+    Entry *set = &entries_[(hash % kSets) * kWays];
+    for (int j = kWays - 1; j > 0; --j) set[j] = set[j - 1];
+    set[0].hash = hash;
+    set[0].features = features;
+  }
+
+ private:
+  // Cache geometry.
+  static const int kSets = 1024;
+  static const int kWays = 4;
+
+  // Cache entry. Entries with zero hash are unused.
+  struct Entry {
+    uint64 hash = 0;
+    TokenFeatures features;
+  };
+
+  // Cache entries for all sets.
+  std::vector<Entry> entries_;
+};
+
 void DocumentFeatures::Extract(const Document &document) {
   features_.resize(document.num_tokens());
-  bool extract_prefixes = lexicon_->prefixes().size() != 0;
-  bool extract_suffixes = lexicon_->suffixes().size() != 0;
-  int oov = lexicon_->oov();
+  WordCache *cache = cache_ ? WordCache::Get() : nullptr;
   bool in_quote = false;
   for (int i = 0; i < document.num_tokens(); ++i) {
-    string word = document.token(i).text();
+    const Token &token = document.token(i);
+    const string &word = token.text();
     TokenFeatures &f = features_[i];
-    f.hyphen = NO_HYPHEN;
-    f.quote = NO_QUOTE;
 
-    // Look up word in lexicon.
-    f.word = lexicon_->LookupWord(word);
-
-    // Look up longest prefix.
-    if (extract_prefixes) {
-      if (f.word != oov) {
-        f.prefix = lexicon_->prefix(f.word);
+    // Get context-independent features for word. The cache is keyed by a
+    // hash of the word seeded with the lexicon id. CityHash is used instead
+    // of Fingerprint() since it also mixes all bytes of non-ASCII words.
+    if (cache != nullptr) {
+      uint64 hash =
+          CityHash64WithSeed(word.data(), word.size(), lexicon_->id());
+      if (hash == 0) hash = 1;
+      const TokenFeatures *cached = cache->Lookup(hash);
+      if (cached != nullptr) {
+        f = *cached;
       } else {
-        f.prefix = lexicon_->prefixes().GetLongestAffix(word);
+        ComputeWordFeatures(word, &f);
+        cache->Insert(hash, f);
       }
+    } else {
+      ComputeWordFeatures(word, &f);
     }
 
-    // Look up longest suffix.
-    if (extract_suffixes) {
-      if (f.word != oov) {
-        f.suffix = lexicon_->suffix(f.word);
-      } else {
-        f.suffix = lexicon_->suffixes().GetLongestAffix(word);
+    // Mixed case words are INITIAL at the start of a sentence.
+    if (f.capitalization == CAPITALIZED) {
+      if (i == 0 || token.brk() >= SENTENCE_BREAK) {
+        f.capitalization = INITIAL;
       }
     }
 
-    // Categorize token.
-    bool has_upper = false;
-    bool has_lower = false;
-    bool has_punctuation = false;
-    bool all_punctuation = true;
-    bool has_digit = false;
-    bool all_digit = true;
-    const char *p = word.data();
-    const char *end = p + word.size();
-    while (p < end) {
-      int code = UTF8::Decode(p);
-      int cat = Unicode::Category(code);
-
-      // Hyphenation.
-      if (cat == CHARCAT_DASH_PUNCTUATION) {
-        f.hyphen = HAS_HYPHEN;
-      }
-
-      // Capitalization.
-      if (Unicode::IsUpper(code)) has_upper = true;
-      if (Unicode::IsLower(code)) has_lower = true;
-
-      // Punctuation.
-      bool is_punct = Unicode::IsPunctuation(code);
-      all_punctuation &= is_punct;
-      has_punctuation |= is_punct;
-
-      // Quotes.
-      switch (cat) {
-        case CHARCAT_INITIAL_QUOTE_PUNCTUATION:
-          f.quote = OPEN_QUOTE;
-          break;
-        case CHARCAT_FINAL_QUOTE_PUNCTUATION:
-          f.quote = CLOSE_QUOTE;
-          break;
-        case CHARCAT_OTHER_PUNCTUATION:
-          if (code == '\'' || code == '"') f.quote = UNKNOWN_QUOTE;
-          break;
-        case CHARCAT_MODIFIER_SYMBOL:
-          if (code == '`') f.quote = UNKNOWN_QUOTE;
-          break;
-      }
+    // Quotes that can both open and close alternate between the two.
+    if (f.quote == UNKNOWN_QUOTE) {
+      f.quote = in_quote ? CLOSE_QUOTE : OPEN_QUOTE;
+      in_quote = !in_quote;
+    }
+  }
+}
 
-      // Digits.
-      bool is_digit = Unicode::IsDigit(code);
-      all_digit &= is_digit;
-      has_digit |= is_digit;
+void DocumentFeatures::ComputeWordFeatures(Text word, TokenFeatures *f) const {
+  // Look up word in lexicon.
+  int oov = lexicon_->oov();
+  f->word = lexicon_->LookupWord(word);
 
-      p = UTF8::Next(p);
+  // Look up longest prefix.
+  f->prefix = nullptr;
+  if (lexicon_->prefixes().size() != 0) {
+    if (f->word != oov) {
+      f->prefix = lexicon_->prefix(f->word);
+    } else {
+      f->prefix = lexicon_->prefixes().GetLongestAffix(word);
     }
+  }
 
-    // Compute word capitalization.
-    if (!has_upper && has_lower) {
-      f.capitalization = LOWERCASE;
-    } else if (has_upper && !has_lower) {
-      f.capitalization = UPPERCASE;
-    } else if (!has_upper && !has_lower) {
-      f.capitalization = NON_ALPHABETIC;
-    } else if (i == 0 || document.token(i).brk() >= SENTENCE_BREAK) {
-      f.capitalization = INITIAL;
+  // Look up longest suffix.
+  f->suffix = nullptr;
+  if (lexicon_->suffixes().size() != 0) {
+    if (f->word != oov) {
+      f->suffix = lexicon_->suffix(f->word);
     } else {
-      f.capitalization = CAPITALIZED;
+      f->suffix = lexicon_->suffixes().GetLongestAffix(word);
     }
+  }
 
-    // Compute punctuation feature.
-    if (all_punctuation) {
-      f.punctuation = ALL_PUNCTUATION;
-    } else if (has_punctuation) {
-      f.punctuation = SOME_PUNCTUATION;
+  // Categorize the characters in the word. ASCII characters are looked up
+  // directly in the character flag table.
+  int any = 0;
+  int all = -1;
+  int quote = NO_QUOTE;
+  const char *p = word.data();
+  const char *end = p + word.size();
+  while (p < end) {
+    int flags;
+    uint8 c = *p;
+    if (c < 0x80) {
+      flags = ascii_chars.flags[c];
+      p++;
     } else {
-      f.punctuation = NO_PUNCTUATION;
+      flags = GetCharFlags(UTF8::Decode(p));
+      p = UTF8::Next(p);
     }
+    any |= flags;
+    all &= flags;
+    if (flags >> CHAR_QUOTE_SHIFT) quote = flags >> CHAR_QUOTE_SHIFT;
+  }
 
-    // Compute quote feature.
-    if (f.quote != NO_QUOTE) {
-      // Penn Treebank open and close quotes are multi-character.
-      if (word == "``") f.quote = OPEN_QUOTE;
-      if (word == "''") f.quote = CLOSE_QUOTE;
-      if (f.quote == UNKNOWN_QUOTE) {
-        f.quote = in_quote ? CLOSE_QUOTE : OPEN_QUOTE;
-        in_quote = !in_quote;
-      }
-    }
+  // Compute hyphenation feature.
+  f->hyphen = (any & CHAR_HYPHEN) ? HAS_HYPHEN : NO_HYPHEN;
 
-    // Compute digit feature.
-    if (all_digit) {
-      f.digit = ALL_DIGIT;
-    } else if (has_digit) {
-      f.digit = SOME_DIGIT;
-    } else {
-      f.digit = NO_DIGIT;
-    }
+  // Compute word capitalization.
+  bool has_upper = any & CHAR_UPPER;
+  bool has_lower = any & CHAR_LOWER;
+  if (!has_upper && has_lower) {
+    f->capitalization = LOWERCASE;
+  } else if (has_upper && !has_lower) {
+    f->capitalization = UPPERCASE;
+  } else if (!has_upper && !has_lower) {
+    f->capitalization = NON_ALPHABETIC;
+  } else {
+    f->capitalization = CAPITALIZED;
+  }
+
+  // Compute punctuation feature.
+  if (all & CHAR_PUNCTUATION) {
+    f->punctuation = ALL_PUNCTUATION;
+  } else if (any & CHAR_PUNCTUATION) {
+    f->punctuation = SOME_PUNCTUATION;
+  } else {
+    f->punctuation = NO_PUNCTUATION;
+  }
+
+  // Compute quote feature. Penn Treebank open and close quotes are
+  // multi-character.
+  f->quote = static_cast<Quote>(quote);
+  if (f->quote != NO_QUOTE) {
+    if (word == "``") f->quote = OPEN_QUOTE;
+    if (word == "''") f->quote = CLOSE_QUOTE;
+  }
+
+  // Compute digit feature.
+  if (all & CHAR_DIGIT) {
+    f->digit = ALL_DIGIT;
+  } else if (any & CHAR_DIGIT) {
+    f->digit = SOME_DIGIT;
+  } else {
+    f->digit = NO_DIGIT;
   }
 }
 
 }  // namespace nlp
 }  // namespace sling
-
@@ -20,6 +20,7 @@
 #include "sling/base/types.h"
 #include "sling/nlp/document/document.h"
 #include "sling/nlp/document/lexicon.h"
+#include "sling/string/text.h"
 
 namespace sling {
 namespace nlp {
@@ -69,8 +70,10 @@ class DocumentFeatures {
     DIGIT__CARDINALITY = 3,
   };
 
-  // Initialize lexical feature extractor.
-  DocumentFeatures(const Lexicon *lexicon) : lexicon_(lexicon) {}
+  // Initialize lexical feature extractor. The features for words are cached
+  // in a thread-local cache unless 'cache' is false.
+  DocumentFeatures(const Lexicon *lexicon, bool cache = true)
+      : lexicon_(lexicon), cache_(cache) {}
 
   // Extract features from document.
   void Extract(const Document &document);
@@ -114,9 +117,20 @@ class DocumentFeatures {
     Digit digit = NO_DIGIT;                     // digits
   };
 
+  // Thread-local cache for word features.
+  class WordCache;
+
+  // Computes the features for a word that do not depend on the context of
+  // the token. Mixed case words are CAPITALIZED and quotes that can both
+  // open and close are UNKNOWN_QUOTE.
+  void ComputeWordFeatures(Text word, TokenFeatures *f) const;
+
   // Lexicon for looking up feature values.
   const Lexicon *lexicon_;
 
+  // Cache features for words.
+  bool cache_;
+
   // Features for tokens.
   std::vector<TokenFeatures> features_;
 };
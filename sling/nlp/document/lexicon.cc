@@ -14,6 +14,8 @@
 
 #include "sling/nlp/document/lexicon.h"
 
+#include <atomic>
+
 #include "sling/base/types.h"
 #include "sling/nlp/document/affix.h"
 #include "sling/stream/memory.h"
@@ -22,7 +24,20 @@
 namespace sling {
 namespace nlp {
 
+// Next unique lexicon id.
+static std::atomic<uint64> next_lexicon_id{1};
+
+Lexicon::Lexicon() {
+  NewId();
+}
+
+void Lexicon::NewId() {
+  id_ = next_lexicon_id++;
+}
+
 void Lexicon::InitWords(const char *data, size_t size) {
+  NewId();
+
   // Initialize mapping from words to ids.
   const static char kTerminator = '\n';
   vocabulary_.Init(data, size, kTerminator);
@@ -47,6 +62,8 @@ void Lexicon::InitWords(const char *data, size_t size) {
 }
 
 void Lexicon::InitPrefixes(const char *data, size_t size) {
+  NewId();
+
   // Read prefixes.
   ArrayInputStream stream(data, size);
   prefixes_.Read(&stream);
@@ -58,6 +75,8 @@ void Lexicon::InitPrefixes(const char *data, size_t size) {
 }
 
 void Lexicon::InitSuffixes(const char *data, size_t size) {
+  NewId();
+
   // Read suffixes.
   ArrayInputStream stream(data, size);
   suffixes_.Read(&stream);
@@ -68,9 +87,9 @@ void Lexicon::InitSuffixes(const char *data, size_t size) {
   }
 }
 
-int Lexicon::LookupWord(const string &word) const {
+int Lexicon::LookupWord(Text word) const {
   // Lookup word in vocabulary.
-  int id = vocabulary_.Lookup(word);
+  int id = vocabulary_.Lookup(word.data(), word.size());
 
   if (id == -1 && normalize_digits_) {
     // Check if word has digits.
@@ -80,12 +99,21 @@ int Lexicon::LookupWord(const string &word) const {
     }
 
     if (has_digits) {
-      // Normalize digits and lookup the normalized word.
-      string normalized = word;
-      for (char &c : normalized) {
-        if (c >= '0' && c <= '9') c = '9';
+      // Normalize digits and lookup the normalized word. Short words are
+      // normalized in a buffer on the stack.
+      const static int kBufferSize = 64;
+      char buffer[kBufferSize];
+      string overflow;
+      char *normalized = buffer;
+      if (word.size() > kBufferSize) {
+        overflow.resize(word.size());
+        normalized = &overflow[0];
+      }
+      for (int i = 0; i < word.size(); ++i) {
+        char c = word[i];
+        normalized[i] = (c >= '0' && c <= '9') ? '9' : c;
       }
-      id = vocabulary_.Lookup(normalized);
+      id = vocabulary_.Lookup(normalized, word.size());
     }
   }
 
@@ -20,6 +20,7 @@
 
 #include "sling/base/types.h"
 #include "sling/nlp/document/affix.h"
+#include "sling/string/text.h"
 #include "sling/util/vocabulary.h"
 
 namespace sling {
@@ -28,6 +29,8 @@ namespace nlp {
 // Lexicon for extracting lexical features from documents.
 class Lexicon {
  public:
+  Lexicon();
+
   // Initialize lexicon with newline-terminated word list.
   void InitWords(const char *data, size_t size);
 
@@ -36,7 +39,7 @@ class Lexicon {
   void InitSuffixes(const char *data, size_t size);
 
   // Look up word in vocabulary. Return OOV if word is not found.
-  int LookupWord(const string &word) const;
+  int LookupWord(Text word) const;
 
   // Return number of words in vocabulary.
   size_t size() const { return words_.size(); }
@@ -56,13 +59,26 @@ class Lexicon {
 
   // Out-of-vocabulary id.
   int oov() const { return oov_; }
-  void set_oov(int oov) { oov_ = oov; }
+  void set_oov(int oov) {
+    oov_ = oov;
+    NewId();
+  }
 
   // Digit normalization of words.
   bool normalize_digits() const { return normalize_digits_; }
-  void set_normalize_digits(bool normalize) { normalize_digits_ = normalize; }
+  void set_normalize_digits(bool normalize) {
+    normalize_digits_ = normalize;
+    NewId();
+  }
+
+  // Unique id for the lexicon. A new id is assigned every time the lexicon
+  // is modified, so features for words can be cached across lexicons.
+  uint64 id() const { return id_; }
 
  private:
+  // Assigns new unique id to lexicon.
+  void NewId();
+
   // Lexicon entry.
   struct Entry {
     string word;                // lexical word form
@@ -83,6 +99,9 @@ class Lexicon {
 
   // Word suffixes.
   AffixTable suffixes_{AffixTable::SUFFIX, 0};
+
+  // Lexicon id.
+  uint64 id_;
 };
 
 }  // namespace nlp
@@ -14,6 +14,8 @@
 
 #include "sling/nlp/parser/action-table.h"
 
+#include <algorithm>
+
 #include "sling/base/logging.h"
 #include "sling/base/types.h"
 #include "sling/file/file.h"
@@ -207,6 +209,167 @@ void ActionTable::Init(Store *store) {
     }
     beyond_bounds_[i] = beyond_bounds;
   }
+
+  // Group the actions within bounds by their arguments.
+  for (int i = 0; i < actions_.size(); ++i) {
+    if (beyond_bounds_[i]) continue;
+    const ParserAction &action = actions_[i];
+    switch (action.type) {
+      case ParserAction::SHIFT:
+        shift_.Add(i);
+        break;
+      case ParserAction::STOP:
+        stop_.Add(i);
+        break;
+      case ParserAction::EVOKE:
+        Group(&evoke_, action.length)->Add(i);
+        break;
+      case ParserAction::REFER:
+        if (refer_.size() <= action.length) refer_.resize(action.length + 1);
+        Group(&refer_[action.length], action.target)->Add(i);
+        break;
+      case ParserAction::CONNECT:
+        if (connect_.size() <= action.source) {
+          connect_.resize(action.source + 1);
+        }
+        Group(&connect_[action.source], action.target)->Add(i);
+        break;
+      case ParserAction::ASSIGN:
+        Group(&assign_, action.source)->Add(i);
+        break;
+      case ParserAction::EMBED:
+        Group(&embed_, action.target)->Add(i);
+        break;
+      case ParserAction::ELABORATE:
+        Group(&elaborate_, action.source)->Add(i);
+        break;
+    }
+  }
+}
+
+void ActionTable::ActionSet::Add(int index) {
+  int word = index >> 6;
+  DCHECK(words.empty() || words.back().first <= word);
+  if (words.empty() || words.back().first != word) words.emplace_back(word, 0);
+  words.back().second |= 1ULL << (index & 63);
+  indices.push_back(index);
+}
+
+void ActionTable::Mask(const ParserState &state, uint64 *mask) const {
+  memset(mask, 0, MaskWords() * sizeof(uint64));
+  int current = state.current();
+  int attention = state.AttentionSize();
+
+  // SHIFT is allowed until the end of the input and STOP only at the end.
+  if (current < state.end()) {
+    shift_.AddTo(mask);
+  } else {
+    stop_.AddTo(mask);
+  }
+
+  // Add EVOKE and REFER actions for spans starting at the current token that
+  // do not cross any existing span.
+  int max_length = state.MaxEvokeLength(max_span_length_);
+  for (int length = 1; length <= max_length; ++length) {
+    if (length < evoke_.size()) evoke_[length].AddTo(mask);
+    if (length < refer_.size()) {
+      const auto &targets = refer_[length];
+      int limit = std::min<int>(targets.size(), attention);
+      for (int t = 0; t < limit; ++t) targets[t].AddTo(mask);
+    }
+  }
+
+  // Remove EVOKE and REFER actions for spans that have already been evoked
+  // with the same type or the same frame. These can only be spans starting at
+  // the current token with the same end as the innermost span.
+  const auto &nesting = state.nesting_;
+  if (nesting.NestingLevel() > 0) {
+    int end = nesting.spans.back().first;
+    int length = end - current;
+    if (length <= max_length) {
+      for (const auto &p : nesting) {
+        if (p.first > end) break;
+        const auto &mention = state.mentions_[p.second];
+        if (mention.begin < current) break;
+        Frame frame(state.store(), state.frame(mention.frame));
+        Clear(ParserAction::Evoke(length, frame.GetHandle(Handle::isa())),
+              mask);
+        int target = state.AttentionIndex(mention.frame);
+        if (target != -1 && length < refer_.size() &&
+            target < refer_[length].size()) {
+          ParserAction refer(ParserAction::REFER, length);
+          refer.target = target;
+          Clear(refer, mask);
+        }
+      }
+    }
+  }
+
+  // The remaining actions are only allowed until the parse is done.
+  if (state.done()) return;
+
+  // Add ASSIGN and CONNECT actions for frames in the attention buffer and
+  // remove the ones that would add slots already present in the frames.
+  int sources = std::min<int>(attention,
+                              std::max(assign_.size(), connect_.size()));
+  for (int s = 0; s < sources; ++s) {
+    bool assign = s < assign_.size();
+    bool connect = s < connect_.size();
+    if (assign) assign_[s].AddTo(mask);
+    if (connect) {
+      const auto &targets = connect_[s];
+      int limit = std::min<int>(targets.size(), attention);
+      for (int t = 0; t < limit; ++t) targets[t].AddTo(mask);
+    }
+
+    Frame frame(state.store(), state.frame(state.Attention(s)));
+    for (const Slot &slot : frame) {
+      if (assign) {
+        ParserAction action(ParserAction::ASSIGN);
+        action.source = s;
+        action.role = slot.name;
+        action.label = slot.value;
+        Clear(action, mask);
+      }
+      if (connect && slot.value.IsIndex()) {
+        int target = state.AttentionIndex(slot.value.AsIndex());
+        if (target != -1 && target < connect_[s].size()) {
+          ParserAction action(ParserAction::CONNECT);
+          action.source = s;
+          action.target = target;
+          action.role = slot.name;
+          Clear(action, mask);
+        }
+      }
+    }
+  }
+
+  // Add EMBED and ELABORATE actions for frames in the attention buffer.
+  int limit = std::min<int>(embed_.size(), attention);
+  for (int t = 0; t < limit; ++t) embed_[t].AddTo(mask);
+  limit = std::min<int>(elaborate_.size(), attention);
+  for (int s = 0; s < limit; ++s) elaborate_[s].AddTo(mask);
+
+  // Remove EMBED and ELABORATE actions that would create a frame of the same
+  // type for the same frame as before at the current position.
+  for (const auto &e : state.embed_) {
+    int t = state.AttentionIndex(e.first);
+    if (t == -1 || t >= embed_.size()) continue;
+    for (int index : embed_[t].indices) {
+      if (actions_[index].label == e.second) {
+        mask[index >> 6] &= ~(1ULL << (index & 63));
+      }
+    }
+  }
+  for (const auto &e : state.elaborate_) {
+    int s = state.AttentionIndex(e.first);
+    if (s == -1 || s >= elaborate_.size()) continue;
+    for (int index : elaborate_[s].indices) {
+      if (actions_[index].label == e.second) {
+        mask[index >> 6] &= ~(1ULL << (index & 63));
+      }
+    }
+  }
 }
 
 void ActionTable::Save(const Store *global,
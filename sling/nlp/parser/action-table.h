@@ -52,6 +52,14 @@ class ActionTable {
   // Sets the indices of only the allowed actions for 'state' to true.
   void Allowed(const ParserState &state, std::vector<bool> *allowed) const;
 
+  // Computes bit mask with the allowed actions for 'state', i.e. the actions
+  // that can be applied to the state and are not beyond bounds. The mask
+  // has MaskWords() words and bit i is set if action i is allowed.
+  void Mask(const ParserState &state, uint64 *mask) const;
+
+  // Returns the number of 64-bit words in the allowed-action mask.
+  int MaskWords() const { return (actions_.size() + 63) / 64; }
+
   // Checks if actions is beyond bounds.
   bool Beyond(int index) const { return beyond_bounds_[index]; }
 
@@ -135,6 +143,35 @@ class ActionTable {
     int total_ = 0;
   };
 
+  // Set of actions stored as a sparse bit mask over the action indices.
+  struct ActionSet {
+    // Adds action to set. Actions must be added in index order.
+    void Add(int index);
+
+    // Adds the actions in the set to a bit mask.
+    void AddTo(uint64 *mask) const {
+      for (const auto &w : words) mask[w.first] |= w.second;
+    }
+
+    // Non-zero mask words as (word index, bits) pairs.
+    std::vector<std::pair<int, uint64>> words;
+
+    // Indices of the actions in the set.
+    std::vector<int> indices;
+  };
+
+  // Returns action set for an argument, adding new sets if needed.
+  static ActionSet *Group(std::vector<ActionSet> *groups, int arg) {
+    if (groups->size() <= arg) groups->resize(arg + 1);
+    return &(*groups)[arg];
+  }
+
+  // Clears action in bit mask if it is in the table.
+  void Clear(const ParserAction &action, uint64 *mask) const {
+    int index = Index(action);
+    if (index != -1) mask[index >> 6] &= ~(1ULL << (index & 63));
+  }
+
   // Mapping from ParserAction -> (0-based index, raw count).
   std::unordered_map<ParserAction, std::pair<int, int>, ParserActionHash>
       index_;
@@ -146,6 +183,19 @@ class ActionTable {
   // max-source-index or max-target-index bounds.
   std::vector<bool> beyond_bounds_;
 
+  // Actions within bounds grouped by the arguments that determine whether
+  // the action can be applied, i.e. evoke_[length], refer_[length][target],
+  // assign_[source], connect_[source][target], embed_[target], and
+  // elaborate_[source]. These are used for computing the allowed-action mask.
+  ActionSet shift_;
+  ActionSet stop_;
+  std::vector<ActionSet> evoke_;
+  std::vector<std::vector<ActionSet>> refer_;
+  std::vector<ActionSet> assign_;
+  std::vector<std::vector<ActionSet>> connect_;
+  std::vector<ActionSet> embed_;
+  std::vector<ActionSet> elaborate_;
+
   // Histograms of integer arguments for various actions. Only populated during
   // a pass over the training data.
   Histogram refer_target_{"Refer Target Histogram"};
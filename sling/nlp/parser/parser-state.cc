@@ -42,10 +42,28 @@ ParserState::ParserState(const ParserState &other)
       mentions_(other.mentions_),
       frame_to_mention_(other.frame_to_mention_),
       attention_(other.attention_),
-      nesting_(other.nesting_) {
+      nesting_(other.nesting_),
+      embed_(other.embed_),
+      elaborate_(other.elaborate_) {
   frames_.assign(other.frames_.begin(), other.frames_.end());
 }
 
+ParserState &ParserState::operator=(const ParserState &other) {
+  DCHECK(store_ == other.store_);
+  begin_ = other.begin_;
+  end_ = other.end_;
+  current_ = other.current_;
+  done_ = other.done_;
+  frames_.assign(other.frames_.begin(), other.frames_.end());
+  mentions_ = other.mentions_;
+  frame_to_mention_ = other.frame_to_mention_;
+  attention_ = other.attention_;
+  nesting_ = other.nesting_;
+  embed_ = other.embed_;
+  elaborate_ = other.elaborate_;
+  return *this;
+}
+
 int ParserState::MaxEvokeLength(int max_length) const {
   if (current_ == end_) return 0;
   int end = max_length + current_;
@@ -373,24 +391,25 @@ int ParserState::AttentionIndex(int index, int k) const {
   return -1;
 }
 
-void ParserState::GetFrames(Handles *frames) {
+void ParserState::GetFrames(Store *store, Handles *frames) {
   // Allocate new frames for all the frames in the frame buffer.
   frames->resize(frames_.size());
   for (int i = 0; i < frames_.size(); ++i) {
     // If the frame has any slots with index values we need to clone it and
     // update the indices to point to the final frames. Otherwise we can just
-    // return the existing frame from the frame buffer.
+    // return the existing frame from the frame buffer. Frames are always
+    // cloned when they are output to another store.
     FrameDatum *frame = store_->GetFrame(frames_[i]);
-    bool has_indices = false;
+    bool clone = store != store_;
     for (Slot *slot = frame->begin(); slot < frame->end(); ++slot) {
       if (slot->value.IsIndex()) {
-        has_indices = true;
+        clone = true;
         break;
       }
     }
 
-    if (has_indices) {
-      (*frames)[i] = store_->AllocateFrame(frame->slots());
+    if (clone) {
+      (*frames)[i] = store->AllocateFrame(frame->slots());
     } else {
       (*frames)[i] = frames_[i];
     }
@@ -399,12 +418,14 @@ void ParserState::GetFrames(Handles *frames) {
   // Copy slots to the new frames translating indices to frame references.
   for (int i = 0; i < frames_.size(); ++i) {
     FrameDatum *source = store_->GetFrame(frames_[i]);
-    FrameDatum *target = store_->GetFrame((*frames)[i]);
+    FrameDatum *target = store->GetFrame((*frames)[i]);
     if (target == source) continue;
+    store->WriteBarrier(target);
     Slot *s = source->begin();
     Slot *end = source->end();
     Slot *t = target->begin();
     while (s < end) {
+      DCHECK(store == store_ || !s->value.IsLocalRef());
       t->name = s->name;
       t->value = s->value.IsIndex() ? (*frames)[s->value.AsIndex()] : s->value;
       s++;
@@ -414,11 +435,9 @@ void ParserState::GetFrames(Handles *frames) {
 }
 
 void ParserState::AddParseToDocument(Document *document) {
-  CHECK(document->store() == store_);
-
   // Get frames generated by parse.
-  Handles frames(store_);
-  GetFrames(&frames);
+  Handles frames(document->store());
+  GetFrames(document->store(), &frames);
   std::vector<bool> evoked(frames.size());
 
   // Add mentions to document document.
@@ -36,6 +36,9 @@ class ParserState {
   // Clones parse state.
   ParserState(const ParserState &other);
 
+  // Copies parse state. Both parse states must use the same store.
+  ParserState &operator=(const ParserState &other);
+
   // Returns first token to be parsed.
   int begin() const { return begin_; }
 
@@ -74,9 +77,16 @@ class ParserState {
   int AttentionIndex(int index, int k = -1) const;
 
   // Creates final set of frames that the parse has generated.
-  void GetFrames(Handles *frames);
+  void GetFrames(Handles *frames) { GetFrames(store_, frames); }
+
+  // Creates final set of frames that the parse has generated in another store.
+  // If the store is not the store for the parser state, all the frames are
+  // copied to the store.
+  void GetFrames(Store *store, Handles *frames);
 
   // Adds frames and mentions that the parse has generated to the document.
+  // The document store can be different from the store for the parser state,
+  // in which case the generated frames are copied to the document store.
   void AddParseToDocument(Document *document);
 
   // The parse is done when we have performed the first STOP action.
@@ -161,6 +171,7 @@ class ParserState {
     // Constructors.
     explicit Nesting(int begin) { current = begin; }
     Nesting(const Nesting &n) : spans(n.spans), current(n.current) {}
+    Nesting &operator=(const Nesting &n) = default;
 
     // (End position (exclusive), mention index).
     std::vector<std::pair<int, int>> spans;
@@ -244,6 +255,8 @@ class ParserState {
   // at the current position. This is cleared once the position advances.
   std::vector<std::pair<int, Handle>> embed_;
   std::vector<std::pair<int, Handle>> elaborate_;
+
+  friend class ActionTable;
 };
 
 }  // namespace nlp
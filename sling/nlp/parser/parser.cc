@@ -13,6 +13,14 @@
 // limitations under the License.
 
 #include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <queue>
 
 #include "sling/nlp/parser/parser.h"
 
@@ -20,10 +28,12 @@
 #include "sling/myelin/cuda/cuda-runtime.h"
 #include "sling/myelin/kernel/cuda.h"
 #include "sling/myelin/kernel/dragnn.h"
+#include "sling/myelin/kernel/quantization.h"
 #include "sling/myelin/kernel/tensorflow.h"
 #include "sling/nlp/document/document.h"
 #include "sling/nlp/document/features.h"
 #include "sling/nlp/document/lexicon.h"
+#include "sling/string/printf.h"
 
 namespace sling {
 namespace nlp {
@@ -43,38 +53,131 @@ void Parser::EnableGPU() {
   }
 }
 
+Parser::~Parser() {
+  delete pool_;
+  delete profile_;
+  delete lr_.pool;
+  delete rl_.pool;
+  delete ff_.pool;
+  delete batch_lr_.pool;
+  delete batch_rl_.pool;
+}
+
 void Parser::Load(Store *store, const string &model) {
   // Register kernels for implementing parser ops.
   RegisterTensorflowLibrary(&library_);
   RegisterDragnnLibrary(&library_);
   if (use_gpu_) RegisterCUDALibrary(&library_);
 
-  // Load and analyze parser flow file.
+  // Quantize weight matrices. The quantized kernels require AVX2.
+  if (use_gpu_ || !jit::CPU::Enabled(jit::AVX2)) quantize_ = false;
+
+  // Matrices with reduced precision are only supported on CPU.
+  if (use_gpu_) weight_type_ = myelin::DT_FLOAT;
+
+  // Beam search needs the FF output on the host, so it is only used on CPU.
+  if (use_gpu_) beam_size_ = 1;
+
+  // Allocate instances and channels from the memory arena on CPU. The runtime
+  // must be set before a precompiled network is loaded.
+  if (use_gpu_) use_arena_ = false;
+  if (use_arena_) network_.set_runtime(&arena_);
+
+  // Try to load precompiled parser network. The network cache is not used on
+  // GPU.
+  if (use_gpu_) network_cache_.clear();
+  string signature;
+  bool precompiled = false;
+  if (!network_cache_.empty()) {
+    signature = NetworkSignature(model);
+    precompiled = network_.Load(network_cache_, library_, signature);
+  }
+
+  // Load parser flow file. The precompiled network only needs the data blocks
+  // from the flow, so the flow file is memory-mapped to avoid reading the
+  // weights.
   myelin::Flow flow;
-  CHECK(flow.Load(model));
+  if (precompiled) {
+    CHECK(flow.Map(model));
+  } else {
+    CHECK(flow.Load(model));
+  }
+
+  if (!precompiled) {
+    if (quantize_) myelin::QuantizeFlow(&flow);
+    if (weight_type_ != myelin::DT_FLOAT) {
+      myelin::ReduceWeightPrecision(&flow, weight_type_);
+    }
 
-  // Add argmax for fast fallback.
-  if (fast_fallback_) {
+    // Convert the FF cell for beam search to compute all the hypotheses in
+    // the beam in one step.
     auto *ff = flow.Func("ff");
     auto *output = flow.Var("ff/output");
-    auto *prediction = flow.AddVariable("ff/prediction", myelin::DT_INT32, {1});
-    flow.AddOperation(ff, "ff/ArgMax", "ArgMax", {output}, {prediction});
+    if (beam_size_ > 1) {
+      flow.set_batch_size(beam_size_);
+      if (!flow.BatchFunction(ff)) {
+        LOG(WARNING) << "FF cell cannot be batched, beam search disabled";
+        beam_size_ = 1;
+        if (!signature.empty()) signature = NetworkSignature(model);
+      }
+    }
+
+    if (beam_size_ > 1) {
+      // Add log-softmax of the FF output for scoring hypotheses in beam
+      // search. The log-softmax is computed for each row of the batch.
+      auto *logprob =
+          flow.AddVariable("ff/logprob", myelin::DT_FLOAT, output->shape);
+      flow.AddOperation(ff, "ff/LogSoftmax", "LogSoftmax", {output},
+                        {logprob});
+    } else {
+      // Add argmax for selecting the predicted action. Without fast fallback,
+      // the argmax is restricted to the allowed actions using a bit mask.
+      auto *prediction =
+          flow.AddVariable("ff/prediction", myelin::DT_INT32, {1});
+      if (fast_fallback_) {
+        flow.AddOperation(ff, "ff/ArgMax", "ArgMax", {output}, {prediction});
+      } else {
+        int words = (output->elements() + 63) / 64;
+        auto *mask = flow.AddVariable("ff/mask", myelin::DT_INT64, {words});
+        flow.AddOperation(ff, "ff/ArgMax", "ArgMax", {output, mask},
+                          {prediction});
+      }
+    }
+
+    // Analyze parser flow file.
+    flow.Analyze(library_);
+
+    // Compile parser flow.
+    if (use_gpu_) network_.set_runtime(&cudart);
+    CHECK(network_.Compile(flow, library_));
+
+    // Save compiled network for other parser processes.
+    if (!network_cache_.empty()) network_.Save(network_cache_, signature);
   }
 
-  // Analyze parser flow file.
-  flow.Analyze(library_);
+  // Batching is not used on GPU where the LSTM channels are in device memory.
+  if (use_gpu_) batch_size_ = 1;
 
-  // Compile parser flow.
-  if (use_gpu_) network_.set_runtime(&cudart);
-  CHECK(network_.Compile(flow, library_));
+  // Start worker threads for parsing sentences in parallel. The profile
+  // summaries are shared by all instances, so parallel parsing is not used
+  // when profiling.
+  bool profiling = GetCell(&network_, "ff")->profile() != nullptr;
+  if (num_threads_ != 1 && !use_gpu_ && batch_size_ <= 1 && !profiling) {
+    pool_ = new ThreadPool(num_threads_);
+  }
 
-  // Initialize cells.
-  InitLSTM("lr_lstm", &lr_, false);
-  InitLSTM("rl_lstm", &rl_, true);
+  // Initialize cells. The instance pools for the cells are sized for the
+  // number of sentences in flight, so the worker threads must be started
+  // first.
+  InitLSTM(&network_, "lr_lstm", &lr_, false);
+  InitLSTM(&network_, "rl_lstm", &rl_, true);
   InitFF("ff", &ff_);
 
+  // Compile LSTM cells for batches of sentences.
+  if (batch_size_ > 1) LoadBatchedLSTM(model);
+
   // Initialize profiling.
-  if (ff_.cell->profile()) profile_ = new Profile(this);
+  if (profiling) profile_ = new Profile(this);
 
   // Load lexicon.
   myelin::Flow::Blob *vocabulary = flow.DataBlock("lexicon");
@@ -115,63 +218,158 @@ void Parser::Load(Store *store, const string &model) {
   roles_.Init(actions_);
 }
 
-void Parser::InitLSTM(const string &name, LSTM *lstm, bool reverse) {
+void Parser::LoadBatchedLSTM(const string &model) {
+  if (use_arena_) batch_network_.set_runtime(&arena_);
+
+  // Try to load precompiled batched LSTM cells.
+  string cache;
+  string signature;
+  if (!network_cache_.empty()) {
+    cache = network_cache_ + ".batch";
+    signature = StringPrintf("%s:b%d", NetworkSignature(model).c_str(),
+                             batch_size_);
+    if (batch_network_.Load(cache, library_, signature)) {
+      InitLSTM(&batch_network_, "lr_lstm", &batch_lr_, false);
+      InitLSTM(&batch_network_, "rl_lstm", &batch_rl_, true);
+      return;
+    }
+  }
+
+  // Load flow and convert the LSTM cells to batched cells. The FF cell is
+  // removed since it is only computed for one sentence at a time.
+  myelin::Flow flow;
+  CHECK(flow.Load(model));
+  if (quantize_) myelin::QuantizeFlow(&flow);
+  if (weight_type_ != myelin::DT_FLOAT) {
+    myelin::ReduceWeightPrecision(&flow, weight_type_);
+  }
+  flow.set_batch_size(batch_size_);
+  myelin::Flow::Function *ff = flow.Func("ff");
+  std::vector<myelin::Flow::Operation *> ops = ff->ops;
+  for (auto *op : ops) flow.RemoveOperation(op);
+  flow.DeleteFunction(ff);
+  if (!flow.BatchFunction(flow.Func("lr_lstm")) ||
+      !flow.BatchFunction(flow.Func("rl_lstm"))) {
+    LOG(WARNING) << "LSTM cells cannot be batched";
+    batch_size_ = 1;
+    return;
+  }
+
+  // Analyze and compile batched LSTM cells.
+  flow.Analyze(library_);
+  if (!batch_network_.Compile(flow, library_)) {
+    LOG(WARNING) << "Batched LSTM cells cannot be compiled";
+    batch_size_ = 1;
+    return;
+  }
+  if (!cache.empty()) batch_network_.Save(cache, signature);
+
+  // Initialize batched cells.
+  InitLSTM(&batch_network_, "lr_lstm", &batch_lr_, false);
+  InitLSTM(&batch_network_, "rl_lstm", &batch_rl_, true);
+}
+
+string Parser::NetworkSignature(const string &model) const {
+  FileStat stat;
+  CHECK(File::Stat(model, &stat));
+  return StringPrintf("%s:%llu:%lld:q%d:w%d:f%d:k%d", model.c_str(),
+                      static_cast<unsigned long long>(stat.size),
+                      static_cast<long long>(stat.mtime),
+                      quantize_, weight_type_, fast_fallback_, beam_size_);
+}
+
+void Parser::LogMemoryUsage() const {
+  auto report = [](const char *name, const myelin::InstancePool *pool) {
+    if (pool == nullptr) return;
+    LOG(INFO) << StringPrintf(
+        "%s pool: %lld instances allocated, %lld reused, "
+        "%lld channels allocated, %lld reused, %lld bytes retained",
+        name, pool->instances_allocated(), pool->instances_reused(),
+        pool->channels_allocated(), pool->channels_reused(),
+        pool->bytes_retained());
+  };
+  report("lr", lr_.pool);
+  report("rl", rl_.pool);
+  report("ff", ff_.pool);
+  report("batch lr", batch_lr_.pool);
+  report("batch rl", batch_rl_.pool);
+
+  if (use_arena_) {
+    myelin::ArenaRuntime::Counters c = arena_.counters();
+    LOG(INFO) << StringPrintf(
+        "arena: %lld instances allocated, %lld freed, "
+        "%lld channels allocated, %lld grown, %lld moved, %lld freed, "
+        "%lld blocks reused, %lld bytes in use, %lld bytes reserved",
+        c.instances_allocated, c.instances_freed,
+        c.channels_allocated, c.channels_grown, c.channels_moved,
+        c.channels_freed, c.blocks_reused, c.bytes_in_use, c.bytes_reserved);
+  }
+}
+
+void Parser::InitLSTM(myelin::Network *network, const string &name,
+                      LSTM *lstm, bool reverse) {
   // Get cell.
-  lstm->cell = GetCell(name);
+  lstm->cell = GetCell(network, name);
   lstm->reverse = reverse;
   lstm->profile = lstm->cell->profile();
+  lstm->pool = new myelin::InstancePool(lstm->cell, MaxSentencesInFlight());
 
   // Get connectors.
-  lstm->control = GetConnector(name + "/control");
-  lstm->hidden = GetConnector(name + "/hidden");
+  lstm->control = GetConnector(network, name + "/control");
+  lstm->hidden = GetConnector(network, name + "/hidden");
 
   // Get feature inputs.
-  lstm->word_feature = GetParam(name + "/words", true);
-  lstm->prefix_feature = GetParam(name + "/prefix", true);
-  lstm->suffix_feature = GetParam(name + "/suffix", true);
-  lstm->hyphen_feature = GetParam(name + "/hyphen", true);
-  lstm->caps_feature = GetParam(name + "/capitalization", true);
-  lstm->punct_feature = GetParam(name + "/punctuation", true);
-  lstm->quote_feature = GetParam(name + "/quote", true);
-  lstm->digit_feature = GetParam(name + "/digit", true);
-
-  // Get feature sizes.
+  lstm->word_feature = GetParam(network, name + "/words", true);
+  lstm->prefix_feature = GetParam(network, name + "/prefix", true);
+  lstm->suffix_feature = GetParam(network, name + "/suffix", true);
+  lstm->hyphen_feature = GetParam(network, name + "/hyphen", true);
+  lstm->caps_feature = GetParam(network, name + "/capitalization", true);
+  lstm->punct_feature = GetParam(network, name + "/punctuation", true);
+  lstm->quote_feature = GetParam(network, name + "/quote", true);
+  lstm->digit_feature = GetParam(network, name + "/digit", true);
+
+  // Get feature sizes. The first dimension is the batch size.
   if (lstm->prefix_feature != nullptr) {
-    lstm->prefix_size = lstm->prefix_feature->elements();
+    lstm->prefix_size = lstm->prefix_feature->dim(1);
   }
   if (lstm->suffix_feature != nullptr) {
-    lstm->suffix_size = lstm->suffix_feature->elements();
+    lstm->suffix_size = lstm->suffix_feature->dim(1);
   }
 
   // Get links.
-  lstm->c_in = GetParam(name + "/c_in");
-  lstm->c_out = GetParam(name + "/c_out");
-  lstm->h_in = GetParam(name + "/h_in");
-  lstm->h_out = GetParam(name + "/h_out");
+  lstm->c_in = GetParam(network, name + "/c_in");
+  lstm->c_out = GetParam(network, name + "/c_out");
+  lstm->h_in = GetParam(network, name + "/h_in");
+  lstm->h_out = GetParam(network, name + "/h_out");
 }
 
 void Parser::InitFF(const string &name, FF *ff) {
   // Get cell.
-  ff->cell = GetCell(name);
+  ff->cell = GetCell(&network_, name);
   ff->profile = ff->cell->profile();
+  ff->pool = new myelin::InstancePool(ff->cell, MaxSentencesInFlight());
 
   // Get connector for recurrence.
-  ff->step = GetConnector(name + "/step");
+  ff->step = GetConnector(&network_, name + "/step");
 
   // Get feature inputs.
-  ff->lr_focus_feature = GetParam(name + "/lr", true);
-  ff->rl_focus_feature = GetParam(name + "/rl", true);
-  ff->lr_attention_feature = GetParam(name + "/frame-end-lr", true);
-  ff->rl_attention_feature = GetParam(name + "/frame-end-rl", true);
-  ff->frame_create_feature = GetParam(name + "/frame-creation-steps", true);
-  ff->frame_focus_feature = GetParam(name + "/frame-focus-steps", true);
-  ff->history_feature = GetParam(name + "/history", true);
-  ff->out_roles_feature = GetParam(name + "/out-roles", true);
-  ff->in_roles_feature = GetParam(name + "/in-roles", true);
-  ff->unlabeled_roles_feature = GetParam(name + "/unlabeled-roles", true);
-  ff->labeled_roles_feature = GetParam(name + "/labeled-roles", true);
-
-  // Get feature sizes.
+  ff->lr_focus_feature = GetParam(&network_, name + "/lr", true);
+  ff->rl_focus_feature = GetParam(&network_, name + "/rl", true);
+  ff->lr_attention_feature = GetParam(&network_, name + "/frame-end-lr", true);
+  ff->rl_attention_feature = GetParam(&network_, name + "/frame-end-rl", true);
+  ff->frame_create_feature =
+      GetParam(&network_, name + "/frame-creation-steps", true);
+  ff->frame_focus_feature =
+      GetParam(&network_, name + "/frame-focus-steps", true);
+  ff->history_feature = GetParam(&network_, name + "/history", true);
+  ff->out_roles_feature = GetParam(&network_, name + "/out-roles", true);
+  ff->in_roles_feature = GetParam(&network_, name + "/in-roles", true);
+  ff->unlabeled_roles_feature =
+      GetParam(&network_, name + "/unlabeled-roles", true);
+  ff->labeled_roles_feature =
+      GetParam(&network_, name + "/labeled-roles", true);
+
+  // Get feature sizes. The first dimension is the beam size.
   std::vector<myelin::Tensor *> attention_features {
     ff->lr_attention_feature,
     ff->rl_attention_feature,
@@ -180,40 +378,55 @@ void Parser::InitFF(const string &name, FF *ff) {
   };
   for (auto *f : attention_features) {
     if (!f) continue;
-    if (f->elements() > ff->attention_depth) {
-      ff->attention_depth = f->elements();
+    if (f->dim(1) > ff->attention_depth) {
+      ff->attention_depth = f->dim(1);
     }
   }
   for (auto *f : attention_features) {
     if (!f) continue;
-    CHECK_EQ(ff->attention_depth, f->elements());
+    CHECK_EQ(ff->attention_depth, f->dim(1));
   }
   if (ff->history_feature != nullptr) {
-    ff->history_size = ff->history_feature->elements();
+    ff->history_size = ff->history_feature->dim(1);
   }
   if (ff->out_roles_feature != nullptr) {
-    ff->out_roles_size = ff->out_roles_feature->elements();
+    ff->out_roles_size = ff->out_roles_feature->dim(1);
   }
   if (ff->in_roles_feature != nullptr) {
-    ff->in_roles_size = ff->in_roles_feature->elements();
+    ff->in_roles_size = ff->in_roles_feature->dim(1);
   }
   if (ff->unlabeled_roles_feature != nullptr) {
-    ff->unlabeled_roles_size = ff->unlabeled_roles_feature->elements();
+    ff->unlabeled_roles_size = ff->unlabeled_roles_feature->dim(1);
   }
   if (ff->labeled_roles_feature != nullptr) {
-    ff->labeled_roles_size = ff->labeled_roles_feature->elements();
+    ff->labeled_roles_size = ff->labeled_roles_feature->dim(1);
   }
 
   // Get links.
-  ff->lr_lstm = GetParam(name + "/link/lr_lstm");
-  ff->rl_lstm = GetParam(name + "/link/rl_lstm");
-  ff->steps = GetParam(name + "/steps");
-  ff->hidden = GetParam(name + "/hidden");
-  ff->output = GetParam(name + "/output");
-  ff->prediction = GetParam(name + "/prediction", true);
+  ff->lr_lstm = GetParam(&network_, name + "/link/lr_lstm");
+  ff->rl_lstm = GetParam(&network_, name + "/link/rl_lstm");
+  ff->steps = GetParam(&network_, name + "/steps");
+  ff->hidden = GetParam(&network_, name + "/hidden");
+  ff->output = GetParam(&network_, name + "/output");
+  ff->logprob = GetParam(&network_, name + "/logprob", true);
+  ff->prediction = GetParam(&network_, name + "/prediction", true);
+  ff->mask = GetParam(&network_, name + "/mask", true);
 }
 
 void Parser::Parse(Document *document) const {
+  // Parse document in batches if batching is enabled.
+  if (batch_size_ > 1) {
+    Parse(std::vector<Document *>{document});
+    return;
+  }
+
+  // Parse sentences in parallel if enabled. The sentences are parsed into
+  // local stores, so the document must be in a local store too.
+  if (pool_ != nullptr && document->store()->globals() != nullptr) {
+    ParseParallel(document);
+    return;
+  }
+
   // Extract lexical features from document.
   DocumentFeatures features(&lexicon_);
   features.Extract(*document);
@@ -221,211 +434,645 @@ void Parser::Parse(Document *document) const {
   // Parse each sentence of the document.
   for (SentenceIterator s(document); s.more(); s.next()) {
     // Initialize parser model instance data.
-    ParserInstance data(this, document, s.begin(), s.end());
-    ParserState &state = data.state_;
-
-    // Compute left-to-right LSTM.
-    for (int i = 0; i < s.length(); ++i) {
-      // Attach hidden and control layers.
-      data.lr_.Clear();
-      int in = i > 0 ? i - 1 : s.length();
-      int out = i;
-      data.AttachLR(in, out);
-
-      // Extract features.
-      data.ExtractFeaturesLSTM(s.begin() + out, features, lr_, &data.lr_);
-
-      // Compute LSTM cell.
-      if (profile_) data.lr_.set_profile(&profile_->lr);
-      data.lr_.Compute();
+    ParserInstance data(this, document->store(), s.begin(), s.end());
+
+    // Compute LSTMs and predict transitions.
+    ComputeLSTM(&data, features);
+    Predict(&data);
+    data.state_.AddParseToDocument(document);
+  }
+}
+
+void Parser::ParseParallel(Document *document) const {
+  // Extract lexical features from document.
+  DocumentFeatures features(&lexicon_);
+  features.Extract(*document);
+
+  // Each sentence is parsed into its own local store, so the sentences can be
+  // parsed independently of each other. The LR and RL LSTMs for a sentence
+  // are computed by separate tasks, and the task that finishes last runs the
+  // FF for predicting the transitions for the sentence. The store and parser
+  // instance for the sentence are created by the LR task, which schedules the
+  // RL task once they have been created.
+  struct Task {
+    int begin;                          // first token in sentence
+    int end;                            // end of sentence
+    Store *store = nullptr;             // local store for sentence frames
+    ParserInstance *data = nullptr;     // parser state for sentence
+    std::atomic<int> pending{2};        // number of LSTMs not yet computed
+    bool done = false;                  // transitions have been predicted
+  };
+
+  // The number of sentences in flight is limited, so the memory used for
+  // parsing does not grow with the length of the document. The tasks are
+  // kept in a deque, so the addresses of the tasks do not change when tasks
+  // are added and removed.
+  std::deque<Task> tasks;
+  int max_in_flight = MaxSentencesInFlight();
+  std::mutex mu;
+  std::condition_variable predicted;
+  const Store *globals = document->store()->globals();
+  SentenceIterator s(document);
+  for (;;) {
+    // Schedule sentences until the limit is reached.
+    while (s.more() && tasks.size() < max_in_flight) {
+      tasks.emplace_back();
+      Task *task = &tasks.back();
+      task->begin = s.begin();
+      task->end = s.end();
+      s.next();
+
+      auto finish = [this, task, &mu, &predicted]() {
+        if (--task->pending > 0) return;
+        Predict(task->data);
+        std::lock_guard<std::mutex> lock(mu);
+        task->done = true;
+        predicted.notify_all();
+      };
+      pool_->Schedule([this, task, globals, &features, finish]() {
+        task->store = new Store(globals);
+        task->data =
+            new ParserInstance(this, task->store, task->begin, task->end);
+        pool_->Schedule([this, task, &features, finish]() {
+          ComputeRL(task->data, features);
+          finish();
+        });
+        ComputeLR(task->data, features);
+        finish();
+      });
     }
+    if (tasks.empty()) break;
+
+    // Add the frames for the oldest sentence to the document while the
+    // remaining sentences are being parsed.
+    Task &task = tasks.front();
+    {
+      std::unique_lock<std::mutex> lock(mu);
+      predicted.wait(lock, [&task]() { return task.done; });
+    }
+    task.data->state_.AddParseToDocument(document);
+    delete task.data;
+    delete task.store;
+    tasks.pop_front();
+  }
+}
 
-    // Compute right-to-left LSTM.
-    for (int i = 0; i < s.length(); ++i) {
-      // Attach hidden and control layers.
-      data.rl_.Clear();
-      int in = s.length() - i;
-      int out = in - 1;
-      data.AttachRL(in, out);
+void Parser::Parse(const std::vector<Document *> &documents) const {
+  // Parse documents one at a time if batching is not enabled.
+  if (batch_size_ <= 1) {
+    for (Document *document : documents) Parse(document);
+    return;
+  }
 
-      // Extract features.
-      data.ExtractFeaturesLSTM(s.begin() + out, features, rl_, &data.rl_);
+  // Extract lexical features from documents.
+  std::vector<DocumentFeatures *> features;
+  for (Document *document : documents) {
+    DocumentFeatures *f = new DocumentFeatures(&lexicon_);
+    f->Extract(*document);
+    features.push_back(f);
+  }
 
-      // Compute LSTM cell.
-      if (profile_) data.rl_.set_profile(&profile_->rl);
-      data.rl_.Compute();
+  // Parse sentences in batches. The sentences of each document are parsed in
+  // order, so the frames are added to the documents in sentence order.
+  std::vector<Sentence> batch;
+  for (int d = 0; d < documents.size(); ++d) {
+    Document *document = documents[d];
+    for (SentenceIterator s(document); s.more(); s.next()) {
+      Sentence sentence;
+      sentence.data = new ParserInstance(this, document->store(),
+                                         s.begin(), s.end());
+      sentence.features = features[d];
+      sentence.document = document;
+      batch.push_back(sentence);
+      if (batch.size() == batch_size_) {
+        ParseBatch(batch);
+        batch.clear();
+      }
     }
+  }
+  if (!batch.empty()) ParseBatch(batch);
 
-    // Run FF to predict transitions.
-    bool done = false;
-    int steps_since_shift = 0;
-    int step = 0;
-    while (!done) {
-      // Allocate space for next step.
-      data.ff_step_.push();
-
-      // Attach instance to recurrent layers.
-      data.ff_.Clear();
-      data.AttachFF(step);
-
-      // Extract features.
-      data.ExtractFeaturesFF(step);
-
-      // Predict next action.
-      if (profile_) data.ff_.set_profile(&profile_->ff);
-      data.ff_.Compute();
-      int prediction = 0;
-      if (fast_fallback_) {
-        // Get highest scoring action.
-        prediction = *data.ff_.Get<int>(ff_.prediction);
-        const ParserAction &action = actions_.Action(prediction);
-        if (!state.CanApply(action) || actions_.Beyond(prediction)) {
-          // Fall back to SHIFT or STOP action.
-          if (state.current() == state.end()) {
-            prediction = actions_.StopIndex();
-          } else {
-            prediction = actions_.ShiftIndex();
-          }
+  for (DocumentFeatures *f : features) delete f;
+}
+
+void Parser::ParseBatch(const std::vector<Sentence> &batch) const {
+  // Compute LSTMs for all sentences in batch.
+  ComputeLSTMBatch(batch_lr_, batch);
+  ComputeLSTMBatch(batch_rl_, batch);
+
+  // Predict transitions for each sentence.
+  for (const Sentence &sentence : batch) {
+    Predict(sentence.data);
+    sentence.data->state_.AddParseToDocument(sentence.document);
+    delete sentence.data;
+  }
+}
+
+void Parser::ComputeLSTM(ParserInstance *data,
+                         const DocumentFeatures &features) const {
+  ComputeLR(data, features);
+  ComputeRL(data, features);
+}
+
+void Parser::ComputeLR(ParserInstance *data,
+                       const DocumentFeatures &features) const {
+  int begin = data->state_.begin();
+  int length = data->state_.end() - begin;
+
+  // Compute left-to-right LSTM.
+  for (int i = 0; i < length; ++i) {
+    // Attach hidden and control layers.
+    data->lr_->Clear();
+    int in = i > 0 ? i - 1 : length;
+    int out = i;
+    data->AttachLR(in, out);
+
+    // Extract features.
+    data->ExtractFeaturesLSTM(begin + out, features, lr_, data->lr_);
+
+    // Compute LSTM cell.
+    if (profile_) data->lr_->set_profile(&profile_->lr);
+    data->lr_->Compute();
+  }
+}
+
+void Parser::ComputeRL(ParserInstance *data,
+                       const DocumentFeatures &features) const {
+  int begin = data->state_.begin();
+  int length = data->state_.end() - begin;
+
+  // Compute right-to-left LSTM.
+  for (int i = 0; i < length; ++i) {
+    // Attach hidden and control layers.
+    data->rl_->Clear();
+    int in = length - i;
+    int out = in - 1;
+    data->AttachRL(in, out);
+
+    // Extract features.
+    data->ExtractFeaturesLSTM(begin + out, features, rl_, data->rl_);
+
+    // Compute LSTM cell.
+    if (profile_) data->rl_->set_profile(&profile_->rl);
+    data->rl_->Compute();
+  }
+}
+
+void Parser::ComputeLSTMBatch(const LSTM &lstm,
+                              const std::vector<Sentence> &batch) const {
+  // Get the maximum sentence length in the batch.
+  int maxlen = 0;
+  for (const Sentence &sentence : batch) {
+    int length = sentence.data->state_.end() - sentence.data->state_.begin();
+    maxlen = std::max(maxlen, length);
+  }
+
+  // The channel elements are rows in the hidden and control layers, and the
+  // activations for position p in batch element b are stored in row
+  // p * batch_size_ + b, so the rows for each position form a batch. The
+  // sentences are aligned to the left for the LR LSTM and to the right for the
+  // RL LSTM, so all sentences start in the first step. The position after the
+  // last position is the zero boundary element.
+  myelin::Channel *control = lstm.pool->AcquireChannel(lstm.control);
+  myelin::Channel *hidden = lstm.pool->AcquireChannel(lstm.hidden);
+  control->resize((maxlen + 1) * batch_size_);
+  hidden->resize((maxlen + 1) * batch_size_);
+  std::vector<int> offset(batch.size());
+  for (int b = 0; b < batch.size(); ++b) {
+    int length = batch[b].data->state_.end() - batch[b].data->state_.begin();
+    offset[b] = lstm.reverse ? maxlen - length : 0;
+  }
+
+  // Compute LSTM cell for all sentences in lockstep.
+  myelin::Instance *data = lstm.pool->Acquire();
+  for (int i = 0; i < maxlen; ++i) {
+    // Attach hidden and control layers.
+    data->Clear();
+    int in, out;
+    if (lstm.reverse) {
+      out = maxlen - i - 1;
+      in = out + 1;
+    } else {
+      out = i;
+      in = i > 0 ? i - 1 : maxlen;
+    }
+    data->Set(lstm.c_in, control, in * batch_size_);
+    data->Set(lstm.c_out, control, out * batch_size_);
+    data->Set(lstm.h_in, hidden, in * batch_size_);
+    data->Set(lstm.h_out, hidden, out * batch_size_);
+
+    // Extract features for sentences that have a token in this position.
+    for (int b = 0; b < batch.size(); ++b) {
+      ParserInstance *sentence = batch[b].data;
+      int token = sentence->state_.begin() + out - offset[b];
+      if (token < sentence->state_.begin()) continue;
+      if (token >= sentence->state_.end()) continue;
+      sentence->ExtractFeaturesLSTM(token, *batch[b].features, lstm, data, b);
+    }
+
+    // Compute LSTM cell.
+    data->Compute();
+  }
+  lstm.pool->Release(data);
+
+  // Copy hidden layer activations to the channels for the sentences.
+  const LSTM &single = lstm.reverse ? rl_ : lr_;
+  for (int b = 0; b < batch.size(); ++b) {
+    ParserInstance *sentence = batch[b].data;
+    myelin::Channel *channel = lstm.reverse ? sentence->rl_h_
+                                            : sentence->lr_h_;
+    int length = sentence->state_.end() - sentence->state_.begin();
+    size_t size = std::min(lstm.hidden->size(), single.hidden->size());
+    for (int p = 0; p < length; ++p) {
+      int row = (p + offset[b]) * batch_size_ + b;
+      memcpy(channel->at(p), hidden->at(row), size);
+    }
+  }
+  lstm.pool->ReleaseChannel(control);
+  lstm.pool->ReleaseChannel(hidden);
+}
+
+void Parser::Predict(ParserInstance *data) const {
+  if (beam_size_ > 1) {
+    PredictBeam(data);
+    return;
+  }
+  ParserState &state = data->state_;
+
+  // Run FF to predict transitions.
+  bool done = false;
+  int steps_since_shift = 0;
+  int step = 0;
+  while (!done) {
+    // Allocate space for next step.
+    data->ff_step_->push();
+
+    // Attach instance to recurrent layers.
+    data->ff_->Clear();
+    data->AttachFF(data->ff_, step);
+
+    // Extract features.
+    data->ExtractFeaturesFF(state, data->steps_, data->ff_);
+
+    // Predict next action.
+    if (profile_) data->ff_->set_profile(&profile_->ff);
+    if (ff_.mask != nullptr) {
+      // Compute mask with the allowed actions for the masked argmax.
+      uint64 *mask =
+          reinterpret_cast<uint64 *>(data->ff_->GetAddress(ff_.mask));
+      actions_.Mask(state, mask);
+    }
+    data->ff_->Compute();
+    int prediction = 0;
+    if (ff_.mask != nullptr) {
+      // Get highest scoring allowed action. If no action has a score above
+      // -inf, fall back to SHIFT or STOP action.
+      prediction = *data->ff_->Get<int>(ff_.prediction);
+      if (prediction < 0) {
+        if (state.current() == state.end()) {
+          prediction = actions_.StopIndex();
+        } else {
+          prediction = actions_.ShiftIndex();
         }
-      } else {
-        // Get highest scoring allowed action.
-        float *output = data.ff_.Get<float>(ff_.output);
-        float max_score = -INFINITY;
-        for (int a = 0; a < num_actions_; ++a) {
-          if (output[a] > max_score) {
-            const ParserAction &action = actions_.Action(a);
-            if (state.CanApply(action) && !actions_.Beyond(a)) {
-              prediction = a;
-              max_score = output[a];
-            }
+      }
+    } else if (fast_fallback_) {
+      // Get highest scoring action.
+      prediction = *data->ff_->Get<int>(ff_.prediction);
+      const ParserAction &action = actions_.Action(prediction);
+      if (!state.CanApply(action) || actions_.Beyond(prediction)) {
+        // Fall back to SHIFT or STOP action.
+        if (state.current() == state.end()) {
+          prediction = actions_.StopIndex();
+        } else {
+          prediction = actions_.ShiftIndex();
+        }
+      }
+    } else {
+      // Get highest scoring allowed action.
+      float *output = data->ff_->Get<float>(ff_.output);
+      float max_score = -INFINITY;
+      for (int a = 0; a < num_actions_; ++a) {
+        if (output[a] > max_score) {
+          const ParserAction &action = actions_.Action(a);
+          if (state.CanApply(action) && !actions_.Beyond(a)) {
+            prediction = a;
+            max_score = output[a];
           }
         }
       }
+    }
 
-      // Apply action to parser state.
-      const ParserAction &action = actions_.Action(prediction);
-      state.Apply(action);
-
-      // Update state.
-      switch (action.type) {
-        case ParserAction::SHIFT:
-          steps_since_shift = 0;
-          break;
-
-        case ParserAction::STOP:
-          done = true;
-          break;
-
-        case ParserAction::EVOKE:
-        case ParserAction::REFER:
-        case ParserAction::CONNECT:
-        case ParserAction::ASSIGN:
-        case ParserAction::EMBED:
-        case ParserAction::ELABORATE:
-          steps_since_shift++;
-          if (state.AttentionSize() > 0) {
-            int focus = state.Attention(0);
-            if (data.create_step_.size() < focus + 1) {
-              data.create_step_.resize(focus + 1);
-              data.create_step_[focus] = step;
-            }
-            if (data.focus_step_.size() < focus + 1) {
-              data.focus_step_.resize(focus + 1);
-            }
-            data.focus_step_[focus] = step;
-          }
+    // Apply action to parser state.
+    const ParserAction &action = actions_.Action(prediction);
+    state.Apply(action);
+    data->steps_.Add(action, state, step);
+
+    // Update state.
+    switch (action.type) {
+      case ParserAction::SHIFT:
+        steps_since_shift = 0;
+        break;
+
+      case ParserAction::STOP:
+        done = true;
+        break;
+
+      case ParserAction::EVOKE:
+      case ParserAction::REFER:
+      case ParserAction::CONNECT:
+      case ParserAction::ASSIGN:
+      case ParserAction::EMBED:
+      case ParserAction::ELABORATE:
+        steps_since_shift++;
+    }
+
+    // Next step.
+    step += 1;
+  }
+}
+
+void Parser::PredictBeam(ParserInstance *data) const {
+  // Parse hypothesis in the beam. The frames in the parser state are
+  // copy-on-write, so the hypotheses can share the frames.
+  struct Hypothesis {
+    explicit Hypothesis(const ParserState &state) : state(state) {}
+
+    ParserState state;                  // parser state for hypothesis
+    ParserSteps steps;                  // FF steps for hypothesis
+    std::vector<int> actions;           // actions applied to initial state
+    float score = 0.0;                  // log-probability of actions
+  };
+
+  // Candidate for extending a hypothesis with an action. Finished hypotheses
+  // are kept in the beam as candidates without an action.
+  struct Candidate {
+    float score;                        // score of extended hypothesis
+    int hypothesis;                     // hypothesis in beam
+    int action;                         // action for extension or -1
+
+    bool operator >(const Candidate &other) const {
+      return score > other.score;
+    }
+  };
+
+  // All hypotheses share the LSTM channels and the FF step channel. The FF
+  // cell is batched over the beam, so the hypotheses are computed together
+  // with one row for each hypothesis. The hidden activations for the step
+  // are output to new rows in the shared step channel, so the activations
+  // for a hypothesis do not have to be copied when it is extended.
+  myelin::Instance *ff = data->ff_;
+  myelin::Channel *channel = data->ff_step_;
+  channel->reserve(channel->capacity() * beam_size_);
+
+  // The candidates that can make it into the beam are kept in a min-heap
+  // with the lowest scoring candidate on top.
+  std::priority_queue<Candidate, std::vector<Candidate>,
+                      std::greater<Candidate>> heap;
+  auto add = [this, &heap](const Candidate &candidate) {
+    if (heap.size() == beam_size_) heap.pop();
+    heap.push(candidate);
+  };
+  auto threshold = [this, &heap]() {
+    return heap.size() < beam_size_ ? -INFINITY : heap.top().score;
+  };
+
+  // Hypotheses that are dropped from the beam are recycled, so the memory
+  // for the parser states can be reused.
+  std::vector<Hypothesis *> beam{new Hypothesis(data->state_)};
+  std::vector<Hypothesis *> next;
+  std::vector<Hypothesis *> spare;
+  std::vector<Candidate> selected;
+  std::vector<int> uses;
+  std::vector<int> ranked;
+  std::vector<uint64> mask(actions_.MaskWords());
+
+  // The beam is ordered by score, and the scores of the hypotheses can only
+  // decrease when they are extended. The search is done when the best
+  // hypothesis has finished.
+  while (!beam[0]->state.done()) {
+    // Allocate rows in step channel for the next step of the hypotheses.
+    int base = channel->size();
+    channel->resize(base + beam_size_);
+
+    // Compute FF for all the hypotheses in the beam. The rows for finished
+    // hypotheses are computed too, but their outputs are not used.
+    ff->Clear();
+    data->AttachFF(ff, base);
+    for (int i = 0; i < beam.size(); ++i) {
+      Hypothesis *h = beam[i];
+      if (!h->state.done()) {
+        data->ExtractFeaturesFF(h->state, h->steps, ff, i);
+      }
+    }
+    if (profile_) ff->set_profile(&profile_->ff);
+    ff->Compute();
+
+    for (int i = 0; i < beam.size(); ++i) {
+      Hypothesis *h = beam[i];
+      if (h->state.done()) {
+        if (h->score > threshold()) add(Candidate{h->score, i, -1});
+        continue;
       }
 
-      // Next step.
-      step += 1;
+      // Only the allowed actions that can make it into the beam are
+      // considered, and they are taken in order of decreasing score from a
+      // max-heap until no more actions from this hypothesis can make it into
+      // the beam.
+      float *logprob = ff->Get<float>(ff_.logprob, i);
+      actions_.Mask(h->state, mask.data());
+      ranked.clear();
+      float cutoff = threshold() - h->score;
+      for (int a = 0; a < num_actions_; ++a) {
+        if (logprob[a] > cutoff && (mask[a >> 6] & (1ULL << (a & 63)))) {
+          ranked.push_back(a);
+        }
+      }
+      auto lower = [logprob](int a, int b) { return logprob[a] < logprob[b]; };
+      std::make_heap(ranked.begin(), ranked.end(), lower);
+      int extensions = 0;
+      while (!ranked.empty()) {
+        std::pop_heap(ranked.begin(), ranked.end(), lower);
+        int a = ranked.back();
+        ranked.pop_back();
+        float score = h->score + logprob[a];
+        if (score <= threshold()) break;
+        add(Candidate{score, i, a});
+        if (++extensions == beam_size_) break;
+      }
     }
 
-    // Add frames for sentence to the document.
-    state.AddParseToDocument(document);
+    // If no action can be applied to any of the hypotheses, the best
+    // hypothesis falls back to SHIFT or STOP like in greedy decoding.
+    if (heap.empty()) {
+      const ParserState &state = beam[0]->state;
+      int fallback = state.current() == state.end() ? actions_.StopIndex()
+                                                    : actions_.ShiftIndex();
+      heap.push(Candidate{beam[0]->score, 0, fallback});
+    }
+
+    // Get the best candidates in order of decreasing score.
+    selected.resize(heap.size());
+    for (int j = selected.size() - 1; j >= 0; --j) {
+      selected[j] = heap.top();
+      heap.pop();
+    }
+
+    // Extend the hypotheses for the best candidates to form the new beam. The
+    // last extension of a hypothesis takes over the hypothesis, and the other
+    // extensions get a copy.
+    uses.assign(beam.size(), 0);
+    for (const Candidate &c : selected) uses[c.hypothesis]++;
+    next.clear();
+    for (const Candidate &c : selected) {
+      Hypothesis *h;
+      if (--uses[c.hypothesis] == 0) {
+        h = beam[c.hypothesis];
+        beam[c.hypothesis] = nullptr;
+      } else if (!spare.empty()) {
+        h = spare.back();
+        spare.pop_back();
+        *h = *beam[c.hypothesis];
+      } else {
+        h = new Hypothesis(*beam[c.hypothesis]);
+      }
+      if (c.action != -1) {
+        const ParserAction &action = actions_.Action(c.action);
+        h->state.Apply(action);
+        h->steps.Add(action, h->state, base + c.hypothesis);
+        h->actions.push_back(c.action);
+        h->score = c.score;
+      }
+      next.push_back(h);
+    }
+    for (Hypothesis *h : beam) {
+      if (h != nullptr) spare.push_back(h);
+    }
+    beam.swap(next);
+  }
+
+  // Apply the actions for the best parse to the parser state.
+  for (int a : beam[0]->actions) data->state_.Apply(actions_.Action(a));
+
+  for (Hypothesis *h : beam) delete h;
+  for (Hypothesis *h : spare) delete h;
+}
+
+void ParserSteps::Add(const ParserAction &action, const ParserState &state,
+                      int row) {
+  rows.push_back(row);
+
+  // Update the creation and focus steps for the frame in focus.
+  if (action.type == ParserAction::SHIFT) return;
+  if (action.type == ParserAction::STOP) return;
+  if (state.AttentionSize() > 0) {
+    int frame = state.Attention(0);
+    if (create.size() < frame + 1) {
+      create.resize(frame + 1);
+      create[frame] = row;
+    }
+    if (focus.size() < frame + 1) {
+      focus.resize(frame + 1);
+    }
+    focus[frame] = row;
   }
 }
 
-myelin::Cell *Parser::GetCell(const string &name) {
-  myelin::Cell *cell = network_.GetCell(name);
+myelin::Cell *Parser::GetCell(myelin::Network *network, const string &name) {
+  myelin::Cell *cell = network->GetCell(name);
   if (cell == nullptr) {
     LOG(FATAL) << "Unknown parser cell: " << name;
   }
   return cell;
 }
 
-myelin::Connector *Parser::GetConnector(const string &name) {
-  myelin::Connector *cnx = network_.GetConnector(name);
+myelin::Connector *Parser::GetConnector(myelin::Network *network,
+                                        const string &name) {
+  myelin::Connector *cnx = network->GetConnector(name);
   if (cnx == nullptr) {
     LOG(FATAL) << "Unknown parser connector: " << name;
   }
   return cnx;
 }
 
-myelin::Tensor *Parser::GetParam(const string &name, bool optional) {
-  myelin::Tensor *param = network_.GetParameter(name);
+myelin::Tensor *Parser::GetParam(myelin::Network *network,
+                                 const string &name, bool optional) {
+  myelin::Tensor *param = network->GetParameter(name);
   if (param == nullptr && !optional) {
     LOG(FATAL) << "Unknown parser parameter: " << name;
   }
   return param;
 }
 
-ParserInstance::ParserInstance(const Parser *parser, Document *document,
+ParserInstance::ParserInstance(const Parser *parser, Store *store,
                                int begin, int end)
     : parser_(parser),
-      state_(document->store(), begin, end),
-      lr_(parser->lr_.cell),
-      rl_(parser->rl_.cell),
-      ff_(parser->ff_.cell),
-      lr_c_(parser->lr_.control),
-      lr_h_(parser->lr_.hidden),
-      rl_c_(parser->rl_.control),
-      rl_h_(parser->rl_.hidden),
-      ff_step_(parser->ff_.step) {
+      state_(store, begin, end),
+      lr_(parser->lr_.pool->Acquire()),
+      rl_(parser->rl_.pool->Acquire()),
+      ff_(parser->ff_.pool->Acquire()),
+      lr_c_(parser->lr_.pool->AcquireChannel(parser->lr_.control)),
+      lr_h_(parser->lr_.pool->AcquireChannel(parser->lr_.hidden)),
+      rl_c_(parser->rl_.pool->AcquireChannel(parser->rl_.control)),
+      rl_h_(parser->rl_.pool->AcquireChannel(parser->rl_.hidden)),
+      ff_step_(parser->ff_.pool->AcquireChannel(parser->ff_.step)) {
   // Add one extra element to LSTM activations for boundary element.
   int length = end - begin;
-  lr_c_.resize(length + 1);
-  lr_h_.resize(length + 1);
-  rl_c_.resize(length + 1);
-  rl_h_.resize(length + 1);
+  lr_c_->resize(length + 1);
+  lr_h_->resize(length + 1);
+  rl_c_->resize(length + 1);
+  rl_h_->resize(length + 1);
 
   // Reserve two transitions per token.
-  ff_step_.reserve(length * 2);
+  ff_step_->reserve(length * 2);
+}
+
+ParserInstance::~ParserInstance() {
+  // Return instances and channels to the pools.
+  parser_->lr_.pool->Release(lr_);
+  parser_->rl_.pool->Release(rl_);
+  parser_->ff_.pool->Release(ff_);
+  parser_->lr_.pool->ReleaseChannel(lr_c_);
+  parser_->lr_.pool->ReleaseChannel(lr_h_);
+  parser_->rl_.pool->ReleaseChannel(rl_c_);
+  parser_->rl_.pool->ReleaseChannel(rl_h_);
+  parser_->ff_.pool->ReleaseChannel(ff_step_);
 }
 
 void ParserInstance::AttachLR(int input, int output) {
-  lr_.Set(parser_->lr_.c_in, &lr_c_, input);
-  lr_.Set(parser_->lr_.c_out, &lr_c_, output);
-  lr_.Set(parser_->lr_.h_in, &lr_h_, input);
-  lr_.Set(parser_->lr_.h_out, &lr_h_, output);
+  lr_->Set(parser_->lr_.c_in, lr_c_, input);
+  lr_->Set(parser_->lr_.c_out, lr_c_, output);
+  lr_->Set(parser_->lr_.h_in, lr_h_, input);
+  lr_->Set(parser_->lr_.h_out, lr_h_, output);
 }
 
 void ParserInstance::AttachRL(int input, int output) {
-  rl_.Set(parser_->rl_.c_in, &rl_c_, input);
-  rl_.Set(parser_->rl_.c_out, &rl_c_, output);
-  rl_.Set(parser_->rl_.h_in, &rl_h_, input);
-  rl_.Set(parser_->rl_.h_out, &rl_h_, output);
+  rl_->Set(parser_->rl_.c_in, rl_c_, input);
+  rl_->Set(parser_->rl_.c_out, rl_c_, output);
+  rl_->Set(parser_->rl_.h_in, rl_h_, input);
+  rl_->Set(parser_->rl_.h_out, rl_h_, output);
 }
 
-void ParserInstance::AttachFF(int output) {
-  ff_.Set(parser_->ff_.lr_lstm, &lr_h_);
-  ff_.Set(parser_->ff_.rl_lstm, &rl_h_);
-  ff_.Set(parser_->ff_.steps, &ff_step_);
-  ff_.Set(parser_->ff_.hidden, &ff_step_, output);
+void ParserInstance::AttachFF(myelin::Instance *ff, int output) {
+  ff->Set(parser_->ff_.lr_lstm, lr_h_);
+  ff->Set(parser_->ff_.rl_lstm, rl_h_);
+  ff->Set(parser_->ff_.steps, ff_step_);
+  ff->Set(parser_->ff_.hidden, ff_step_, output);
 }
 
 void ParserInstance::ExtractFeaturesLSTM(int token,
                                          const DocumentFeatures &features,
                                          const Parser::LSTM &lstm,
-                                         myelin::Instance *data) {
+                                         myelin::Instance *data,
+                                         int row) {
   // Extract word feature.
   if (lstm.word_feature) {
-    *data->Get<int>(lstm.word_feature) = features.word(token);
+    *data->Get<int>(lstm.word_feature, row) = features.word(token);
   }
 
   // Extract prefix feature.
   if (lstm.prefix_feature) {
     Affix *affix = features.prefix(token);
-    int *a = data->Get<int>(lstm.prefix_feature);
+    int *a = data->Get<int>(lstm.prefix_feature, row);
     for (int n = 0; n < lstm.prefix_size; ++n) {
       if (affix != nullptr) {
         *a++ = affix->id();
@@ -439,7 +1086,7 @@ void ParserInstance::ExtractFeaturesLSTM(int token,
   // Extract suffix feature.
   if (lstm.suffix_feature) {
     Affix *affix = features.suffix(token);
-    int *a = data->Get<int>(lstm.suffix_feature);
+    int *a = data->Get<int>(lstm.suffix_feature, row);
     for (int n = 0; n < lstm.suffix_size; ++n) {
       if (affix != nullptr) {
         *a++ = affix->id();
@@ -452,61 +1099,64 @@ void ParserInstance::ExtractFeaturesLSTM(int token,
 
   // Extract hyphen feature.
   if (lstm.hyphen_feature) {
-    *data->Get<int>(lstm.hyphen_feature) = features.hyphen(token);
+    *data->Get<int>(lstm.hyphen_feature, row) = features.hyphen(token);
   }
 
   // Extract capitalization feature.
   if (lstm.caps_feature) {
-    *data->Get<int>(lstm.caps_feature) = features.capitalization(token);
+    *data->Get<int>(lstm.caps_feature, row) = features.capitalization(token);
   }
 
   // Extract punctuation feature.
   if (lstm.punct_feature) {
-    *data->Get<int>(lstm.punct_feature) = features.punctuation(token);
+    *data->Get<int>(lstm.punct_feature, row) = features.punctuation(token);
   }
 
   // Extract quote feature.
   if (lstm.quote_feature) {
-    *data->Get<int>(lstm.quote_feature) = features.quote(token);
+    *data->Get<int>(lstm.quote_feature, row) = features.quote(token);
   }
 
   // Extract digit feature.
   if (lstm.digit_feature) {
-    *data->Get<int>(lstm.digit_feature) = features.digit(token);
+    *data->Get<int>(lstm.digit_feature, row) = features.digit(token);
   }
 }
 
-void ParserInstance::ExtractFeaturesFF(int step) {
+void ParserInstance::ExtractFeaturesFF(const ParserState &state,
+                                       const ParserSteps &steps,
+                                       myelin::Instance *instance,
+                                       int row) {
   // Extract LSTM focus features.
   const Parser::FF &ff = parser_->ff_;
-  int current = state_.current() - state_.begin();
-  if (state_.current() == state_.end()) current = -1;
-  int *lr_focus = GetFF(ff.lr_focus_feature);
-  int *rl_focus = GetFF(ff.rl_focus_feature);
+  int current = state.current() - state.begin();
+  if (state.current() == state.end()) current = -1;
+  int *lr_focus = GetFF(instance, ff.lr_focus_feature, row);
+  int *rl_focus = GetFF(instance, ff.rl_focus_feature, row);
   if (lr_focus != nullptr) *lr_focus = current;
   if (rl_focus != nullptr) *rl_focus = current;
 
   // Extract frame attention, create, and focus features.
   if (ff.attention_depth > 0) {
-    int *lr = GetFF(ff.lr_attention_feature);
-    int *rl = GetFF(ff.rl_attention_feature);
-    int *create = GetFF(ff.frame_create_feature);
-    int *focus = GetFF(ff.frame_focus_feature);
+    int *lr = GetFF(instance, ff.lr_attention_feature, row);
+    int *rl = GetFF(instance, ff.rl_attention_feature, row);
+    int *create = GetFF(instance, ff.frame_create_feature, row);
+    int *focus = GetFF(instance, ff.frame_focus_feature, row);
     for (int d = 0; d < ff.attention_depth; ++d) {
       int att = -1;
       int created = -1;
       int focused = -1;
-      if (d < state_.AttentionSize()) {
+      if (d < state.AttentionSize()) {
         // Get frame from attention buffer.
-        int frame = state_.Attention(d);
+        int frame = state.Attention(d);
 
         // Get end token for phrase that evoked frame.
-        att = state_.FrameEvokeEnd(frame);
-        if (att != -1) att -= state_.begin() + 1;
+        att = state.FrameEvokeEnd(frame);
+        if (att != -1) att -= state.begin() + 1;
 
-        // Get the step numbers that created and focused the frame.
-        created = create_step_[frame];
-        focused = focus_step_[frame];
+        // Get the steps that created and focused the frame.
+        created = steps.create[frame];
+        focused = steps.focus[frame];
       }
       if (lr != nullptr) lr[d] = att;
       if (rl != nullptr) rl[d] = att;
@@ -516,11 +1166,11 @@ void ParserInstance::ExtractFeaturesFF(int step) {
   }
 
   // Extract history feature.
-  int *history = GetFF(ff.history_feature);
+  int *history = GetFF(instance, ff.history_feature, row);
   if (history != nullptr) {
     int h = 0;
-    int s = step - 1;
-    while (h < ff.history_size && s >= 0) history[h++] = s--;
+    int s = steps.rows.size() - 1;
+    while (h < ff.history_size && s >= 0) history[h++] = steps.rows[s--];
     while (h < ff.history_size) history[h++] = -1;
   }
 
@@ -528,10 +1178,10 @@ void ParserInstance::ExtractFeaturesFF(int step) {
   if (parser_->frame_limit_ > 0 && parser_->roles_.size() > 0) {
     // Construct role graph for center of attention.
     RoleGraph graph;
-    graph.Compute(state_, parser_->frame_limit_, parser_->roles_);
+    graph.Compute(state, parser_->frame_limit_, parser_->roles_);
 
     // Extract out roles.
-    int *out = GetFF(ff.out_roles_feature);
+    int *out = GetFF(instance, ff.out_roles_feature, row);
     if (out != nullptr) {
       int *end = out + ff.out_roles_size;
       graph.out([&out, end](int f) {
@@ -541,7 +1191,7 @@ void ParserInstance::ExtractFeaturesFF(int step) {
     }
 
     // Extract in roles.
-    int *in = GetFF(ff.in_roles_feature);
+    int *in = GetFF(instance, ff.in_roles_feature, row);
     if (in != nullptr) {
       int *end = in + ff.in_roles_size;
       graph.in([&in, end](int f) {
@@ -551,7 +1201,7 @@ void ParserInstance::ExtractFeaturesFF(int step) {
     }
 
     // Extract unlabeled roles.
-    int *unlabeled = GetFF(ff.unlabeled_roles_feature);
+    int *unlabeled = GetFF(instance, ff.unlabeled_roles_feature, row);
     if (unlabeled != nullptr) {
       int *end = unlabeled + ff.unlabeled_roles_size;
       graph.unlabeled([&unlabeled, end](int f) {
@@ -561,7 +1211,7 @@ void ParserInstance::ExtractFeaturesFF(int step) {
     }
 
     // Extract labeled roles.
-    int *labeled = GetFF(ff.labeled_roles_feature);
+    int *labeled = GetFF(instance, ff.labeled_roles_feature, row);
     if (labeled != nullptr) {
       int *end = labeled + ff.labeled_roles_size;
       graph.labeled([&labeled, end](int f) {
@@ -24,6 +24,7 @@
 #include "sling/base/types.h"
 #include "sling/file/file.h"
 #include "sling/frame/store.h"
+#include "sling/myelin/arena-runtime.h"
 #include "sling/myelin/compute.h"
 #include "sling/myelin/flow.h"
 #include "sling/myelin/profile.h"
@@ -33,12 +34,25 @@
 #include "sling/nlp/parser/action-table.h"
 #include "sling/nlp/parser/parser-state.h"
 #include "sling/nlp/parser/roles.h"
+#include "sling/util/thread-pool.h"
 
 namespace sling {
 namespace nlp {
 
 class ParserInstance;
 
+// FF steps taken for a parse. Each step has a row in the FF step channel with
+// the hidden activations for the step, and the frame creation and focus steps
+// refer to these rows.
+struct ParserSteps {
+  // Record step after the action has been applied to the parser state.
+  void Add(const ParserAction &action, const ParserState &state, int row);
+
+  std::vector<int> rows;                      // step channel row for steps
+  std::vector<int> create;                    // frame creation steps
+  std::vector<int> focus;                     // frame focus steps
+};
+
 // Frame semantics parser model.
 class Parser {
  public:
@@ -52,7 +66,7 @@ class Parser {
     myelin::ProfileSummary ff;                // profile summary for FF
   };
 
-  ~Parser() { delete profile_; }
+  ~Parser();
 
   // Load and initialize parser model.
   void Load(Store *store, const string &filename);
@@ -60,6 +74,10 @@ class Parser {
   // Parse document.
   void Parse(Document *document) const;
 
+  // Parse documents. When batching is enabled, the LSTMs for the sentences in
+  // the documents are computed in batches.
+  void Parse(const std::vector<Document *> &documents) const;
+
   // Enable profiling. Must be called before Load().
   void EnableProfiling() {
     network_.options().profiling = true;
@@ -72,6 +90,59 @@ class Parser {
   // Run parser on GPU if available. Must be called before Load().
   void EnableGPU();
 
+  // Compute the LSTMs for batches of sentences in lockstep, so the LSTM
+  // weights are only read once for each batch. Must be called before Load().
+  void EnableBatching(int batch_size) { batch_size_ = batch_size; }
+
+  // Return the number of sentences in each LSTM batch.
+  int batch_size() const { return batch_size_; }
+
+  // Quantize the weight matrices to 8-bit integers. This makes the matrix
+  // multiplications faster at a small loss of accuracy. Quantization is only
+  // used on CPUs with AVX2. Must be called before Load().
+  void EnableQuantization() { quantize_ = true; }
+
+  // Store the embedding and weight matrices as half-precision (DT_HALF) or
+  // bfloat16 (DT_BFLOAT16) floats. This halves the memory used by the model
+  // at a small loss of accuracy. Matrices are only converted if the CPU
+  // supports the conversion in the kernels. Must be called before Load().
+  void EnableReducedPrecision(myelin::Type type) { weight_type_ = type; }
+
+  // Parse the sentences of a document in parallel on a pool of worker threads
+  // and compute the LR and RL LSTMs for each sentence concurrently. This
+  // reduces the latency for parsing long documents. If the number of threads
+  // is zero or negative, one thread is used per hardware thread. Parallel
+  // parsing is not used with batching, profiling, or on GPU. Must be called
+  // before Load().
+  void EnableParallelism(int threads) { num_threads_ = threads; }
+
+  // Decode transitions with beam search, keeping the beam_size highest
+  // scoring parses of each sentence in each step instead of only the best
+  // one. Parses are scored by the sum of the log-softmax of the FF output for
+  // the actions, which are computed by a LogSoftmax op in the FF cell. The
+  // FF cell is batched over the beam, so the hypotheses in the beam are
+  // computed together and share the reads of the FF weights. Fast fallback
+  // is not used with beam search, and beam search is not used on GPU. Must
+  // be called before Load().
+  void EnableBeamSearch(int beam_size) { beam_size_ = beam_size; }
+
+  // Use a precompiled network file to skip compiling the parser networks. If
+  // the file does not exist or was compiled for another model, options, or
+  // CPU, the networks are compiled and saved to the file for later parser
+  // processes. Must be called before Load().
+  void EnableNetworkCache(const string &filename) {
+    network_cache_ = filename;
+  }
+
+  // Allocate instance data and channel buffers for the parser cells from a
+  // memory arena instead of the system allocator. The arena is not used on
+  // GPU. Must be called before Load().
+  void EnableArena() { use_arena_ = true; }
+
+  // Log allocation counters and retained bytes for the instance pools and
+  // the memory arena.
+  void LogMemoryUsage() const;
+
   // Return profile summary for parser.
   Profile *profile() const { return profile_; }
 
@@ -82,6 +153,7 @@ class Parser {
     myelin::Cell *cell;                       // LSTM cell
     bool reverse;                             // LSTM direction
     myelin::Tensor *profile;                  // LSTM profiling block
+    myelin::InstancePool *pool = nullptr;     // LSTM instances and channels
 
     // Connectors.
     myelin::Connector *control;               // LSTM control layer
@@ -112,6 +184,7 @@ class Parser {
     myelin::Cell *cell;                       // feed-forward cell
     myelin::Connector *step;                  // FF step hidden activations
     myelin::Tensor *profile;                  // FF profiling block
+    myelin::InstancePool *pool = nullptr;     // FF instances and channels
 
     // Features.
     myelin::Tensor *lr_focus_feature;         // LR LSTM input focus feature
@@ -143,19 +216,81 @@ class Parser {
     myelin::Tensor *steps;                    // link to FF step hidden layer
     myelin::Tensor *hidden;                   // link to FF hidden layer output
     myelin::Tensor *output;                   // link to FF logit layer output
+    myelin::Tensor *logprob;                  // log-softmax of FF output
     myelin::Tensor *prediction;               // link to FF argmax
+    myelin::Tensor *mask;                     // allowed actions for argmax
+  };
+
+  // Sentence in a batch of sentences.
+  struct Sentence {
+    ParserInstance *data;                     // parser state for sentence
+    const DocumentFeatures *features;         // features for document
+    Document *document;                       // document for sentence
   };
 
+  // Compile LSTM cells for computing batches of sentences.
+  void LoadBatchedLSTM(const string &model);
+
+  // Return signature for precompiled parser networks. This identifies the
+  // model file and the options used for compiling the networks.
+  string NetworkSignature(const string &model) const;
+
   // Initialize LSTM cell.
-  void InitLSTM(const string &name, LSTM *lstm, bool reverse);
+  void InitLSTM(myelin::Network *network, const string &name, LSTM *lstm,
+                bool reverse);
 
   // Initialize FF cell.
   void InitFF(const string &name, FF *ff);
 
+  // Parse sentences of document in parallel.
+  void ParseParallel(Document *document) const;
+
+  // Compute LSTMs for sentence.
+  void ComputeLSTM(ParserInstance *data,
+                   const DocumentFeatures &features) const;
+
+  // Compute left-to-right and right-to-left LSTM for sentence.
+  void ComputeLR(ParserInstance *data,
+                 const DocumentFeatures &features) const;
+  void ComputeRL(ParserInstance *data,
+                 const DocumentFeatures &features) const;
+
+  // Compute LSTM for a batch of sentences and copy the hidden layer
+  // activations to the channels for the sentences.
+  void ComputeLSTMBatch(const LSTM &lstm,
+                        const std::vector<Sentence> &batch) const;
+
+  // Parse batch of sentences.
+  void ParseBatch(const std::vector<Sentence> &batch) const;
+
+  // Run FF to predict transitions for sentence. The frames for the sentence
+  // are added to the document with AddParseToDocument().
+  void Predict(ParserInstance *data) const;
+
+  // Run FF to predict transitions for sentence using beam search. The FF is
+  // computed for all the hypotheses in the beam in one step. The actions for
+  // the highest scoring parse are applied to the parser state.
+  void PredictBeam(ParserInstance *data) const;
+
+  // Return the maximum number of sentences parsed at the same time by a call
+  // to Parse(). Parallel parsing keeps twice as many sentences in flight as
+  // there are worker threads.
+  int MaxSentencesInFlight() const {
+    return pool_ != nullptr ? 2 * pool_->num_workers() : 1;
+  }
+
   // Lookup cells, connectors, and parameters.
-  myelin::Cell *GetCell(const string &name);
-  myelin::Connector *GetConnector(const string &name);
-  myelin::Tensor *GetParam(const string &name, bool optional = false);
+  static myelin::Cell *GetCell(myelin::Network *network, const string &name);
+  static myelin::Connector *GetConnector(myelin::Network *network,
+                                         const string &name);
+  static myelin::Tensor *GetParam(myelin::Network *network,
+                                  const string &name,
+                                  bool optional = false);
+
+  // Memory arena for instances and channels. It is declared before the
+  // networks so it outlives them.
+  bool use_arena_ = false;
+  myelin::ArenaRuntime arena_;
 
   // Parser network.
   myelin::Library library_;
@@ -166,6 +301,12 @@ class Parser {
   LSTM rl_;                                   // right-to-left LSTM cell
   FF ff_;                                     // feed-forward cell
 
+  // Network with LSTM cells for batches of sentences.
+  int batch_size_ = 1;
+  myelin::Network batch_network_;
+  LSTM batch_lr_;                             // batched left-to-right LSTM
+  LSTM batch_rl_;                             // batched right-to-left LSTM
+
   // Profile summary.
   Profile *profile_ = nullptr;
 
@@ -193,6 +334,22 @@ class Parser {
   // Run parser on GPU.
   bool use_gpu_ = false;
 
+  // Quantize weight matrices.
+  bool quantize_ = false;
+
+  // Storage type for embedding and weight matrices.
+  myelin::Type weight_type_ = myelin::DT_FLOAT;
+
+  // Precompiled network file for parser networks.
+  string network_cache_;
+
+  // Worker threads for parsing sentences in parallel.
+  int num_threads_ = 1;
+  ThreadPool *pool_ = nullptr;
+
+  // Number of parses kept in each step of beam search.
+  int beam_size_ = 1;
+
   // Symbols.
   Names names_;
   Name n_document_tokens_{names_, "/s/document/tokens"};
@@ -205,7 +362,11 @@ class Parser {
 // Parser state for running an instance of the parser on a document.
 class ParserInstance {
  public:
-  ParserInstance(const Parser *parser, Document *document, int begin, int end);
+  // Initialize parser instance for sentence. The frames for the sentence are
+  // created in the store, which is either the document store or a local store
+  // for parsing the sentence independently of the document.
+  ParserInstance(const Parser *parser, Store *store, int begin, int end);
+  ~ParserInstance();
 
   // Attach connectors for LR LSTM.
   void AttachLR(int input, int output);
@@ -213,22 +374,31 @@ class ParserInstance {
   // Attach connectors for RL LSTM.
   void AttachRL(int input, int output);
 
-  // Attach connectors for FF.
-  void AttachFF(int output);
+  // Attach connectors for FF instance. The hidden activations are output to
+  // the given row in the FF step channel. For beam search, the hidden
+  // activations for the beam are output to consecutive rows.
+  void AttachFF(myelin::Instance *ff, int output);
 
-  // Extract features for LSTM.
+  // Extract features for LSTM. The features are stored in the given row of
+  // the feature inputs for batched LSTMs.
   void ExtractFeaturesLSTM(int token,
                            const DocumentFeatures &features,
                            const Parser::LSTM &lstm,
-                           myelin::Instance *data);
+                           myelin::Instance *data,
+                           int row = 0);
 
-  // Extract features for FF.
-  void ExtractFeaturesFF(int step);
+  // Extract features for FF from parser state and the steps taken to reach
+  // the state. The features are stored in the given row of the feature
+  // inputs for beam search.
+  void ExtractFeaturesFF(const ParserState &state,
+                         const ParserSteps &steps,
+                         myelin::Instance *ff,
+                         int row = 0);
 
  private:
   // Get feature vector for FF.
-  int *GetFF(myelin::Tensor *type) {
-    return type ? ff_.Get<int>(type) : nullptr;
+  static int *GetFF(myelin::Instance *ff, myelin::Tensor *type, int row) {
+    return type ? ff->Get<int>(type, row) : nullptr;
   }
 
   // Parser model.
@@ -237,21 +407,21 @@ class ParserInstance {
   // Parser transition state.
   ParserState state_;
 
-  // Instances for network computations.
-  myelin::Instance lr_;
-  myelin::Instance rl_;
-  myelin::Instance ff_;
+  // Instances for network computations. These are acquired from the instance
+  // pools for the parser cells.
+  myelin::Instance *lr_;
+  myelin::Instance *rl_;
+  myelin::Instance *ff_;
 
   // Channels for connectors.
-  myelin::Channel lr_c_;
-  myelin::Channel lr_h_;
-  myelin::Channel rl_c_;
-  myelin::Channel rl_h_;
-  myelin::Channel ff_step_;
-
-  // Frame creation and focus steps.
-  std::vector<int> create_step_;
-  std::vector<int> focus_step_;
+  myelin::Channel *lr_c_;
+  myelin::Channel *lr_h_;
+  myelin::Channel *rl_c_;
+  myelin::Channel *rl_h_;
+  myelin::Channel *ff_step_;
+
+  // FF steps for parser state.
+  ParserSteps steps_;
 
   friend class Parser;
 };
@@ -22,8 +22,11 @@
 #include "sling/base/flags.h"
 #include "sling/frame/object.h"
 #include "sling/frame/serialization.h"
+#include "sling/frame/snapshot.h"
 
 DEFINE_string(o, "", "Output for encoded store");
+DEFINE_bool(snapshot, false, "Also write snapshot of store");
+DEFINE_int32(segment_size, 0, "Segment size for parallel decoding (0=off)");
 
 using namespace sling;
 
@@ -58,10 +61,17 @@ int main(int argc, char *argv[]) {
   Output output(&stream);
   Encoder encoder(&store, &output);
   encoder.set_shallow(true);
+  encoder.set_segment_size(FLAGS_segment_size);
   encoder.EncodeAll();
   output.Flush();
   CHECK(stream.Close());
 
+  // Save snapshot of store for fast loading.
+  if (FLAGS_snapshot) {
+    LOG(INFO) << "Writing snapshot to " << Snapshot::Filename(FLAGS_o);
+    CHECK(Snapshot::Write(&store, FLAGS_o));
+  }
+
   LOG(INFO) << "Done.";
   return 0;
 }
@@ -19,15 +19,45 @@
 //    The output frames are printed in textual form, whose indentation is
 //    controlled by --indent.
 // B. If --benchmark is true, then it runs the parser over the corpus
-//    specified via --corpus, and reports the processing speed.
+//    specified via --corpus, and reports the processing speed. With --batch,
+//    the LSTMs are computed for batches of sentences from several documents.
 // C. If --evaluate is true, then it takes gold documents via --corpus, runs
 //    the parser over them, and reports frame evaluation numbers.
 //
+// If --parse is true, the documents in --corpus are parsed and output in
+// textual form, or written to the record file specified by --output. The
+// record file is written asynchronously, so the parser does not stall on
+// compression and disk writes.
+//
+// For --parse and --benchmark, the corpus is processed by a pipeline with a
+// reader thread, --threads parser workers, and a writer stage connected by
+// bounded queues. Each worker decodes, parses, and encodes documents in its
+// own local store, so the work scales with the number of workers. With
+// --ordered, the parsed documents are output in corpus order. Throughput and
+// latency statistics are reported for each stage of the pipeline. With
+// --sentence_threads, the sentences of each document are also parsed in
+// parallel, which reduces the latency for long documents.
+//
+// By default, the parser greedily takes the best transition in each step.
+// With --beam, the transitions are decoded with beam search instead.
+//
 // For B and C, --maxdocs can be used to limit the processing to the specified
-// number of documents.
+// number of documents. With --quantize, the parser weights are quantized to
+// 8-bit integers, so the loss of accuracy can be measured with --evaluate.
+// Likewise, --weight_type=float16 or --weight_type=bfloat16 stores the parser
+// weights as 16-bit floats.
+//
+// With --network_cache, the compiled parser networks are saved to the file and
+// later runs load them from there instead of compiling the parser flow.
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "sling/base/clock.h"
@@ -35,6 +65,7 @@
 #include "sling/base/logging.h"
 #include "sling/base/types.h"
 #include "sling/base/flags.h"
+#include "sling/file/recordio.h"
 #include "sling/frame/object.h"
 #include "sling/frame/serialization.h"
 #include "sling/nlp/document/document.h"
@@ -43,18 +74,33 @@
 #include "sling/nlp/parser/parser.h"
 #include "sling/nlp/parser/trainer/frame-evaluation.h"
 #include "sling/string/printf.h"
+#include "sling/util/thread-pool.h"
 
 DEFINE_string(parser, "", "Input file with flow model");
 DEFINE_string(text, "", "Text to parse");
 DEFINE_int32(indent, 2, "Indentation for SLING output");
 DEFINE_string(corpus, "", "Input corpus");
+DEFINE_bool(parallel_reader, false, "Read corpus record files in parallel");
 DEFINE_bool(parse, false, "Parse input corpus");
+DEFINE_string(output, "", "Output record file for parsed documents");
 DEFINE_bool(benchmark, false, "Benchmark parser");
 DEFINE_bool(evaluate, false, "Evaluate parser");
 DEFINE_bool(profile, false, "Profile parser");
 DEFINE_int32(maxdocs, -1, "Maximum number of documents to process");
 DEFINE_bool(fast_fallback, false, "Use fast fallback for parser predictions");
 DEFINE_bool(gpu, false, "Run parser on GPU");
+DEFINE_int32(batch, 1, "Number of sentences in each LSTM batch");
+DEFINE_bool(quantize, false, "Quantize parser weights to 8-bit integers");
+DEFINE_string(weight_type, "float",
+              "Storage type for parser weights (float, float16, bfloat16)");
+DEFINE_string(network_cache, "", "Precompiled network file for parser");
+DEFINE_int32(threads, 1, "Number of parser threads (0 for all cores)");
+DEFINE_int32(queue_size, 64, "Capacity of queues between pipeline stages");
+DEFINE_bool(ordered, true, "Output parsed documents in corpus order");
+DEFINE_int32(sentence_threads, 1,
+             "Number of threads for parsing sentences in parallel");
+DEFINE_int32(beam, 1, "Beam size for decoding parser transitions");
+DEFINE_bool(arena, false, "Allocate parser instances from a memory arena");
 
 using namespace sling;
 using namespace sling::nlp;
@@ -124,6 +170,356 @@ class ParserEvaulationCorpus : public ParallelCorpus {
   int num_documents_ = 0;    // number of documents processed
 };
 
+// Bounded queue for passing items between the stages of the parse pipeline.
+// Push() waits when the queue is full and Pop() waits when it is empty.
+template <typename T> class BoundedQueue {
+ public:
+  explicit BoundedQueue(int capacity) : capacity_(capacity) {}
+
+  // Add item to queue, waiting until there is room for it. Returns the number
+  // of cycles spent waiting.
+  int64 Push(T item) {
+    Clock::Timestamp start = Clock::now();
+    std::unique_lock<std::mutex> lock(mu_);
+    nonfull_.wait(lock, [this]() { return items_.size() < capacity_; });
+    items_.push_back(item);
+    lock.unlock();
+    nonempty_.notify_one();
+    return Clock::now() - start;
+  }
+
+  // Remove next item from queue, waiting until one is available. Returns
+  // false when the queue has been closed and all items have been removed. The
+  // number of cycles spent waiting is added to waited.
+  bool Pop(T *item, int64 *waited) {
+    Clock::Timestamp start = Clock::now();
+    std::unique_lock<std::mutex> lock(mu_);
+    nonempty_.wait(lock, [this]() { return closed_ || !items_.empty(); });
+    *waited += Clock::now() - start;
+    if (items_.empty()) return false;
+    *item = items_.front();
+    items_.pop_front();
+    lock.unlock();
+    nonfull_.notify_one();
+    return true;
+  }
+
+  // Remove next item from queue if one is available without waiting.
+  bool TryPop(T *item) {
+    std::unique_lock<std::mutex> lock(mu_);
+    if (items_.empty()) return false;
+    *item = items_.front();
+    items_.pop_front();
+    lock.unlock();
+    nonfull_.notify_one();
+    return true;
+  }
+
+  // Close queue, signaling that no more items will be added.
+  void Close() {
+    std::lock_guard<std::mutex> lock(mu_);
+    closed_ = true;
+    nonempty_.notify_all();
+  }
+
+ private:
+  int capacity_;
+  std::deque<T> items_;
+  bool closed_ = false;
+  std::mutex mu_;
+  std::condition_variable nonempty_;
+  std::condition_variable nonfull_;
+};
+
+// Pipeline for parsing a corpus with multiple threads. A reader thread reads
+// encoded documents from the corpus and a pool of workers decodes, parses,
+// and encodes the documents, each in a local store over the frozen commons
+// store. The parsed documents are written by the calling thread, optionally
+// reordered to corpus order.
+class ParsePipeline {
+ public:
+  // Parse output format.
+  enum Output {DISCARD, TEXT, ENCODED};
+
+  ParsePipeline(const Parser *parser, Store *commons, Output output)
+      : parser_(parser), commons_(commons), output_(output),
+        input_queue_(FLAGS_queue_size), output_queue_(FLAGS_queue_size) {
+    threads_ = FLAGS_threads;
+    if (threads_ <= 0) threads_ = ThreadPool::NumHardwareThreads();
+    batch_ = std::max(FLAGS_batch, 1);
+
+    // Limit the number of documents in flight, so the reorder buffer for
+    // ordered output cannot grow without bounds when one document is slow.
+    window_ = 2 * FLAGS_queue_size + threads_ * batch_;
+  }
+
+  // Parse documents in corpus. If writer is not null, encoded documents are
+  // written to it. Otherwise, text output is written to stdout.
+  void Run(DocumentSource *corpus, RecordWriter *writer) {
+    Clock clock;
+    clock.start();
+    std::thread reader(&ParsePipeline::Reader, this, corpus);
+    std::vector<Stats> worker_stats(threads_);
+    active_workers_ = threads_;
+    ThreadPool workers(threads_);
+    for (int i = 0; i < threads_; ++i) {
+      Stats *stats = &worker_stats[i];
+      workers.Schedule([this, stats]() { Worker(stats); });
+    }
+    Writer(writer);
+    reader.join();
+    workers.Wait();
+    clock.stop();
+    secs_ = clock.secs();
+    for (const Stats &s : worker_stats) parser_stats_.Add(s);
+  }
+
+  // Output throughput and latency statistics.
+  void Report() const {
+    LOG(INFO) << num_documents_ << " documents, "
+              << num_tokens_ << " tokens, "
+              << num_tokens_ / secs_ << " tokens/sec, "
+              << num_documents_ / secs_ << " documents/sec with "
+              << threads_ << " threads";
+    ReportStage("reader", reader_stats_, 1);
+    ReportStage("parser", parser_stats_, threads_);
+    ReportStage("writer", writer_stats_, 1);
+    parser_->LogMemoryUsage();
+
+    std::vector<int64> latency = latency_;
+    if (latency.empty()) return;
+    std::sort(latency.begin(), latency.end());
+    double ms = Clock::mhz() * 1000.0;
+    int64 sum = 0;
+    for (int64 l : latency) sum += l;
+    LOG(INFO) << StringPrintf(
+        "latency: mean %.3f ms, p50 %.3f ms, p90 %.3f ms, p99 %.3f ms",
+        sum / latency.size() / ms,
+        latency[latency.size() * 50 / 100] / ms,
+        latency[latency.size() * 90 / 100] / ms,
+        latency[latency.size() * 99 / 100] / ms);
+  }
+
+  int num_documents() const { return num_documents_; }
+  int64 num_tokens() const { return num_tokens_; }
+  double secs() const { return secs_; }
+
+ private:
+  // Document passing through the pipeline.
+  struct Item {
+    int64 seqno;                  // position of document in corpus
+    string name;                  // document name
+    string data;                  // encoded input or parsed output
+    int tokens = 0;               // number of tokens in document
+    Clock::Timestamp read;        // time when document was read
+  };
+
+  // Statistics for a pipeline stage. All times are in cycles.
+  struct Stats {
+    int64 items = 0;              // documents processed by stage
+    int64 busy = 0;               // time spent processing documents
+    int64 starved = 0;            // time spent waiting for input
+    int64 blocked = 0;            // time spent waiting for room for output
+
+    void Add(const Stats &other) {
+      items += other.items;
+      busy += other.busy;
+      starved += other.starved;
+      blocked += other.blocked;
+    }
+  };
+
+  // Reader stage for reading encoded documents from the corpus.
+  void Reader(DocumentSource *corpus) {
+    for (;;) {
+      if (FLAGS_maxdocs != -1 && reader_stats_.items >= FLAGS_maxdocs) break;
+
+      // Wait until there is room for another document in the pipeline.
+      Clock::Timestamp start = Clock::now();
+      {
+        std::unique_lock<std::mutex> lock(mu_);
+        room_.wait(lock, [this]() { return inflight_ < window_; });
+      }
+      Clock::Timestamp ready = Clock::now();
+      reader_stats_.blocked += ready - start;
+
+      // Read next document.
+      Item *item = new Item();
+      if (!corpus->NextSerialized(&item->name, &item->data)) {
+        delete item;
+        break;
+      }
+      item->seqno = reader_stats_.items++;
+      item->read = ready;
+      {
+        std::lock_guard<std::mutex> lock(mu_);
+        inflight_++;
+      }
+      reader_stats_.busy += Clock::now() - ready;
+
+      reader_stats_.blocked += input_queue_.Push(item);
+    }
+    input_queue_.Close();
+  }
+
+  // Worker stage for parsing documents. When batching is enabled, up to a
+  // batch of documents are parsed together.
+  void Worker(Stats *stats) {
+    std::vector<Item *> items;
+    std::vector<Store *> stores;
+    std::vector<Document *> documents;
+    for (;;) {
+      // Get next group of documents.
+      Item *item;
+      if (!input_queue_.Pop(&item, &stats->starved)) break;
+      items.push_back(item);
+      while (items.size() < batch_ && input_queue_.TryPop(&item)) {
+        items.push_back(item);
+      }
+
+      // Decode documents into local stores.
+      Clock::Timestamp start = Clock::now();
+      for (Item *item : items) {
+        Store *store = new Store(commons_);
+        StringDecoder decoder(store, item->data);
+        Document *document = new Document(decoder.Decode().AsFrame());
+        document->ClearAnnotations();
+        item->tokens = document->num_tokens();
+        stores.push_back(store);
+        documents.push_back(document);
+      }
+
+      // Parse documents.
+      parser_->Parse(documents);
+
+      // Encode parsed documents for output.
+      for (int i = 0; i < items.size(); ++i) {
+        Document *document = documents[i];
+        document->Update();
+        if (output_ == ENCODED) {
+          items[i]->data = Encode(document->top());
+        } else if (output_ == TEXT) {
+          items[i]->data = ToText(document->top(), FLAGS_indent);
+        } else {
+          items[i]->data.clear();
+        }
+        delete document;
+        delete stores[i];
+      }
+      stats->items += items.size();
+      stats->busy += Clock::now() - start;
+
+      // Pass parsed documents on to the writer.
+      for (Item *item : items) stats->blocked += output_queue_.Push(item);
+      items.clear();
+      stores.clear();
+      documents.clear();
+    }
+
+    // The last worker to finish closes the output queue.
+    std::lock_guard<std::mutex> lock(mu_);
+    if (--active_workers_ == 0) output_queue_.Close();
+  }
+
+  // Writer stage for outputting parsed documents.
+  void Writer(RecordWriter *writer) {
+    std::map<int64, Item *> pending;
+    int64 next = 0;
+    Item *item;
+    while (output_queue_.Pop(&item, &writer_stats_.starved)) {
+      if (!FLAGS_ordered) {
+        Write(item, writer);
+        continue;
+      }
+
+      // Hold back documents until all preceding documents have been written.
+      pending[item->seqno] = item;
+      while (!pending.empty() && pending.begin()->first == next) {
+        Write(pending.begin()->second, writer);
+        pending.erase(pending.begin());
+        next++;
+      }
+    }
+    CHECK(pending.empty());
+  }
+
+  // Write parsed document and free up room for another document in the
+  // pipeline.
+  void Write(Item *item, RecordWriter *writer) {
+    Clock::Timestamp start = Clock::now();
+    num_documents_++;
+    num_tokens_ += item->tokens;
+    if (writer != nullptr) {
+      CHECK(writer->Write(item->name, item->data));
+    } else if (output_ == TEXT) {
+      std::cout << item->data << "\n";
+    } else if (num_documents_ % 10 == 0) {
+      std::cout << num_documents_ << " documents\r";
+      std::cout.flush();
+    }
+    Clock::Timestamp end = Clock::now();
+    latency_.push_back(end - item->read);
+    writer_stats_.items++;
+    writer_stats_.busy += end - start;
+    delete item;
+
+    std::lock_guard<std::mutex> lock(mu_);
+    inflight_--;
+    room_.notify_one();
+  }
+
+  // Output statistics for pipeline stage.
+  void ReportStage(const char *name, const Stats &stats, int threads) const {
+    double total = secs_ * Clock::hz() * threads;
+    double ms = Clock::mhz() * 1000.0;
+    LOG(INFO) << StringPrintf(
+        "%s: %lld docs, %.1f docs/sec, %.3f ms/doc, "
+        "busy %.1f%%, starved %.1f%%, blocked %.1f%%",
+        name, stats.items, stats.items / secs_,
+        stats.items > 0 ? stats.busy / stats.items / ms : 0.0,
+        stats.busy * 100.0 / total,
+        stats.starved * 100.0 / total,
+        stats.blocked * 100.0 / total);
+  }
+
+  // Parser and commons store.
+  const Parser *parser_;
+  Store *commons_;
+
+  // Output format.
+  Output output_;
+
+  // Number of parser threads and documents in each parser batch.
+  int threads_;
+  int batch_;
+
+  // Queues between reader and workers and between workers and writer.
+  BoundedQueue<Item *> input_queue_;
+  BoundedQueue<Item *> output_queue_;
+
+  // Maximum number of documents in flight and number of documents read but
+  // not yet written.
+  int window_;
+  int inflight_ = 0;
+
+  // Number of workers still running.
+  int active_workers_ = 0;
+
+  // Mutex for in-flight and active worker counts, and signal for room in the
+  // pipeline.
+  std::mutex mu_;
+  std::condition_variable room_;
+
+  // Statistics.
+  Stats reader_stats_;
+  Stats parser_stats_;
+  Stats writer_stats_;
+  std::vector<int64> latency_;
+  int num_documents_ = 0;
+  int64 num_tokens_ = 0;
+  double secs_ = 0.0;
+};
+
 int main(int argc, char *argv[]) {
   InitProgram(&argc, &argv);
 
@@ -136,6 +532,25 @@ int main(int argc, char *argv[]) {
   if (FLAGS_fast_fallback) parser.EnableFastFallback();
   if (FLAGS_profile) parser.EnableProfiling();
   if (FLAGS_gpu) parser.EnableGPU();
+  if (FLAGS_batch > 1) parser.EnableBatching(FLAGS_batch);
+  if (FLAGS_sentence_threads != 1) {
+    parser.EnableParallelism(FLAGS_sentence_threads);
+  }
+  if (FLAGS_beam > 1) parser.EnableBeamSearch(FLAGS_beam);
+  if (FLAGS_arena) parser.EnableArena();
+  if (FLAGS_quantize) parser.EnableQuantization();
+  if (FLAGS_weight_type != "float") {
+    const auto &traits = myelin::TypeTraits::of(FLAGS_weight_type);
+    CHECK(traits.type() == myelin::DT_HALF ||
+          traits.type() == myelin::DT_BFLOAT16)
+        << "Unsupported weight type: " << FLAGS_weight_type;
+    parser.EnableReducedPrecision(traits.type());
+  }
+  if (!FLAGS_network_cache.empty()) {
+    parser.EnableNetworkCache(FLAGS_network_cache);
+  }
+  CHECK(!FLAGS_profile || FLAGS_threads == 1)
+      << "Profiling is only supported with one parser thread";
   parser.Load(&commons, FLAGS_parser);
   commons.Freeze();
   clock.stop();
@@ -165,23 +580,25 @@ int main(int argc, char *argv[]) {
   if (FLAGS_parse) {
     CHECK(!FLAGS_corpus.empty());
     LOG(INFO) << "Parse " << FLAGS_corpus;
-    DocumentSource *corpus = DocumentSource::Create(FLAGS_corpus);
-    int num_documents = 0;
-    for (;;) {
-      if (FLAGS_maxdocs != -1 && num_documents >= FLAGS_maxdocs) break;
-
-      Store store(&commons);
-      Document *document = corpus->Next(&store);
-      if (document == nullptr) break;
-      num_documents++;
-
-      document->ClearAnnotations();
-      parser.Parse(document);
-      document->Update();
-      std::cout << ToText(document->top(), FLAGS_indent) << "\n";
-
-      delete document;
+    DocumentSource *corpus =
+        DocumentSource::Create(FLAGS_corpus, FLAGS_parallel_reader);
+    RecordWriter *writer = nullptr;
+    if (!FLAGS_output.empty()) {
+      RecordFileOptions options;
+      options.async = true;
+      writer = new RecordWriter(FLAGS_output, options);
+    }
+    ParsePipeline pipeline(&parser, &commons,
+                           writer != nullptr ? ParsePipeline::ENCODED
+                                             : ParsePipeline::TEXT);
+    pipeline.Run(corpus, writer);
+    if (writer != nullptr) {
+      CHECK(writer->Close());
+      LOG(INFO) << "Parser blocked on output for "
+                << writer->blocked_time() << " secs";
+      delete writer;
     }
+    pipeline.Report();
     delete corpus;
   }
 
@@ -189,31 +606,15 @@ int main(int argc, char *argv[]) {
   if (FLAGS_benchmark) {
     CHECK(!FLAGS_corpus.empty());
     LOG(INFO) << "Benchmarking parser on " << FLAGS_corpus;
-    DocumentSource *corpus = DocumentSource::Create(FLAGS_corpus);
-    int num_documents = 0;
-    int num_tokens = 0;
-    clock.start();
-    for (;;) {
-      if (FLAGS_maxdocs != -1 && num_documents >= FLAGS_maxdocs) break;
-
-      Store store(&commons);
-      Document *document = corpus->Next(&store);
-      if (document == nullptr) break;
-
-      num_documents++;
-      num_tokens += document->num_tokens();
-      if (num_documents % 10 == 0) {
-        std::cout << num_documents << " documents\r";
-        std::cout.flush();
-      }
-      parser.Parse(document);
-
-      delete document;
-    }
-    clock.stop();
-    LOG(INFO) << num_documents << " documents, "
-              << num_tokens << " tokens, "
-              << num_tokens / clock.secs() << " tokens/sec";
+    DocumentSource *corpus =
+        DocumentSource::Create(FLAGS_corpus, FLAGS_parallel_reader);
+    ParsePipeline pipeline(&parser, &commons, ParsePipeline::DISCARD);
+    pipeline.Run(corpus, nullptr);
+    LOG(INFO) << pipeline.num_documents() << " documents, "
+              << pipeline.num_tokens() << " tokens, "
+              << pipeline.num_tokens() / pipeline.secs() << " tokens/sec"
+              << " with batch size " << parser.batch_size();
+    pipeline.Report();
     delete corpus;
   }
 
@@ -97,7 +97,9 @@ int PyArray::SetItem(Py_ssize_t index, PyObject *value) {
   // Set array element.
   Handle handle = pystore->Value(value);
   if (handle.IsError()) return -1;
-  *array()->at(index) = handle;
+  ArrayDatum *arr = array();
+  *arr->at(index) = handle;
+  pystore->store->WriteBarrier(arr);
   return 0;
 }
 
@@ -0,0 +1,77 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sling/util/thread-pool.h"
+
+namespace sling {
+
+ThreadPool::ThreadPool(int num_workers) {
+  if (num_workers <= 0) num_workers = NumHardwareThreads();
+  for (int i = 0; i < num_workers; ++i) {
+    workers_.emplace_back(&ThreadPool::Worker, this);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  // Wait for all tasks to complete.
+  Wait();
+
+  // Stop all workers.
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stop_ = true;
+  }
+  ready_.notify_all();
+  for (auto &t : workers_) t.join();
+}
+
+void ThreadPool::Schedule(Task task) {
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    queue_.push_back(std::move(task));
+    pending_++;
+  }
+  ready_.notify_one();
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(mu_);
+  done_.wait(lock, [this]() { return pending_ == 0; });
+}
+
+int ThreadPool::NumHardwareThreads() {
+  int n = std::thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+void ThreadPool::Worker() {
+  std::unique_lock<std::mutex> lock(mu_);
+  for (;;) {
+    // Wait for next task.
+    ready_.wait(lock, [this]() { return stop_ || !queue_.empty(); });
+    if (queue_.empty()) return;
+    Task task = std::move(queue_.front());
+    queue_.pop_front();
+
+    // Run task without holding the lock.
+    lock.unlock();
+    task();
+    lock.lock();
+
+    // Signal waiters when all tasks have completed.
+    if (--pending_ == 0) done_.notify_all();
+  }
+}
+
+}  // namespace sling
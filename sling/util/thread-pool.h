@@ -0,0 +1,82 @@
+// Copyright 2017 Google Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SLING_UTIL_THREAD_POOL_H_
+#define SLING_UTIL_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "sling/base/macros.h"
+
+namespace sling {
+
+// Pool of worker threads for running tasks in parallel. Tasks are run in the
+// order they are scheduled, but they can complete in any order.
+class ThreadPool {
+ public:
+  // Task closure.
+  typedef std::function<void()> Task;
+
+  // Starts thread pool with the number of worker threads. If the number of
+  // workers is zero or negative, one worker is started per hardware thread.
+  explicit ThreadPool(int num_workers);
+
+  // Waits for all scheduled tasks to complete and stops the worker threads.
+  ~ThreadPool();
+
+  // Schedules task to be run by one of the worker threads.
+  void Schedule(Task task);
+
+  // Waits until all scheduled tasks have completed.
+  void Wait();
+
+  // Number of worker threads.
+  int num_workers() const { return workers_.size(); }
+
+  // Returns the number of hardware threads.
+  static int NumHardwareThreads();
+
+ private:
+  // Worker thread loop.
+  void Worker();
+
+  // Worker threads.
+  std::vector<std::thread> workers_;
+
+  // Queue of tasks waiting to be run.
+  std::deque<Task> queue_;
+
+  // Number of tasks that have been scheduled, but not completed yet.
+  int pending_ = 0;
+
+  // Flag to signal workers to stop.
+  bool stop_ = false;
+
+  // Mutex for protecting the task queue and the signals for workers and
+  // waiters.
+  std::mutex mu_;
+  std::condition_variable ready_;
+  std::condition_variable done_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThreadPool);
+};
+
+}  // namespace sling
+
+#endif  // SLING_UTIL_THREAD_POOL_H_
@@ -222,6 +222,38 @@ void Assembler::emit_operand(int code, const Operand &adr, int sl) {
   }
 }
 
+void Assembler::emit_evex_operand(int code, const Operand &adr, int n,
+                                  int sl) {
+  // Operands without displacement or with RIP-relative or absolute addressing
+  // are encoded as for VEX instructions.
+  byte modrm = adr.buf_[0];
+  byte mode = modrm & 0xC0;
+  if (mode == 0) {
+    emit_operand(code, adr, sl);
+    return;
+  }
+
+  // Get displacement.
+  bool has_sib = ((modrm & 0x07) == 0x04);
+  int disp_offset = has_sib ? 2 : 1;
+  int32_t disp;
+  if (mode == 0x40) {
+    disp = static_cast<int8_t>(adr.buf_[disp_offset]);
+  } else {
+    disp = *bit_cast<const int32_t *>(&adr.buf_[disp_offset]);
+  }
+
+  // Use compressed 8-bit displacement if possible.
+  bool compressed = disp % n == 0 && is_int8(disp / n);
+  emit((modrm & 0x07) | code << 3 | (compressed ? 0x40 : 0x80));
+  if (has_sib) emit(adr.buf_[1]);
+  if (compressed) {
+    emit(static_cast<byte>(disp / n));
+  } else {
+    emitl(disp);
+  }
+}
+
 void Assembler::arithmetic_op(byte opcode,
                               Register reg,
                               const Operand &op,
@@ -4271,6 +4303,87 @@ void Assembler::vucomiss(XMMRegister dst, const Operand &src) {
   emit_sse_operand(dst, src);
 }
 
+void Assembler::emit_evex_prefix(ZMMRegister reg, ZMMRegister vreg,
+                                 ZMMRegister rm, Mask mask, SIMDPrefix pp,
+                                 LeadingOpcode mm, VexW w) {
+  // The register extension bits are stored inverted. The X bit is used as
+  // the high bit of the r/m register.
+  byte rxb = (reg.high_bit() << 7) | (rm.ext_bit() << 6) |
+             (rm.high_bit() << 5) | (reg.ext_bit() << 4);
+  emit(0x62);
+  emit((~rxb & 0xf0) | mm);
+  emit(w | ((~vreg.code() & 0xf) << 3) | 0x04 | pp);
+  emit((mask.mode << 7) | 0x40 | ((~vreg.code() & 0x10) >> 1) |
+       mask.reg.code());
+}
+
+void Assembler::emit_evex_prefix(ZMMRegister reg, ZMMRegister vreg,
+                                 const Operand &rm, Mask mask, SIMDPrefix pp,
+                                 LeadingOpcode mm, VexW w) {
+  byte rxb = (reg.high_bit() << 7) | (rm.rex_ << 5) | (reg.ext_bit() << 4);
+  emit(0x62);
+  emit((~rxb & 0xf0) | mm);
+  emit(w | ((~vreg.code() & 0xf) << 3) | 0x04 | pp);
+  emit((mask.mode << 7) | 0x40 | ((~vreg.code() & 0x10) >> 1) |
+       mask.reg.code());
+}
+
+void Assembler::zinstr(byte op, ZMMRegister dst, ZMMRegister src1,
+                       ZMMRegister src2, Mask mask, SIMDPrefix pp,
+                       LeadingOpcode m, VexW w) {
+  DCHECK(Enabled(AVX512F));
+  EnsureSpace ensure_space(this);
+  emit_evex_prefix(dst, src1, src2, mask, pp, m, w);
+  emit(op);
+  emit(0xC0 | dst.low_bits() << 3 | src2.low_bits());
+}
+
+void Assembler::zinstr(byte op, ZMMRegister dst, ZMMRegister src1,
+                       const Operand &src2, Mask mask, SIMDPrefix pp,
+                       LeadingOpcode m, VexW w, int n, int sl) {
+  DCHECK(Enabled(AVX512F));
+  EnsureSpace ensure_space(this);
+  emit_evex_prefix(dst, src1, src2, mask, pp, m, w);
+  emit(op);
+  emit_evex_operand(dst.low_bits(), src2, n, sl);
+}
+
+void Assembler::kinstr(byte op, int reg, int rm, SIMDPrefix pp, VexW w) {
+  DCHECK(Enabled(AVX512F));
+  EnsureSpace ensure_space(this);
+  XMMRegister ireg = {reg};
+  XMMRegister irm = {rm};
+  emit_vex_prefix(ireg, xmm0, irm, kL128, pp, k0F, w);
+  emit(op);
+  emit(0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+void Assembler::kmovw(OpmaskRegister dst, Register src) {
+  kinstr(0x92, dst.code(), src.code(), kNone, kW0);
+}
+
+void Assembler::kmovw(Register dst, OpmaskRegister src) {
+  kinstr(0x93, dst.code(), src.code(), kNone, kW0);
+}
+
+void Assembler::kmovw(OpmaskRegister dst, OpmaskRegister src) {
+  kinstr(0x90, dst.code(), src.code(), kNone, kW0);
+}
+
+void Assembler::kmovq(OpmaskRegister dst, Register src) {
+  DCHECK(Enabled(AVX512BW));
+  kinstr(0x92, dst.code(), src.code(), kF2, kW1);
+}
+
+void Assembler::kmovq(Register dst, OpmaskRegister src) {
+  DCHECK(Enabled(AVX512BW));
+  kinstr(0x93, dst.code(), src.code(), kF2, kW1);
+}
+
+void Assembler::kortestw(OpmaskRegister src1, OpmaskRegister src2) {
+  kinstr(0x98, src1.code(), src2.code(), kNone, kW0);
+}
+
 void Assembler::bmi1q(byte op, Register reg, Register vreg, Register rm) {
   DCHECK(Enabled(BMI1));
   EnsureSpace ensure_space(this);
@@ -1845,6 +1845,28 @@ class Assembler : public CodeGenerator {
     emit(imm8);
   }
 
+  void vpmovzxbw(YMMRegister dst, XMMRegister src) {
+    YMMRegister isrc = {src.code()};
+    vinstr(0x30, dst, ymm0, isrc, k66, k0F38, kWIG);
+  }
+  void vpmovzxbw(YMMRegister dst, const Operand &src) {
+    vinstr(0x30, dst, ymm0, src, k66, k0F38, kWIG);
+  }
+  void vpmovsxbw(YMMRegister dst, XMMRegister src) {
+    YMMRegister isrc = {src.code()};
+    vinstr(0x20, dst, ymm0, isrc, k66, k0F38, kWIG);
+  }
+  void vpmovsxbw(YMMRegister dst, const Operand &src) {
+    vinstr(0x20, dst, ymm0, src, k66, k0F38, kWIG);
+  }
+  void vpmovzxwd(YMMRegister dst, XMMRegister src) {
+    YMMRegister isrc = {src.code()};
+    vinstr(0x33, dst, ymm0, isrc, k66, k0F38, kWIG);
+  }
+  void vpmovzxwd(YMMRegister dst, const Operand &src) {
+    vinstr(0x33, dst, ymm0, src, k66, k0F38, kWIG);
+  }
+
   void vbroadcastss(XMMRegister dst, XMMRegister src) {
     vinstr(0x18, dst, xmm0, src, k66, k0F38, kW0);
   }
@@ -2078,6 +2100,34 @@ class Assembler : public CodeGenerator {
     vinstr(0x5b, dst, ymm0, src, kNone, k0F, kWIG);
   }
 
+  void vcvtps2dq(XMMRegister dst, XMMRegister src) {
+    vinstr(0x5b, dst, xmm0, src, k66, k0F, kWIG);
+  }
+  void vcvtps2dq(XMMRegister dst, const Operand &src) {
+    vinstr(0x5b, dst, xmm0, src, k66, k0F, kWIG);
+  }
+  void vcvtps2dq(YMMRegister dst, YMMRegister src) {
+    vinstr(0x5b, dst, ymm0, src, k66, k0F, kWIG);
+  }
+  void vcvtps2dq(YMMRegister dst, const Operand &src) {
+    vinstr(0x5b, dst, ymm0, src, k66, k0F, kWIG);
+  }
+
+  // Convert half-precision floats to single precision (F16C).
+  void vcvtph2ps(XMMRegister dst, XMMRegister src) {
+    vinstr(0x13, dst, xmm0, src, k66, k0F38, kW0);
+  }
+  void vcvtph2ps(XMMRegister dst, const Operand &src) {
+    vinstr(0x13, dst, xmm0, src, k66, k0F38, kW0);
+  }
+  void vcvtph2ps(YMMRegister dst, XMMRegister src) {
+    YMMRegister isrc = {src.code()};
+    vinstr(0x13, dst, ymm0, isrc, k66, k0F38, kW0);
+  }
+  void vcvtph2ps(YMMRegister dst, const Operand &src) {
+    vinstr(0x13, dst, ymm0, src, k66, k0F38, kW0);
+  }
+
   void vrcpps(XMMRegister dst, XMMRegister src) {
     vinstr(0x53, dst, xmm0, src, kNone, k0F, kWIG);
   }
@@ -2418,6 +2468,224 @@ class Assembler : public CodeGenerator {
   void vfmad(byte op, YMMRegister dst, YMMRegister src1, YMMRegister src2);
   void vfmad(byte op, YMMRegister dst, YMMRegister src1, const Operand &src2);
 
+  // AVX-512 instructions. These use the EVEX encoding, which supports 512-bit
+  // ZMM registers, the registers zmm16-zmm31, and masking with opmask
+  // registers. Memory operand displacements are compressed to 8 bits when
+  // they are multiples of the memory operand size n.
+  void zinstr(byte op, ZMMRegister dst, ZMMRegister src1, ZMMRegister src2,
+              Mask mask, SIMDPrefix pp, LeadingOpcode m, VexW w);
+  void zinstr(byte op, ZMMRegister dst, ZMMRegister src1, const Operand &src2,
+              Mask mask, SIMDPrefix pp, LeadingOpcode m, VexW w,
+              int n = 64, int sl = 0);
+
+#define DECLARE_AVX512_INSTRUCTION(instruction, prefix, escape, w, opcode) \
+  void instruction(ZMMRegister dst, ZMMRegister src1, ZMMRegister src2,    \
+                   Mask mask = nomask) {                                   \
+    zinstr(0x##opcode, dst, src1, src2, mask, k##prefix, k##escape, k##w); \
+  }                                                                        \
+  void instruction(ZMMRegister dst, ZMMRegister src1, const Operand &src2, \
+                   Mask mask = nomask) {                                   \
+    zinstr(0x##opcode, dst, src1, src2, mask, k##prefix, k##escape, k##w); \
+  }
+
+  AVX512_INSTRUCTION_LIST(DECLARE_AVX512_INSTRUCTION)
+#undef DECLARE_AVX512_INSTRUCTION
+
+#define DECLARE_AVX512_UNARY_INSTRUCTION(instruction, prefix, escape, w,    \
+                                         opcode)                            \
+  void instruction(ZMMRegister dst, ZMMRegister src, Mask mask = nomask) {  \
+    zinstr(0x##opcode, dst, zmm0, src, mask, k##prefix, k##escape, k##w);   \
+  }                                                                         \
+  void instruction(ZMMRegister dst, const Operand &src,                     \
+                   Mask mask = nomask) {                                    \
+    zinstr(0x##opcode, dst, zmm0, src, mask, k##prefix, k##escape, k##w);   \
+  }
+
+  AVX512_UNARY_INSTRUCTION_LIST(DECLARE_AVX512_UNARY_INSTRUCTION)
+#undef DECLARE_AVX512_UNARY_INSTRUCTION
+
+  void vmovaps(ZMMRegister dst, ZMMRegister src, Mask mask = nomask) {
+    zinstr(0x28, dst, zmm0, src, mask, kNone, k0F, kW0);
+  }
+  void vmovaps(ZMMRegister dst, const Operand &src, Mask mask = nomask) {
+    zinstr(0x28, dst, zmm0, src, mask, kNone, k0F, kW0);
+  }
+  void vmovaps(const Operand &dst, ZMMRegister src, Mask mask = nomask) {
+    zinstr(0x29, src, zmm0, dst, mask, kNone, k0F, kW0);
+  }
+  void vmovapd(ZMMRegister dst, ZMMRegister src, Mask mask = nomask) {
+    zinstr(0x28, dst, zmm0, src, mask, k66, k0F, kW1);
+  }
+  void vmovapd(ZMMRegister dst, const Operand &src, Mask mask = nomask) {
+    zinstr(0x28, dst, zmm0, src, mask, k66, k0F, kW1);
+  }
+  void vmovapd(const Operand &dst, ZMMRegister src, Mask mask = nomask) {
+    zinstr(0x29, src, zmm0, dst, mask, k66, k0F, kW1);
+  }
+  void vmovups(ZMMRegister dst, ZMMRegister src, Mask mask = nomask) {
+    zinstr(0x10, dst, zmm0, src, mask, kNone, k0F, kW0);
+  }
+  void vmovups(ZMMRegister dst, const Operand &src, Mask mask = nomask) {
+    zinstr(0x10, dst, zmm0, src, mask, kNone, k0F, kW0);
+  }
+  void vmovups(const Operand &dst, ZMMRegister src, Mask mask = nomask) {
+    zinstr(0x11, src, zmm0, dst, mask, kNone, k0F, kW0);
+  }
+  void vmovupd(ZMMRegister dst, ZMMRegister src, Mask mask = nomask) {
+    zinstr(0x10, dst, zmm0, src, mask, k66, k0F, kW1);
+  }
+  void vmovupd(ZMMRegister dst, const Operand &src, Mask mask = nomask) {
+    zinstr(0x10, dst, zmm0, src, mask, k66, k0F, kW1);
+  }
+  void vmovupd(const Operand &dst, ZMMRegister src, Mask mask = nomask) {
+    zinstr(0x11, src, zmm0, dst, mask, k66, k0F, kW1);
+  }
+
+  void vbroadcastss(ZMMRegister dst, XMMRegister src, Mask mask = nomask) {
+    zinstr(0x18, dst, zmm0, ZMMRegister::from_code(src.code()), mask,
+           k66, k0F38, kW0);
+  }
+  void vbroadcastss(ZMMRegister dst, const Operand &src, Mask mask = nomask) {
+    zinstr(0x18, dst, zmm0, src, mask, k66, k0F38, kW0, 4);
+  }
+  void vbroadcastsd(ZMMRegister dst, XMMRegister src, Mask mask = nomask) {
+    zinstr(0x19, dst, zmm0, ZMMRegister::from_code(src.code()), mask,
+           k66, k0F38, kW1);
+  }
+  void vbroadcastsd(ZMMRegister dst, const Operand &src, Mask mask = nomask) {
+    zinstr(0x19, dst, zmm0, src, mask, k66, k0F38, kW1, 8);
+  }
+
+  // Compare vectors and set bits in opmask register.
+  void vcmpps(OpmaskRegister kdst, ZMMRegister src1, ZMMRegister src2,
+              int8_t cmp, Mask mask = nomask) {
+    ZMMRegister idst = {kdst.code()};
+    zinstr(0xC2, idst, src1, src2, mask, kNone, k0F, kW0);
+    emit(cmp);
+  }
+  void vcmpps(OpmaskRegister kdst, ZMMRegister src1, const Operand &src2,
+              int8_t cmp, Mask mask = nomask) {
+    ZMMRegister idst = {kdst.code()};
+    zinstr(0xC2, idst, src1, src2, mask, kNone, k0F, kW0, 64, 1);
+    emit(cmp);
+  }
+  void vcmppd(OpmaskRegister kdst, ZMMRegister src1, ZMMRegister src2,
+              int8_t cmp, Mask mask = nomask) {
+    ZMMRegister idst = {kdst.code()};
+    zinstr(0xC2, idst, src1, src2, mask, k66, k0F, kW1);
+    emit(cmp);
+  }
+  void vcmppd(OpmaskRegister kdst, ZMMRegister src1, const Operand &src2,
+              int8_t cmp, Mask mask = nomask) {
+    ZMMRegister idst = {kdst.code()};
+    zinstr(0xC2, idst, src1, src2, mask, k66, k0F, kW1, 64, 1);
+    emit(cmp);
+  }
+
+  // Bitwise ternary logic where the immediate is the truth table.
+  void vpternlogd(ZMMRegister dst, ZMMRegister src1, ZMMRegister src2,
+                  int8_t imm8, Mask mask = nomask) {
+    zinstr(0x25, dst, src1, src2, mask, k66, k0F3A, kW0);
+    emit(imm8);
+  }
+  void vpternlogq(ZMMRegister dst, ZMMRegister src1, ZMMRegister src2,
+                  int8_t imm8, Mask mask = nomask) {
+    zinstr(0x25, dst, src1, src2, mask, k66, k0F3A, kW1);
+    emit(imm8);
+  }
+
+  // Round to the number of fraction bits in imm8[7:4] using the rounding mode
+  // in imm8[1:0].
+  void vrndscaleps(ZMMRegister dst, ZMMRegister src, int8_t imm8,
+                   Mask mask = nomask) {
+    zinstr(0x08, dst, zmm0, src, mask, k66, k0F3A, kW0);
+    emit(imm8);
+  }
+  void vrndscaleps(ZMMRegister dst, const Operand &src, int8_t imm8,
+                   Mask mask = nomask) {
+    zinstr(0x08, dst, zmm0, src, mask, k66, k0F3A, kW0, 64, 1);
+    emit(imm8);
+  }
+  void vrndscalepd(ZMMRegister dst, ZMMRegister src, int8_t imm8,
+                   Mask mask = nomask) {
+    zinstr(0x09, dst, zmm0, src, mask, k66, k0F3A, kW1);
+    emit(imm8);
+  }
+  void vrndscalepd(ZMMRegister dst, const Operand &src, int8_t imm8,
+                   Mask mask = nomask) {
+    zinstr(0x09, dst, zmm0, src, mask, k66, k0F3A, kW1, 64, 1);
+    emit(imm8);
+  }
+
+  // Shift integer elements by immediate.
+  void vpslld(ZMMRegister dst, ZMMRegister src, int8_t imm8,
+              Mask mask = nomask) {
+    ZMMRegister iop = {6};
+    zinstr(0x72, iop, dst, src, mask, k66, k0F, kW0);
+    emit(imm8);
+  }
+  void vpsrld(ZMMRegister dst, ZMMRegister src, int8_t imm8,
+              Mask mask = nomask) {
+    ZMMRegister iop = {2};
+    zinstr(0x72, iop, dst, src, mask, k66, k0F, kW0);
+    emit(imm8);
+  }
+
+  // Widen 16 half-precision floats or 16-bit integers in a ymm register or a
+  // 256-bit memory operand to 32-bit elements.
+  void vcvtph2ps(ZMMRegister dst, YMMRegister src, Mask mask = nomask) {
+    ZMMRegister isrc = {src.code()};
+    zinstr(0x13, dst, zmm0, isrc, mask, k66, k0F38, kW0);
+  }
+  void vcvtph2ps(ZMMRegister dst, const Operand &src, Mask mask = nomask) {
+    zinstr(0x13, dst, zmm0, src, mask, k66, k0F38, kW0, 32);
+  }
+  void vpmovzxwd(ZMMRegister dst, YMMRegister src, Mask mask = nomask) {
+    ZMMRegister isrc = {src.code()};
+    zinstr(0x33, dst, zmm0, isrc, mask, k66, k0F38, kW0);
+  }
+  void vpmovzxwd(ZMMRegister dst, const Operand &src, Mask mask = nomask) {
+    zinstr(0x33, dst, zmm0, src, mask, k66, k0F38, kW0, 32);
+  }
+  void vpsllq(ZMMRegister dst, ZMMRegister src, int8_t imm8,
+              Mask mask = nomask) {
+    ZMMRegister iop = {6};
+    zinstr(0x73, iop, dst, src, mask, k66, k0F, kW1);
+    emit(imm8);
+  }
+  void vpsrlq(ZMMRegister dst, ZMMRegister src, int8_t imm8,
+              Mask mask = nomask) {
+    ZMMRegister iop = {2};
+    zinstr(0x73, iop, dst, src, mask, k66, k0F, kW1);
+    emit(imm8);
+  }
+
+  // Extract and insert 128-bit and 256-bit parts of ZMM registers.
+  void vextractf32x4(XMMRegister dst, ZMMRegister src, int8_t imm8) {
+    ZMMRegister idst = {dst.code()};
+    zinstr(0x19, src, zmm0, idst, nomask, k66, k0F3A, kW0);
+    emit(imm8);
+  }
+  void vextractf64x4(YMMRegister dst, ZMMRegister src, int8_t imm8) {
+    ZMMRegister idst = {dst.code()};
+    zinstr(0x1B, src, zmm0, idst, nomask, k66, k0F3A, kW1);
+    emit(imm8);
+  }
+  void vinsertf64x4(ZMMRegister dst, ZMMRegister src1, YMMRegister src2,
+                    int8_t imm8) {
+    ZMMRegister isrc2 = {src2.code()};
+    zinstr(0x1A, dst, src1, isrc2, nomask, k66, k0F3A, kW1);
+    emit(imm8);
+  }
+
+  // Opmask register instructions.
+  void kmovw(OpmaskRegister dst, Register src);
+  void kmovw(Register dst, OpmaskRegister src);
+  void kmovw(OpmaskRegister dst, OpmaskRegister src);
+  void kmovq(OpmaskRegister dst, Register src);
+  void kmovq(Register dst, OpmaskRegister src);
+  void kortestw(OpmaskRegister src1, OpmaskRegister src2);
+
   // BMI instructions.
   void andnq(Register dst, Register src1, Register src2) {
     bmi1q(0xf2, dst, src1, src2);
@@ -2857,6 +3125,19 @@ class Assembler : public CodeGenerator {
     emit_vex_prefix(ireg, ivreg, rm, l, pp, mm, w);
   }
 
+  // Emit 4-byte EVEX prefix for 512-bit instruction.
+  void emit_evex_prefix(ZMMRegister reg, ZMMRegister vreg, ZMMRegister rm,
+                        Mask mask, SIMDPrefix pp, LeadingOpcode mm, VexW w);
+  void emit_evex_prefix(ZMMRegister reg, ZMMRegister vreg, const Operand &rm,
+                        Mask mask, SIMDPrefix pp, LeadingOpcode mm, VexW w);
+
+  // Emit memory operand for EVEX-encoded instruction. The 8-bit displacement
+  // is scaled by the memory operand size n.
+  void emit_evex_operand(int code, const Operand &adr, int n, int sl = 0);
+
+  // Emit VEX-encoded opmask instruction.
+  void kinstr(byte op, int reg, int rm, SIMDPrefix pp, VexW w);
+
   // Emit the ModR/M byte, and optionally the SIB byte and
   // 1- or 4-byte offset for a memory operand.  Also encodes
   // the second operand of the operation, a register or operation
@@ -41,13 +41,16 @@ namespace jit {
 bool CPU::initialized = false;
 unsigned CPU::features = 0;
 unsigned CPU::cache_line_size = 0;
+unsigned CPU::l1_cache_size = 0;
+unsigned CPU::l2_cache_size = 0;
+unsigned CPU::l3_cache_size = 0;
 bool CPU::vzero_needed = false;
 
-static void __cpuid(int cpu_info[4], int info_type) {
+static void __cpuid(int cpu_info[4], int info_type, int subleaf = 0) {
   __asm__ volatile("cpuid \n\t"
                    : "=a"(cpu_info[0]), "=b"(cpu_info[1]), "=c"(cpu_info[2]),
                      "=d"(cpu_info[3])
-                   : "a"(info_type), "c"(0));
+                   : "a"(info_type), "c"(subleaf));
 }
 
 static uint64_t _xgetbv(unsigned int xcr) {
@@ -64,6 +67,14 @@ static bool os_has_avx_support() {
   return (feature_mask & 0x6) == 0x6;
 }
 
+static bool os_has_avx512_support() {
+  // Get XFEATURE_ENABLED_MASK register.
+  uint64_t feature_mask = _xgetbv(0);
+
+  // Check that the OS saves the opmask and all 32 ZMM registers.
+  return (feature_mask & 0xe6) == 0xe6;
+}
+
 ProcessorInformation::ProcessorInformation() {
   memcpy(vendor_, "Unknown", 8);
   memcpy(brand_, "Unknown", 8);
@@ -107,6 +118,11 @@ ProcessorInformation::ProcessorInformation() {
     has_bmi1_ = (cpu_info[1] & 0x00000008) != 0;
     has_bmi2_ = (cpu_info[1] & 0x00000100) != 0;
     has_avx2_ = (cpu_info[1] & 0x00000020) != 0;
+    has_avx512f_ = (cpu_info[1] & 0x00010000) != 0;
+    has_avx512dq_ = (cpu_info[1] & 0x00020000) != 0;
+    has_avx512bw_ = (cpu_info[1] & 0x40000000) != 0;
+    has_avx512vl_ = (cpu_info[1] & 0x80000000) != 0;
+    has_avx512vnni_ = (cpu_info[2] & 0x00000800) != 0;
   }
 
   // Query extended IDs.
@@ -161,10 +177,43 @@ ProcessorInformation::ProcessorInformation() {
   } else {
     cache_line_size_ = 64;
   }
+
+  // Get data cache sizes.
+  if (strcmp(vendor_, "GenuineIntel") == 0 && num_ids >= 4) {
+    // Enumerate the deterministic cache parameters.
+    for (int i = 0; i < 16; ++i) {
+      __cpuid(cpu_info, 4, i);
+      int type = cpu_info[0] & 0x1f;
+      if (type == 0) break;
+      if (type != 1 && type != 3) continue;
+      int level = (cpu_info[0] >> 5) & 0x7;
+      int ways = ((cpu_info[1] >> 22) & 0x3ff) + 1;
+      int partitions = ((cpu_info[1] >> 12) & 0x3ff) + 1;
+      int line_size = (cpu_info[1] & 0xfff) + 1;
+      int sets = cpu_info[2] + 1;
+      int size = ways * partitions * line_size * sets;
+      if (level == 1) l1_cache_size_ = size;
+      if (level == 2) l2_cache_size_ = size;
+      if (level == 3) l3_cache_size_ = size;
+    }
+  } else if (strcmp(vendor_, "AuthenticAMD") == 0) {
+    if (num_ext_ids >= 0x80000005) {
+      __cpuid(cpu_info, 0x80000005);
+      l1_cache_size_ = ((cpu_info[2] >> 24) & 0xff) * 1024;
+    }
+    if (num_ext_ids >= 0x80000006) {
+      __cpuid(cpu_info, 0x80000006);
+      l2_cache_size_ = ((cpu_info[2] >> 16) & 0xffff) * 1024;
+      l3_cache_size_ = ((cpu_info[3] >> 18) & 0x3fff) * 512 * 1024;
+    }
+  }
 }
 
 const char *ProcessorInformation::architecture() {
   switch (family_model()) {
+    case 0x0655:
+      return "Skylake-X";
+
     case 0x065E:
       return "Skylake";
 
@@ -237,6 +286,13 @@ void CPU::Initialize() {
     features |= 1u << AVX;
     if (cpu.has_fma3()) features |= 1u << FMA3;
     if (cpu.has_avx2()) features |= 1u << AVX2;
+    if (cpu.has_avx512f() && os_has_avx512_support()) {
+      features |= 1u << AVX512F;
+      if (cpu.has_avx512bw()) features |= 1u << AVX512BW;
+      if (cpu.has_avx512dq()) features |= 1u << AVX512DQ;
+      if (cpu.has_avx512vl()) features |= 1u << AVX512VL;
+      if (cpu.has_avx512vnni()) features |= 1u << AVX512VNNI;
+    }
   }
 
   if (cpu.has_bmi1()) features |= 1u << BMI1;
@@ -248,6 +304,9 @@ void CPU::Initialize() {
   if (cpu.has_one_idiom()) features |= 1u << ONEIDIOM;
 
   cache_line_size = cpu.cache_line_size();
+  l1_cache_size = cpu.l1_cache_size() > 0 ? cpu.l1_cache_size() : 32 * 1024;
+  l2_cache_size = cpu.l2_cache_size() > 0 ? cpu.l2_cache_size() : 256 * 1024;
+  l3_cache_size = cpu.l3_cache_size();
 
   vzero_needed = false;
   if (cpu.has_avx()) {
@@ -60,6 +60,11 @@ class ProcessorInformation {
   int cache_line_size() const { return cache_line_size_; }
   static const int UNKNOWN_CACHE_LINE_SIZE = 0;
 
+  // Data cache sizes in bytes (zero if unknown).
+  int l1_cache_size() const { return l1_cache_size_; }
+  int l2_cache_size() const { return l2_cache_size_; }
+  int l3_cache_size() const { return l3_cache_size_; }
+
   // x86 features.
   bool has_cmov() const { return has_cmov_; }
   bool has_sahf() const { return has_sahf_; }
@@ -75,6 +80,11 @@ class ProcessorInformation {
   bool has_avx() const { return has_avx_; }
   bool has_avx2() const { return has_avx2_; }
   bool has_fma3() const { return has_fma3_; }
+  bool has_avx512f() const { return has_avx512f_; }
+  bool has_avx512bw() const { return has_avx512bw_; }
+  bool has_avx512dq() const { return has_avx512dq_; }
+  bool has_avx512vl() const { return has_avx512vl_; }
+  bool has_avx512vnni() const { return has_avx512vnni_; }
   bool has_bmi1() const { return has_bmi1_; }
   bool has_bmi2() const { return has_bmi2_; }
   bool has_lzcnt() const { return has_lzcnt_; }
@@ -92,6 +102,9 @@ class ProcessorInformation {
   int ext_family_ = 0;
   int type_ = 0;
   int cache_line_size_ = UNKNOWN_CACHE_LINE_SIZE;
+  int l1_cache_size_ = 0;
+  int l2_cache_size_ = 0;
+  int l3_cache_size_ = 0;
   bool has_fpu_ = false;
   bool has_cmov_ = false;
   bool has_sahf_ = false;
@@ -107,6 +120,11 @@ class ProcessorInformation {
   bool has_avx_ = false;
   bool has_avx2_ = false;
   bool has_fma3_ = false;
+  bool has_avx512f_ = false;
+  bool has_avx512bw_ = false;
+  bool has_avx512dq_ = false;
+  bool has_avx512vl_ = false;
+  bool has_avx512vnni_ = false;
   bool has_bmi1_ = false;
   bool has_bmi2_ = false;
   bool has_lzcnt_ = false;
@@ -135,6 +153,11 @@ enum CpuFeature {
   POPCNT,
   ZEROIDIOM,
   ONEIDIOM,
+  AVX512F,
+  AVX512BW,
+  AVX512DQ,
+  AVX512VL,
+  AVX512VNNI,
 
   NUMBER_OF_CPU_FEATURES,
 };
@@ -180,6 +203,21 @@ class CPU {
     return cache_line_size;
   }
 
+  // Data cache sizes in bytes. Defaults are used if the cache sizes cannot be
+  // determined.
+  static unsigned L1CacheSize() {
+    Probe();
+    return l1_cache_size;
+  }
+  static unsigned L2CacheSize() {
+    Probe();
+    return l2_cache_size;
+  }
+  static unsigned L3CacheSize() {
+    Probe();
+    return l3_cache_size;
+  }
+
   // VZEROUPPER is only needed on some processors.
   static bool VZeroNeeded() {
     Probe();
@@ -196,6 +234,11 @@ class CPU {
   // Cache line size.
   static unsigned cache_line_size;
 
+  // Data cache sizes.
+  static unsigned l1_cache_size;
+  static unsigned l2_cache_size;
+  static unsigned l3_cache_size;
+
   // VZEROUPPER needed on AVX/SSE transitions.
   static bool vzero_needed;
 
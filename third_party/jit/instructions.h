@@ -97,6 +97,7 @@ namespace jit {
   V(pmaxub, 66, 0F, DE)          \
   V(pminsw, 66, 0F, EA)          \
   V(pminub, 66, 0F, DA)          \
+  V(pmaddwd, 66, 0F, F5)         \
   V(pmullw, 66, 0F, D5)          \
   V(pmuludq, 66, 0F, F4)         \
   V(psllw, 66, 0F, F1)           \
@@ -144,6 +145,83 @@ namespace jit {
   V(pmulld, 66, 0F, 38, 40)      \
   V(ptest, 66, 0F, 38, 17)
 
+// AVX-512 instructions with three ZMM operands. The logical instructions for
+// floating-point vectors (vandps, vorps, etc.) require AVX512DQ, vpmaddwd
+// requires AVX512BW, and vpdpbusd requires AVX512VNNI.
+#define AVX512_INSTRUCTION_LIST(V)  \
+  V(vaddps, None, 0F, W0, 58)       \
+  V(vaddpd, 66, 0F, W1, 58)         \
+  V(vsubps, None, 0F, W0, 5C)       \
+  V(vsubpd, 66, 0F, W1, 5C)         \
+  V(vmulps, None, 0F, W0, 59)       \
+  V(vmulpd, 66, 0F, W1, 59)         \
+  V(vdivps, None, 0F, W0, 5E)       \
+  V(vdivpd, 66, 0F, W1, 5E)         \
+  V(vminps, None, 0F, W0, 5D)       \
+  V(vminpd, 66, 0F, W1, 5D)         \
+  V(vmaxps, None, 0F, W0, 5F)       \
+  V(vmaxpd, 66, 0F, W1, 5F)         \
+  V(vandps, None, 0F, W0, 54)       \
+  V(vandpd, 66, 0F, W1, 54)         \
+  V(vandnps, None, 0F, W0, 55)      \
+  V(vandnpd, 66, 0F, W1, 55)        \
+  V(vorps, None, 0F, W0, 56)        \
+  V(vorpd, 66, 0F, W1, 56)          \
+  V(vxorps, None, 0F, W0, 57)       \
+  V(vxorpd, 66, 0F, W1, 57)         \
+  V(vpandd, 66, 0F, W0, DB)         \
+  V(vpandq, 66, 0F, W1, DB)         \
+  V(vpandnd, 66, 0F, W0, DF)        \
+  V(vpandnq, 66, 0F, W1, DF)        \
+  V(vpord, 66, 0F, W0, EB)          \
+  V(vporq, 66, 0F, W1, EB)          \
+  V(vpxord, 66, 0F, W0, EF)         \
+  V(vpxorq, 66, 0F, W1, EF)         \
+  V(vpaddd, 66, 0F, W0, FE)         \
+  V(vpaddq, 66, 0F, W1, D4)         \
+  V(vpsubd, 66, 0F, W0, FA)         \
+  V(vpsubq, 66, 0F, W1, FB)         \
+  V(vpmaddwd, 66, 0F, W0, F5)       \
+  V(vpdpbusd, 66, 0F38, W0, 50)     \
+  V(vpermps, 66, 0F38, W0, 16)      \
+  V(vpermpd, 66, 0F38, W1, 16)      \
+  V(vblendmps, 66, 0F38, W0, 65)    \
+  V(vblendmpd, 66, 0F38, W1, 65)    \
+  V(vfmadd132ps, 66, 0F38, W0, 98)  \
+  V(vfmadd132pd, 66, 0F38, W1, 98)  \
+  V(vfmadd213ps, 66, 0F38, W0, A8)  \
+  V(vfmadd213pd, 66, 0F38, W1, A8)  \
+  V(vfmadd231ps, 66, 0F38, W0, B8)  \
+  V(vfmadd231pd, 66, 0F38, W1, B8)  \
+  V(vfmsub132ps, 66, 0F38, W0, 9A)  \
+  V(vfmsub132pd, 66, 0F38, W1, 9A)  \
+  V(vfmsub213ps, 66, 0F38, W0, AA)  \
+  V(vfmsub213pd, 66, 0F38, W1, AA)  \
+  V(vfmsub231ps, 66, 0F38, W0, BA)  \
+  V(vfmsub231pd, 66, 0F38, W1, BA)  \
+  V(vfnmadd132ps, 66, 0F38, W0, 9C) \
+  V(vfnmadd132pd, 66, 0F38, W1, 9C) \
+  V(vfnmadd213ps, 66, 0F38, W0, AC) \
+  V(vfnmadd213pd, 66, 0F38, W1, AC) \
+  V(vfnmadd231ps, 66, 0F38, W0, BC) \
+  V(vfnmadd231pd, 66, 0F38, W1, BC)
+
+// AVX-512 instructions with two ZMM operands. The conversions between double
+// and quadword integer vectors require AVX512DQ.
+#define AVX512_UNARY_INSTRUCTION_LIST(V) \
+  V(vsqrtps, None, 0F, W0, 51)           \
+  V(vsqrtpd, 66, 0F, W1, 51)             \
+  V(vrcp14ps, 66, 0F38, W0, 4C)          \
+  V(vrcp14pd, 66, 0F38, W1, 4C)          \
+  V(vrsqrt14ps, 66, 0F38, W0, 4E)        \
+  V(vrsqrt14pd, 66, 0F38, W1, 4E)        \
+  V(vcvtdq2ps, None, 0F, W0, 5B)         \
+  V(vcvtps2dq, 66, 0F, W0, 5B)           \
+  V(vcvttps2dq, F3, 0F, W0, 5B)          \
+  V(vcvtqq2pd, F3, 0F, W1, E6)           \
+  V(vcvtpd2qq, 66, 0F, W1, 7B)           \
+  V(vcvttpd2qq, 66, 0F, W1, 7A)
+
 }  // namespace jit
 }  // namespace sling
 
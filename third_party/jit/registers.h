@@ -247,6 +247,162 @@ SIMD256_REGISTERS(DECLARE_REGISTER)
 #undef DECLARE_REGISTER
 const YMMRegister no_ymm_reg = {YMMRegister::kCode_no_reg};
 
+#define SIMD512_REGISTERS(V) \
+  V(zmm0)                   \
+  V(zmm1)                   \
+  V(zmm2)                   \
+  V(zmm3)                   \
+  V(zmm4)                   \
+  V(zmm5)                   \
+  V(zmm6)                   \
+  V(zmm7)                   \
+  V(zmm8)                   \
+  V(zmm9)                   \
+  V(zmm10)                  \
+  V(zmm11)                  \
+  V(zmm12)                  \
+  V(zmm13)                  \
+  V(zmm14)                  \
+  V(zmm15)                  \
+  V(zmm16)                  \
+  V(zmm17)                  \
+  V(zmm18)                  \
+  V(zmm19)                  \
+  V(zmm20)                  \
+  V(zmm21)                  \
+  V(zmm22)                  \
+  V(zmm23)                  \
+  V(zmm24)                  \
+  V(zmm25)                  \
+  V(zmm26)                  \
+  V(zmm27)                  \
+  V(zmm28)                  \
+  V(zmm29)                  \
+  V(zmm30)                  \
+  V(zmm31)
+
+struct ZMMRegister {
+  enum Code {
+#define REGISTER_CODE(R) kCode_##R,
+    SIMD512_REGISTERS(REGISTER_CODE)
+#undef REGISTER_CODE
+    kAfterLast,
+    kCode_no_reg = -1
+  };
+
+  static const int kMaxNumRegisters = Code::kAfterLast;
+
+  static ZMMRegister from_code(int code) {
+    ZMMRegister result = {code};
+    return result;
+  }
+
+  bool is_valid() const { return 0 <= reg_code && reg_code < kMaxNumRegisters; }
+
+  bool is(ZMMRegister reg) const { return reg_code == reg.reg_code; }
+
+  // The lower 128 and 256 bits of the first 16 ZMM registers are the XMM and
+  // YMM registers.
+  XMMRegister xmm() const {
+    DCHECK(reg_code < XMMRegister::kMaxNumRegisters);
+    XMMRegister result = {reg_code};
+    return result;
+  }
+
+  YMMRegister ymm() const {
+    DCHECK(reg_code < YMMRegister::kMaxNumRegisters);
+    YMMRegister result = {reg_code};
+    return result;
+  }
+
+  int code() const {
+    DCHECK(is_valid());
+    return reg_code;
+  }
+
+  // Return bit 3 and bit 4 of the register code as 0 or 1. These are encoded
+  // in the EVEX prefix.
+  int high_bit() const { return (reg_code >> 3) & 1; }
+  int ext_bit() const { return reg_code >> 4; }
+
+  // Return the 3 low bits of the register code. Used when encoding registers
+  // in modR/M, SIB, and opcode bytes.
+  int low_bits() const { return reg_code & 0x7; }
+
+  // Register code.
+  int reg_code;
+};
+
+#define DECLARE_REGISTER(R) const ZMMRegister R = {ZMMRegister::kCode_##R};
+SIMD512_REGISTERS(DECLARE_REGISTER)
+#undef DECLARE_REGISTER
+const ZMMRegister no_zmm_reg = {ZMMRegister::kCode_no_reg};
+
+// AVX-512 opmask registers.
+#define OPMASK_REGISTERS(V) \
+  V(k0)                     \
+  V(k1)                     \
+  V(k2)                     \
+  V(k3)                     \
+  V(k4)                     \
+  V(k5)                     \
+  V(k6)                     \
+  V(k7)
+
+struct OpmaskRegister {
+  enum Code {
+#define REGISTER_CODE(R) kCode_##R,
+    OPMASK_REGISTERS(REGISTER_CODE)
+#undef REGISTER_CODE
+    kAfterLast,
+    kCode_no_reg = -1
+  };
+
+  static const int kMaxNumRegisters = Code::kAfterLast;
+
+  static OpmaskRegister from_code(int code) {
+    OpmaskRegister result = {code};
+    return result;
+  }
+
+  bool is_valid() const { return 0 <= reg_code && reg_code < kMaxNumRegisters; }
+
+  bool is(OpmaskRegister reg) const { return reg_code == reg.reg_code; }
+
+  int code() const {
+    DCHECK(is_valid());
+    return reg_code;
+  }
+
+  // Register code.
+  int reg_code;
+};
+
+#define DECLARE_REGISTER(R) \
+  const OpmaskRegister R = {OpmaskRegister::kCode_##R};
+OPMASK_REGISTERS(DECLARE_REGISTER)
+#undef DECLARE_REGISTER
+
+// Masking mode for AVX-512 instructions. With merge masking, the elements in
+// the destination are left unchanged for zero bits in the opmask, and with
+// zero masking these elements are zeroed.
+enum MaskingMode {
+  merging = 0,
+  zeroing = 1,
+};
+
+// Opmask and masking mode for EVEX-encoded instructions. Opmask register k0
+// means no masking.
+struct Mask {
+  Mask(OpmaskRegister reg, MaskingMode mode = merging)
+      : reg(reg), mode(mode) {}
+
+  OpmaskRegister reg;
+  MaskingMode mode;
+};
+
+const Mask nomask(k0);
+
 // Condition flags.
 enum Condition {
   // Any value < 0 is considered no_condition